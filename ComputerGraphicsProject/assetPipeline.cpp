@@ -0,0 +1,124 @@
+/*
+* \file assetPipeline.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Parallel asset loading - CPU work on the worker threads, GL uploads from a completion queue on the GL thread
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "assetPipeline.h"
+#include "threadPool.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+/**
+ * \brief One asset in flight.
+ */
+typedef struct _AssetJob {
+	std::string name;
+	std::function<bool()> load;		///< CPU part (import, decode, ...), runs on a worker thread
+	std::function<void()> upload;	///< GL part (buffers, textures, vao), always runs on the GL thread
+
+	bool loaded;
+	double loadMs;
+	double uploadMs;
+	double readyAtMs;				///< time since beginAssetLoading() when the CPU part finished
+} AssetJob;
+
+static std::list<AssetJob> jobs;			// std::list keeps the job addresses stable for the workers
+static std::deque<AssetJob*> completed;		// completion queue, filled by the workers
+static std::mutex completedMutex;
+static std::condition_variable completedAvailable;
+static Clock::time_point loadingStart;
+
+static double millisecondsSince(const Clock::time_point& start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * \brief Start a new batch of assets.
+ */
+void beginAssetLoading() {
+	jobs.clear();
+	completed.clear();
+	loadingStart = Clock::now();
+}
+
+/**
+ * \brief Queue an asset. The load function runs on a worker thread, the upload function runs later on the GL thread
+ * (even when loading failed, so it can set up fallback data).
+ * \param name asset name used in the report
+ * \param load CPU work, returns false on failure - must not make any GL call
+ * \param upload GL work, done inside finishAssetLoading()
+ */
+void queueAsset(const std::string& name, const std::function<bool()>& load, const std::function<void()>& upload) {
+	AssetJob job;
+	job.name = name;
+	job.load = load;
+	job.upload = upload;
+	job.loaded = false;
+	job.loadMs = 0.0;
+	job.uploadMs = 0.0;
+	job.readyAtMs = 0.0;
+	jobs.push_back(job);
+
+	AssetJob* queued = &jobs.back();
+	submitTask([queued] {
+		Clock::time_point start = Clock::now();
+		queued->loaded = queued->load();
+		queued->loadMs = millisecondsSince(start);
+		queued->readyAtMs = millisecondsSince(loadingStart);
+
+		std::lock_guard<std::mutex> lock(completedMutex);
+		completed.push_back(queued);
+		completedAvailable.notify_one();
+	});
+}
+
+/**
+ * \brief Upload every queued asset as soon as its CPU part is done, then print the per-asset timing report.
+ * Must be called on the GL thread.
+ */
+void finishAssetLoading() {
+	double cpuTotalMs = 0.0;
+	double uploadTotalMs = 0.0;
+
+	for (size_t uploaded = 0; uploaded < jobs.size(); uploaded++) {
+		AssetJob* job;
+		{
+			std::unique_lock<std::mutex> lock(completedMutex);
+			completedAvailable.wait(lock, [] { return !completed.empty(); });
+			job = completed.front();
+			completed.pop_front();
+		}
+
+		if (!job->loaded) {
+			std::cerr << "\033[31mfinishAssetLoading : Cannot load : " << job->name << "\033[0m" << std::endl;
+		}
+
+		Clock::time_point start = Clock::now();
+		job->upload();
+		job->uploadMs = millisecondsSince(start);
+
+		cpuTotalMs += job->loadMs;
+		uploadTotalMs += job->uploadMs;
+	}
+
+	const double wallMs = millisecondsSince(loadingStart);
+
+	printf("\nAsset loading report (%u worker threads)\n", threadPoolSize());
+	printf("%-50s %10s %10s %10s\n", "asset", "cpu ms", "upload ms", "ready at");
+	for (std::list<AssetJob>::const_iterator it = jobs.begin(); it != jobs.end(); ++it) {
+		printf("%-50s %10.2f %10.2f %10.2f%s\n", it->name.c_str(), it->loadMs, it->uploadMs, it->readyAtMs, it->loaded ? "" : "  FAILED");
+	}
+	printf("cpu total %.2f ms, upload total %.2f ms, serial estimate %.2f ms, wall clock %.2f ms\n\n",
+		cpuTotalMs, uploadTotalMs, cpuTotalMs + uploadTotalMs, wallMs);
+
+	jobs.clear();
+}
@@ -0,0 +1,20 @@
+/*
+* \file assetPipeline.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Parallel asset loading - CPU work on the worker threads, GL uploads from a completion queue on the GL thread
+*/
+
+#pragma once
+
+#ifndef __ASSET_PIPELINE_H
+#define __ASSET_PIPELINE_H
+
+#include <string>
+#include <functional>
+
+void beginAssetLoading();
+void queueAsset(const std::string& name, const std::function<bool()>& load, const std::function<void()>& upload);
+void finishAssetLoading();
+
+#endif // __ASSET_PIPELINE_H
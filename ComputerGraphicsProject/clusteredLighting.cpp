@@ -0,0 +1,481 @@
+/*
+* \file clusteredLighting.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Clustered forward lighting - dynamic point lights binned on the CPU into a grid of view frustum clusters,
+* every fragment only shades the lights of its cluster
+*
+* The view frustum is split into CLUSTER_TILES_X x CLUSTER_TILES_Y screen tiles and CLUSTER_SLICES depth slices.
+* Every frame the lights are transformed to view space and given a range of slices and tiles (structure of arrays),
+* then each depth slice is binned by a worker of the thread pool with a sphere / cluster box test, and the lists are
+* compacted into one index array. GLSL 1.40 has no storage buffers, the lights, the clusters and the indices are
+* uploaded in three buffer textures read with texelFetch by lightingShaderPerFrag.frag.
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include "clusteredLighting.h"
+#include "renderer.h"
+#include "threadPool.h"
+
+bool useClusteredLighting = true;
+unsigned int lightStressCount = 0;
+
+static std::vector<PointLight> frameLights;
+static unsigned int lightsDropped = 0;		///< lights refused because the frame already had CLUSTER_MAX_LIGHTS
+
+static GLuint lightDataBuffer = 0;			///< RGBA32F, 2 texels per light : view space position + radius, color
+static GLuint gridBuffer = 0;				///< RG32UI, offset and count of every cluster in the index buffer
+static GLuint indexBuffer = 0;				///< R16UI, light indices of all clusters one after the other
+static GLuint lightDataTexture = 0;
+static GLuint gridTexture = 0;
+static GLuint indexTexture = 0;
+static unsigned int indexCapacity = 0;		///< texels of a buffer texture (GL_MAX_TEXTURE_BUFFER_SIZE), bounds the index list
+
+/**
+ * \brief Cluster grid of the camera, the depth slices are logarithmic in perspective and linear in parallel projection.
+ */
+typedef struct _ClusterCamera {
+	bool  perspective;
+	float nearPlane;
+	float farPlane;
+	float sliceScale;		///< slice = log(depth) * sliceScale + sliceBias (depth without log in parallel projection)
+	float sliceBias;
+	float tileWidth;		///< pixels
+	float tileHeight;
+} ClusterCamera;
+
+// lights of the frame in view space with their range of clusters (structure of arrays, filled by prepareLights())
+static float lightX[CLUSTER_MAX_LIGHTS];
+static float lightY[CLUSTER_MAX_LIGHTS];
+static float lightZ[CLUSTER_MAX_LIGHTS];
+static float lightRadius[CLUSTER_MAX_LIGHTS];
+static int lightSliceMin[CLUSTER_MAX_LIGHTS];	///< min > max when the light is outside of the frustum
+static int lightSliceMax[CLUSTER_MAX_LIGHTS];
+static int lightTileMinX[CLUSTER_MAX_LIGHTS];
+static int lightTileMaxX[CLUSTER_MAX_LIGHTS];
+static int lightTileMinY[CLUSTER_MAX_LIGHTS];
+static int lightTileMaxY[CLUSTER_MAX_LIGHTS];
+
+// view space bounding box of every cluster, rebuilt when the projection or the window size changes
+static float clusterMinX[CLUSTER_COUNT];
+static float clusterMinY[CLUSTER_COUNT];
+static float clusterMinZ[CLUSTER_COUNT];
+static float clusterMaxX[CLUSTER_COUNT];
+static float clusterMaxY[CLUSTER_COUNT];
+static float clusterMaxZ[CLUSTER_COUNT];
+static glm::mat4 boundsProjection(0.0f);
+static int boundsWidth = 0;
+static int boundsHeight = 0;
+
+// light lists of the clusters before compaction, each slice is written by one worker only
+static unsigned short clusterLights[CLUSTER_COUNT][CLUSTER_MAX_LIGHTS_PER_CLUSTER];
+static unsigned int clusterLightCounts[CLUSTER_COUNT];
+static unsigned int sliceOverflow[CLUSTER_SLICES];	///< light / cluster pairs over CLUSTER_MAX_LIGHTS_PER_CLUSTER
+
+static std::vector<glm::vec4> lightData;
+static std::vector<GLuint> gridData(2 * CLUSTER_COUNT);
+static std::vector<GLushort> indexData;
+
+static inline int clusterIndex(int slice, int tileX, int tileY) {
+	return (slice * CLUSTER_TILES_Y + tileY) * CLUSTER_TILES_X + tileX;
+}
+
+static GLuint createBufferTexture(GLuint& buffer, GLenum format, GLsizeiptr size, GLenum unit) {
+	const std::vector<unsigned char> zeros(size, 0);
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, zeros.data(), GL_STREAM_DRAW);
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glActiveTexture(unit);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	return texture;
+}
+
+/**
+ * \brief Create the buffer textures, they stay bound to their texture units (nothing else uses units 1 to 3).
+ */
+void initClusteredLighting() {
+	lightDataTexture = createBufferTexture(lightDataBuffer, GL_RGBA32F, 2 * sizeof(glm::vec4), GL_TEXTURE0 + CLUSTER_LIGHT_DATA_UNIT);
+	gridTexture = createBufferTexture(gridBuffer, GL_RG32UI, gridData.size() * sizeof(GLuint), GL_TEXTURE0 + CLUSTER_GRID_UNIT);
+	indexTexture = createBufferTexture(indexBuffer, GL_R16UI, sizeof(GLushort), GL_TEXTURE0 + CLUSTER_INDEX_UNIT);
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// only 65536 texels are guaranteed, less than every cluster full (CLUSTER_COUNT * CLUSTER_MAX_LIGHTS_PER_CLUSTER)
+	GLint maxTextureBufferSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+	indexCapacity = (unsigned int)std::min<GLint>(std::max<GLint>(maxTextureBufferSize, 65536), CLUSTER_COUNT * CLUSTER_MAX_LIGHTS_PER_CLUSTER);
+	CHECK_GL_ERROR();
+
+	frameLights.reserve(CLUSTER_MAX_LIGHTS);
+	lightData.reserve(2 * CLUSTER_MAX_LIGHTS);
+	std::cout << "Clustered lighting : " << CLUSTER_TILES_X << " x " << CLUSTER_TILES_Y << " x " << CLUSTER_SLICES << " clusters, up to "
+		<< CLUSTER_MAX_LIGHTS << " lights (" << CLUSTER_MAX_LIGHTS_PER_CLUSTER << " per cluster, " << indexCapacity << " in all)" << std::endl;
+}
+
+void cleanupClusteredLighting() {
+	const GLuint textures[] = { lightDataTexture, gridTexture, indexTexture };
+	const GLuint buffers[] = { lightDataBuffer, gridBuffer, indexBuffer };
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+	lightDataTexture = gridTexture = indexTexture = 0;
+	lightDataBuffer = gridBuffer = indexBuffer = 0;
+	boundsWidth = boundsHeight = 0;
+}
+
+// -----------------------  Lights of the frame ---------------------------------
+
+/**
+ * \brief Start the list of lights of the frame.
+ */
+void beginLights() {
+	frameLights.clear();
+	lightsDropped = 0;
+}
+
+/**
+ * \brief Add a light to the frame.
+ * \return false if the frame already has CLUSTER_MAX_LIGHTS lights (the light is counted as dropped)
+ */
+bool addPointLight(const glm::vec3& position, float radius, const glm::vec3& color) {
+	if (frameLights.size() >= CLUSTER_MAX_LIGHTS) {
+		lightsDropped++;
+		return false;
+	}
+	PointLight light;
+	light.position = position;
+	light.radius = radius;
+	light.color = color;
+	frameLights.push_back(light);
+	return true;
+}
+
+/**
+ * \brief Pseudo random value in [0, 1) of an integer, the stress lights keep their path from frame to frame.
+ */
+static float hashUnit(unsigned int value) {
+	value = (value ^ 61u) ^ (value >> 16);
+	value *= 9u;
+	value ^= value >> 4;
+	value *= 0x27d4eb2du;
+	value ^= value >> 15;
+	return (value & 0xffffffu) / 16777216.0f;
+}
+
+/**
+ * \brief Lights of the scene : street lamps, car headlights, police light bars, explosions and the lights of the
+ * stress scene (--stress-lights).
+ * \param time [in] time since the start of the application in seconds
+ * \param streetLampsOn [in] night or sun turned off
+ */
+void collectSceneLights(float time, bool streetLampsOn) {
+	beginLights();
+	if (!useClusteredLighting)
+		return;
+
+	if (streetLampsOn) {
+		for (int gridY = 0; gridY < STREET_LAMP_GRID; gridY++) {
+			for (int gridX = 0; gridX < STREET_LAMP_GRID; gridX++) {
+				const float x = SCENE_WIDTH * ((gridX + 0.5f) * 2.0f / STREET_LAMP_GRID - 1.0f);
+				const float y = SCENE_HEIGHT * ((gridY + 0.5f) * 2.0f / STREET_LAMP_GRID - 1.0f);
+				addPointLight(glm::vec3(x, y, terrainHeight(terrainHeightfield, x, y) + 0.12f), 0.35f, glm::vec3(1.0f, 0.75f, 0.4f));
+			}
+		}
+	}
+
+	for (unsigned int slot = 0; slot < entities.count; slot++) {
+		const unsigned char mesh = entities.mesh[slot];
+		if ((entities.flags[slot] & ENTITY_DESTROYED) != 0 ||
+			(mesh != ENTITY_MESH_CAR && mesh != ENTITY_MESH_POLICE && mesh != ENTITY_MESH_CADILLAC))
+			continue;
+
+		const glm::vec3& position = entities.position[slot];
+		const float size = entities.size[slot];
+		const glm::vec3 heading(entities.direction[slot].x, entities.direction[slot].y, 0.0f);
+		const float headingLength = glm::length(heading);
+		if (headingLength < 1e-6f)
+			continue;
+		const glm::vec3 forward = heading / headingLength;
+		const glm::vec3 side(-forward.y, forward.x, 0.0f);
+		const float ground = terrainHeight(terrainHeightfield, position.x, position.y);
+
+		// the headlights are placed in front of the car so that they light the road
+		const glm::vec3 front = glm::vec3(position.x, position.y, ground + 0.3f * size) + forward * (1.2f * size);
+		addPointLight(front + side * (0.3f * size), 2.5f * size, glm::vec3(1.0f, 0.95f, 0.8f));
+		addPointLight(front - side * (0.3f * size), 2.5f * size, glm::vec3(1.0f, 0.95f, 0.8f));
+
+		if (mesh == ENTITY_MESH_POLICE) {
+			const bool red = std::fmod(time * 4.0f + slot * 0.37f, 2.0f) < 1.0f;
+			addPointLight(glm::vec3(position.x, position.y, ground + 0.8f * size), 3.0f * size,
+				red ? glm::vec3(1.5f, 0.1f, 0.1f) : glm::vec3(0.1f, 0.2f, 1.5f));
+		}
+	}
+
+	// explosions fade out over the lifetime of their billboard
+	for (unsigned int i = 0; i < explosionParticles.count; i++) {
+		const ParticleInstance& particle = explosionParticles.instances[i];
+		const float lifetime = explosionParticles.endTime[i] - particle.startTime;
+		const float fade = lifetime > 0.0f ? 1.0f - (time - particle.startTime) / lifetime : 0.0f;
+		if (fade <= 0.0f)
+			continue;
+		if (!addPointLight(glm::vec3(particle.positionSize), 6.0f * particle.positionSize.w, glm::vec3(2.0f, 1.1f, 0.4f) * std::min(fade, 1.0f)))
+			break;
+	}
+
+	// stress scene, every light circles around its own point of the scene
+	for (unsigned int i = 0; i < lightStressCount; i++) {
+		const float centerX = (2.0f * hashUnit(9 * i + 0) - 1.0f) * 0.9f * SCENE_WIDTH;
+		const float centerY = (2.0f * hashUnit(9 * i + 1) - 1.0f) * 0.9f * SCENE_HEIGHT;
+		const float orbit = 0.05f + 0.1f * hashUnit(9 * i + 2);
+		const float angle = time * (0.5f + hashUnit(9 * i + 3)) + 6.2831853f * hashUnit(9 * i + 4);
+		const float x = centerX + orbit * std::cos(angle);
+		const float y = centerY + orbit * std::sin(angle);
+		const glm::vec3 color(hashUnit(9 * i + 5), hashUnit(9 * i + 6), hashUnit(9 * i + 7));
+		if (!addPointLight(glm::vec3(x, y, terrainHeight(terrainHeightfield, x, y) + 0.05f), 0.08f + 0.1f * hashUnit(9 * i + 8),
+			color / std::max(std::max(color.r, color.g), std::max(color.b, 0.1f))))
+			break;
+	}
+}
+
+// -----------------------  Binning ---------------------------------
+
+/**
+ * \brief Near and far planes of the projection and the slice mapping (glm::perspective or glm::ortho).
+ */
+static ClusterCamera clusterCamera(const glm::mat4& projection, int width, int height) {
+	ClusterCamera camera;
+	camera.perspective = projection[2][3] != 0.0f;
+	if (camera.perspective) {
+		camera.nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+		camera.farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+		camera.sliceScale = CLUSTER_SLICES / std::log(camera.farPlane / camera.nearPlane);
+		camera.sliceBias = -std::log(camera.nearPlane) * camera.sliceScale;
+	}
+	else {
+		camera.nearPlane = (projection[3][2] + 1.0f) / projection[2][2];
+		camera.farPlane = (projection[3][2] - 1.0f) / projection[2][2];
+		camera.sliceScale = CLUSTER_SLICES / (camera.farPlane - camera.nearPlane);
+		camera.sliceBias = -camera.nearPlane * camera.sliceScale;
+	}
+	camera.tileWidth = std::ceil(std::max(width, 1) / (float)CLUSTER_TILES_X);
+	camera.tileHeight = std::ceil(std::max(height, 1) / (float)CLUSTER_TILES_Y);
+	return camera;
+}
+
+static float sliceDepth(const ClusterCamera& camera, int slice) {
+	const float t = slice / (float)CLUSTER_SLICES;
+	if (camera.perspective)
+		return camera.nearPlane * std::pow(camera.farPlane / camera.nearPlane, t);
+	return camera.nearPlane + (camera.farPlane - camera.nearPlane) * t;
+}
+
+static int depthSlice(const ClusterCamera& camera, float depth) {
+	const float slice = (camera.perspective ? std::log(std::max(depth, 1e-4f)) : depth) * camera.sliceScale + camera.sliceBias;
+	return std::min(std::max((int)std::floor(slice), 0), CLUSTER_SLICES - 1);
+}
+
+/**
+ * \brief View space point seen at a normalized device position and a depth (distance along -z).
+ */
+static glm::vec3 viewPoint(const glm::mat4& projection, bool perspective, float ndcX, float ndcY, float depth) {
+	const float w = perspective ? depth : 1.0f;
+	const float z = -depth;
+	return glm::vec3((ndcX * w - projection[2][0] * z - projection[3][0]) / projection[0][0],
+		(ndcY * w - projection[2][1] * z - projection[3][1]) / projection[1][1], z);
+}
+
+static void buildClusterBounds(const glm::mat4& projection, const ClusterCamera& camera, int width, int height) {
+	for (int slice = 0; slice < CLUSTER_SLICES; slice++) {
+		const float depths[2] = { sliceDepth(camera, slice), sliceDepth(camera, slice + 1) };
+		for (int tileY = 0; tileY < CLUSTER_TILES_Y; tileY++) {
+			const float ndcY[2] = { 2.0f * tileY * camera.tileHeight / height - 1.0f,
+				std::min(2.0f * (tileY + 1) * camera.tileHeight / height - 1.0f, 1.0f) };
+			for (int tileX = 0; tileX < CLUSTER_TILES_X; tileX++) {
+				const float ndcX[2] = { 2.0f * tileX * camera.tileWidth / width - 1.0f,
+					std::min(2.0f * (tileX + 1) * camera.tileWidth / width - 1.0f, 1.0f) };
+
+				glm::vec3 minimum(FLT_MAX);
+				glm::vec3 maximum(-FLT_MAX);
+				for (int corner = 0; corner < 8; corner++) {
+					const glm::vec3 point = viewPoint(projection, camera.perspective, ndcX[corner & 1], ndcY[(corner >> 1) & 1], depths[corner >> 2]);
+					minimum = glm::min(minimum, point);
+					maximum = glm::max(maximum, point);
+				}
+				const int cluster = clusterIndex(slice, tileX, tileY);
+				clusterMinX[cluster] = minimum.x;
+				clusterMinY[cluster] = minimum.y;
+				clusterMinZ[cluster] = minimum.z;
+				clusterMaxX[cluster] = maximum.x;
+				clusterMaxY[cluster] = maximum.y;
+				clusterMaxZ[cluster] = maximum.z;
+			}
+		}
+	}
+}
+
+static int screenTile(float ndc, int size, float tileSize, int tiles) {
+	const int tile = (int)std::floor((ndc * 0.5f + 0.5f) * size / tileSize);
+	return std::min(std::max(tile, 0), tiles - 1);
+}
+
+/**
+ * \brief View space position and conservative range of slices and tiles of every light (bounding box of the
+ * sphere projected on the screen, the whole screen when the sphere crosses the near plane).
+ */
+static void prepareLights(const glm::mat4& viewMatrix, const glm::mat4& projection, const ClusterCamera& camera, int width, int height) {
+	const unsigned int count = (unsigned int)frameLights.size();
+	for (unsigned int i = 0; i < count; i++) {
+		const PointLight& light = frameLights[i];
+		const glm::vec3 center = glm::vec3(viewMatrix * glm::vec4(light.position, 1.0f));
+		lightX[i] = center.x;
+		lightY[i] = center.y;
+		lightZ[i] = center.z;
+		lightRadius[i] = light.radius;
+
+		const float depth = -center.z;
+		lightSliceMin[i] = 1;
+		lightSliceMax[i] = 0;
+		if (depth + light.radius < camera.nearPlane || depth - light.radius > camera.farPlane)
+			continue;
+
+		float ndcMinX = -1.0f, ndcMinY = -1.0f;
+		float ndcMaxX = 1.0f, ndcMaxY = 1.0f;
+		if (!camera.perspective || depth - light.radius > camera.nearPlane) {
+			ndcMinX = ndcMinY = FLT_MAX;
+			ndcMaxX = ndcMaxY = -FLT_MAX;
+			for (int corner = 0; corner < 8; corner++) {
+				const glm::vec3 offset((corner & 1) ? light.radius : -light.radius, (corner & 2) ? light.radius : -light.radius,
+					(corner & 4) ? light.radius : -light.radius);
+				const glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+				ndcMinX = std::min(ndcMinX, clip.x / clip.w);
+				ndcMinY = std::min(ndcMinY, clip.y / clip.w);
+				ndcMaxX = std::max(ndcMaxX, clip.x / clip.w);
+				ndcMaxY = std::max(ndcMaxY, clip.y / clip.w);
+			}
+			if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+				continue;
+		}
+
+		lightSliceMin[i] = depthSlice(camera, depth - light.radius);
+		lightSliceMax[i] = depthSlice(camera, depth + light.radius);
+		lightTileMinX[i] = screenTile(ndcMinX, width, camera.tileWidth, CLUSTER_TILES_X);
+		lightTileMaxX[i] = screenTile(ndcMaxX, width, camera.tileWidth, CLUSTER_TILES_X);
+		lightTileMinY[i] = screenTile(ndcMinY, height, camera.tileHeight, CLUSTER_TILES_Y);
+		lightTileMaxY[i] = screenTile(ndcMaxY, height, camera.tileHeight, CLUSTER_TILES_Y);
+	}
+}
+
+/**
+ * \brief Light lists of the clusters of one depth slice (sphere against the box of every cluster of its range).
+ */
+static void binSlice(int slice, unsigned int count) {
+	unsigned int overflow = 0;
+	const int first = clusterIndex(slice, 0, 0);
+	std::fill(clusterLightCounts + first, clusterLightCounts + first + CLUSTER_TILES_X * CLUSTER_TILES_Y, 0u);
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (slice < lightSliceMin[i] || slice > lightSliceMax[i])
+			continue;
+		const float x = lightX[i];
+		const float y = lightY[i];
+		const float z = lightZ[i];
+		const float radiusSquared = lightRadius[i] * lightRadius[i];
+
+		for (int tileY = lightTileMinY[i]; tileY <= lightTileMaxY[i]; tileY++) {
+			for (int tileX = lightTileMinX[i]; tileX <= lightTileMaxX[i]; tileX++) {
+				const int cluster = clusterIndex(slice, tileX, tileY);
+				const float dx = std::max(std::max(clusterMinX[cluster] - x, x - clusterMaxX[cluster]), 0.0f);
+				const float dy = std::max(std::max(clusterMinY[cluster] - y, y - clusterMaxY[cluster]), 0.0f);
+				const float dz = std::max(std::max(clusterMinZ[cluster] - z, z - clusterMaxZ[cluster]), 0.0f);
+				if (dx * dx + dy * dy + dz * dz > radiusSquared)
+					continue;
+
+				unsigned int& lights = clusterLightCounts[cluster];
+				if (lights < CLUSTER_MAX_LIGHTS_PER_CLUSTER)
+					clusterLights[cluster][lights++] = (unsigned short)i;
+				else
+					overflow++;
+			}
+		}
+	}
+	sliceOverflow[slice] = overflow;
+}
+
+static void uploadBuffer(GLuint buffer, GLsizeiptr size, const void* data) {
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+}
+
+/**
+ * \brief Bin the lights of the frame into the clusters of the camera and upload the lists (the buffers are
+ * orphaned, the previous frame may still read them). Fills the cluster fields of the frame block.
+ * \param width [in] size of the framebuffer in pixels, the shader finds its tile from gl_FragCoord
+ */
+void buildLightClusters(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int width, int height, FrameData& frameData) {
+	typedef std::chrono::high_resolution_clock Clock;
+	const Clock::time_point start = Clock::now();
+
+	const unsigned int count = (unsigned int)frameLights.size();
+	frameData.dynamicLightCount = 0;
+	renderStats.dynamicLightsDropped += lightsDropped;
+	if (count == 0 || lightDataBuffer == 0)
+		return;
+
+	width = std::max(width, 1);
+	height = std::max(height, 1);
+	const ClusterCamera camera = clusterCamera(projectionMatrix, width, height);
+	if (projectionMatrix != boundsProjection || width != boundsWidth || height != boundsHeight) {
+		buildClusterBounds(projectionMatrix, camera, width, height);
+		boundsProjection = projectionMatrix;
+		boundsWidth = width;
+		boundsHeight = height;
+	}
+
+	prepareLights(viewMatrix, projectionMatrix, camera, width, height);
+	parallelFor(CLUSTER_SLICES, 1, [count](size_t begin, size_t end) {
+		for (size_t slice = begin; slice < end; slice++)
+			binSlice((int)slice, count);
+	});
+
+	// compaction of the lists into one index array, the entries past the size of the buffer texture are dropped
+	indexData.clear();
+	unsigned int overflow = 0;
+	for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+		const unsigned int lights = std::min(clusterLightCounts[cluster], indexCapacity - (unsigned int)indexData.size());
+		overflow += clusterLightCounts[cluster] - lights;
+		gridData[2 * cluster] = (GLuint)indexData.size();
+		gridData[2 * cluster + 1] = lights;
+		indexData.insert(indexData.end(), clusterLights[cluster], clusterLights[cluster] + lights);
+	}
+	for (int slice = 0; slice < CLUSTER_SLICES; slice++)
+		overflow += sliceOverflow[slice];
+
+	lightData.resize(2 * count);
+	for (unsigned int i = 0; i < count; i++) {
+		lightData[2 * i] = glm::vec4(lightX[i], lightY[i], lightZ[i], lightRadius[i]);
+		lightData[2 * i + 1] = glm::vec4(frameLights[i].color, 0.0f);
+	}
+
+	uploadBuffer(lightDataBuffer, lightData.size() * sizeof(glm::vec4), lightData.data());
+	uploadBuffer(gridBuffer, gridData.size() * sizeof(GLuint), gridData.data());
+	if (!indexData.empty())
+		uploadBuffer(indexBuffer, indexData.size() * sizeof(GLushort), indexData.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	COUNT_GL_CALLS(indexData.empty() ? 5 : 7);
+
+	frameData.clusterParams = glm::vec4((float)CLUSTER_TILES_X, (float)CLUSTER_TILES_Y, camera.sliceScale, camera.sliceBias);
+	frameData.clusterTileSize = glm::vec4(camera.tileWidth, camera.tileHeight, (float)CLUSTER_SLICES, camera.perspective ? 1.0f : 0.0f);
+	frameData.dynamicLightCount = (GLint)count;
+
+	renderStats.dynamicLights += count;
+	renderStats.dynamicLightsDropped += overflow;
+	renderStats.clusterLightEntries += (unsigned int)indexData.size();
+	renderStats.lightBinningMicroseconds += (unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
@@ -0,0 +1,51 @@
+/*
+* \file clusteredLighting.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Clustered forward lighting - dynamic point lights binned on the CPU into a grid of view frustum clusters,
+* every fragment only shades the lights of its cluster
+*/
+
+#pragma once
+
+#ifndef __CLUSTERED_LIGHTING_H
+#define __CLUSTERED_LIGHTING_H
+
+#include "pgr.h"
+#include "uniformBuffers.h"
+
+#define CLUSTER_TILES_X 16					// screen tiles per row
+#define CLUSTER_TILES_Y 9					// screen tiles per column
+#define CLUSTER_SLICES 24					// depth slices, logarithmic for perspective cameras
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+#define CLUSTER_MAX_LIGHTS 4096				// lights per frame, the indices are 16 bit
+#define CLUSTER_MAX_LIGHTS_PER_CLUSTER 64	// bounds the cost of the most crowded fragment
+
+#define CLUSTER_LIGHT_DATA_UNIT 1			// texture units of the buffer textures, unit 0 is the material texture
+#define CLUSTER_GRID_UNIT 2
+#define CLUSTER_INDEX_UNIT 3
+
+#define LIGHT_STRESS_COUNT 1000				// default number of lights of the stress scene
+#define STREET_LAMP_GRID 6					// street lamps per side of the scene
+
+/**
+ * \brief Dynamic point light, the intensity falls to zero at the radius.
+ */
+typedef struct _PointLight {
+	glm::vec3 position;		///< world space
+	float     radius;
+	glm::vec3 color;		///< premultiplied by the intensity
+} PointLight;
+
+extern bool useClusteredLighting;		///< false shades only the sun, spot and bulb lights (--no-clustered-lights)
+extern unsigned int lightStressCount;	///< animated lights of the stress scene, 0 = off (--stress-lights)
+
+void initClusteredLighting();
+void cleanupClusteredLighting();
+
+void beginLights();
+bool addPointLight(const glm::vec3& position, float radius, const glm::vec3& color);
+void collectSceneLights(float time, bool streetLampsOn);
+void buildLightClusters(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int width, int height, FrameData& frameData);
+
+#endif // __CLUSTERED_LIGHTING_H
@@ -25,6 +25,10 @@
 #define TREE_SIZE 0.25f
 #define TORCH_SIZE 1.0f
 #define BANNER_SIZE 1.0f
+#define EXPLOSION_SIZE 0.1f
+
+#define EXPLOSION_FRAME_DURATION 0.1f
+#define EXPLOSION_TEXTURE_FRAMES 16
 
 #define CAMERA_ELEVATION_MAX 50.0f
 
@@ -0,0 +1,255 @@
+/*
+* \file drawQueue.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Draw queue - draws are submitted with a sort key, sorted once per frame and executed through a shadow state cache
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include "drawQueue.h"
+#include "renderer.h"
+
+static std::vector<DrawCommand> commands;
+static std::vector<uint64_t> keys;
+static std::vector<glm::mat4> transforms;
+static glm::mat4 queueViewMatrix;
+static glm::mat4 queueProjectionMatrix;
+static RenderStateCache stateCache;
+static std::vector<ObjectGeometry*> batchGeometries;
+static std::vector<DrawBatch> batches;
+static std::vector<glm::mat4> pvmMatrices;
+static std::vector<glm::mat4> normalMatrices;
+
+/**
+ * \brief Start collecting the draws of a frame.
+ */
+void beginDrawQueue(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+	commands.clear();
+	keys.clear();
+	transforms.clear();
+	queueViewMatrix = viewMatrix;
+	queueProjectionMatrix = projectionMatrix;
+}
+
+/**
+ * \brief Queue a model matrix, returns its index for submitDraw().
+ */
+unsigned int submitTransform(const glm::mat4& modelMatrix) {
+	transforms.push_back(modelMatrix);
+	return (unsigned int)transforms.size() - 1;
+}
+
+/**
+ * \brief View space depth quantized to 24 bits. Positive floats keep their order when compared as integers.
+ */
+static uint64_t depthKey(float depth) {
+	if (!(depth > 0.0f))
+		return 0;
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> 8;
+}
+
+static void queueCommand(const DrawCommand& command) {
+	if (commands.size() >= DRAW_QUEUE_MAX_COMMANDS) {
+		std::cerr << "\033[31msubmitDraw : too many draws in one frame\033[0m" << std::endl;
+		return;
+	}
+
+	const glm::vec4 viewPosition = queueViewMatrix * transforms[command.transform][3];
+	const uint64_t programBits = (uint64_t)(command.program & 0xf);
+	const uint64_t textureBits = (uint64_t)(command.geometry->material.texture & 0xfff);
+	const uint64_t vaoBits = (uint64_t)(command.vertexArray & 0xff);
+
+	keys.push_back((programBits << DRAW_KEY_PROGRAM_SHIFT)
+		| (textureBits << DRAW_KEY_TEXTURE_SHIFT)
+		| (vaoBits << DRAW_KEY_VAO_SHIFT)
+		| (depthKey(-viewPosition.z) << DRAW_KEY_DEPTH_SHIFT)
+		| (uint64_t)commands.size());
+	commands.push_back(command);
+}
+
+/**
+ * \brief Queue a draw of the geometry with the lighting shader (the permutation of the frame features and of its
+ * material), sub-meshes outside of the view frustum are skipped.
+ * \param geometry [in] geometry to draw, must stay alive until executeDrawQueue()
+ * \param transform [in] model matrix returned by submitTransform()
+ */
+void submitDraw(const ObjectGeometry* geometry, unsigned int transform) {
+	if (geometry == NULL || !geometryVisible(geometry, transforms[transform]))
+		return;
+	requestTextureResidency(geometry, transforms[transform]);
+
+	DrawCommand command;
+	command.geometry = geometry;
+	command.transform = transform;
+	command.vertexArray = geometry->vertexArrayObject;
+	command.instanceCount = 0;
+	command.program = lightingProgram(lightingFeatures | (geometry->material.texture != 0 ? LIGHTING_TEXTURE : 0), false);
+	queueCommand(command);
+}
+
+/**
+ * \brief Queue an instanced draw of the geometry with the instanced lighting shader.
+ * \param vertexArray [in] vao providing the vertices of the geometry and the per instance attributes
+ * \param instanceCount [in] number of instances in the instance buffer of the vao
+ * \param transform [in] only used to order the draws, the model matrices are per instance
+ */
+void submitInstancedDraw(const ObjectGeometry* geometry, GLuint vertexArray, GLsizei instanceCount, unsigned int transform) {
+	if (geometry == NULL || instanceCount <= 0)
+		return;
+
+	DrawCommand command;
+	command.geometry = geometry;
+	command.transform = transform;
+	command.vertexArray = vertexArray;
+	command.instanceCount = instanceCount;
+	command.program = lightingProgram(lightingFeatures | (geometry->material.texture != 0 ? LIGHTING_TEXTURE : 0), true);
+	queueCommand(command);
+}
+
+// -----------------------  Shadow state cache ---------------------------------
+
+static void cachedUseProgram(GLuint program) {
+	if (stateCache.program == program) {
+		renderStats.stateChangesSkipped++;
+		return;
+	}
+	glUseProgram(program);
+	COUNT_GL_CALLS(1);
+	stateCache.program = program;
+}
+
+static void cachedBindVertexArray(GLuint vertexArray) {
+	if (stateCache.vertexArray == vertexArray) {
+		renderStats.stateChangesSkipped++;
+		return;
+	}
+	bindVertexArray(vertexArray);
+	stateCache.vertexArray = vertexArray;
+}
+
+static void cachedBindTexture(GLuint texture) {
+	if (texture == 0)
+		return;
+	if (stateCache.texture == texture) {
+		renderStats.stateChangesSkipped++;
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	COUNT_GL_CALLS(1);
+	stateCache.texture = texture;
+}
+
+// -----------------------  Execution ---------------------------------
+
+/**
+ * \brief Group the sorted draws into batches - following sub-meshes of the same object with the same state.
+ */
+static void buildBatches() {
+	batchGeometries.clear();
+	batches.clear();
+
+	for (size_t k = 0; k < keys.size(); ) {
+		const DrawCommand& command = commands[keys[k] & 0xffff];
+
+		DrawBatch batch;
+		batch.first = (unsigned int)batchGeometries.size();
+		batch.command = &command;
+		batchGeometries.push_back(const_cast<ObjectGeometry*>(command.geometry));
+
+		size_t next = k + 1;
+		while (next < keys.size()) {
+			const DrawCommand& other = commands[keys[next] & 0xffff];
+			if (command.instanceCount != 0 || other.instanceCount != 0
+				|| other.transform != command.transform
+				|| other.program != command.program
+				|| !haveSameDrawState(command.geometry, other.geometry))
+				break;
+			batchGeometries.push_back(const_cast<ObjectGeometry*>(other.geometry));
+			next++;
+		}
+		batch.count = (unsigned int)batchGeometries.size() - batch.first;
+		batches.push_back(batch);
+		k = next;
+	}
+}
+
+/**
+ * \brief Fill the ObjectData block of every batch, the matrices are computed once per queued transform.
+ */
+static void writeObjectData() {
+	pvmMatrices.resize(transforms.size());
+	normalMatrices.resize(transforms.size());
+	const glm::mat4 projectionView = queueProjectionMatrix * queueViewMatrix;
+	for (size_t i = 0; i < transforms.size(); i++) {
+		pvmMatrices[i] = projectionView * transforms[i];
+		normalMatrices[i] = glm::transpose(glm::inverse(glm::mat4(glm::mat3(transforms[i]))));
+	}
+
+	for (size_t b = 0; b < batches.size(); b++) {
+		const DrawCommand& command = *batches[b].command;
+		const ObjectGeometry* geometry = command.geometry;
+		ObjectData* data = objectDataAt((unsigned int)b);
+
+		data->PVM = pvmMatrices[command.transform];
+		data->modelMatrix = transforms[command.transform];
+		data->normalMatrix = normalMatrices[command.transform];
+		data->positionScale = glm::vec4(geometry->positionScale, 0.0f);
+		data->positionOffset = glm::vec4(geometry->positionOffset, 0.0f);
+		data->materialAmbient = glm::vec4(geometry->material.ambient, 0.0f);
+		data->materialDiffuse = glm::vec4(geometry->material.diffuse, 0.0f);
+		data->materialSpecular = glm::vec4(geometry->material.specular, geometry->material.shininess);
+		data->useTexture = geometry->material.texture != 0 ? 1 : 0;
+	}
+}
+
+/**
+ * \brief Sort the queued draws and execute them. Consecutive sub-meshes of the same object sharing the draw state
+ * are drawn by one multi draw call, each batch reads its transform and material from its own ObjectData block.
+ */
+void executeDrawQueue() {
+	if (commands.empty())
+		return;
+
+	std::sort(keys.begin(), keys.end());
+	buildBatches();
+
+	if (batches.size() > OBJECT_RING_ENTRIES) {
+		std::cerr << "\033[31mexecuteDrawQueue : " << batches.size() << " batches, only " << OBJECT_RING_ENTRIES << " are drawn\033[0m" << std::endl;
+		batches.resize(OBJECT_RING_ENTRIES);
+	}
+	if (!beginObjectData((unsigned int)batches.size()))
+		return;
+	writeObjectData();
+	endObjectData();
+
+	// the state left by the other draw functions is unknown
+	stateCache.invalidate();
+	glActiveTexture(GL_TEXTURE0);
+	COUNT_GL_CALLS(1);
+
+	for (size_t b = 0; b < batches.size(); b++) {
+		const DrawBatch& batch = batches[b];
+		const DrawCommand& command = *batch.command;
+
+		cachedUseProgram(command.program);
+		bindObjectData((unsigned int)b);
+		cachedBindTexture(command.geometry->material.texture);
+		cachedBindVertexArray(command.vertexArray);
+
+		if (command.instanceCount != 0)
+			drawGeometryInstanced(command.geometry, command.instanceCount);
+		else
+			drawGeometryBatch(&batchGeometries[batch.first], batch.count);
+	}
+	CHECK_GL_ERROR();
+	finishObjectDataFrame();
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+	COUNT_GL_CALLS(2);
+	stateCache.invalidate();
+}
@@ -0,0 +1,72 @@
+/*
+* \file drawQueue.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Draw queue - draws are submitted with a sort key, sorted once per frame and executed through a shadow state cache
+*/
+
+#pragma once
+
+#ifndef __DRAW_QUEUE_H
+#define __DRAW_QUEUE_H
+
+#include <vector>
+#include <cstdint>
+#include "pgr.h"
+#include "object.h"
+
+/*
+ * Sort key layout (most significant first), draws with the same program, texture and vao end up next to each other
+ * and are drawn front to back inside such a group:
+ *   | program 4 | texture 12 | vao 8 | depth 24 | command index 16 |
+ */
+#define DRAW_KEY_PROGRAM_SHIFT 60
+#define DRAW_KEY_TEXTURE_SHIFT 48
+#define DRAW_KEY_VAO_SHIFT 40
+#define DRAW_KEY_DEPTH_SHIFT 16
+#define DRAW_QUEUE_MAX_COMMANDS 65536
+
+/**
+ * \brief One queued draw of a geometry with the lighting shader.
+ */
+typedef struct _DrawCommand {
+	const ObjectGeometry* geometry;
+	unsigned int transform;		///< index of the model matrix in the queue, shared by all sub-meshes of an object
+	GLuint vertexArray;			///< geometry vao, or the instanced vao of an instance group
+	GLsizei instanceCount;		///< 0 for a single draw with the lighting shader, instances drawn with its instanced variant otherwise
+	GLuint program;				///< lighting program specialized for the features of the frame and the material
+} DrawCommand;
+
+/**
+ * \brief Consecutive queued draws of one object sharing the draw state, drawn by one (multi) draw call with one
+ * ObjectData uniform block.
+ */
+typedef struct _DrawBatch {
+	unsigned int first;			///< first geometry in the batch geometry list
+	unsigned int count;
+	const DrawCommand* command;	///< first command of the batch (transform and draw state of the batch)
+} DrawBatch;
+
+/**
+ * \brief GL state as last set by the draw queue, used to skip redundant state changes.
+ */
+typedef struct _RenderStateCache {
+	GLuint program;
+	GLuint vertexArray;
+	GLuint texture;				///< GL_TEXTURE_2D on unit 0
+
+	_RenderStateCache() { invalidate(); }
+	void invalidate() {
+		program = 0;
+		vertexArray = 0;
+		texture = 0;
+	}
+} RenderStateCache;
+
+void beginDrawQueue(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+unsigned int submitTransform(const glm::mat4& modelMatrix);
+void submitDraw(const ObjectGeometry* geometry, unsigned int transform);
+void submitInstancedDraw(const ObjectGeometry* geometry, GLuint vertexArray, GLsizei instanceCount, unsigned int transform);
+void executeDrawQueue();
+
+#endif // __DRAW_QUEUE_H
@@ -0,0 +1,307 @@
+/*
+* \file entityStore.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Scene entities (props, airplanes) stored as structure of arrays and updated linearly
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include "entityStore.h"
+#include "spatialHash.h"
+#include "object.h"
+#include "data.h"
+#include "spline.h"
+#include "frameLoop.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+#define ENTITY_MOVE_SCALE 0.015f	// distance per simulation step = speed * ENTITY_MOVE_SCALE (same as the player)
+
+EntityStore entities;
+
+/**
+ * \brief Create an entity at the end of the store.
+ * \return id of the entity, valid until removeEntity() or clearEntities()
+ */
+EntityId createEntity(EntityStore& store, EntityMesh mesh, unsigned int flags, const glm::vec3& position,
+	const glm::vec3& direction, float size, float time) {
+
+	EntityId id;
+	if (!store.freeIds.empty()) {
+		id = store.freeIds.back();
+		store.freeIds.pop_back();
+	}
+	else {
+		id = (EntityId)store.slots.size();
+		store.slots.push_back(ENTITY_NONE);
+	}
+
+	store.slots[id] = store.count;
+	store.ids.push_back(id);
+	store.position.push_back(position);
+	store.previousPosition.push_back(position);
+	store.direction.push_back(direction);
+	store.previousDirection.push_back(direction);
+	store.origin.push_back(position);
+	store.speed.push_back(0.0f);
+	store.size.push_back(size);
+	store.groundOffset.push_back(0.0f);
+	store.startTime.push_back(time);
+	store.currentTime.push_back(time);
+	store.flags.push_back(flags);
+	store.mesh.push_back((unsigned char)mesh);
+	store.count++;
+
+	return id;
+}
+
+template <typename T>
+static void moveLastInto(std::vector<T>& values, unsigned int slot) {
+	values[slot] = values.back();
+	values.pop_back();
+}
+
+/**
+ * \brief Remove the entity in the slot, the last entity is moved into it.
+ */
+static void removeSlot(EntityStore& store, unsigned int slot) {
+	const EntityId removed = store.ids[slot];
+	const EntityId moved = store.ids.back();
+
+	moveLastInto(store.ids, slot);
+	moveLastInto(store.position, slot);
+	moveLastInto(store.previousPosition, slot);
+	moveLastInto(store.direction, slot);
+	moveLastInto(store.previousDirection, slot);
+	moveLastInto(store.origin, slot);
+	moveLastInto(store.speed, slot);
+	moveLastInto(store.size, slot);
+	moveLastInto(store.groundOffset, slot);
+	moveLastInto(store.startTime, slot);
+	moveLastInto(store.currentTime, slot);
+	moveLastInto(store.flags, slot);
+	moveLastInto(store.mesh, slot);
+	store.count--;
+
+	store.slots[moved] = slot;
+	store.slots[removed] = ENTITY_NONE;
+	store.freeIds.push_back(removed);
+}
+
+void removeEntity(EntityStore& store, EntityId id) {
+	const unsigned int slot = entitySlot(store, id);
+	if (slot != ENTITY_NONE)
+		removeSlot(store, slot);
+}
+
+void clearEntities(EntityStore& store) {
+	store.ids.clear();
+	store.position.clear();
+	store.previousPosition.clear();
+	store.direction.clear();
+	store.previousDirection.clear();
+	store.origin.clear();
+	store.speed.clear();
+	store.size.clear();
+	store.groundOffset.clear();
+	store.startTime.clear();
+	store.currentTime.clear();
+	store.flags.clear();
+	store.mesh.clear();
+	store.slots.clear();
+	store.freeIds.clear();
+	store.count = 0;
+}
+
+void reserveEntities(EntityStore& store, unsigned int capacity) {
+	store.ids.reserve(capacity);
+	store.position.reserve(capacity);
+	store.previousPosition.reserve(capacity);
+	store.direction.reserve(capacity);
+	store.previousDirection.reserve(capacity);
+	store.origin.reserve(capacity);
+	store.speed.reserve(capacity);
+	store.size.reserve(capacity);
+	store.groundOffset.reserve(capacity);
+	store.startTime.reserve(capacity);
+	store.currentTime.reserve(capacity);
+	store.flags.reserve(capacity);
+	store.mesh.reserve(capacity);
+	store.slots.reserve(capacity);
+}
+
+/**
+ * \brief Advance every entity by one simulation step, in one pass over the arrays.
+ * \param elapsedTime [in] simulation time of the step in seconds
+ */
+void updateEntities(EntityStore& store, float elapsedTime) {
+	const unsigned int count = store.count;
+
+	// state of the previous step, the rendered frames are interpolated from it
+	std::copy(store.position.begin(), store.position.end(), store.previousPosition.begin());
+	std::copy(store.direction.begin(), store.direction.end(), store.previousDirection.begin());
+
+	for (unsigned int i = 0; i < count; i++) {
+		const unsigned int flags = store.flags[i];
+		if (flags & ENTITY_DESTROYED)
+			continue;
+
+		store.currentTime[i] = elapsedTime;
+
+		if (flags & ENTITY_DYNAMIC) {
+			glm::vec3 position = store.position[i] + store.direction[i] * (store.speed[i] * ENTITY_MOVE_SCALE);
+			const float limit = TERRAIN_SIZE - store.size[i];
+			position.x = glm::clamp(position.x, -limit, limit);
+			position.y = glm::clamp(position.y, -limit, limit);
+			store.position[i] = position;
+		}
+
+		if (flags & ENTITY_FOLLOW_CURVE) {
+			const float curveParamT = store.speed[i] * (elapsedTime - store.startTime[i]);
+			glm::vec3 position = store.origin[i] + evaluateClosedCurve(curveData, curveSize, curveParamT);
+			// keep the airplane above the terrain
+			const float limit = TERRAIN_SIZE - store.size[i];
+			position.x = glm::clamp(position.x, -limit, limit);
+			position.y = glm::clamp(position.y, -limit, limit);
+			store.position[i] = position;
+			store.direction[i] = glm::normalize(evaluateClosedCurve_1stDerivative(curveData, curveSize, curveParamT));
+		}
+
+		if (flags & ENTITY_SPIN) {
+			store.direction[i] = glm::vec3(std::cos(elapsedTime), std::sin(elapsedTime), 0.0f);
+			// move up and down
+			store.position[i].z = (-MIN_HEIGHT - 0.08f) + 0.1f * std::sin(elapsedTime);
+		}
+	}
+}
+
+/**
+ * \brief Put the grounded entities on the terrain, their heights are queried in one batch.
+ */
+void groundEntities(EntityStore& store, const Heightfield& ground) {
+	static std::vector<unsigned int> slots;
+	static std::vector<float> x, y, heights;
+	slots.clear();
+	x.clear();
+	y.clear();
+
+	for (unsigned int i = 0; i < store.count; i++) {
+		if ((store.flags[i] & (ENTITY_GROUNDED | ENTITY_DESTROYED)) == ENTITY_GROUNDED) {
+			slots.push_back(i);
+			x.push_back(store.position[i].x);
+			y.push_back(store.position[i].y);
+		}
+	}
+
+	heights.resize(slots.size());
+	terrainHeights(ground, x.data(), y.data(), heights.data(), slots.size());
+	for (size_t i = 0; i < slots.size(); i++)
+		store.position[slots[i]].z = heights[i] + store.groundOffset[slots[i]];
+}
+
+/**
+ * \brief Collect the slots of the entities touching the sphere (ENTITY_COLLIDE or ENTITY_LETHAL, not destroyed).
+ *  Same sphere test as the spatial hash, without the broad phase.
+ * \return number of hits
+ */
+unsigned int findCollisions(const EntityStore& store, const glm::vec3& center, float radius, std::vector<unsigned int>& hits) {
+	hits.clear();
+	for (unsigned int i = 0; i < store.count; i++) {
+		const unsigned int flags = store.flags[i];
+		if ((flags & (ENTITY_COLLIDE | ENTITY_LETHAL)) == 0 || (flags & ENTITY_DESTROYED))
+			continue;
+		const float reach = (radius + store.size[i]) * COLLISION_RADIUS_SCALE;
+		const glm::vec3 delta = store.position[i] - center;
+		if (glm::dot(delta, delta) < reach * reach)
+			hits.push_back(i);
+	}
+	return (unsigned int)hits.size();
+}
+
+// -----------------------  Benchmark ---------------------------------
+
+/**
+ * \brief Compare one simulation step (movement, bounds, sphere test against the player) of count entities
+ *  stored as heap allocated objects reached through pointers (former GameObjectsList layout) and in the entity store.
+ */
+void benchmarkEntityStore(unsigned int count) {
+	const int frames = 200;
+	const glm::vec3 playerPosition(0.0f);
+	const float playerSize = PLAYER_SIZE;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+	// per pointer layout, the objects are allocated among other allocations as during the game
+	std::vector<Object*> objects;
+	std::vector<char*> otherAllocations;
+	objects.reserve(count);
+	otherAllocations.reserve(count);
+
+	EntityStore store;
+	reserveEntities(store, count);
+
+	for (unsigned int i = 0; i < count; i++) {
+		const glm::vec3 position(uniform(random), uniform(random), MIN_HEIGHT);
+		const float angle = 3.14159265f * uniform(random);
+		const glm::vec3 direction(std::cos(angle), std::sin(angle), 0.0f);
+		const float speed = 0.2f + 0.2f * uniform(random);
+
+		otherAllocations.push_back(new char[16 + random() % 256]);
+		Object* object = new Object((int)i);
+		object->position = position;
+		object->direction = direction;
+		object->speed = speed;
+		object->size = CAR_SIZE;
+		objects.push_back(object);
+
+		const EntityId id = createEntity(store, ENTITY_MESH_CAR, ENTITY_DYNAMIC | ENTITY_COLLIDE, position, direction, CAR_SIZE, 0.0f);
+		store.speed[entitySlot(store, id)] = speed;
+	}
+	std::shuffle(objects.begin(), objects.end(), random);
+
+	unsigned int pointerHits = 0;
+	Clock::time_point start = Clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		const float elapsedTime = (float)(frame * SIMULATION_STEP);
+		for (size_t i = 0; i < objects.size(); i++) {
+			Object* object = objects[i];
+			if (object->destroyed)
+				continue;
+			object->currentTime = elapsedTime;
+			glm::vec3 position = object->position + object->direction * (object->speed * ENTITY_MOVE_SCALE);
+			const float limit = TERRAIN_SIZE - object->size;
+			position.x = glm::clamp(position.x, -limit, limit);
+			position.y = glm::clamp(position.y, -limit, limit);
+			object->position = position;
+			const float reach = (playerSize + object->size) * COLLISION_RADIUS_SCALE;
+			const glm::vec3 delta = object->position - playerPosition;
+			if (glm::dot(delta, delta) < reach * reach)
+				pointerHits++;
+		}
+	}
+	const double pointerMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+	unsigned int storeHits = 0;
+	std::vector<unsigned int> hits;
+	start = Clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		updateEntities(store, (float)(frame * SIMULATION_STEP));
+		storeHits += findCollisions(store, playerPosition, playerSize, hits);
+	}
+	const double storeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+	printf("%u entities, %d steps (%u / %u collisions)\n", count, frames, pointerHits, storeHits);
+	printf("  objects through pointers : %8.3f ms per step (%.2f ns per entity)\n", pointerMs, 1.0e6 * pointerMs / count);
+	printf("  entity store (SoA)       : %8.3f ms per step (%.2f ns per entity), x%.2f\n", storeMs, 1.0e6 * storeMs / count,
+		storeMs > 0.0 ? pointerMs / storeMs : 0.0);
+
+	for (size_t i = 0; i < objects.size(); i++)
+		delete objects[i];
+	for (size_t i = 0; i < otherAllocations.size(); i++)
+		delete[] otherAllocations[i];
+}
@@ -0,0 +1,100 @@
+/*
+* \file entityStore.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Scene entities (props, airplanes) stored as structure of arrays and updated linearly
+*/
+
+#pragma once
+
+#ifndef __ENTITY_STORE_H
+#define __ENTITY_STORE_H
+
+#include <vector>
+#include "pgr.h"
+#include "heightfield.h"
+
+#define ENTITY_NONE 0xFFFFFFFFu
+#define ENTITY_BENCH_COUNT 100000		// entities of the --bench-entities microbenchmark
+
+typedef unsigned int EntityId;
+
+/**
+ * \brief Mesh drawn for an entity (index in the geometry table of the renderer).
+ */
+enum EntityMesh {
+	ENTITY_MESH_NONE,
+	ENTITY_MESH_CUBE,
+	ENTITY_MESH_FOXBAT,
+	ENTITY_MESH_ZEPPLIN,
+	ENTITY_MESH_CAR,
+	ENTITY_MESH_POLICE,
+	ENTITY_MESH_CADILLAC,
+	ENTITY_MESH_TREE1,
+	ENTITY_MESH_TREE2,
+	ENTITY_MESH_COUNT
+};
+
+/**
+ * \brief Behaviour of an entity, combined in EntityStore::flags.
+ */
+enum EntityFlags {
+	ENTITY_DESTROYED    = 1 << 0,	///< not drawn and no collisions (kept until the restart)
+	ENTITY_DYNAMIC      = 1 << 1,	///< moves by direction * speed every simulation step
+	ENTITY_FOLLOW_CURVE = 1 << 2,	///< flies along the closed curve around its origin (airplane)
+	ENTITY_SPIN         = 1 << 3,	///< rotates around its center and moves up and down (cube)
+	ENTITY_COLLIDE      = 1 << 4,	///< destroyed when the player runs into it
+	ENTITY_LETHAL       = 1 << 5,	///< destroys the player on contact
+	ENTITY_PICKABLE     = 1 << 6,	///< explodes when clicked (cars)
+	ENTITY_SOLID        = 1 << 7,	///< blocks the player, tested against the triangles of its model (cars, trees)
+	ENTITY_GROUNDED     = 1 << 8	///< z follows the terrain (+ groundOffset) every simulation step
+};
+
+/**
+ * \brief Entity components in contiguous arrays, all indexed by slot [0, count).
+ *  Removing an entity moves the last one into its slot, an EntityId stays valid until the entity is removed.
+ */
+typedef struct _EntityStore {
+	std::vector<glm::vec3> position;
+	std::vector<glm::vec3> previousPosition;	///< position at the previous simulation step (rendering interpolation)
+	std::vector<glm::vec3> direction;
+	std::vector<glm::vec3> previousDirection;
+	std::vector<glm::vec3> origin;				///< position at creation (curve followers)
+	std::vector<float> speed;
+	std::vector<float> size;
+	std::vector<float> groundOffset;			///< height above the terrain of the grounded entities
+	std::vector<float> startTime;
+	std::vector<float> currentTime;
+	std::vector<unsigned int> flags;
+	std::vector<unsigned char> mesh;			///< EntityMesh
+
+	std::vector<EntityId> ids;					///< entity of each slot
+	std::vector<unsigned int> slots;			///< slot of each entity id, ENTITY_NONE for free ids
+	std::vector<EntityId> freeIds;
+	unsigned int count;
+
+	_EntityStore() : count(0) {}
+} EntityStore;
+
+extern EntityStore entities;
+
+EntityId createEntity(EntityStore& store, EntityMesh mesh, unsigned int flags, const glm::vec3& position,
+	const glm::vec3& direction, float size, float time);
+void removeEntity(EntityStore& store, EntityId id);
+void clearEntities(EntityStore& store);
+void reserveEntities(EntityStore& store, unsigned int capacity);
+
+/**
+ * \brief Slot of a live entity, ENTITY_NONE if the entity was removed.
+ */
+inline unsigned int entitySlot(const EntityStore& store, EntityId id) {
+	return id < store.slots.size() ? store.slots[id] : ENTITY_NONE;
+}
+
+void updateEntities(EntityStore& store, float elapsedTime);
+void groundEntities(EntityStore& store, const Heightfield& ground);
+unsigned int findCollisions(const EntityStore& store, const glm::vec3& center, float radius, std::vector<unsigned int>& hits);
+
+void benchmarkEntityStore(unsigned int count);
+
+#endif // __ENTITY_STORE_H
@@ -1,15 +1,31 @@
 #version 140
 
-uniform mat4 PVM;     // Projection * View * Model --> model to clip coordinates
+uniform mat4 PVM;           // Projection * View (the billboards are in world space)
+uniform mat4 ViewMatrix;    // its rows give the camera right and up vectors
+uniform float time;         // used to select proper animation frame
+uniform float frameDuration = 0.05f;
 
-in vec3 position;           // vertex position in world space
+in vec3 position;           // corner of the billboard quad [-1, 1]
 in vec2 texCoord;           // incoming texture coordinates
 
-smooth out vec2 texCoord_v; // outgoing vertex texture coordinates
+in vec4 particlePositionSize;   // per instance : world center (xyz) and half size (w)
+in float particleStartTime;     // per instance : start of the animation
+
+smooth out vec2 texCoord_v; // texture coordinates inside the current frame of the sprite sheet
+
+// 4x4 frames in the texture, the first row is at the top
+const vec2 grid = vec2(4.0, -4.0);
 
 void main() {
-	// Transform vertex into clip coordinates
-	gl_Position = PVM * vec4(position, 1); 
+	// the quad faces the camera
+	vec3 cameraRight = vec3(ViewMatrix[0][0], ViewMatrix[1][0], ViewMatrix[2][0]);
+	vec3 cameraUp = vec3(ViewMatrix[0][1], ViewMatrix[1][1], ViewMatrix[2][1]);
+	vec3 worldPosition = particlePositionSize.xyz + particlePositionSize.w * (position.x * cameraRight + position.y * cameraUp);
+	gl_Position = PVM * vec4(worldPosition, 1);
 
-	texCoord_v = texCoord;
+	// frame of the texture to be used for explosion drawing
+	int frame = int((time - particleStartTime) / frameDuration);
+	vec2 subImage = 1.0 / grid;
+	vec2 subImageCoord = vec2(mod(float(frame), grid.x), floor(float(frame) / grid.x));
+	texCoord_v = (subImageCoord + texCoord) * subImage;
 }
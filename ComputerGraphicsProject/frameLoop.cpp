@@ -0,0 +1,124 @@
+/*
+* \file frameLoop.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Fixed timestep simulation loop (accumulator), high resolution clock and frame time histograms
+*/
+
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include "frameLoop.h"
+
+typedef std::chrono::steady_clock Clock;
+
+FrameLoop frameLoop;
+TimeHistogram frameTimeHistogram("frame time");
+TimeHistogram simulationStepHistogram("simulation step");
+bool printFrameHistograms = false;
+
+static const Clock::time_point clockStart = Clock::now();
+static double lastHistogramReport = 0.0;
+
+/**
+ * \brief Monotonic high resolution time since the start of the application in seconds.
+ */
+double clockSeconds() {
+	return std::chrono::duration<double>(Clock::now() - clockStart).count();
+}
+
+/**
+ * \brief Start a frame : accumulate the real time since the previous frame.
+ * \return number of simulation steps to run before the frame is rendered
+ */
+unsigned int beginFrameLoop() {
+	const double now = clockSeconds();
+	if (!frameLoop.started) {
+		// the first frame comes after the asset loading, which must not be simulated
+		frameLoop.started = true;
+		frameLoop.lastFrameTime = now;
+		return 0;
+	}
+
+	const double frameTime = now - frameLoop.lastFrameTime;
+	frameLoop.lastFrameTime = now;
+	recordTime(frameTimeHistogram, 1000.0 * frameTime);
+
+	frameLoop.accumulator += frameTime;
+	unsigned int steps = (unsigned int)(frameLoop.accumulator / SIMULATION_STEP);
+	if (steps > MAX_SIMULATION_STEPS_PER_FRAME) {
+		steps = MAX_SIMULATION_STEPS_PER_FRAME;
+		frameLoop.accumulator = steps * SIMULATION_STEP;
+	}
+	return steps;
+}
+
+/**
+ * \brief Consume the simulated steps and compute the interpolation factor of the frame.
+ *  Called after the steps returned by beginFrameLoop() were run.
+ */
+void endFrameLoop() {
+	while (frameLoop.accumulator >= SIMULATION_STEP) {
+		frameLoop.accumulator -= SIMULATION_STEP;
+		frameLoop.simulationTime += SIMULATION_STEP;
+		frameLoop.steps++;
+	}
+	frameLoop.interpolationAlpha = (float)(frameLoop.accumulator / SIMULATION_STEP);
+
+	const double now = clockSeconds();
+	if (printFrameHistograms && now - lastHistogramReport >= 1.0) {
+		printTimeHistogram(frameTimeHistogram);
+		printTimeHistogram(simulationStepHistogram);
+		frameTimeHistogram.clear();
+		simulationStepHistogram.clear();
+		lastHistogramReport = now;
+	}
+}
+
+/**
+ * \brief Restart the loop at the given simulation time (the next frame does not simulate the time spent until then).
+ */
+void resetFrameLoop(double simulationTime) {
+	frameLoop.started = false;
+	frameLoop.accumulator = 0.0;
+	frameLoop.simulationTime = simulationTime;
+	frameLoop.interpolationAlpha = 1.0f;
+}
+
+void recordTime(TimeHistogram& histogram, double milliseconds) {
+	int bucket = 0;
+	for (double limit = HISTOGRAM_BUCKET_BASE; bucket < HISTOGRAM_BUCKETS - 1 && milliseconds >= limit; limit *= 2.0)
+		bucket++;
+	histogram.buckets[bucket]++;
+
+	histogram.min = histogram.count == 0 ? milliseconds : std::min(histogram.min, milliseconds);
+	histogram.max = histogram.count == 0 ? milliseconds : std::max(histogram.max, milliseconds);
+	histogram.sum += milliseconds;
+	histogram.count++;
+}
+
+void printTimeHistogram(const TimeHistogram& histogram) {
+	if (histogram.count == 0)
+		return;
+
+	printf("%s : %u samples, %.3f ms average, %.3f ms min, %.3f ms max\n",
+		histogram.name.c_str(), histogram.count, histogram.sum / histogram.count, histogram.min, histogram.max);
+
+	unsigned int largest = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		largest = std::max(largest, histogram.buckets[i]);
+
+	double lower = 0.0;
+	double upper = HISTOGRAM_BUCKET_BASE;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		if (histogram.buckets[i] != 0) {
+			const int bar = (int)(40.0 * histogram.buckets[i] / largest + 0.5);
+			if (i == HISTOGRAM_BUCKETS - 1)
+				printf("  >= %8.3f ms %6u %s\n", lower, histogram.buckets[i], std::string(bar, '#').c_str());
+			else
+				printf("  %8.3f - %8.3f ms %6u %s\n", lower, upper, histogram.buckets[i], std::string(bar, '#').c_str());
+		}
+		lower = upper;
+		upper *= 2.0;
+	}
+}
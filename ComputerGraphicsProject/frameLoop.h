@@ -0,0 +1,74 @@
+/*
+* \file frameLoop.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Fixed timestep simulation loop (accumulator), high resolution clock and frame time histograms
+*/
+
+#pragma once
+
+#ifndef __FRAME_LOOP_H
+#define __FRAME_LOOP_H
+
+#include <string>
+
+#define SIMULATION_RATE 30									// simulation steps per second
+#define SIMULATION_STEP (1.0 / SIMULATION_RATE)				// in seconds
+#define MAX_SIMULATION_STEPS_PER_FRAME 8					// a longer frame is dropped instead of simulated (e.g. window dragged)
+
+#define HISTOGRAM_BUCKETS 16								// bucket i holds [2^(i-1), 2^i) * HISTOGRAM_BUCKET_BASE ms, bucket 0 below the base
+#define HISTOGRAM_BUCKET_BASE 0.125							// in ms
+
+/**
+ * \brief Histogram of durations in ms with power of two buckets.
+ */
+typedef struct _TimeHistogram {
+	std::string name;
+	unsigned int buckets[HISTOGRAM_BUCKETS];
+	unsigned int count;
+	double sum;
+	double min;
+	double max;
+
+	_TimeHistogram(const std::string& histogramName) : name(histogramName) { clear(); }
+
+	void clear() {
+		for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+			buckets[i] = 0;
+		count = 0;
+		sum = 0.0;
+		min = 0.0;
+		max = 0.0;
+	}
+} TimeHistogram;
+
+/**
+ * \brief State of the fixed timestep loop. The simulation runs in steps of SIMULATION_STEP,
+ *  the rendered frame interpolates between the last two steps with interpolationAlpha.
+ */
+typedef struct _FrameLoop {
+	bool started;
+	double lastFrameTime;		///< clock time of the previous frame in seconds
+	double accumulator;			///< real time not simulated yet, in seconds
+	double simulationTime;		///< time of the current simulation state, in seconds
+	unsigned long long steps;	///< simulation steps since the start
+	float interpolationAlpha;	///< position of the rendered frame between the previous and the current step [0, 1]
+
+	_FrameLoop() : started(false), lastFrameTime(0.0), accumulator(0.0), simulationTime(0.0), steps(0), interpolationAlpha(1.0f) {}
+} FrameLoop;
+
+extern FrameLoop frameLoop;
+extern TimeHistogram frameTimeHistogram;		///< time between two rendered frames
+extern TimeHistogram simulationStepHistogram;	///< CPU time of one simulation step
+extern bool printFrameHistograms;				///< print the histograms once per second (--frame-histograms)
+
+double clockSeconds();
+
+unsigned int beginFrameLoop();
+void endFrameLoop();
+void resetFrameLoop(double simulationTime);
+
+void recordTime(TimeHistogram& histogram, double milliseconds);
+void printTimeHistogram(const TimeHistogram& histogram);
+
+#endif // __FRAME_LOOP_H
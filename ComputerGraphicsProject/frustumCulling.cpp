@@ -0,0 +1,239 @@
+/*
+* \file frustumCulling.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Bounding volumes of the geometries and view frustum tests (SSE, 4 planes per instruction)
+*/
+
+#include <cmath>
+#include <algorithm>
+#include "frustumCulling.h"
+#include "renderStats.h"
+
+Frustum viewFrustum;
+bool useFrustumCulling = true;
+
+/**
+ * \brief Extract the frustum planes from projection * view (Gribb & Hartmann), in world space.
+ */
+void extractFrustum(const glm::mat4& projectionView, Frustum& frustum) {
+	const glm::mat4& m = projectionView;
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+	const glm::vec4 planes[6] = {
+		rows[3] + rows[0],	// left
+		rows[3] - rows[0],	// right
+		rows[3] + rows[1],	// bottom
+		rows[3] - rows[1],	// top
+		rows[3] + rows[2],	// near
+		rows[3] - rows[2],	// far
+	};
+
+	for (int i = 0; i < 8; i++) {
+		// the two padding planes accept everything
+		glm::vec4 plane(0.0f, 0.0f, 0.0f, 1.0f);
+		if (i < 6) {
+			const float length = glm::length(glm::vec3(planes[i].x, planes[i].y, planes[i].z));
+			plane = length > 0.0f ? planes[i] / length : planes[i];
+		}
+		frustum.planeX[i] = plane.x;
+		frustum.planeY[i] = plane.y;
+		frustum.planeZ[i] = plane.z;
+		frustum.planeW[i] = plane.w;
+		frustum.absPlaneX[i] = fabsf(plane.x);
+		frustum.absPlaneY[i] = fabsf(plane.y);
+		frustum.absPlaneZ[i] = fabsf(plane.z);
+	}
+}
+
+/**
+ * \brief False if the sphere is completely outside of one of the planes.
+ */
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius) {
+#ifdef FRUSTUM_CULLING_SSE
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 cz = _mm_set1_ps(center.z);
+	const __m128 negativeRadius = _mm_set1_ps(-radius);
+
+	for (int i = 0; i < 8; i += 4) {
+		// distance = n . c + w, outside if distance < -radius
+		__m128 distance = _mm_mul_ps(_mm_loadu_ps(frustum.planeX + i), cx);
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(frustum.planeY + i), cy));
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(frustum.planeZ + i), cz));
+		distance = _mm_add_ps(distance, _mm_loadu_ps(frustum.planeW + i));
+		if (_mm_movemask_ps(_mm_cmplt_ps(distance, negativeRadius)) != 0)
+			return false;
+	}
+	return true;
+#else
+	for (int i = 0; i < 6; i++) {
+		const float distance = frustum.planeX[i] * center.x + frustum.planeY[i] * center.y + frustum.planeZ[i] * center.z + frustum.planeW[i];
+		if (distance < -radius)
+			return false;
+	}
+	return true;
+#endif
+}
+
+/**
+ * \brief False if the axis aligned box (world space center and half size) is completely outside of one of the planes.
+ */
+bool boxInFrustum(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extent) {
+#ifdef FRUSTUM_CULLING_SSE
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 cz = _mm_set1_ps(center.z);
+	const __m128 ex = _mm_set1_ps(extent.x);
+	const __m128 ey = _mm_set1_ps(extent.y);
+	const __m128 ez = _mm_set1_ps(extent.z);
+
+	for (int i = 0; i < 8; i += 4) {
+		// distance of the box corner furthest along the normal = n . c + |n| . e + w
+		__m128 distance = _mm_mul_ps(_mm_loadu_ps(frustum.planeX + i), cx);
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(frustum.planeY + i), cy));
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(frustum.planeZ + i), cz));
+		distance = _mm_add_ps(distance, _mm_loadu_ps(frustum.planeW + i));
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(frustum.absPlaneX + i), ex));
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(frustum.absPlaneY + i), ey));
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(frustum.absPlaneZ + i), ez));
+		if (_mm_movemask_ps(_mm_cmplt_ps(distance, _mm_setzero_ps())) != 0)
+			return false;
+	}
+	return true;
+#else
+	for (int i = 0; i < 6; i++) {
+		const float distance = frustum.planeX[i] * center.x + frustum.planeY[i] * center.y + frustum.planeZ[i] * center.z + frustum.planeW[i]
+			+ frustum.absPlaneX[i] * extent.x + frustum.absPlaneY[i] * extent.y + frustum.absPlaneZ[i] * extent.z;
+		if (distance < 0.0f)
+			return false;
+	}
+	return true;
+#endif
+}
+
+// -----------------------  Bounding volumes ---------------------------------
+
+/**
+ * \brief Model space AABB and bounding sphere of the mesh positions.
+ */
+void computeGeometryBounds(ObjectGeometry* geometry, const MeshData& mesh) {
+	if (mesh.numVertices == 0)
+		return;
+
+	const float* positions = mesh.vertices();
+	glm::vec3 minimum(positions[0], positions[1], positions[2]);
+	glm::vec3 maximum = minimum;
+	for (unsigned int v = 1; v < mesh.numVertices; v++) {
+		const glm::vec3 position(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]);
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+
+	// the sphere is centered on the box, its radius reaches the furthest vertex (tighter than the half diagonal)
+	const glm::vec3 center = (minimum + maximum) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (unsigned int v = 0; v < mesh.numVertices; v++) {
+		const glm::vec3 offset = glm::vec3(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]) - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+
+	geometry->boundsMin = minimum;
+	geometry->boundsMax = maximum;
+	geometry->boundsCenter = center;
+	geometry->boundsRadius = sqrtf(radiusSquared);
+}
+
+/**
+ * \brief Model space sphere enclosing the bounding spheres of all sub-meshes.
+ * \return false if the bounds of a sub-mesh are unknown
+ */
+bool mergeGeometryBounds(ObjectGeometry* const* geometries, size_t count, glm::vec3& center, float& radius) {
+	center = glm::vec3(0.0f);
+	radius = -1.0f;
+	for (size_t i = 0; i < count; i++) {
+		if (geometries[i] == NULL)
+			continue;
+		const glm::vec3& otherCenter = geometries[i]->boundsCenter;
+		const float otherRadius = geometries[i]->boundsRadius;
+		if (otherRadius < 0.0f)
+			return false;
+		if (radius < 0.0f) {
+			center = otherCenter;
+			radius = otherRadius;
+			continue;
+		}
+
+		const float distance = glm::length(otherCenter - center);
+		if (distance + otherRadius <= radius)
+			continue;
+		if (distance + radius <= otherRadius) {
+			center = otherCenter;
+			radius = otherRadius;
+			continue;
+		}
+		const float newRadius = (distance + radius + otherRadius) * 0.5f;
+		center += (otherCenter - center) * ((newRadius - radius) / distance);
+		radius = newRadius;
+	}
+	return radius >= 0.0f;
+}
+
+/**
+ * \brief Largest scale of the model matrix, the radius of transformed spheres grows by it.
+ */
+float maxScale(const glm::mat4& modelMatrix) {
+	const float x = glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0]));
+	const float y = glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1]));
+	const float z = glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2]));
+	return sqrtf(std::max(x, std::max(y, z)));
+}
+
+// -----------------------  Culling ---------------------------------
+
+/**
+ * \brief Test the sphere around all sub-meshes of an object, counted in the render stats.
+ */
+bool objectVisible(ObjectGeometry* const* geometries, size_t count, const glm::mat4& modelMatrix) {
+	if (!useFrustumCulling || count == 0)
+		return true;
+
+	glm::vec3 center;
+	float radius;
+	if (!mergeGeometryBounds(geometries, count, center, radius))
+		return true;
+
+	const glm::vec3 worldCenter = glm::vec3(modelMatrix * glm::vec4(center, 1.0f));
+	if (!sphereInFrustum(viewFrustum, worldCenter, radius * maxScale(modelMatrix))) {
+		renderStats.objectsCulled++;
+		return false;
+	}
+	renderStats.objectsVisible++;
+	return true;
+}
+
+/**
+ * \brief Test one sub-mesh, sphere first and its transformed AABB when the sphere intersects the frustum.
+ */
+bool geometryVisible(const ObjectGeometry* geometry, const glm::mat4& modelMatrix) {
+	if (!useFrustumCulling || geometry->boundsRadius < 0.0f)
+		return true;
+
+	const glm::vec3 worldCenter = glm::vec3(modelMatrix * glm::vec4(geometry->boundsCenter, 1.0f));
+	bool visible = sphereInFrustum(viewFrustum, worldCenter, geometry->boundsRadius * maxScale(modelMatrix));
+	if (visible) {
+		// world AABB of the transformed box: extent = |M| * half size
+		const glm::vec3 halfSize = (geometry->boundsMax - geometry->boundsMin) * 0.5f;
+		const glm::vec3 boxCenter = glm::vec3(modelMatrix * glm::vec4((geometry->boundsMin + geometry->boundsMax) * 0.5f, 1.0f));
+		const glm::vec3 extent = glm::abs(glm::vec3(modelMatrix[0])) * halfSize.x
+			+ glm::abs(glm::vec3(modelMatrix[1])) * halfSize.y
+			+ glm::abs(glm::vec3(modelMatrix[2])) * halfSize.z;
+		visible = boxInFrustum(viewFrustum, boxCenter, extent);
+	}
+
+	if (!visible)
+		renderStats.meshesCulled++;
+	return visible;
+}
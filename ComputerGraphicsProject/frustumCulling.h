@@ -0,0 +1,50 @@
+/*
+* \file frustumCulling.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Bounding volumes of the geometries and view frustum tests (SSE, 4 planes per instruction)
+*/
+
+#pragma once
+
+#ifndef __FRUSTUM_CULLING_H
+#define __FRUSTUM_CULLING_H
+
+#include "pgr.h"
+#include "object.h"
+#include "meshCache.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULLING_SSE 1
+#include <xmmintrin.h>
+#endif
+
+/**
+ * \brief The 6 planes of the view frustum (normals pointing inside, normalized), stored as structure of arrays and
+ * padded to 8 planes so that two SSE registers hold one component of all of them.
+ */
+typedef struct _Frustum {
+	float planeX[8];
+	float planeY[8];
+	float planeZ[8];
+	float planeW[8];
+	float absPlaneX[8];		///< absolute values of the normals, for the AABB tests
+	float absPlaneY[8];
+	float absPlaneZ[8];
+} Frustum;
+
+extern Frustum viewFrustum;		///< frustum of the current frame, set in drawScene
+extern bool useFrustumCulling;	///< false draws everything (--no-culling)
+
+void extractFrustum(const glm::mat4& projectionView, Frustum& frustum);
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius);
+bool boxInFrustum(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extent);
+
+void computeGeometryBounds(ObjectGeometry* geometry, const MeshData& mesh);
+bool mergeGeometryBounds(ObjectGeometry* const* geometries, size_t count, glm::vec3& center, float& radius);
+
+float maxScale(const glm::mat4& modelMatrix);
+bool objectVisible(ObjectGeometry* const* geometries, size_t count, const glm::mat4& modelMatrix);
+bool geometryVisible(const ObjectGeometry* geometry, const glm::mat4& modelMatrix);
+
+#endif // __FRUSTUM_CULLING_H
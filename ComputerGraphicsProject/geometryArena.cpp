@@ -0,0 +1,308 @@
+/*
+* \file geometryArena.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Shared vertex/index buffers and vao for every static mesh, drawn with (multi) draw base vertex calls
+*/
+
+#include <iostream>
+#include <cstring>
+#include "geometryArena.h"
+#include "renderStats.h"
+#include "renderer.h"
+
+GeometryArena geometryArena;
+bool useGeometryArena = true;
+
+static const ShaderProgram* arenaShader = NULL;
+
+/**
+ * \brief Command layout of glMultiDrawElementsIndirect.
+ */
+typedef struct _DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint  baseVertex;
+	GLuint baseInstance;
+} DrawElementsIndirectCommand;
+
+/**
+ * \brief Layout used by the arena for the requested layout - separate blocks cannot share one vao, they are interleaved.
+ */
+VertexLayout geometryArenaLayout(VertexLayout layout) {
+	return layout == VERTEX_LAYOUT_SEPARATE ? VERTEX_LAYOUT_INTERLEAVED : layout;
+}
+
+/**
+ * \brief Make sure the buffer can hold required bytes, grows it (and keeps its content) if needed.
+ * The copy targets are used so the element array binding of the currently bound vao is never touched.
+ */
+static bool reserveArenaBuffer(GLuint& buffer, size_t used, size_t& capacity, size_t required) {
+	if (required <= capacity)
+		return false;
+
+	size_t newCapacity = capacity > 0 ? capacity : required;
+	while (newCapacity < required)
+		newCapacity *= 2;
+
+	GLuint newBuffer = 0;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+
+	if (used > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (buffer != 0)
+		glDeleteBuffers(1, &buffer);
+	buffer = newBuffer;
+	capacity = newCapacity;
+	CHECK_GL_ERROR();
+	return true;
+}
+
+/**
+ * \brief Connect the arena buffers to the arena vao (again after a buffer was reallocated).
+ */
+static void setupArenaVertexArray() {
+	glBindVertexArray(geometryArena.vertexArrayObject);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometryArena.elementBufferObject);
+	glBindBuffer(GL_ARRAY_BUFFER, geometryArena.vertexBufferObject);
+	setVertexLayoutAttributes(geometryArena.layout, 0, *arenaShader, true);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	CHECK_GL_ERROR();
+	geometryArena.generation++;
+}
+
+/**
+ * \brief Create the shared buffers and vao.
+ * \param shader [in] the vao connects the arena to this shader
+ * \param layout [in] requested vertex layout (see geometryArenaLayout())
+ */
+void initGeometryArena(const ShaderProgram& shader, VertexLayout layout) {
+	if (geometryArena.initialized)
+		return;
+
+	arenaShader = &shader;
+	geometryArena.layout = geometryArenaLayout(layout);
+	if (geometryArena.layout != layout)
+		std::cout << "Geometry arena : " << vertexLayoutName(layout) << " vertex layout cannot be shared, using " << vertexLayoutName(geometryArena.layout) << std::endl;
+
+	reserveArenaBuffer(geometryArena.vertexBufferObject, 0, geometryArena.vertexCapacity, GEOMETRY_ARENA_VERTEX_BYTES);
+	reserveArenaBuffer(geometryArena.elementBufferObject, 0, geometryArena.indexCapacity, GEOMETRY_ARENA_INDEX_BYTES);
+	glGenVertexArrays(1, &geometryArena.vertexArrayObject);
+	setupArenaVertexArray();
+
+	geometryArena.multiDrawIndirect = hasOpenGLVersion(4, 3);
+	if (geometryArena.multiDrawIndirect)
+		glGenBuffers(1, &geometryArena.indirectBufferObject);
+
+	std::cout << "Geometry arena : " << (geometryArena.multiDrawIndirect ? "glMultiDrawElementsIndirect" : "glMultiDrawElementsBaseVertex") << std::endl;
+	geometryArena.initialized = true;
+}
+
+void cleanupGeometryArena() {
+	if (!geometryArena.initialized)
+		return;
+
+	glDeleteVertexArrays(1, &geometryArena.vertexArrayObject);
+	glDeleteBuffers(1, &geometryArena.vertexBufferObject);
+	glDeleteBuffers(1, &geometryArena.elementBufferObject);
+	if (geometryArena.indirectBufferObject != 0)
+		glDeleteBuffers(1, &geometryArena.indirectBufferObject);
+
+	geometryArena = GeometryArena();
+	arenaShader = NULL;
+}
+
+/**
+ * \brief Suballocate a mesh from the arena.
+ * \param mesh [in] CPU side mesh (indices, material)
+ * \param vertices [in] vertex buffer content, must use the arena layout
+ * \param texture [in] diffuse texture of the mesh (0 if the mesh is not textured)
+ * \return geometry record, its vao is the arena vao
+ */
+ObjectGeometry* addArenaGeometry(const MeshData& mesh, const PackedVertices& vertices, GLuint texture) {
+	if (!geometryArena.initialized || vertices.layout != geometryArena.layout) {
+		std::cerr << "\033[31maddArenaGeometry : vertices do not match the arena layout\033[0m" << std::endl;
+		return NULL;
+	}
+
+	const size_t stride = vertexLayoutStride(geometryArena.layout);
+	const size_t vertexOffset = geometryArena.vertexSize;
+	const size_t vertexBytes = vertices.bytes.size();
+	const size_t indexOffset = (geometryArena.indexSize + sizeof(unsigned int) - 1) & ~(sizeof(unsigned int) - 1);
+	const size_t indexBytes = mesh.indexBytes();
+
+	bool reallocated = reserveArenaBuffer(geometryArena.vertexBufferObject, geometryArena.vertexSize, geometryArena.vertexCapacity, vertexOffset + vertexBytes);
+	reallocated |= reserveArenaBuffer(geometryArena.elementBufferObject, geometryArena.indexSize, geometryArena.indexCapacity, indexOffset + indexBytes);
+	if (reallocated)
+		setupArenaVertexArray();
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, geometryArena.vertexBufferObject);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset, vertexBytes, vertices.bytes.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, geometryArena.elementBufferObject);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, mesh.indices());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	CHECK_GL_ERROR();
+
+	geometryArena.vertexSize = vertexOffset + vertexBytes;
+	geometryArena.indexSize = indexOffset + indexBytes;
+
+	ObjectGeometry* geometry = new ObjectGeometry;
+	geometry->vertexArrayObject = geometryArena.vertexArrayObject;
+	geometry->inArena = true;
+	geometry->baseVertex = (GLint)(vertexOffset / stride);
+	geometry->indexOffset = indexOffset;
+	geometry->numTriangles = mesh.numTriangles;
+	geometry->indexType = mesh.indexType();
+	geometry->positionScale = vertices.positionScale;
+	geometry->positionOffset = vertices.positionOffset;
+	computeGeometryBounds(geometry, mesh);
+
+	geometry->material.ambient = mesh.ambient;
+	geometry->material.diffuse = mesh.diffuse;
+	geometry->material.specular = mesh.specular;
+	geometry->material.shininess = mesh.shininess;
+	geometry->material.texture = texture;
+
+	return geometry;
+}
+
+// -----------------------  Drawing ---------------------------------
+
+/**
+ * \brief True if both geometries can be drawn by one multi draw call (same vao, index type, material and dequantization).
+ */
+bool haveSameDrawState(const ObjectGeometry* a, const ObjectGeometry* b) {
+	return a->vertexArrayObject == b->vertexArrayObject
+		&& a->indexType == b->indexType
+		&& a->material.texture == b->material.texture
+		&& a->material.ambient == b->material.ambient
+		&& a->material.diffuse == b->material.diffuse
+		&& a->material.specular == b->material.specular
+		&& a->material.shininess == b->material.shininess
+		&& a->positionScale == b->positionScale
+		&& a->positionOffset == b->positionOffset;
+}
+
+static bool vec3Less(const glm::vec3& a, const glm::vec3& b) {
+	if (a.x != b.x)
+		return a.x < b.x;
+	if (a.y != b.y)
+		return a.y < b.y;
+	return a.z < b.z;
+}
+
+/**
+ * \brief Order of the geometries which puts the ones with the same draw state next to each other.
+ */
+bool drawStateLess(const ObjectGeometry* a, const ObjectGeometry* b) {
+	if (a->vertexArrayObject != b->vertexArrayObject)
+		return a->vertexArrayObject < b->vertexArrayObject;
+	if (a->indexType != b->indexType)
+		return a->indexType < b->indexType;
+	if (a->material.texture != b->material.texture)
+		return a->material.texture < b->material.texture;
+	if (a->material.ambient != b->material.ambient)
+		return vec3Less(a->material.ambient, b->material.ambient);
+	if (a->material.diffuse != b->material.diffuse)
+		return vec3Less(a->material.diffuse, b->material.diffuse);
+	if (a->material.specular != b->material.specular)
+		return vec3Less(a->material.specular, b->material.specular);
+	if (a->material.shininess != b->material.shininess)
+		return a->material.shininess < b->material.shininess;
+	if (a->positionScale != b->positionScale)
+		return vec3Less(a->positionScale, b->positionScale);
+	return vec3Less(a->positionOffset, b->positionOffset);
+}
+
+/**
+ * \brief Draw one geometry, its vao must be bound.
+ */
+void drawGeometry(const ObjectGeometry* geometry) {
+	glDrawElementsBaseVertex(GL_TRIANGLES, geometry->numTriangles * 3, geometry->indexType, (void*)geometry->indexOffset, geometry->baseVertex);
+
+	COUNT_GL_CALLS(1);
+	renderStats.drawCalls++;
+	renderStats.meshesDrawn++;
+	renderStats.triangles += geometry->numTriangles;
+}
+
+/**
+ * \brief Draw instanceCount copies of one geometry, the bound vao must provide the per instance attributes.
+ */
+void drawGeometryInstanced(const ObjectGeometry* geometry, GLsizei instanceCount) {
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, geometry->numTriangles * 3, geometry->indexType, (void*)geometry->indexOffset,
+		instanceCount, geometry->baseVertex);
+
+	COUNT_GL_CALLS(1);
+	renderStats.drawCalls++;
+	renderStats.meshesDrawn++;
+	renderStats.instancesDrawn += instanceCount;
+	renderStats.triangles += geometry->numTriangles * instanceCount;
+}
+
+/**
+ * \brief Draw several geometries sharing the same draw state (see haveSameDrawState()) with a single call.
+ * The vao and the uniforms of the first geometry must be set.
+ */
+void drawGeometryBatch(ObjectGeometry* const* geometries, size_t count) {
+	if (count == 0)
+		return;
+	if (count == 1) {
+		drawGeometry(geometries[0]);
+		return;
+	}
+
+	const GLenum indexType = geometries[0]->indexType;
+	const size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+	if (geometryArena.multiDrawIndirect) {
+		std::vector<DrawElementsIndirectCommand> commands(count);
+		for (size_t i = 0; i < count; i++) {
+			commands[i].count = geometries[i]->numTriangles * 3;
+			commands[i].instanceCount = 1;
+			commands[i].firstIndex = (GLuint)(geometries[i]->indexOffset / indexSize);
+			commands[i].baseVertex = geometries[i]->baseVertex;
+			commands[i].baseInstance = 0;
+			renderStats.triangles += geometries[i]->numTriangles;
+		}
+
+		const size_t bytes = count * sizeof(DrawElementsIndirectCommand);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, geometryArena.indirectBufferObject);
+		if (bytes > geometryArena.indirectCapacity) {
+			geometryArena.indirectCapacity = bytes;
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, bytes, commands.data(), GL_STREAM_DRAW);
+		}
+		else {
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, commands.data());
+		}
+		glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, 0, (GLsizei)count, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		COUNT_GL_CALLS(4);
+	}
+	else {
+		std::vector<GLsizei> counts(count);
+		std::vector<const void*> offsets(count);
+		std::vector<GLint> baseVertices(count);
+		for (size_t i = 0; i < count; i++) {
+			counts[i] = geometries[i]->numTriangles * 3;
+			offsets[i] = (const void*)geometries[i]->indexOffset;
+			baseVertices[i] = geometries[i]->baseVertex;
+			renderStats.triangles += geometries[i]->numTriangles;
+		}
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, offsets.data(), (GLsizei)count, baseVertices.data());
+		COUNT_GL_CALLS(1);
+	}
+
+	renderStats.drawCalls++;
+	renderStats.multiDrawCalls++;
+	renderStats.meshesDrawn += (unsigned int)count;
+}
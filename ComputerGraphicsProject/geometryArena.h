@@ -0,0 +1,64 @@
+/*
+* \file geometryArena.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Shared vertex/index buffers and vao for every static mesh, drawn with (multi) draw base vertex calls
+*/
+
+#pragma once
+
+#ifndef __GEOMETRY_ARENA_H
+#define __GEOMETRY_ARENA_H
+
+#include <vector>
+#include "pgr.h"
+#include "object.h"
+#include "meshCache.h"
+#include "vertexFormat.h"
+#include "frustumCulling.h"
+
+#define GEOMETRY_ARENA_VERTEX_BYTES (8 * 1024 * 1024)	// initial capacities, the buffers grow when needed
+#define GEOMETRY_ARENA_INDEX_BYTES (4 * 1024 * 1024)
+
+/**
+ * \brief One vertex buffer, one index buffer and one vao shared by all static meshes.
+ * Every mesh is an (index offset, index count, base vertex) record in these buffers.
+ */
+typedef struct _GeometryArena {
+	GLuint vertexBufferObject;
+	GLuint elementBufferObject;
+	GLuint vertexArrayObject;
+	GLuint indirectBufferObject;	///< draw commands of glMultiDrawElementsIndirect (GL 4.3+)
+
+	VertexLayout layout;			///< vertex layout of the whole arena (always interleaved)
+	size_t vertexCapacity;			///< sizes in bytes
+	size_t vertexSize;
+	size_t indexCapacity;
+	size_t indexSize;
+	size_t indirectCapacity;
+
+	unsigned int generation;		///< incremented when the buffers are reallocated, other vaos reading them must be set up again
+	bool multiDrawIndirect;			///< glMultiDrawElementsIndirect is available
+	bool initialized;
+
+	_GeometryArena() : vertexBufferObject(0), elementBufferObject(0), vertexArrayObject(0), indirectBufferObject(0),
+		layout(VERTEX_LAYOUT_INTERLEAVED), vertexCapacity(0), vertexSize(0), indexCapacity(0), indexSize(0), indirectCapacity(0),
+		generation(0), multiDrawIndirect(false), initialized(false) {}
+} GeometryArena;
+
+extern GeometryArena geometryArena;
+extern bool useGeometryArena;		///< false keeps one vbo/ebo/vao per mesh (--no-geometry-arena)
+
+VertexLayout geometryArenaLayout(VertexLayout layout);
+
+void initGeometryArena(const ShaderProgram& shader, VertexLayout layout);
+void cleanupGeometryArena();
+ObjectGeometry* addArenaGeometry(const MeshData& mesh, const PackedVertices& vertices, GLuint texture);
+
+bool haveSameDrawState(const ObjectGeometry* a, const ObjectGeometry* b);
+bool drawStateLess(const ObjectGeometry* a, const ObjectGeometry* b);
+void drawGeometry(const ObjectGeometry* geometry);
+void drawGeometryInstanced(const ObjectGeometry* geometry, GLsizei instanceCount);
+void drawGeometryBatch(ObjectGeometry* const* geometries, size_t count);
+
+#endif // __GEOMETRY_ARENA_H
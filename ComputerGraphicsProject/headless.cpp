@@ -0,0 +1,233 @@
+/*
+* \file headless.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Offscreen rendering of scripted frames into a framebuffer object with CPU/GPU timings and optional PNG dumps
+*
+* The frames never reach the window, but the context is still created by GLUT through a hidden window, so an X
+* display (or Xvfb) is needed on Linux.
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "headless.h"
+#include "image.h"
+#include "renderStats.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+HeadlessOptions headlessOptions;
+
+/**
+ * \brief Timings of one rendered frame.
+ */
+typedef struct _HeadlessFrameTiming {
+	const char* cameraName;
+	double cpuMs;		///< time spent on the CPU to issue the frame
+	double gpuMs;		///< GL_TIME_ELAPSED of the frame, -1 until the query result is read
+} HeadlessFrameTiming;
+
+static GLuint framebuffer = 0;
+static GLuint colorRenderbuffer = 0;
+static GLuint depthStencilRenderbuffer = 0;
+static GLuint timerQueries[HEADLESS_TIMER_QUERIES] = { 0 };
+static unsigned int queryFrames[HEADLESS_TIMER_QUERIES];	///< frame measured by each query
+static bool queryPending[HEADLESS_TIMER_QUERIES] = { false };
+
+static std::vector<HeadlessFrameTiming> timings;
+static unsigned int currentFrame = 0;
+static Clock::time_point frameStart;
+
+/**
+ * \brief Parse the headless options at argv[i], i is moved past the option arguments.
+ *   --headless <frames>, --headless-size <width>x<height>, --headless-dump <directory> [interval], --headless-lighting
+ * \return true if argv[i] was a headless option
+ */
+bool parseHeadlessOption(int argc, char** argv, int& i) {
+	const std::string option = argv[i];
+
+	if (option == "--headless") {
+		headlessOptions.enabled = true;
+		if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+			headlessOptions.frames = (unsigned int)atoi(argv[++i]);
+		return true;
+	}
+	if (option == "--headless-size" && i + 1 < argc) {
+		int width = 0;
+		int height = 0;
+		if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+			headlessOptions.width = width;
+			headlessOptions.height = height;
+		}
+		else {
+			std::cerr << "\033[31mInvalid headless size : " << argv[i] << " (expected <width>x<height>)\033[0m" << std::endl;
+		}
+		return true;
+	}
+	if (option == "--headless-lighting") {
+		headlessOptions.enabled = true;
+		headlessOptions.lightingSweep = true;
+		return true;
+	}
+	if (option == "--headless-dump" && i + 1 < argc) {
+		headlessOptions.dumpDirectory = argv[++i];
+		if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+			headlessOptions.dumpInterval = std::max(1, atoi(argv[++i]));
+		return true;
+	}
+	return false;
+}
+
+/**
+ * \brief Create the offscreen framebuffer (RGBA8 color, depth + stencil for the object picking) and the timer queries.
+ */
+bool initHeadlessTarget() {
+	glGenRenderbuffers(1, &colorRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, headlessOptions.width, headlessOptions.height);
+
+	glGenRenderbuffers(1, &depthStencilRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, headlessOptions.width, headlessOptions.height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilRenderbuffer);
+
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "\033[31minitHeadlessTarget : framebuffer incomplete (0x" << std::hex << status << std::dec << ")\033[0m" << std::endl;
+		cleanupHeadlessTarget();
+		return false;
+	}
+
+	glGenQueries(HEADLESS_TIMER_QUERIES, timerQueries);
+	CHECK_GL_ERROR();
+
+	timings.clear();
+	timings.reserve(headlessOptions.frames);
+	std::cout << "Headless : " << headlessOptions.frames << " frames at " << headlessOptions.width << "x" << headlessOptions.height
+		<< (headlessOptions.dumpDirectory.empty() ? "" : ", PNG dumps in " + headlessOptions.dumpDirectory) << std::endl;
+	return true;
+}
+
+void cleanupHeadlessTarget() {
+	if (timerQueries[0] != 0)
+		glDeleteQueries(HEADLESS_TIMER_QUERIES, timerQueries);
+	for (int i = 0; i < HEADLESS_TIMER_QUERIES; i++) {
+		timerQueries[i] = 0;
+		queryPending[i] = false;
+	}
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &colorRenderbuffer);
+	glDeleteRenderbuffers(1, &depthStencilRenderbuffer);
+	framebuffer = 0;
+	colorRenderbuffer = 0;
+	depthStencilRenderbuffer = 0;
+}
+
+/**
+ * \brief Read the result of a timer query into the timing of its frame (waits if the GPU is not done yet).
+ */
+static void readTimerQuery(int slot) {
+	if (!queryPending[slot])
+		return;
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(timerQueries[slot], GL_QUERY_RESULT, &elapsed);
+	timings[queryFrames[slot]].gpuMs = elapsed / 1.0e6;
+	queryPending[slot] = false;
+}
+
+/**
+ * \brief Bind the offscreen framebuffer, clear it and start the CPU and GPU timers of the frame.
+ */
+void beginHeadlessFrame(unsigned int frame, const char* cameraName) {
+	const int slot = frame % HEADLESS_TIMER_QUERIES;
+	readTimerQuery(slot);
+
+	currentFrame = (unsigned int)timings.size();
+	HeadlessFrameTiming timing;
+	timing.cameraName = cameraName;
+	timing.cpuMs = 0.0;
+	timing.gpuMs = -1.0;
+	timings.push_back(timing);
+
+	frameStart = Clock::now();
+	glBeginQuery(GL_TIME_ELAPSED, timerQueries[slot]);
+	queryFrames[slot] = currentFrame;
+	queryPending[slot] = true;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, headlessOptions.width, headlessOptions.height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+}
+
+/**
+ * \brief Stop the timers and dump the frame if requested. The read back is not part of the measured time.
+ */
+void endHeadlessFrame() {
+	glEndQuery(GL_TIME_ELAPSED);
+	glFlush();
+	timings[currentFrame].cpuMs = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+
+	if (!headlessOptions.dumpDirectory.empty() && currentFrame % headlessOptions.dumpInterval == 0) {
+		ImageData image;
+		image.width = (unsigned int)headlessOptions.width;
+		image.height = (unsigned int)headlessOptions.height;
+		image.pixels.resize(4 * (size_t)image.width * image.height);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, headlessOptions.width, headlessOptions.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+
+		char fileName[64];
+		snprintf(fileName, sizeof(fileName), "/frame_%05u.png", currentFrame);
+		saveImagePNG(headlessOptions.dumpDirectory + fileName, image);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static double percentile(std::vector<double> values, double p) {
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	const size_t index = std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5));
+	return values[index];
+}
+
+/**
+ * \brief Collect the pending GPU timings and print every frame (CSV) and a summary per camera.
+ */
+void finishHeadlessRun() {
+	for (int slot = 0; slot < HEADLESS_TIMER_QUERIES; slot++)
+		readTimerQuery(slot);
+
+	printf("frame,camera,cpu_ms,gpu_ms\n");
+	for (size_t i = 0; i < timings.size(); i++)
+		printf("%zu,%s,%.3f,%.3f\n", i, timings[i].cameraName, timings[i].cpuMs, timings[i].gpuMs);
+
+	printf("%-32s %8s %12s %12s %12s %12s\n", "camera", "frames", "cpu avg ms", "cpu p95 ms", "gpu avg ms", "gpu p95 ms");
+	for (size_t i = 0; i < timings.size(); ) {
+		// the cameras follow each other along the path, every run of the same camera is one summary line
+		const std::string camera = timings[i].cameraName;
+		std::vector<double> cpu;
+		std::vector<double> gpu;
+		double cpuSum = 0.0;
+		double gpuSum = 0.0;
+		for (; i < timings.size() && camera == timings[i].cameraName; i++) {
+			cpu.push_back(timings[i].cpuMs);
+			gpu.push_back(timings[i].gpuMs);
+			cpuSum += timings[i].cpuMs;
+			gpuSum += timings[i].gpuMs;
+		}
+		printf("%-32s %8zu %12.3f %12.3f %12.3f %12.3f\n", camera.c_str(), cpu.size(),
+			cpuSum / cpu.size(), percentile(cpu, 0.95), gpuSum / gpu.size(), percentile(gpu, 0.95));
+	}
+}
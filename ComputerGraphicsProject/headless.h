@@ -0,0 +1,43 @@
+/*
+* \file headless.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Offscreen rendering of scripted frames into a framebuffer object with CPU/GPU timings and optional PNG dumps
+*/
+
+#pragma once
+
+#ifndef __HEADLESS_H
+#define __HEADLESS_H
+
+#include <string>
+#include "pgr.h"
+
+#define HEADLESS_TIMER_QUERIES 4	// GPU timer queries in flight, results are read HEADLESS_TIMER_QUERIES frames later
+
+/**
+ * \brief Command line options of the headless benchmark (--headless ...).
+ */
+typedef struct _HeadlessOptions {
+	bool enabled;
+	unsigned int frames;			///< frames rendered along the scripted camera path
+	int width;						///< resolution of the offscreen framebuffer
+	int height;
+	std::string dumpDirectory;		///< PNG dumps are written here, empty = no dumps
+	unsigned int dumpInterval;		///< dump every n-th frame
+	bool lightingSweep;				///< time every combination of the lighting toggles instead of the camera path
+
+	_HeadlessOptions() : enabled(false), frames(300), width(1280), height(720), dumpInterval(1), lightingSweep(false) {}
+} HeadlessOptions;
+
+extern HeadlessOptions headlessOptions;
+
+bool parseHeadlessOption(int argc, char** argv, int& i);
+
+bool initHeadlessTarget();
+void cleanupHeadlessTarget();
+void beginHeadlessFrame(unsigned int frame, const char* cameraName);
+void endHeadlessFrame();
+void finishHeadlessRun();
+
+#endif // __HEADLESS_H
@@ -0,0 +1,277 @@
+/*
+* \file heightfield.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Terrain baked into a regular height grid - ground height and normal queries (SSE batch)
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cfloat>
+#include "heightfield.h"
+#include "object.h"
+#include "data.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+Heightfield terrainHeightfield;
+
+/**
+ * \brief Rasterize the triangles of the model from above, every grid sample keeps the highest surface over it.
+ *  CPU only, runs on the asset loading threads.
+ */
+void bakeHeightfield(const ModelData& model, Heightfield& heightfield, unsigned int resolution) {
+	const Clock::time_point start = Clock::now();
+
+	std::vector<glm::vec3> vertices;
+	std::vector<unsigned int> indices;
+	for (size_t m = 0; m < model.meshes.size(); m++) {
+		const MeshData& mesh = model.meshes[m];
+		const float* positions = mesh.vertices();
+		getMeshIndices(mesh, indices);
+		for (size_t i = 0; i < indices.size(); i++) {
+			const float* position = positions + 3 * (size_t)indices[i];
+			vertices.push_back(glm::vec3(position[0], position[1], position[2]));
+		}
+	}
+
+	heightfield.resolution = 0;
+	heightfield.heights.clear();
+	if (vertices.empty() || resolution < 2)
+		return;
+
+	glm::vec2 boundsMin(FLT_MAX);
+	glm::vec2 boundsMax(-FLT_MAX);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		boundsMin = glm::vec2(std::min(boundsMin.x, vertices[i].x), std::min(boundsMin.y, vertices[i].z));
+		boundsMax = glm::vec2(std::max(boundsMax.x, vertices[i].x), std::max(boundsMax.y, vertices[i].z));
+	}
+	const float extent = std::max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y);
+
+	heightfield.resolution = resolution;
+	heightfield.modelMin = boundsMin;
+	heightfield.cellSize = extent > 0.0f ? extent / (resolution - 1) : 1.0f;
+	heightfield.heights.assign((size_t)resolution * resolution, -FLT_MAX);
+
+	const float inverseCell = 1.0f / heightfield.cellSize;
+	const int last = (int)resolution - 1;
+	for (size_t t = 0; t + 2 < vertices.size(); t += 3) {
+		const glm::vec3& a = vertices[t];
+		const glm::vec3& b = vertices[t + 1];
+		const glm::vec3& c = vertices[t + 2];
+
+		// signed area in the (x, z) plane, vertical triangles do not cover any sample
+		const float area = (b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z);
+		if (std::fabs(area) < 1e-12f)
+			continue;
+		const float inverseArea = 1.0f / area;
+
+		const int x0 = std::max(0, (int)std::ceil((std::min(a.x, std::min(b.x, c.x)) - boundsMin.x) * inverseCell - 1e-3f));
+		const int x1 = std::min(last, (int)std::floor((std::max(a.x, std::max(b.x, c.x)) - boundsMin.x) * inverseCell + 1e-3f));
+		const int z0 = std::max(0, (int)std::ceil((std::min(a.z, std::min(b.z, c.z)) - boundsMin.y) * inverseCell - 1e-3f));
+		const int z1 = std::min(last, (int)std::floor((std::max(a.z, std::max(b.z, c.z)) - boundsMin.y) * inverseCell + 1e-3f));
+
+		for (int gz = z0; gz <= z1; gz++) {
+			const float pz = boundsMin.y + gz * heightfield.cellSize;
+			for (int gx = x0; gx <= x1; gx++) {
+				const float px = boundsMin.x + gx * heightfield.cellSize;
+				// barycentric coordinates, a small tolerance closes the cracks along the shared edges
+				const float u = ((c.x - b.x) * (pz - b.z) - (px - b.x) * (c.z - b.z)) * inverseArea;
+				const float v = ((a.x - c.x) * (pz - c.z) - (px - c.x) * (a.z - c.z)) * inverseArea;
+				const float w = 1.0f - u - v;
+				if (u < -1e-4f || v < -1e-4f || w < -1e-4f)
+					continue;
+				float& height = heightfield.heights[(size_t)gz * resolution + gx];
+				height = std::max(height, u * a.y + v * b.y + w * c.y);
+			}
+		}
+	}
+
+	// samples outside of the mesh (non square terrain) get the lowest height
+	float lowest = FLT_MAX;
+	for (size_t i = 0; i < heightfield.heights.size(); i++) {
+		if (heightfield.heights[i] != -FLT_MAX)
+			lowest = std::min(lowest, heightfield.heights[i]);
+	}
+	if (lowest == FLT_MAX)
+		lowest = 0.0f;
+	for (size_t i = 0; i < heightfield.heights.size(); i++) {
+		if (heightfield.heights[i] == -FLT_MAX)
+			heightfield.heights[i] = lowest;
+	}
+
+	printf("Heightfield %s : %ux%u samples, %.1f ms\n", model.fileName.c_str(), resolution, resolution,
+		std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+}
+
+/**
+ * \brief Set the transform of the terrain in the scene (position and size of the Terrain object).
+ */
+void placeHeightfield(Heightfield& heightfield, const glm::vec3& position, float size) {
+	// model (x, y, z) -> world position + size * (x, -z, y)
+	heightfield.gridOriginX = position.x + size * heightfield.modelMin.x;
+	heightfield.gridOriginY = position.y - size * heightfield.modelMin.y;
+	heightfield.inverseCellSize = 1.0f / (size * heightfield.cellSize);
+	heightfield.heightScale = size;
+	heightfield.heightOffset = position.z;
+}
+
+/**
+ * \brief Cell of the grid under a world position (clamped to the terrain) and the position inside it.
+ */
+static inline const float* gridCell(const Heightfield& heightfield, float x, float y, float& fx, float& fy) {
+	const float maxCoordinate = (float)(heightfield.resolution - 1) - 1e-3f;
+	const float gx = glm::clamp((x - heightfield.gridOriginX) * heightfield.inverseCellSize, 0.0f, maxCoordinate);
+	const float gy = glm::clamp((heightfield.gridOriginY - y) * heightfield.inverseCellSize, 0.0f, maxCoordinate);
+	const int ix = (int)gx;
+	const int iy = (int)gy;
+	fx = gx - ix;
+	fy = gy - iy;
+	return heightfield.heights.data() + (size_t)iy * heightfield.resolution + ix;
+}
+
+/**
+ * \brief Height of the ground under a world position (bilinear), heightOffset when the terrain is not baked.
+ */
+float terrainHeight(const Heightfield& heightfield, float x, float y) {
+	if (heightfield.resolution == 0)
+		return heightfield.heightOffset;
+
+	float fx, fy;
+	const float* cell = gridCell(heightfield, x, y, fx, fy);
+	const float* next = cell + heightfield.resolution;
+	const float top = cell[0] + (cell[1] - cell[0]) * fx;
+	const float bottom = next[0] + (next[1] - next[0]) * fx;
+	return heightfield.heightOffset + heightfield.heightScale * (top + (bottom - top) * fy);
+}
+
+/**
+ * \brief Normal of the ground under a world position (gradient of the bilinear patch).
+ */
+glm::vec3 terrainNormal(const Heightfield& heightfield, float x, float y) {
+	if (heightfield.resolution == 0)
+		return glm::vec3(0.0f, 0.0f, 1.0f);
+
+	float fx, fy;
+	const float* cell = gridCell(heightfield, x, y, fx, fy);
+	const float* next = cell + heightfield.resolution;
+	// derivatives per sample, the rows go towards -y
+	const float dx = (cell[1] - cell[0]) + ((next[1] - next[0]) - (cell[1] - cell[0])) * fy;
+	const float dy = -((next[0] - cell[0]) + ((next[1] - cell[1]) - (next[0] - cell[0])) * fx);
+	const float scale = heightfield.heightScale * heightfield.inverseCellSize;
+	return glm::normalize(glm::vec3(-dx * scale, -dy * scale, 1.0f));
+}
+
+/**
+ * \brief Ground height under many positions (4 per SSE instruction).
+ * \param x, y [in] world positions, count each
+ * \param heights [out] count heights
+ */
+void terrainHeights(const Heightfield& heightfield, const float* x, const float* y, float* heights, size_t count) {
+	if (heightfield.resolution == 0) {
+		std::fill(heights, heights + count, heightfield.heightOffset);
+		return;
+	}
+
+	size_t i = 0;
+#ifdef HEIGHTFIELD_SSE
+	const float* samples = heightfield.heights.data();
+	const int row = (int)heightfield.resolution;
+	const __m128 originX = _mm_set1_ps(heightfield.gridOriginX);
+	const __m128 originY = _mm_set1_ps(heightfield.gridOriginY);
+	const __m128 inverseCell = _mm_set1_ps(heightfield.inverseCellSize);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maxCoordinate = _mm_set1_ps((float)(heightfield.resolution - 1) - 1e-3f);
+	const __m128 scale = _mm_set1_ps(heightfield.heightScale);
+	const __m128 offset = _mm_set1_ps(heightfield.heightOffset);
+	const __m128 rowSize = _mm_set1_ps((float)row);
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), originX), inverseCell);
+		__m128 gy = _mm_mul_ps(_mm_sub_ps(originY, _mm_loadu_ps(y + i)), inverseCell);
+		gx = _mm_min_ps(_mm_max_ps(gx, zero), maxCoordinate);
+		gy = _mm_min_ps(_mm_max_ps(gy, zero), maxCoordinate);
+
+		// the coordinates are positive, truncation is floor
+		const __m128i ix = _mm_cvttps_epi32(gx);
+		const __m128i iy = _mm_cvttps_epi32(gy);
+		const __m128 fx = _mm_sub_ps(gx, _mm_cvtepi32_ps(ix));
+		const __m128 fy = _mm_sub_ps(gy, _mm_cvtepi32_ps(iy));
+
+		// no 32 bit multiply nor gather in SSE2 : the index is exact in float (< 2^24), the corners are loaded one by one
+		alignas(16) int cellIndex[4];
+		const __m128 index = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(iy), rowSize), _mm_cvtepi32_ps(ix));
+		_mm_store_si128((__m128i*)cellIndex, _mm_cvttps_epi32(index));
+		const float* c0 = samples + cellIndex[0];
+		const float* c1 = samples + cellIndex[1];
+		const float* c2 = samples + cellIndex[2];
+		const float* c3 = samples + cellIndex[3];
+		const __m128 h00 = _mm_setr_ps(c0[0], c1[0], c2[0], c3[0]);
+		const __m128 h10 = _mm_setr_ps(c0[1], c1[1], c2[1], c3[1]);
+		const __m128 h01 = _mm_setr_ps(c0[row], c1[row], c2[row], c3[row]);
+		const __m128 h11 = _mm_setr_ps(c0[row + 1], c1[row + 1], c2[row + 1], c3[row + 1]);
+
+		const __m128 top = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fx));
+		const __m128 bottom = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), fx));
+		const __m128 height = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+		_mm_storeu_ps(heights + i, _mm_add_ps(offset, _mm_mul_ps(scale, height)));
+	}
+#endif
+	for (; i < count; i++)
+		heights[i] = terrainHeight(heightfield, x[i], y[i]);
+}
+
+// -----------------------  Benchmark ---------------------------------
+
+/**
+ * \brief Compare the ground height of count random positions queried one by one and in batch (--bench-heightfield).
+ */
+void benchmarkHeightfield(unsigned int count) {
+	ModelData model;
+	if (!loadModelData(TERRAIN_MODEL_NAME, model)) {
+		std::cerr << "\033[31mbenchmarkHeightfield : Cannot load " << TERRAIN_MODEL_NAME << "\033[0m" << std::endl;
+		return;
+	}
+	Heightfield heightfield;
+	bakeHeightfield(model, heightfield);
+	placeHeightfield(heightfield, glm::vec3(0.0f, 0.0f, MIN_HEIGHT), TERRAIN_SIZE);
+	releaseModelData(model);
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(-TERRAIN_SIZE, TERRAIN_SIZE);
+	std::vector<float> x(count), y(count), single(count), batch(count);
+	for (unsigned int i = 0; i < count; i++) {
+		x[i] = uniform(random);
+		y[i] = uniform(random);
+	}
+
+	const int runs = 20;
+	Clock::time_point start = Clock::now();
+	for (int run = 0; run < runs; run++) {
+		for (unsigned int i = 0; i < count; i++)
+			single[i] = terrainHeight(heightfield, x[i], y[i]);
+	}
+	const double singleMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+
+	start = Clock::now();
+	for (int run = 0; run < runs; run++)
+		terrainHeights(heightfield, x.data(), y.data(), batch.data(), count);
+	const double batchMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+
+	float maxDifference = 0.0f;
+	for (unsigned int i = 0; i < count; i++)
+		maxDifference = std::max(maxDifference, std::fabs(single[i] - batch[i]));
+
+#ifdef HEIGHTFIELD_SSE
+	const char* batchName = "batch (SSE)";
+#else
+	const char* batchName = "batch (scalar)";
+#endif
+	printf("%u ground heights :\n", count);
+	printf("  one by one    %8.3f ms  %6.2f ns per position\n", singleMs, 1e6 * singleMs / count);
+	printf("  %-14s%8.3f ms  %6.2f ns per position  (speedup %.2fx, max difference %g)\n", batchName, batchMs,
+		1e6 * batchMs / count, batchMs > 0.0 ? singleMs / batchMs : 0.0, maxDifference);
+}
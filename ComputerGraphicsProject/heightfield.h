@@ -0,0 +1,58 @@
+/*
+* \file heightfield.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Terrain baked into a regular height grid - ground height and normal queries (SSE batch)
+*/
+
+#pragma once
+
+#ifndef __HEIGHTFIELD_H
+#define __HEIGHTFIELD_H
+
+#include <vector>
+#include "pgr.h"
+#include "meshCache.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHTFIELD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#define HEIGHTFIELD_RESOLUTION 257		// samples per side of the grid
+#define HEIGHTFIELD_BENCH_COUNT 100000	// positions of the --bench-heightfield microbenchmark
+
+/**
+ * \brief Highest point of the terrain model sampled on a regular grid over its horizontal (x, z) extent.
+ *  The grid is baked in model space, placeHeightfield() gives the transform of the terrain in the scene
+ *  (same as drawTerrain() : translation, +90 degrees around x, uniform scale).
+ */
+typedef struct _Heightfield {
+	unsigned int resolution;	///< samples per side, 0 until the terrain is baked
+	glm::vec2 modelMin;			///< model (x, z) of the first sample
+	float cellSize;				///< distance between two samples in model units
+	std::vector<float> heights;	///< model y of every sample, resolution * resolution, row = z
+
+	// world placement, derived from the terrain transform
+	float gridOriginX;			///< world x of the first column
+	float gridOriginY;			///< world y of the first row (the rows go towards -y)
+	float inverseCellSize;		///< samples per world unit
+	float heightScale;			///< world height = heightOffset + heightScale * model y
+	float heightOffset;
+
+	_Heightfield() : resolution(0), modelMin(0.0f), cellSize(1.0f), gridOriginX(0.0f), gridOriginY(0.0f),
+		inverseCellSize(1.0f), heightScale(1.0f), heightOffset(0.0f) {}
+} Heightfield;
+
+extern Heightfield terrainHeightfield;
+
+void bakeHeightfield(const ModelData& model, Heightfield& heightfield, unsigned int resolution = HEIGHTFIELD_RESOLUTION);
+void placeHeightfield(Heightfield& heightfield, const glm::vec3& position, float size);
+
+float terrainHeight(const Heightfield& heightfield, float x, float y);
+glm::vec3 terrainNormal(const Heightfield& heightfield, float x, float y);
+void terrainHeights(const Heightfield& heightfield, const float* x, const float* y, float* heights, size_t count);
+
+void benchmarkHeightfield(unsigned int count);
+
+#endif // __HEIGHTFIELD_H
@@ -0,0 +1,156 @@
+/*
+* \file image.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Image decoding on any thread and texture creation from decoded images
+*/
+
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <cstdio>
+#include <IL/il.h>
+#include "image.h"
+
+// DevIL keeps the bound image in global state, decoding itself must be serialized.
+// Reading the file and everything done with the decoded pixels still runs in parallel.
+static std::mutex devilMutex;
+
+TextureMemory textureMemory;
+
+/**
+ * \brief Read and decode an image file into RGBA8 pixels. Safe to call from worker threads.
+ * \param fileName [in] image to decode (format is deduced from the extension)
+ * \param image [out] decoded image
+ */
+bool decodeImage(const std::string& fileName, ImageData& image) {
+	std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+	if (!file) {
+		std::cerr << "\033[31mdecodeImage : Cannot open : " << fileName << "\033[0m" << std::endl;
+		return false;
+	}
+
+	std::vector<char> encoded((size_t)file.tellg());
+	file.seekg(0);
+	file.read(encoded.data(), encoded.size());
+	file.close();
+
+	std::lock_guard<std::mutex> lock(devilMutex);
+
+	ILuint imageId;
+	ilGenImages(1, &imageId);
+	ilBindImage(imageId);
+
+	bool decoded = ilLoadL(ilTypeFromExt(fileName.c_str()), encoded.data(), (ILuint)encoded.size()) == IL_TRUE
+		&& ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE) == IL_TRUE;
+
+	if (decoded) {
+		image.fileName = fileName;
+		image.width = (unsigned int)ilGetInteger(IL_IMAGE_WIDTH);
+		image.height = (unsigned int)ilGetInteger(IL_IMAGE_HEIGHT);
+		const unsigned char* data = ilGetData();
+		image.pixels.assign(data, data + 4 * (size_t)image.width * image.height);
+	}
+	else {
+		std::cerr << "\033[31mdecodeImage : Cannot decode : " << fileName << "\033[0m" << std::endl;
+	}
+
+	ilDeleteImages(1, &imageId);
+	return decoded;
+}
+
+/**
+ * \brief Encode the image into a PNG file (rows bottom to top, as read back by glReadPixels).
+ */
+bool saveImagePNG(const std::string& fileName, const ImageData& image) {
+	std::lock_guard<std::mutex> lock(devilMutex);
+
+	ILuint imageId;
+	ilGenImages(1, &imageId);
+	ilBindImage(imageId);
+
+	ilEnable(IL_FILE_OVERWRITE);
+	bool saved = ilTexImage(image.width, image.height, 1, 4, IL_RGBA, IL_UNSIGNED_BYTE, (void*)image.pixels.data()) == IL_TRUE
+		&& ilSave(IL_PNG, fileName.c_str()) == IL_TRUE;
+	if (!saved)
+		std::cerr << "\033[31msaveImagePNG : Cannot write : " << fileName << "\033[0m" << std::endl;
+
+	ilDeleteImages(1, &imageId);
+	return saved;
+}
+
+/**
+ * \brief Bytes of a full mip chain of the image.
+ */
+size_t mipChainBytes(unsigned int width, unsigned int height, unsigned int bytesPerPixel) {
+	size_t bytes = 0;
+	while (true) {
+		bytes += (size_t)width * height * bytesPerPixel;
+		if (width == 1 && height == 1)
+			return bytes;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+}
+
+/**
+ * \brief Upload an image into the given target of the currently bound texture.
+ * Baked images upload their whole mip chain, decoded images only level 0 (the mipmaps are generated by the caller).
+ */
+void loadTexImageFromImage(const ImageData& image, GLenum target) {
+	textureMemory.images++;
+	textureMemory.rgbaBytes += mipChainBytes(image.width, image.height, 4);
+
+	if (!image.levels.empty()) {
+		for (size_t i = 0; i < image.levels.size(); i++) {
+			const ImageLevel& level = image.levels[i];
+			glCompressedTexImage2D(target, (GLint)i, image.compressedFormat, level.width, level.height, 0,
+				(GLsizei)level.size, image.levelData + level.offset);
+			textureMemory.bytes += level.size;
+		}
+		return;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(target, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+	textureMemory.bytes += mipChainBytes(image.width, image.height, 4);
+}
+
+/**
+ * \brief Create a 2D texture from a decoded image, same sampling setup as pgr::createTexture().
+ */
+GLuint createTextureFromImage(const ImageData& image, bool mipmap) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	loadTexImageFromImage(image, GL_TEXTURE_2D);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (mipmap) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		// baked images bring their mip chain, compressed levels cannot be generated by the driver
+		if (image.levels.empty())
+			glGenerateMipmap(GL_TEXTURE_2D);
+		else
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+	}
+	else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	CHECK_GL_ERROR();
+	return texture;
+}
+
+/**
+ * \brief Print the video memory taken by the textures, and what they would take as RGBA8.
+ */
+void printTextureMemoryReport() {
+	printf("Textures : %u images, %.1f KB of video memory (%.1f KB as RGBA8, %.1fx)\n", textureMemory.images,
+		textureMemory.bytes / 1024.0, textureMemory.rgbaBytes / 1024.0,
+		textureMemory.bytes > 0 ? (double)textureMemory.rgbaBytes / textureMemory.bytes : 1.0);
+}
@@ -0,0 +1,69 @@
+/*
+* \file image.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Image decoding on any thread and texture creation from decoded images
+*/
+
+#pragma once
+
+#ifndef __IMAGE_H
+#define __IMAGE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "pgr.h"
+
+/**
+ * \brief One level of a baked mip chain.
+ */
+typedef struct _ImageLevel {
+	unsigned int width;
+	unsigned int height;
+	size_t offset;		///< first byte of the level in ImageData::levelData
+	size_t size;		///< bytes of the level
+} ImageLevel;
+
+/**
+ * \brief Decoded RGBA8 image (rows bottom to top, as pgr::createTexture expects them), or its block compressed mip chain
+ * baked by the texture cache (see textureCache.h), which is uploaded as is.
+ */
+typedef struct _ImageData {
+	std::string fileName;
+	unsigned int width;
+	unsigned int height;
+	std::vector<unsigned char> pixels;	///< width * height * 4 bytes, empty for baked images
+
+	GLenum compressedFormat;					///< format of the baked levels (0 for decoded images)
+	std::vector<ImageLevel> levels;				///< baked mip chain, level 0 first
+	const unsigned char* levelData;				///< first byte of the baked levels
+	std::shared_ptr<const void> levelStorage;	///< keeps levelData alive (buffer baked in this run or mapped cache file)
+
+	_ImageData() : width(0), height(0), compressedFormat(0), levelData(NULL) {}
+
+	bool empty() const { return pixels.empty() && levels.empty(); }
+} ImageData;
+
+/**
+ * \brief Video memory of the textures created from images (mipmaps included).
+ */
+typedef struct _TextureMemory {
+	unsigned int images;	///< uploaded images (a cube map counts its 6 faces)
+	size_t bytes;			///< in their uploaded format
+	size_t rgbaBytes;		///< if they were all uploaded as RGBA8
+
+	_TextureMemory() : images(0), bytes(0), rgbaBytes(0) {}
+} TextureMemory;
+
+extern TextureMemory textureMemory;
+
+bool decodeImage(const std::string& fileName, ImageData& image);
+bool saveImagePNG(const std::string& fileName, const ImageData& image);
+
+GLuint createTextureFromImage(const ImageData& image, bool mipmap = true);
+void loadTexImageFromImage(const ImageData& image, GLenum target);
+size_t mipChainBytes(unsigned int width, unsigned int height, unsigned int bytesPerPixel);
+void printTextureMemoryReport();
+
+#endif // __IMAGE_H
@@ -0,0 +1,229 @@
+/*
+* \file instancing.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Instanced drawing of repeated scene props - one per instance buffer per model, one instanced draw per sub-mesh
+*/
+
+#include <iostream>
+#include <cstddef>
+#include <cfloat>
+#include <algorithm>
+#include "instancing.h"
+#include "renderer.h"
+
+unsigned int instanceStressCount = 0;
+
+/**
+ * \brief Create an empty group of instances of a model.
+ * \param geometries [in] sub-meshes of the model, must outlive the group
+ */
+InstanceGroup* createInstanceGroup(const std::vector<ObjectGeometry*>* geometries) {
+	InstanceGroup* group = new InstanceGroup;
+	group->geometries = geometries;
+	glGenBuffers(1, &group->instanceBufferObject);
+	return group;
+}
+
+static void deleteInstancedVertexArrays(InstanceGroup* group) {
+	for (size_t i = 0; i < group->vertexArrays.size(); i++) {
+		// arena sub-meshes share their vao
+		if (i == 0 || group->vertexArrays[i] != group->vertexArrays[i - 1])
+			glDeleteVertexArrays(1, &group->vertexArrays[i]);
+	}
+	group->vertexArrays.clear();
+}
+
+void destroyInstanceGroup(InstanceGroup* group) {
+	if (group == NULL)
+		return;
+	deleteInstancedVertexArrays(group);
+	glDeleteBuffers(1, &group->instanceBufferObject);
+	delete group;
+}
+
+/**
+ * \brief Add an instance, uploaded by the next submitInstanceGroup().
+ */
+void addInstance(InstanceGroup* group, const glm::mat4& modelMatrix, GLuint objectId, const glm::vec4& tint) {
+	InstanceData instance;
+	instance.modelMatrix = modelMatrix;
+	instance.objectId = objectId;
+	for (int i = 0; i < 4; i++)
+		instance.tint[i] = (GLubyte)(glm::clamp(tint[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+
+	group->instances.push_back(instance);
+	group->dirty = true;
+	group->boundsDirty = true;
+}
+
+void clearInstances(InstanceGroup* group) {
+	group->instances.clear();
+	group->dirty = true;
+	group->boundsDirty = true;
+}
+
+/**
+ * \brief Scatter count randomly rotated, scaled and tinted instances over the terrain.
+ * \param size [in] average size of the instances (scale of the model)
+ */
+void scatterInstances(InstanceGroup* group, unsigned int count, float size) {
+	group->instances.reserve(group->instances.size() + count);
+
+	for (unsigned int i = 0; i < count; i++) {
+		const float x = (2.0f * rand() / (float)RAND_MAX - 1.0f) * (TERRAIN_SIZE - size);
+		const float y = (2.0f * rand() / (float)RAND_MAX - 1.0f) * (TERRAIN_SIZE - size);
+		const float angle = glm::radians(360.0f * rand() / (float)RAND_MAX);
+		const float scale = size * (0.8f + 0.4f * rand() / (float)RAND_MAX);
+		const float shade = 0.8f + 0.2f * rand() / (float)RAND_MAX;
+
+		// same transform as drawModel()
+		glm::mat4 modelMatrix = alignObject(glm::vec3(x, y, MIN_HEIGHT), glm::vec3(cos(angle), sin(angle), 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		modelMatrix = glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0, 1, 0));
+		modelMatrix = glm::scale(modelMatrix, glm::vec3(scale));
+
+		addInstance(group, modelMatrix, INSTANCE_OBJECT_ID_BASE + (GLuint)group->instances.size(), glm::vec4(shade, 1.0f, shade, 1.0f));
+	}
+}
+
+// -----------------------  Vertex arrays ---------------------------------
+
+/**
+ * \brief Vao reading the vertices of the geometry and the per instance attributes of the group.
+ */
+static GLuint createInstancedVertexArray(const ObjectGeometry* geometry, GLuint instanceBuffer) {
+	GLuint vertexArray = 0;
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+
+	if (geometry->inArena) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometryArena.elementBufferObject);
+		glBindBuffer(GL_ARRAY_BUFFER, geometryArena.vertexBufferObject);
+		setVertexLayoutAttributes(geometryArena.layout, 0, instancedShaderProgram, true);
+	}
+	else {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBufferObject);
+		glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBufferObject);
+		setVertexLayoutAttributes(meshVertexLayout(), geometry->numVertices, instancedShaderProgram, true);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (int column = 0; column < 4; column++) {
+		const GLuint location = (GLuint)instancedShaderProgram.locations.instanceModelMatrix + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, modelMatrix) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	glEnableVertexAttribArray(instancedShaderProgram.locations.instanceTint);
+	glVertexAttribPointer(instancedShaderProgram.locations.instanceTint, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(InstanceData), (void*)offsetof(InstanceData, tint));
+	glVertexAttribDivisor(instancedShaderProgram.locations.instanceTint, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	CHECK_GL_ERROR();
+	return vertexArray;
+}
+
+/**
+ * \brief (Re)create the vaos once the model is loaded or after the geometry arena was reallocated.
+ */
+static void setupInstancedVertexArrays(InstanceGroup* group) {
+	const std::vector<ObjectGeometry*>& geometries = *group->geometries;
+	if (group->vertexArrays.size() == geometries.size() && group->arenaGeneration == geometryArena.generation)
+		return;
+
+	deleteInstancedVertexArrays(group);
+	GLuint arenaVertexArray = 0;
+	for (size_t i = 0; i < geometries.size(); i++) {
+		if (!geometries[i]->inArena) {
+			group->vertexArrays.push_back(createInstancedVertexArray(geometries[i], group->instanceBufferObject));
+			continue;
+		}
+		if (arenaVertexArray == 0)
+			arenaVertexArray = createInstancedVertexArray(geometries[i], group->instanceBufferObject);
+		group->vertexArrays.push_back(arenaVertexArray);
+	}
+	group->arenaGeneration = geometryArena.generation;
+}
+
+// -----------------------  Drawing ---------------------------------
+
+/**
+ * \brief Compute the world space bounding sphere of every instance from the bounds of the model.
+ * \return false while the bounds of the model are unknown (model still loading)
+ */
+static bool updateInstanceBounds(InstanceGroup* group) {
+	if (!group->boundsDirty && group->instanceBounds.size() == group->instances.size())
+		return true;
+
+	glm::vec3 center;
+	float radius;
+	if (!mergeGeometryBounds(group->geometries->data(), group->geometries->size(), center, radius))
+		return false;
+
+	group->instanceBounds.resize(group->instances.size());
+	for (size_t i = 0; i < group->instances.size(); i++) {
+		const glm::mat4& modelMatrix = group->instances[i].modelMatrix;
+		group->instanceBounds[i] = glm::vec4(glm::vec3(modelMatrix * glm::vec4(center, 1.0f)), radius * maxScale(modelMatrix));
+	}
+	group->boundsDirty = false;
+	return true;
+}
+
+static void uploadInstances(InstanceGroup* group, const std::vector<InstanceData>& instances) {
+	const size_t bytes = instances.size() * sizeof(InstanceData);
+	glBindBuffer(GL_ARRAY_BUFFER, group->instanceBufferObject);
+	if (instances.size() > group->instanceCapacity) {
+		glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), GL_DYNAMIC_DRAW);
+		group->instanceCapacity = instances.size();
+	}
+	else if (bytes > 0) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	COUNT_GL_CALLS(3);
+}
+
+/**
+ * \brief Cull the instances against the view frustum, upload the visible ones and queue one instanced draw per sub-mesh.
+ * Without culling the instance buffer is only uploaded when the instances changed.
+ */
+void submitInstanceGroup(InstanceGroup* group) {
+	if (group == NULL || group->instances.empty() || group->geometries->empty())
+		return;
+
+	setupInstancedVertexArrays(group);
+
+	const std::vector<InstanceData>* drawn = &group->instances;
+	// textures are streamed for the largest visible instance (whole model size without the bounds)
+	float screenSize = FLT_MAX;
+	if (useFrustumCulling && updateInstanceBounds(group)) {
+		screenSize = 0.0f;
+		group->visibleInstances.clear();
+		for (size_t i = 0; i < group->instances.size(); i++) {
+			const glm::vec4& sphere = group->instanceBounds[i];
+			if (sphereInFrustum(viewFrustum, glm::vec3(sphere), sphere.w)) {
+				group->visibleInstances.push_back(group->instances[i]);
+				screenSize = std::max(screenSize, projectedSphereSize(glm::vec3(sphere), sphere.w));
+			}
+		}
+		renderStats.instancesCulled += (unsigned int)(group->instances.size() - group->visibleInstances.size());
+
+		drawn = &group->visibleInstances;
+		uploadInstances(group, *drawn);
+		group->dirty = true;	// the buffer only holds the visible instances
+	}
+	else if (group->dirty) {
+		uploadInstances(group, *drawn);
+		group->dirty = false;
+	}
+	if (drawn->empty())
+		return;
+
+	// the model matrices are per instance, the queued transform only orders the draws
+	const unsigned int transform = submitTransform(glm::mat4(1.0f));
+	for (size_t i = 0; i < group->geometries->size(); i++) {
+		submitInstancedDraw((*group->geometries)[i], group->vertexArrays[i], (GLsizei)drawn->size(), transform);
+		requestTextureCoverage((*group->geometries)[i]->material.texture, screenSize);
+	}
+}
@@ -0,0 +1,60 @@
+/*
+* \file instancing.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Instanced drawing of repeated scene props - one per instance buffer per model, one instanced draw per sub-mesh
+*/
+
+#pragma once
+
+#ifndef __INSTANCING_H
+#define __INSTANCING_H
+
+#include <vector>
+#include "pgr.h"
+#include "object.h"
+
+#define INSTANCE_OBJECT_ID_BASE 1000	// object ids of the instances start here
+#define INSTANCE_STRESS_COUNT 10000		// default number of trees of the stress scene
+
+/**
+ * \brief Per instance vertex attributes (divisor 1).
+ */
+typedef struct _InstanceData {
+	glm::mat4 modelMatrix;
+	GLuint    objectId;		///< id of the instance, for picking
+	GLubyte   tint[4];		///< RGBA8, multiplied with the lit color
+} InstanceData;
+
+static_assert(sizeof(InstanceData) == 72, "InstanceData is uploaded as is, it must stay tightly packed");
+
+/**
+ * \brief Instances of one model. The vaos combine the vertex buffer of each sub-mesh with the instance buffer.
+ */
+typedef struct _InstanceGroup {
+	const std::vector<ObjectGeometry*>* geometries;	///< sub-meshes of the model, may still be loading
+	std::vector<InstanceData> instances;
+	std::vector<InstanceData> visibleInstances;	///< instances inside the view frustum this frame
+	std::vector<glm::vec4> instanceBounds;	///< world space bounding sphere of every instance (xyz center, w radius)
+	GLuint instanceBufferObject;
+	size_t instanceCapacity;				///< instances the buffer can hold
+	std::vector<GLuint> vertexArrays;		///< instanced vao of every sub-mesh (arena sub-meshes share one)
+	unsigned int arenaGeneration;			///< geometry arena generation the vaos were set up for
+	bool dirty;								///< the instance buffer does not hold all the instances
+	bool boundsDirty;						///< instanceBounds must be computed again
+
+	_InstanceGroup() : geometries(NULL), instanceBufferObject(0), instanceCapacity(0), arenaGeneration(0), dirty(false), boundsDirty(false) {}
+} InstanceGroup;
+
+extern unsigned int instanceStressCount;	///< trees of the instancing stress scene, 0 = off (--stress-trees)
+
+InstanceGroup* createInstanceGroup(const std::vector<ObjectGeometry*>* geometries);
+void destroyInstanceGroup(InstanceGroup* group);
+
+void addInstance(InstanceGroup* group, const glm::mat4& modelMatrix, GLuint objectId, const glm::vec4& tint);
+void clearInstances(InstanceGroup* group);
+void scatterInstances(InstanceGroup* group, unsigned int count, float size);
+
+void submitInstanceGroup(InstanceGroup* group);
+
+#endif // __INSTANCING_H
@@ -0,0 +1,70 @@
+#version 140
+
+// Inputs
+in vec3 position;
+in vec3 normal;
+in vec2 texCoord;
+
+// Per instance inputs (instancing.h)
+in mat4 instanceModelMatrix;
+in vec4 instanceTint;
+
+// Per frame data, shared by every draw (uniformBuffers.h), the lights are already in view space
+layout(std140) uniform FrameData {
+	mat4  ViewMatrix;
+	mat4  ProjectionMatrix;
+	vec4  sunAmbient;
+	vec4  sunDiffuse;
+	vec4  sunSpecular;
+	vec4  sunPosition;        // direction towards the sun, w = 0
+	vec4  spotLightPosition;  // player position
+	vec4  spotLightDirection; // normalized
+	vec4  pointLightPosition;
+	vec4  clusterParams;      // tiles x, tiles y, slice scale, slice bias
+	vec4  clusterTileSize;    // tile size in pixels, slices, 1 = logarithmic slices
+	float time;           // Time since the beginning of the program
+	float fogAmount;      // fog movement along a sin wave, 0 to 1
+	int   fogOn;
+	int   turnSunOn;
+	int   useSpotLight;
+	int   usePointLight;
+	int   dynamicLightCount;
+};
+
+// Per object data, one block per object / material in a ring buffer (uniformBuffers.h)
+layout(std140) uniform ObjectData {
+	mat4  PVM;
+	mat4  ModelMatrix;
+	mat4  NormalMatrix;
+	vec4  positionScale;  // positions may be stored as 16 bit values relative to the mesh bounding box
+	vec4  positionOffset;
+	vec4  materialAmbient;
+	vec4  materialDiffuse;
+	vec4  materialSpecular; // w = shininess
+	int   materialUseTexture;
+};
+
+// Outputs to fragment shader
+smooth out vec3 fragPosition;
+smooth out vec3 fragNormal;
+smooth out vec2 fragTexCoord;
+flat out vec4 fragTint;
+
+
+void main() {
+	vec4 modelPosition = vec4(position * positionScale.xyz + positionOffset.xyz, 1.0);
+	vec4 worldPosition = instanceModelMatrix * modelPosition;
+
+	// Calculate the position of the vertex in eye coordinates for the fragment shader
+    fragPosition = vec3(ViewMatrix * worldPosition);
+
+    // Instances are only rotated and uniformly scaled, the model matrix transforms the normals as well
+    fragNormal = normalize(mat3(instanceModelMatrix) * normal);
+
+    // Pass through the texture coordinates
+    fragTexCoord = texCoord;
+    fragTint = instanceTint;
+
+    // Calculate the position of the vertex for rasterization
+    gl_Position = ProjectionMatrix * ViewMatrix * worldPosition;
+}
\ No newline at end of file
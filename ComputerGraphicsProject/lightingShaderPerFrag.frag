@@ -21,68 +21,95 @@ struct Material {      // structure that describes currently used material
 };
 
 uniform Light light;
-uniform Material material;
 uniform sampler2D fragTexSampler;  // sampler for the texture access
 
-// Uniforms
-uniform mat4 PVM;
-uniform mat4 ViewMatrix;
-uniform mat4 ModelMatrix;
-uniform mat4 NormalMatrix;
-
-uniform float time; // Time since the beginning of the program
-uniform bool fogOn;
+// Dynamic lights binned into view frustum clusters on the CPU (clusteredLighting.h)
+uniform samplerBuffer clusterLightData;      // 2 texels per light: view space position + radius, color
+uniform usamplerBuffer clusterGrid;          // offset and count of the lights of every cluster in clusterLightIndices
+uniform usamplerBuffer clusterLightIndices;
+
+// Per frame data, shared by every draw (uniformBuffers.h), the lights are already in view space
+layout(std140) uniform FrameData {
+	mat4  ViewMatrix;
+	mat4  ProjectionMatrix;
+	vec4  sunAmbient;
+	vec4  sunDiffuse;
+	vec4  sunSpecular;
+	vec4  sunPosition;        // direction towards the sun, w = 0
+	vec4  spotLightPosition;  // player position
+	vec4  spotLightDirection; // normalized
+	vec4  pointLightPosition;
+	vec4  clusterParams;      // tiles x, tiles y, slice scale, slice bias
+	vec4  clusterTileSize;    // tile size in pixels, slices, 1 = logarithmic slices
+	float time;           // Time since the beginning of the program
+	float fogAmount;      // fog movement along a sin wave, 0 to 1
+	int   fogOn;
+	int   turnSunOn;
+	int   useSpotLight;
+	int   usePointLight;
+	int   dynamicLightCount;
+};
 
+// Per object data, one block per object / material in a ring buffer (uniformBuffers.h)
+layout(std140) uniform ObjectData {
+	mat4  PVM;
+	mat4  ModelMatrix;
+	mat4  NormalMatrix;
+	vec4  positionScale;  // positions may be stored as 16 bit values relative to the mesh bounding box
+	vec4  positionOffset;
+	vec4  materialAmbient;
+	vec4  materialDiffuse;
+	vec4  materialSpecular; // w = shininess
+	int   materialUseTexture;
+};
 
-uniform bool turnSunOn;
-uniform bool useSpotLight;
-uniform bool usePointLight;
-uniform vec3 sunAmbient;
-uniform vec3 sunDiffuse;
-uniform vec3 sunSpecular;
-uniform vec3 spotLightPosition;
-uniform vec3 spotLightDirection;
 uniform vec3 viewPosition; // Position of the camera/view
 
+// Lighting features: compile time constants in the specialized programs (shaderPermutations.h), read from the
+// uniform blocks when the program is compiled without the defines
+#ifndef LIGHTING_FOG
+#define LIGHTING_FOG (fogOn != 0)
+#endif
+#ifndef LIGHTING_SUN
+#define LIGHTING_SUN (turnSunOn != 0)
+#endif
+#ifndef LIGHTING_SPOT_LIGHT
+#define LIGHTING_SPOT_LIGHT (useSpotLight != 0)
+#endif
+#ifndef LIGHTING_POINT_LIGHT
+#define LIGHTING_POINT_LIGHT (usePointLight != 0)
+#endif
+#ifndef LIGHTING_TEXTURE
+#define LIGHTING_TEXTURE (materialUseTexture != 0)
+#endif
+#ifndef LIGHTING_DYNAMIC_LIGHTS
+#define LIGHTING_DYNAMIC_LIGHTS (dynamicLightCount != 0)
+#endif
+
 // Inputs from the vertex shader
 smooth in vec3 fragPosition;
 smooth in vec3 fragNormal;
 smooth in vec2 fragTexCoord;
+flat in vec4 fragTint;      // per instance tint, white for single objects
 
 // Outputs to the fragment shader
 out vec4 fragColor;
 
 
-Light sun;
-float sunSpeed = 0.25f;		// sun speed to simulate night and day cycle
-Light playerLight;
-Light bulbLight;
-vec3 bulbLightPosition = vec3(0.0f, 1.0f, 1.0f);
-vec3 bulbLightDirection = vec3(0.0f, -1.0f, -1.0f);
-
-void SetupLight() {
-	// Light parameters
-
-	sun.ambient  = sunAmbient;
-	sun.diffuse  = sunDiffuse;
-	sun.specular = sunSpecular;
-	sun.position = (ViewMatrix * vec4(cos(time * sunSpeed), 0.0f, sin(time * sunSpeed), 0.0f)).xyz;
-	sun.spotDirection = normalize((ViewMatrix * vec4(spotLightDirection, 0.0)).xyz);
-
-	playerLight.ambient = vec3(0.2f);
-	playerLight.diffuse = vec3(1.0);
-	playerLight.specular = vec3(1.0);
-	playerLight.spotCosCutOff = 0.95f;
-	playerLight.spotExponent = 0.0;
-	playerLight.position = (ViewMatrix * vec4(spotLightPosition, 1.0)).xyz;
-	playerLight.spotDirection = normalize((ViewMatrix * vec4(spotLightDirection, 0.0)).xyz);
-
-	bulbLight.ambient = vec3(0.2f);
-	bulbLight.diffuse = vec3(1.0);
-	bulbLight.specular = vec3(1.0);
-	bulbLight.position = (ViewMatrix * vec4(bulbLightPosition, 1.0)).xyz;
-	bulbLight.spotDirection = normalize((ViewMatrix * vec4(bulbLightDirection, 0.0)).xyz);
+Material material;
 
+// The light positions and directions are computed once per frame on the CPU (drawScene), only the constant
+// colors are set here
+Light SunLight() {
+	return Light(sunAmbient.xyz, sunDiffuse.xyz, sunSpecular.xyz, sunPosition.xyz, vec3(0.0), 0.0, 0.0);
+}
+
+Light PlayerLight() {
+	return Light(vec3(0.2f), vec3(1.0), vec3(1.0), spotLightPosition.xyz, spotLightDirection.xyz, 0.95f, 0.0);
+}
+
+Light BulbLight() {
+	return Light(vec3(0.2f), vec3(1.0), vec3(1.0), pointLightPosition.xyz, vec3(0.0), 0.0, 0.0);
 }
 
 vec4 directionalLight(Light light, Material material, vec3 vertexPosition, vec3 vertexNormal) {
@@ -114,7 +141,7 @@ vec4 spotLight(Light spotLight, Material material, vec3 vertexPosition, vec3 ver
 	ret += material.diffuse * spotLight.diffuse * NdotL;
 	ret += material.specular * spotLight.specular * pow(NdotH, material.shininess); // Blinn-Phong specular term
 
-	float spotCoef = dot(normalize(spotLight.spotDirection), -L);
+	float spotCoef = dot(spotLight.spotDirection, -L);
 
 	if (spotCoef >= spotLight.spotCosCutOff) {
 		ret *= pow(spotCoef, spotLight.spotExponent);
@@ -146,6 +173,41 @@ vec4 pointLight(Light pointLight, Material material, vec3 vertexPosition, vec3 v
 	return vec4(ret, 1.0);
 }
 
+// Cluster of the fragment: screen tile from gl_FragCoord, depth slice from the view space depth
+int clusterIndex(vec3 vertexPosition) {
+	ivec2 tiles = ivec2(clusterParams.xy);
+	ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize.xy), ivec2(0), tiles - 1);
+	float depth = -vertexPosition.z;
+	float slice = (clusterTileSize.w > 0.5 ? log(max(depth, 1e-4)) : depth) * clusterParams.z + clusterParams.w;
+	int s = clamp(int(floor(slice)), 0, int(clusterTileSize.z) - 1);
+	return (s * tiles.y + tile.y) * tiles.x + tile.x;
+}
+
+// Only the lights of the cluster are shaded, their intensity falls to zero at the radius
+vec4 clusteredLights(Material material, vec3 vertexPosition, vec3 vertexNormal) {
+	vec3 ret = vec3(0.0);
+
+	uvec2 cluster = texelFetch(clusterGrid, clusterIndex(vertexPosition)).xy;
+	vec3 V = normalize(-vertexPosition); // View direction
+	for (uint i = 0u; i < cluster.y; i++) {
+		int light = int(texelFetch(clusterLightIndices, int(cluster.x + i)).r);
+		vec4 positionRadius = texelFetch(clusterLightData, 2 * light);
+		vec3 color = texelFetch(clusterLightData, 2 * light + 1).rgb;
+
+		vec3 toLight = positionRadius.xyz - vertexPosition;
+		float dist = length(toLight);
+		float falloff = clamp(1.0 - dist / positionRadius.w, 0.0, 1.0);
+		vec3 L = toLight / max(dist, 1e-4); // Light direction
+		vec3 H = normalize(L + V); // Halfway vector between light and view directions
+		float NdotL = max(0.0, dot(vertexNormal, L));
+		float NdotH = max(0.0, dot(vertexNormal, H));
+
+		ret += (material.diffuse * NdotL + material.specular * pow(NdotH, material.shininess)) * color * (falloff * falloff);
+	}
+
+	return vec4(ret, 0.0);
+}
+
 float computeVisbility(float distToCam) {
 	float fogNear = 0.0f;
 	float fogFar = 1.0f;
@@ -154,30 +216,33 @@ float computeVisbility(float distToCam) {
 }
 
 void main() {
-	// First we need to setup the light
-	SetupLight();
+	// First we need to setup the material
+	material = Material(materialAmbient.xyz, materialDiffuse.xyz, materialSpecular.xyz, materialSpecular.w, LIGHTING_TEXTURE);
 
 	// initialize the output color with the global ambient term
 	vec3 globalAmbientLight = vec3(0.5f);
 	vec4 outputColor = vec4(material.ambient * globalAmbientLight, 0.0);
 
 	// accumulate contributions from all lights 
-	if (turnSunOn)
-		outputColor += directionalLight(sun, material, fragPosition, fragNormal);
-	if (useSpotLight)
-		outputColor += spotLight(playerLight, material, fragPosition, fragNormal);
-	if (usePointLight)
-		outputColor += pointLight(bulbLight, material, fragPosition, fragNormal);
+	if (LIGHTING_SUN)
+		outputColor += directionalLight(SunLight(), material, fragPosition, fragNormal);
+	if (LIGHTING_SPOT_LIGHT)
+		outputColor += spotLight(PlayerLight(), material, fragPosition, fragNormal);
+	if (LIGHTING_POINT_LIGHT)
+		outputColor += pointLight(BulbLight(), material, fragPosition, fragNormal);
+	if (LIGHTING_DYNAMIC_LIGHTS)
+		outputColor += clusteredLights(material, fragPosition, fragNormal);
 
 	// apply texture if it is on
-	if(material.useTexture)
+	if (LIGHTING_TEXTURE)
         outputColor = outputColor * texture(fragTexSampler, fragTexCoord);
+	outputColor.rgb *= fragTint.rgb;
 
 	// apply fog if it is on
-    if(fogOn) {
+    if (LIGHTING_FOG) {
         vec4 fogcolor = vec4(0.4, 0.4, 0.4, 1);
         float distToCam = -fragPosition.z;
-        float visibility = computeVisbility(distToCam) * ((sin(time * 0.4f) + 1.0f) / 2); // Add some fog movement along a sin wave
+        float visibility = computeVisbility(distToCam) * fogAmount;
         outputColor = mix(outputColor, fogcolor, visibility);
     }
 
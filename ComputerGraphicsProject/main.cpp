@@ -7,6 +7,7 @@
 
 
 #include <iostream>
+#include <algorithm>
 #include "main.h"
 
 
@@ -45,6 +46,12 @@ struct _GameState {
 	}
 } GameState;
 
+// state of the previous simulation step
+SimulationSnapshot previousSnapshot;
+
+// number of asset loading threads (-1 = one per core, 0 = load everything serially on the GL thread)
+int workerThreadCount = -1;
+
 // -----------------------  Application ---------------------------------
 
 /**
@@ -54,8 +61,11 @@ void initApplication() {
 	// init OpenGL
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 	glEnable(GL_DEPTH_TEST);
-	// initialize random seed
-	srand((unsigned int)time(NULL));
+	// initialize random seed (fixed in headless runs so that every run renders the same scene)
+	srand(headlessOptions.enabled ? 1u : (unsigned int)time(NULL));
+
+	// worker threads for the CPU side of asset loading
+	initThreadPool(workerThreadCount);
 
 	// - all programs (shaders), buffers, textures, ...
 	loadShaderPrograms();
@@ -85,6 +95,8 @@ void finalizeApplication() {
 
 	// delete shaders
 	cleanupShaderPrograms();
+
+	shutdownThreadPool();
 }
 
 /**
@@ -94,10 +106,14 @@ void restartGame() {
 	// delete all objects
 	cleanUpObjects();
 
-	GameState.elapsedTime = 0.001f * (float)glutGet(GLUT_ELAPSED_TIME); // milliseconds => seconds
+	GameState.elapsedTime = (float)frameLoop.simulationTime;
 
 	// Objects reinisialisation
 	reinisialiseObjects();
+	// nothing to interpolate from
+	captureSnapshot(previousSnapshot);
+	// the time spent rebuilding the scene is not simulated
+	resetFrameLoop(frameLoop.simulationTime);
 
 	// GameState reinitialization
 	if (GameState.fpsCameraMode or GameState.sceneCamera or GameState.splineCamera) {
@@ -117,6 +133,18 @@ void restartGame() {
 		GameState.keyMap[i] = false;
 }
 
+/**
+ * \brief Create an entity standing on the terrain at (x, y), it follows the ground when it moves.
+ * \param groundOffset [in] height of the entity position above the ground
+ */
+static EntityId createGroundedEntity(EntityMesh mesh, unsigned int flags, float x, float y, float groundOffset,
+	const glm::vec3& direction, float size) {
+	const glm::vec3 position(x, y, terrainHeight(terrainHeightfield, x, y) + groundOffset);
+	const EntityId id = createEntity(entities, mesh, flags | ENTITY_GROUNDED, position, direction, size, GameState.elapsedTime);
+	entities.groundOffset[entitySlot(entities, id)] = groundOffset;
+	return id;
+}
+
 void reinisialiseObjects() {
 	if (GameObjects.player == NULL) {
 		GameObjects.player = new Player(1);
@@ -126,38 +154,6 @@ void reinisialiseObjects() {
 		GameObjects.terrain = new Terrain(2);
 		GameObjects.terrain->isInitialized = true;
 	}
-	if (GameObjects.cube == NULL) {
-		GameObjects.cube = new Object(3);
-		GameObjects.cube->isInitialized = true;
-	}
-	if (GameObjects.foxbat == NULL) {
-		GameObjects.foxbat = new Aircraft(4);
-		GameObjects.foxbat->isInitialized = true;
-	}
-	if (GameObjects.zepplin == NULL) {
-		GameObjects.zepplin = new Aircraft(5);
-		GameObjects.zepplin->isInitialized = true;
-	}
-	if (GameObjects.car == NULL) {
-		GameObjects.car = new Object(6);
-		GameObjects.car->isInitialized = true;
-	}
-	if (GameObjects.police == NULL) {
-		GameObjects.police = new Object(7);
-		GameObjects.police->isInitialized = true;
-	}
-	if (GameObjects.cadillac == NULL) {
-		GameObjects.cadillac = new Object(8);
-		GameObjects.cadillac->isInitialized = true;
-	}
-	if (GameObjects.tree1 == NULL) {
-		GameObjects.tree1 = new Object(9);
-		GameObjects.tree1->isInitialized = true;
-	}
-	if (GameObjects.tree2 == NULL) {
-		GameObjects.tree2 = new Object(10);
-		GameObjects.tree2->isInitialized = true;
-	}
 	if (GameObjects.gameOver == NULL) {
 		GameObjects.gameOver = new Object(11);
 		GameObjects.gameOver->isInitialized = true;
@@ -177,72 +173,52 @@ void reinisialiseObjects() {
 	GameObjects.player->startTime = GameState.elapsedTime;
 	GameObjects.player->currentTime = GameObjects.player->startTime;
 
-	// Reinitialization Cube
-	GameObjects.cube->position = glm::vec3(-0.5f, 0.48f, MIN_HEIGHT -0.2f);
-	GameObjects.cube->direction = glm::vec3(0.0f, 0.0f, 0.0f);
-	GameObjects.cube->speed = 0.0f;
-	GameObjects.cube->size = CUBE_SIZE;
-	GameObjects.cube->destroyed = false;
-	GameObjects.cube->startTime = GameState.elapsedTime;
-	GameObjects.cube->currentTime = GameObjects.cube->startTime;
-
-	// Reinitialization Foxbat object
-	GameObjects.foxbat->position = glm::vec3(0.1f, 0.3f, 0.0f);
-	GameObjects.foxbat->initPosition = GameObjects.foxbat->position;
-	GameObjects.foxbat->direction = glm::vec3(0.8f, 0.5f, 0.0f);
-	GameObjects.foxbat->speed = 0.4f;
-	GameObjects.foxbat->size = AIRCRAFT_SIZE;
-	GameObjects.foxbat->destroyed = false;
-	GameObjects.foxbat->isMoving = true;
-
-	// Reinitialization Zepplin object
-	GameObjects.zepplin->position = glm::vec3(0.3f, -0.4f, 0.0f);
-	GameObjects.zepplin->initPosition = GameObjects.zepplin->position;
-	GameObjects.zepplin->direction = glm::vec3(0.8f, -0.5f, 0.0f);
-	GameObjects.zepplin->speed = 0.4f;
-	GameObjects.zepplin->size = AIRCRAFT_SIZE;
-	GameObjects.zepplin->destroyed = false;
-	GameObjects.zepplin->isMoving = false;
-
-	// Reinitialization Car object
-	GameObjects.car->position = glm::vec3(0.8f, 0.15f, MIN_HEIGHT-CAR_SIZE);
-	GameObjects.car->direction = glm::vec3(0.1f, 0.1f, 0.0f);
-	GameObjects.car->speed = 0.0f;
-	GameObjects.car->size = CAR_SIZE;
-	GameObjects.car->destroyed = false;
-
-	// Reinitialization Police object
-	GameObjects.police->position = glm::vec3(0.5f, 0.2f, MIN_HEIGHT - CAR_SIZE);
-	GameObjects.police->direction = glm::vec3(0.0f, 0.1f, 0.0f);
-	GameObjects.police->speed = 0.0f;
-	GameObjects.police->size = CAR_SIZE;
-	GameObjects.police->destroyed = false;
-
-	// Reinitialization Cadillac object
-	GameObjects.cadillac->position = glm::vec3(0.85f, -0.2f, MIN_HEIGHT - CAR_SIZE);
-	GameObjects.cadillac->direction = glm::vec3(0.0f, -0.1f, 0.0f);
-	GameObjects.cadillac->speed = 0.0f;
-	GameObjects.cadillac->size = CAR_SIZE;
-	GameObjects.cadillac->destroyed = false;
-
-
-	// Reinitialization Tree1 object
-	GameObjects.tree1->position = glm::vec3(-0.7f, -0.6f, MIN_HEIGHT);
-	GameObjects.tree1->direction = glm::vec3(0.1f, 0.1f, 0.0f);
-	GameObjects.tree1->speed = 0.0f;
-	GameObjects.tree1->size = TREE_SIZE;
-	GameObjects.tree1->destroyed = false;
-
-	// Reinitialization Tree2 object
-	GameObjects.tree2->position = glm::vec3(0.6f, 0.3f, MIN_HEIGHT);
-	GameObjects.tree2->direction = glm::vec3(0.1f, 0.1f, 0.0f);
-	GameObjects.tree2->speed = 0.0f;
-	GameObjects.tree2->size = TREE_SIZE;
-	GameObjects.tree2->destroyed = false;
-
 	// Setting up the terrain with position (0,0,MIN_HEIGHT) (xyz)
 	GameObjects.terrain->position = glm::vec3(0.0f, 0.0f, MIN_HEIGHT);
 	GameObjects.terrain->size = TERRAIN_SIZE;
+	placeHeightfield(terrainHeightfield, GameObjects.terrain->position, GameObjects.terrain->size);
+
+	// scene entities (every restart creates them again)
+	clearEntities(entities);
+
+	// Cube (the game is over if the player runs into it)
+	createEntity(entities, ENTITY_MESH_CUBE, ENTITY_SPIN | ENTITY_LETHAL, glm::vec3(-0.5f, 0.48f, MIN_HEIGHT - 0.2f),
+		glm::vec3(0.0f, 0.0f, 0.0f), CUBE_SIZE, GameState.elapsedTime);
+
+	// Foxbat (airplane flying along the curve)
+	GameObjects.foxbat = createEntity(entities, ENTITY_MESH_FOXBAT, ENTITY_FOLLOW_CURVE | ENTITY_COLLIDE, glm::vec3(0.1f, 0.3f, 0.0f),
+		glm::vec3(0.8f, 0.5f, 0.0f), AIRCRAFT_SIZE, GameState.elapsedTime);
+	entities.speed[entitySlot(entities, GameObjects.foxbat)] = 0.4f;
+
+	// Zepplin
+	createEntity(entities, ENTITY_MESH_ZEPPLIN, ENTITY_COLLIDE, glm::vec3(0.3f, -0.4f, 0.0f),
+		glm::vec3(0.8f, -0.5f, 0.0f), AIRCRAFT_SIZE, GameState.elapsedTime);
+
+	// Cars (explode when clicked, block the player)
+	GameObjects.car = createGroundedEntity(ENTITY_MESH_CAR, ENTITY_PICKABLE | ENTITY_SOLID, 0.8f, 0.15f, -CAR_SIZE,
+		glm::vec3(0.1f, 0.1f, 0.0f), CAR_SIZE);
+
+	createGroundedEntity(ENTITY_MESH_POLICE, ENTITY_PICKABLE | ENTITY_SOLID, 0.5f, 0.2f, -CAR_SIZE,
+		glm::vec3(0.0f, 0.1f, 0.0f), CAR_SIZE);
+
+	createGroundedEntity(ENTITY_MESH_CADILLAC, ENTITY_PICKABLE | ENTITY_SOLID, 0.85f, -0.2f, -CAR_SIZE,
+		glm::vec3(0.0f, -0.1f, 0.0f), CAR_SIZE);
+
+	// Trees (block the player)
+	createGroundedEntity(ENTITY_MESH_TREE1, ENTITY_SOLID, -0.7f, -0.6f, 0.0f,
+		glm::vec3(0.1f, 0.1f, 0.0f), TREE_SIZE);
+
+	createGroundedEntity(ENTITY_MESH_TREE2, ENTITY_SOLID, 0.6f, 0.3f, 0.0f,
+		glm::vec3(0.1f, 0.1f, 0.0f), TREE_SIZE);
+
+	// Crowd of parked cars of the level of detail stress scene (--stress-models)
+	for (unsigned int i = 0; i < modelStressCount; i++) {
+		static const EntityMesh carMeshes[] = { ENTITY_MESH_CAR, ENTITY_MESH_POLICE, ENTITY_MESH_CADILLAC };
+		const float x = (2.0f * rand() / (float)RAND_MAX - 1.0f) * (SCENE_WIDTH - CAR_SIZE);
+		const float y = (2.0f * rand() / (float)RAND_MAX - 1.0f) * (SCENE_HEIGHT - CAR_SIZE);
+		const float angle = glm::radians(360.0f * rand() / (float)RAND_MAX);
+		createGroundedEntity(carMeshes[i % 3], 0, x, y, -CAR_SIZE, glm::vec3(cos(angle), sin(angle), 0.0f), CAR_SIZE);
+	}
 
 	// Banner 
 	GameObjects.gameOver->position = glm::vec3(0.0f);
@@ -272,95 +248,86 @@ void cleanUpObjects() {
 	// delete all non essential objects (i.e not the player and the terrain)
 	// TODO : Delete objects when we have impl
 
-	// delete explosions
-	std::list<void*>::iterator it = GameObjects.explosions.begin();
-	while (it != GameObjects.explosions.end()) {
-		ExplosionObject* explosion = (ExplosionObject*)(*it);
-		delete explosion;
-		it = GameObjects.explosions.erase(it);
-	}
-	// delete foxbat
-	if (GameObjects.foxbat != NULL) {
-		delete GameObjects.foxbat;
-		GameObjects.foxbat = NULL;
-	}
-	// delete cube
-	if (GameObjects.cube != NULL) {
-		delete GameObjects.cube;
-		GameObjects.cube = NULL;
-	}
-	// delete car
-	if (GameObjects.car != NULL) {
-		delete GameObjects.car;
-		GameObjects.car = NULL;
-	}
-	// delete tree1
-	if (GameObjects.tree1 != NULL) {
-		delete GameObjects.tree1;
-		GameObjects.tree1 = NULL;
-	}
-	// delete tree2
-	if (GameObjects.tree2 != NULL) {
-		delete GameObjects.tree2;
-		GameObjects.tree2 = NULL;
-	}
+	// delete the scene entities and the explosions
+	clearEntities(entities);
+	clearParticles(explosionParticles);
+	GameObjects.foxbat = ENTITY_NONE;
+	GameObjects.car = ENTITY_NONE;
 }
 
 // -----------------------  Colision Detection ---------------------------------
 
 /**
- * \brief Check if the object is out of bounds.
- * \param position Position of the object.
- * \param objectSize Size of the object.
- * \return Clamped position of the object.
+ * \brief Narrow phase of a broad phase hit : player sphere against the triangles of the model, or against the entity sphere.
+ * \param push [out] when set, translation moving the player out of the entity
  */
-bool detectColision(const glm::vec3& center1, float radius1, const glm::vec3& center2, float radius2) {
-	// Using sphere colision detection
-	float distance = glm::distance(center1, center2);
-	return distance < (radius1 + radius2) * 0.7;
-}
-
-void checkCollisions() {
-	// check colision between player and foxbat
-	if (!GameObjects.foxbat->destroyed && detectColision(GameObjects.player->position, GameObjects.player->size, GameObjects.foxbat->position, GameObjects.foxbat->size)) {
-		// add explosion
-		addExplosion(GameObjects.foxbat->position);
-		// destroy foxbat
-		GameObjects.foxbat->destroyed = true;
+static bool playerTouchesEntity(unsigned int slot, glm::vec3* push) {
+	const glm::vec3& center = GameObjects.player->position;
+	const float radius = GameObjects.player->size;
+
+	const MeshBVH* bvh = entityBVH(entities.mesh[slot]);
+	if (bvh == NULL) {
+		const float reach = (radius + entities.size[slot]) * COLLISION_RADIUS_SCALE;
+		const glm::vec3 delta = center - entities.position[slot];
+		const float distance = glm::length(delta);
+		if (distance >= reach)
+			return false;
+		if (push != NULL)
+			*push = distance > 1e-6f ? delta * ((reach - distance) / distance) : glm::vec3(0.0f);
+		return true;
 	}
 
-	// check colision between player and tree1
-	if (!GameObjects.tree1->destroyed && detectColision(GameObjects.player->position, GameObjects.player->size, GameObjects.tree1->position, GameObjects.tree1->size)) {
-		// add explosion
-		addExplosion(GameObjects.tree1->position);
-		// destroy tree1
-		GameObjects.tree1->destroyed = true;
-	}
-
-	// check colision between player and tree2
-	if (!GameObjects.tree2->destroyed && detectColision(GameObjects.player->position, GameObjects.player->size, GameObjects.tree2->position, GameObjects.tree2->size)) {
-		// add explosion
-		addExplosion(GameObjects.tree2->position);
-		// destroy tree2
-		GameObjects.tree2->destroyed = true;
-	}
-
-	// check colision between player and zepplin
-	if (!GameObjects.player->destroyed && detectColision(GameObjects.player->position, GameObjects.player->size, GameObjects.zepplin->position, GameObjects.zepplin->size)) {
-		// add explosion
-		addExplosion(GameObjects.zepplin->position);
-		// destroy player
-		GameObjects.zepplin->destroyed = true;
+	// the sphere is moved into model space, the models are scaled uniformly
+	const glm::mat4 modelMatrix = modelEntityMatrix(entities.position[slot], entities.direction[slot], entities.size[slot]);
+	const glm::vec3 modelCenter = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(center, 1.0f));
+	const float modelRadius = radius / entities.size[slot];
+
+	SphereContact contact;
+	if (!intersectSphere(*bvh, modelCenter, modelRadius, push != NULL ? &contact : NULL))
+		return false;
+	if (push != NULL) {
+		const glm::vec3 away = modelCenter - contact.point;
+		const glm::vec3 modelPush = contact.distance > 1e-6f ? away * ((modelRadius - contact.distance) / contact.distance) : glm::vec3(0.0f);
+		*push = glm::vec3(modelMatrix * glm::vec4(modelPush, 0.0f));
 	}
+	return true;
+}
 
-	// check colision between player and cube (if the player hits the cube the game is over)
-	if (!GameObjects.player->destroyed && detectColision(GameObjects.player->position, GameObjects.player->size, GameObjects.cube->position, GameObjects.cube->size)) {
-		// add explosion
-		addExplosion(GameObjects.player->position);
-		// destroy player
-		GameObjects.player->destroyed = true;
+void checkCollisions() {
+	// broad phase over the collidable entities, rebuilt every step because the entities move
+	static SpatialHash collisionHash;
+	static std::vector<unsigned int> hits;
+	buildSpatialHash(collisionHash, entities, ENTITY_COLLIDE | ENTITY_LETHAL | ENTITY_SOLID);
+
+	// entities whose model may touch the player : the query radius is grown so that the broad phase sphere
+	// of every candidate covers the farthest triangle of its model
+	const float meshReach = maxMeshBoundingRadius() * collisionHash.maxRadius;
+	const float queryRadius = std::max(GameObjects.player->size, (GameObjects.player->size + meshReach) / COLLISION_RADIUS_SCALE);
+	querySpatialHash(collisionHash, GameObjects.player->position, queryRadius, hits);
+
+	for (size_t i = 0; i < hits.size(); i++) {
+		const unsigned int slot = hits[i];
+		if (entities.flags[slot] & ENTITY_SOLID) {
+			// the player slides along the model instead of going through it
+			glm::vec3 push;
+			if (playerTouchesEntity(slot, &push))
+				GameObjects.player->position += push;
+			continue;
+		}
+		if (!playerTouchesEntity(slot, NULL))
+			continue;
+		if (entities.flags[slot] & ENTITY_LETHAL) {
+			// if the player hits the cube the game is over
+			if (!GameObjects.player->destroyed) {
+				addExplosion(GameObjects.player->position);
+				GameObjects.player->destroyed = true;
+			}
+		}
+		else {
+			addExplosion(entities.position[slot]);
+			entities.flags[slot] |= ENTITY_DESTROYED;
+		}
 	}
-
 }
 
 
@@ -438,15 +405,34 @@ void drawScene() {
 
 	CHECK_GL_ERROR();
 
-	glUseProgram(commonShaderProgram.program);
-	glUniform1f(commonShaderProgram.locations.time, GameState.elapsedTime);
-	glUniform1i(commonShaderProgram.locations.fogOn, GameState.fogOn);
-	glUniform1i(commonShaderProgram.locations.turnSunOn, GameState.turnSunOn);
-	glUniform1i(commonShaderProgram.locations.useSpotLight, GameState.useSpotLight);
-	glUniform1i(commonShaderProgram.locations.usePointLight, GameState.usePointLight);
-	glUniform3fv(commonShaderProgram.locations.spotLightPosition, 1, glm::value_ptr(GameObjects.player->position));
-	glUniform3fv(commonShaderProgram.locations.spotLightDirection, 1, glm::value_ptr(spotlightDirection));
-	glUseProgram(0);
+	// per frame uniforms of the lighting shader, uploaded once for every draw
+	FrameData frameData;
+	frameData.viewMatrix = viewMatrix;
+	frameData.projectionMatrix = projectionMatrix;
+	setPickingCamera(viewMatrix, projectionMatrix);
+	setLodCamera(viewMatrix, projectionMatrix, GameState.windowHeight);
+	frameData.sunAmbient = glm::vec4(0.2f, 0.2f, 0.2f, 0.0f);
+	frameData.sunDiffuse = glm::vec4(0.8f, 0.8f, 0.8f, 0.0f);
+	frameData.sunSpecular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	frameData.time = GameState.elapsedTime;
+	setFrameLights(frameData, GameObjects.player->position, spotlightDirection);
+	frameData.fogOn = GameState.fogOn;
+	frameData.turnSunOn = GameState.turnSunOn;
+	frameData.useSpotLight = GameState.useSpotLight;
+	frameData.usePointLight = GameState.usePointLight;
+
+	// dynamic lights binned into the clusters of this camera, the street lamps are lit at night
+	collectSceneLights(GameState.elapsedTime, !GameState.turnSunOn || std::sin(GameState.elapsedTime * SUN_SPEED) < 0.0f);
+	buildLightClusters(viewMatrix, projectionMatrix, GameState.windowWidth, GameState.windowHeight, frameData);
+	updateFrameData(frameData);
+
+	// the lighting program of every draw is specialized for the toggles of the frame (shaderPermutations.h)
+	lightingFeatures = (GameState.fogOn ? LIGHTING_FOG : 0) | (GameState.turnSunOn ? LIGHTING_SUN : 0)
+		| (GameState.useSpotLight ? LIGHTING_SPOT_LIGHT : 0) | (GameState.usePointLight ? LIGHTING_POINT_LIGHT : 0)
+		| (frameData.dynamicLightCount > 0 ? LIGHTING_DYNAMIC_LIGHTS : 0);
+
+	// objects outside of this frustum are skipped before any draw is queued
+	extractFrustum(projectionMatrix * viewMatrix, viewFrustum);
 
 	// draw the scene objects
 	drawObjects(GameObjects, viewMatrix, projectionMatrix);
@@ -493,76 +479,31 @@ void updateObjects(float elapsedTime) {
 	GameObjects.player->position += GameObjects.player->direction * GameObjects.player->speed * 0.015f;
 	// We clamp the player position to the scene size 
 	// Not using the checkBounds() because we don't want to teleport the player to the other side of the scene
-	GameObjects.player->position = glm::clamp(
-		GameObjects.player->position, 
-		glm::vec3(-SCENE_WIDTH + GameObjects.player->size, -SCENE_HEIGHT + GameObjects.player->size, MIN_HEIGHT), 
-		glm::vec3(SCENE_WIDTH - GameObjects.player->size, SCENE_HEIGHT - GameObjects.player->size, MAX_HEIGHT)
-	);
-
-	// Update Foxbat (airplane)
-	if (GameObjects.foxbat->isMoving) {
-		GameObjects.foxbat->currentTime = elapsedTime;
-		float curveParamT = GameObjects.foxbat->speed * (GameObjects.foxbat->currentTime - GameObjects.foxbat->startTime);
-		glm::vec3 closedCurve = evaluateClosedCurve(curveData, curveSize, curveParamT);
-		GameObjects.foxbat->position = GameObjects.foxbat->initPosition + closedCurve;
-		GameObjects.foxbat->position = checkBounds(GameObjects.foxbat->position, GameObjects.foxbat->size);
-		GameObjects.foxbat->direction = glm::normalize(evaluateClosedCurve_1stDerivative(curveData, curveSize, curveParamT));
-	}
-
-	// Update Cube rotation
-	GameObjects.cube->currentTime = elapsedTime;
-	GameObjects.cube->direction = glm::vec3(
-		std::cos(GameObjects.cube->currentTime),
-		std::sin(GameObjects.cube->currentTime),
-		0.0f
-	);
-	// make the cube move up and down
-	GameObjects.cube->position.z = (-MIN_HEIGHT - 0.08f) + 0.1f * std::sin(GameObjects.cube->currentTime);
-
-	// Update Explosion frame (ietrate through the list of frames)
-	std::list<void*>::iterator it = GameObjects.explosions.begin();
-	while (it != GameObjects.explosions.end()) {
-		ExplosionObject* explosion = (ExplosionObject*)(*it);
-
-		// update explosion
-		explosion->currentTime = elapsedTime;
-
-		if (explosion->currentTime > explosion->startTime + explosion->textureFrames * explosion->frameDuration) {
-			explosion->destroyed = true;
-		}
-		if (explosion->destroyed == true) {
-			it = GameObjects.explosions.erase(it);
-		}
-		else {
-			++it;
-		}
-	}
+	glm::vec3& playerPosition = GameObjects.player->position;
+	playerPosition.x = glm::clamp(playerPosition.x, -SCENE_WIDTH + GameObjects.player->size, SCENE_WIDTH - GameObjects.player->size);
+	playerPosition.y = glm::clamp(playerPosition.y, -SCENE_HEIGHT + GameObjects.player->size, SCENE_HEIGHT - GameObjects.player->size);
+	// the player stays above the terrain under it
+	const float ground = std::min(terrainHeight(terrainHeightfield, playerPosition.x, playerPosition.y), MAX_HEIGHT);
+	playerPosition.z = glm::clamp(playerPosition.z, ground, MAX_HEIGHT);
+
+	// Update the scene entities (airplane, cube) and put the grounded ones back on the terrain
+	updateEntities(entities, elapsedTime);
+	groundEntities(entities, terrainHeightfield);
+
+	// Remove the finished explosions
+	updateParticles(explosionParticles, elapsedTime);
+	if (particleStressCount > 0)
+		scatterParticles(explosionParticles, particleStressCount, EXPLOSION_SIZE, elapsedTime, EXPLOSION_TEXTURE_FRAMES * EXPLOSION_FRAME_DURATION);
 
 }
 
 /*
-* \brief Add a new explosion in the GameObjects.explosions list
+* \brief Add a new explosion in the explosion pool
 * \param glm::vec3 position
 */
 void addExplosion(const glm::vec3& position) {
 
-	ExplosionObject* newExplosion = new ExplosionObject();
-
-	newExplosion->speed = 0.0f;
-	newExplosion->destroyed = false;
-
-	newExplosion->startTime = GameState.elapsedTime;
-	newExplosion->currentTime = newExplosion->startTime;
-
-	newExplosion->size = 0.1f;
-	newExplosion->direction = glm::vec3(0.0f, 0.0f, 1.0f);
-
-	newExplosion->frameDuration = 0.1f;
-	newExplosion->textureFrames = 16;
-
-	newExplosion->position = position;
-
-	GameObjects.explosions.push_back(newExplosion);
+	spawnParticle(explosionParticles, position, EXPLOSION_SIZE, GameState.elapsedTime, EXPLOSION_TEXTURE_FRAMES * EXPLOSION_FRAME_DURATION);
 }
 
 // -----------------------  Window callbacks ---------------------------------
@@ -572,10 +513,23 @@ void addExplosion(const glm::vec3& position) {
  */
 void displayCb() {
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// draw the objects between the last two simulation steps, the simulated state is restored afterwards
+	SimulationSnapshot currentSnapshot;
+	captureSnapshot(currentSnapshot);
+	applySnapshot(interpolateSnapshots(previousSnapshot, currentSnapshot, frameLoop.interpolationAlpha));
 
 	// draw the window contents (scene objects)
+	beginRenderStatsFrame();
 	drawScene();
+	endRenderStatsFrame(GameState.elapsedTime);
+	// upload the texture levels the frame asked for, the GL thread never waits for them
+	updateTextureStreaming();
+	// swap in the programs relinked from the shader files edited since the last frame
+	updateShaderHotReload();
+
+	applySnapshot(currentSnapshot);
 
 	glutSwapBuffers();
 }
@@ -605,32 +559,22 @@ void mouseMotionCb(int mouseX, int mouseY) {
 void mouseCb(int buttonPressed, int buttonState, int mouseX, int mouseY) {
 	// do picking only on mouse down
 	if ((buttonPressed == GLUT_LEFT_BUTTON) && (buttonState == GLUT_DOWN)) {
-		unsigned int objectID = 0;
-		int y = GameState.windowHeight - mouseY - 1;
-		glReadPixels(mouseX, y, 1, 1, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, &objectID);
-		if (objectID != 0) {
-			std::cout << "Clicked on Object with id : " << objectID << std::endl;
-
-			if (objectID == GameObjects.car->id) {
-				addExplosion(GameObjects.car->position);
-				GameObjects.car->destroyed = true;
+		// the mouse ray is cast against the entities on the CPU, no read back of the frame
+		const PickingRay ray = screenRay(mouseX, mouseY, GameState.windowWidth, GameState.windowHeight);
+		float distance;
+		const unsigned int slot = pickEntity(entities, ray, distance);
+		if (slot != ENTITY_NONE) {
+			std::cout << "Clicked on entity " << entities.ids[slot] << " at distance " << distance << std::endl;
+
+			if (entities.flags[slot] & ENTITY_PICKABLE) {
+				addExplosion(entities.position[slot]);
+				entities.flags[slot] |= ENTITY_DESTROYED;
 				std::cout << "Car exploded" << std::endl;
-			} else if (objectID == GameObjects.police->id) {
-				addExplosion(GameObjects.police->position);
-				GameObjects.police->destroyed = true;
-				std::cout << "Police car exploded" << std::endl;
-			} else if (objectID == GameObjects.cadillac->id) {
-				addExplosion(GameObjects.cadillac->position);
-				GameObjects.cadillac->destroyed = true;
-				std::cout << "Cadillac car exploded" << std::endl;
 			}
 		}
 		else {
 			std::cout << "Clicked on the background" << std::endl;
 		}
-
-
-		
 	}
 }
 
@@ -700,14 +644,20 @@ void keyboardCb(unsigned char keyPressed, int mouseX, int mouseY) {
 			GameState.usePointLight ? printf("Point light On\n") : printf("Point light Off\n");
 			break;
 		case 'm':
-			GameObjects.foxbat->isMoving = !GameObjects.foxbat->isMoving;
-			GameObjects.foxbat->isMoving ? printf("Foxbat moving\n") : printf("Foxbat stopped\n");
+			if (entitySlot(entities, GameObjects.foxbat) != ENTITY_NONE) {
+				unsigned int& flags = entities.flags[entitySlot(entities, GameObjects.foxbat)];
+				flags ^= ENTITY_FOLLOW_CURVE;
+				(flags & ENTITY_FOLLOW_CURVE) ? printf("Foxbat moving\n") : printf("Foxbat stopped\n");
+			}
 			break;
 		case 'e':
-			if (!GameObjects.car->destroyed) {
-				addExplosion(GameObjects.car->position);
-				GameObjects.car->destroyed = true;
-				printf("Car destroyed\n");
+			if (entitySlot(entities, GameObjects.car) != ENTITY_NONE) {
+				const unsigned int slot = entitySlot(entities, GameObjects.car);
+				if (!(entities.flags[slot] & ENTITY_DESTROYED)) {
+					addExplosion(entities.position[slot]);
+					entities.flags[slot] |= ENTITY_DESTROYED;
+					printf("Car destroyed\n");
+				}
 			}
 			break;
 	default:
@@ -875,15 +825,58 @@ void movePlayerRight(float deltaAngle) {
 	GameObjects.player->direction = newVector;
 }
 
-// -----------------------  GLUT callbacks ---------------------------------
+// -----------------------  Simulation ---------------------------------
+
+void captureSnapshot(SimulationSnapshot& snapshot) {
+	snapshot.elapsedTime = GameState.elapsedTime;
+	snapshot.playerPosition = GameObjects.player->position;
+	snapshot.playerDirection = GameObjects.player->direction;
+	snapshot.playerViewAngle = GameObjects.player->viewAngle;
+}
+
+void applySnapshot(const SimulationSnapshot& snapshot) {
+	GameState.elapsedTime = snapshot.elapsedTime;
+	GameObjects.player->position = snapshot.playerPosition;
+	GameObjects.player->direction = snapshot.playerDirection;
+	GameObjects.player->viewAngle = snapshot.playerViewAngle;
+}
+
+static glm::vec3 interpolatePosition(const glm::vec3& from, const glm::vec3& to, float alpha) {
+	// jumps (wrap around the scene bounds, restart) are not interpolated
+	if (glm::length(to - from) > 0.5f * SCENE_WIDTH)
+		return to;
+	return glm::mix(from, to, alpha);
+}
+
+static glm::vec3 interpolateDirection(const glm::vec3& from, const glm::vec3& to, float alpha) {
+	const glm::vec3 direction = glm::mix(from, to, alpha);
+	const float length = glm::length(direction);
+	return length > 1e-4f ? direction / length : to;
+}
+
+SimulationSnapshot interpolateSnapshots(const SimulationSnapshot& previous, const SimulationSnapshot& current, float alpha) {
+	SimulationSnapshot snapshot;
+	snapshot.elapsedTime = glm::mix(previous.elapsedTime, current.elapsedTime, alpha);
+	snapshot.playerPosition = interpolatePosition(previous.playerPosition, current.playerPosition, alpha);
+	snapshot.playerDirection = interpolateDirection(previous.playerDirection, current.playerDirection, alpha);
+	// shortest way around the circle
+	float angleDelta = std::fmod(current.playerViewAngle - previous.playerViewAngle, 360.0f);
+	if (angleDelta > 180.0f)
+		angleDelta -= 360.0f;
+	else if (angleDelta < -180.0f)
+		angleDelta += 360.0f;
+	snapshot.playerViewAngle = previous.playerViewAngle + alpha * angleDelta;
+	return snapshot;
+}
 
 /**
- * \brief Timer callback.
- * \param timerId Identifier of the timer.
+ * \brief Advance the game by one fixed step of SIMULATION_STEP seconds (input, movements, collisions).
  */
+void simulationStep() {
+	const double stepStart = clockSeconds();
 
-void timerCb(int timerId) {
-	GameState.elapsedTime = 0.001f * (float)glutGet(GLUT_ELAPSED_TIME); // milliseconds => seconds
+	captureSnapshot(previousSnapshot);
+	GameState.elapsedTime = (float)(frameLoop.simulationTime + SIMULATION_STEP);
 
 	if (GameState.keyMap[KEY_UP_ARROW] == true)
 		movePlayerForward(PLAYER_SPEED_INCREMENT);
@@ -896,11 +889,25 @@ void timerCb(int timerId) {
 
 	if (GameState.keyMap[KEY_LEFT_ARROW] == true)
 		movePlayerLeft(PLAYER_VIEW_ANGLE_DELTA);
-	
+
 	// update objects in the scene
 	updateObjects(GameState.elapsedTime);
 
-	glutTimerFunc(1000 / 30, timerCb, 0); // redraw every 30 ms = frame rate of 33 FPS
+	recordTime(simulationStepHistogram, 1000.0 * (clockSeconds() - stepStart));
+}
+
+// -----------------------  GLUT callbacks ---------------------------------
+
+/**
+ * \brief Idle callback, one iteration of the frame loop : run the simulation steps due since the previous
+ *  frame and redraw. Rendering is not capped (vsync permitting), the simulation runs at SIMULATION_RATE.
+ */
+void idleCb() {
+	const unsigned int steps = beginFrameLoop();
+	for (unsigned int i = 0; i < steps; i++)
+		simulationStep();
+	endFrameLoop();
+
 	glutPostRedisplay();
 }
 
@@ -914,8 +921,262 @@ void reshapeCb(int newWidth, int newHeight) {
 	glViewport(0, 0, (GLsizei)newWidth, (GLsizei)newHeight);
 }
 
+// -----------------------  Benchmarks ---------------------------------
+
+/**
+ * \brief Render headlessOptions.frames frames offscreen along a scripted path, without the GLUT main loop.
+ *  The run is split in four equal parts, one per camera (top, fps, scene, spline), the simulated time advances
+ *  by one SIMULATION_STEP per frame and the player drives around a fixed circle so that every run renders the same frames.
+ */
+void runHeadless() {
+	static const char* cameraNames[] = { "top", "fps", "scene", "spline" };
+
+	if (!initHeadlessTarget())
+		return;
+
+	GameState.windowWidth = headlessOptions.width;
+	GameState.windowHeight = headlessOptions.height;
+
+	const unsigned int segmentFrames = std::max(1u, (headlessOptions.frames + 3) / 4);
+
+	for (unsigned int frame = 0; frame < headlessOptions.frames; frame++) {
+		const int camera = std::min(3u, frame / segmentFrames);
+		GameState.fpsCameraMode = (camera == 1);
+		GameState.sceneCamera = (camera == 2);
+		GameState.splineCamera = (camera == 3);
+
+		GameState.elapsedTime = (float)(frame * SIMULATION_STEP);
+
+		// scripted player path
+		const float angle = 0.02f * frame;
+		GameObjects.player->speed = 0.0f;
+		GameObjects.player->position = glm::vec3(0.5f * std::cos(angle), 0.5f * std::sin(angle), 0.0f);
+		GameObjects.player->direction = glm::vec3(-std::sin(angle), std::cos(angle), 0.0f);
+		GameObjects.player->viewAngle = glm::degrees(angle) + 90.0f;
+
+		updateObjects(GameState.elapsedTime);
+
+		beginHeadlessFrame(frame, cameraNames[camera]);
+		beginRenderStatsFrame();
+		drawScene();
+		endRenderStatsFrame(GameState.elapsedTime);
+		updateTextureStreaming();
+		endHeadlessFrame();
+	}
+
+	finishHeadlessRun();
+	cleanupHeadlessTarget();
+}
+
+/**
+ * \brief Render the same fps camera frame with every combination of the lighting toggles, first with the generic
+ *  program branching on the toggles for every fragment, then with the permutation specialized for the combination.
+ *  headlessOptions.frames is split evenly between the 32 runs, the summary gives the GPU time of each run.
+ */
+void runLightingSweep() {
+	static std::string runNames[2 * (LIGHTING_TOGGLES + 1)];
+
+	if (!initHeadlessTarget())
+		return;
+
+	GameState.windowWidth = headlessOptions.width;
+	GameState.windowHeight = headlessOptions.height;
+	GameState.fpsCameraMode = true;
+	GameState.sceneCamera = false;
+	GameState.splineCamera = false;
+	GameState.elapsedTime = 2.0f;
+	GameObjects.player->speed = 0.0f;
+	updateObjects(GameState.elapsedTime);
+
+	// every permutation is created before the timings
+	for (unsigned int features = 0; features < LIGHTING_PERMUTATIONS; features++) {
+		lightingProgram(features, false);
+		lightingProgram(features, true);
+	}
+
+	const unsigned int runFrames = std::max(1u, headlessOptions.frames / (2 * (LIGHTING_TOGGLES + 1)));
+	unsigned int frame = 0;
+	// the dynamic lights follow the scene, only the keyboard toggles are swept
+	for (unsigned int features = 0; features <= LIGHTING_TOGGLES; features++) {
+		GameState.fogOn = (features & LIGHTING_FOG) != 0;
+		GameState.turnSunOn = (features & LIGHTING_SUN) != 0;
+		GameState.useSpotLight = (features & LIGHTING_SPOT_LIGHT) != 0;
+		GameState.usePointLight = (features & LIGHTING_POINT_LIGHT) != 0;
+
+		for (int specialized = 0; specialized < 2; specialized++) {
+			useShaderPermutations = specialized != 0;
+			std::string& name = runNames[2 * features + specialized];
+			name = (specialized ? "specialized:" : "branching:") + lightingFeatureNames(features);
+
+			for (unsigned int i = 0; i < runFrames; i++, frame++) {
+				beginHeadlessFrame(frame, name.c_str());
+				beginRenderStatsFrame();
+				drawScene();
+				endRenderStatsFrame(GameState.elapsedTime);
+				updateTextureStreaming();
+				endHeadlessFrame();
+			}
+		}
+	}
+	useShaderPermutations = true;
+
+	finishHeadlessRun();
+	cleanupHeadlessTarget();
+}
+
+/**
+ * \brief Run the benchmark requested on the command line (if any).
+ * \return true if a benchmark was run and the application should exit.
+ */
+bool runCommandLineBenchmarks(int argc, char** argv) {
+	if (argc < 2)
+		return false;
+
+	const std::string option = argv[1];
+
+	if (option == "--bench-mesh-cache" || option == "--bench-vertex-cache" || option == "--bench-lod") {
+		std::vector<std::string> models;
+		models.push_back(TERRAIN_MODEL_NAME);
+		models.push_back(PLAYER_MODEL_NAME);
+		models.push_back(FOXBAT_MODEL_NAME);
+		models.push_back(CAR_MODEL_NAME);
+		models.push_back(POLICE_MODEL_NAME);
+		models.push_back(CADILLAC_MODEL_NAME);
+		models.push_back(ZEPPLIN_MODEL_NAME);
+		models.push_back(TREE1_MODEL_NAME);
+		models.push_back(TREE2_MODEL_NAME);
+		if (option == "--bench-mesh-cache")
+			benchmarkMeshCache(models);
+		else if (option == "--bench-vertex-cache")
+			benchmarkVertexCache(models);
+		else
+			benchmarkMeshLod(models);
+		return true;
+	}
+
+	if (option == "--bench-textures") {
+		std::vector<std::string> textures;
+		const char* models[] = { TERRAIN_MODEL_NAME, PLAYER_MODEL_NAME, FOXBAT_MODEL_NAME, CAR_MODEL_NAME, POLICE_MODEL_NAME,
+			CADILLAC_MODEL_NAME, ZEPPLIN_MODEL_NAME, TREE1_MODEL_NAME, TREE2_MODEL_NAME };
+		for (size_t m = 0; m < sizeof(models) / sizeof(models[0]); m++) {
+			ModelData model;
+			if (!loadModelData(models[m], model))
+				continue;
+			for (size_t i = 0; i < model.meshes.size(); i++) {
+				const std::string& textureName = model.meshes[i].textureName;
+				if (!textureName.empty() && std::find(textures.begin(), textures.end(), textureName) == textures.end())
+					textures.push_back(textureName);
+			}
+			releaseModelData(model);
+		}
+		textures.push_back(CUBE_TEXTURE_NAME);
+		textures.push_back(EXPLOSION_TEXTURE_NAME);
+		textures.push_back(GAMEOVER_BANNER_NAME);
+		textures.push_back(COMMANDS_BANNER_NAME);
+		const char* suffixes[] = { "posx", "negx", "posy", "negy", "posz", "negz" };
+		for (int i = 0; i < 6; i++)
+			textures.push_back(std::string(SKYBOX_PATH_NAME) + "/sh_" + suffixes[i] + ".jpg");
+		benchmarkTextureCache(textures);
+		return true;
+	}
+
+	if (option == "--bench-collisions") {
+		unsigned int count = COLLISION_BENCH_COUNT;
+		if (argc > 2 && isdigit((unsigned char)argv[2][0]))
+			count = (unsigned int)atoi(argv[2]);
+		benchmarkSpatialHash(count);
+		return true;
+	}
+
+	if (option == "--bench-terrain") {
+		benchmarkTerrainChunks();
+		return true;
+	}
+
+	if (option == "--bench-heightfield") {
+		unsigned int count = HEIGHTFIELD_BENCH_COUNT;
+		if (argc > 2 && isdigit((unsigned char)argv[2][0]))
+			count = (unsigned int)atoi(argv[2]);
+		benchmarkHeightfield(count);
+		return true;
+	}
+
+	if (option == "--bench-entities") {
+		unsigned int count = ENTITY_BENCH_COUNT;
+		if (argc > 2 && isdigit((unsigned char)argv[2][0]))
+			count = (unsigned int)atoi(argv[2]);
+		benchmarkEntityStore(count);
+		return true;
+	}
+
+	return false;
+}
+
 int main(int argc, char** argv) {
 
+	// benchmarks run without any window
+	if (runCommandLineBenchmarks(argc, argv))
+		return EXIT_SUCCESS;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--serial-load")
+			workerThreadCount = 0;
+		else if (std::string(argv[i]) == "--no-geometry-arena")
+			useGeometryArena = false;
+		else if (std::string(argv[i]) == "--render-stats")
+			printRenderStats = true;
+		else if (std::string(argv[i]) == "--frame-histograms")
+			printFrameHistograms = true;
+		else if (std::string(argv[i]) == "--no-culling")
+			useFrustumCulling = false;
+		else if (std::string(argv[i]) == "--no-terrain-lod")
+			useTerrainLod = false;
+		else if (std::string(argv[i]) == "--no-mesh-lod")
+			useMeshLod = false;
+		else if (std::string(argv[i]) == "--no-texture-compression")
+			useTextureCompression = false;
+		else if (std::string(argv[i]) == "--no-texture-streaming")
+			useTextureStreaming = false;
+		else if (std::string(argv[i]) == "--texture-stats")
+			printStreamingStats = true;
+		else if (std::string(argv[i]) == "--no-shader-cache")
+			useProgramBinaryCache = false;
+		else if (std::string(argv[i]) == "--shader-hot-reload")
+			useShaderHotReload = true;
+		else if (std::string(argv[i]) == "--no-shader-permutations")
+			useShaderPermutations = false;
+		else if (std::string(argv[i]) == "--texture-budget" && i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+			textureStreamingBudget = (size_t)atoi(argv[++i]) << 20;
+		else if (std::string(argv[i]) == "--stress-models") {
+			modelStressCount = MESH_LOD_STRESS_COUNT;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+				modelStressCount = (unsigned int)atoi(argv[++i]);
+		}
+		else if (std::string(argv[i]) == "--no-clustered-lights")
+			useClusteredLighting = false;
+		else if (std::string(argv[i]) == "--stress-lights") {
+			lightStressCount = LIGHT_STRESS_COUNT;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+				lightStressCount = (unsigned int)atoi(argv[++i]);
+		}
+		else if (std::string(argv[i]) == "--stress-trees") {
+			instanceStressCount = INSTANCE_STRESS_COUNT;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+				instanceStressCount = (unsigned int)atoi(argv[++i]);
+		}
+		else if (parseHeadlessOption(argc, argv, i))
+			continue;
+		else if (std::string(argv[i]) == "--stress-particles") {
+			particleStressCount = PARTICLE_STRESS_COUNT;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+				particleStressCount = (unsigned int)atoi(argv[++i]);
+		}
+		else if (std::string(argv[i]) == "--vertex-layout" && i + 1 < argc) {
+			if (!parseVertexLayout(argv[++i], vertexLayout))
+				std::cerr << "\033[31mUnknown vertex layout : " << argv[i] << " (separate, interleaved, packed, quantized)\033[0m" << std::endl;
+		}
+	}
+
 	// initialize the GLUT library (windowing system)
 	glutInit(&argc, argv);
 
@@ -930,6 +1191,9 @@ int main(int argc, char** argv) {
 		//   initial window size + title
 		glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
 		glutCreateWindow(WINDOW_TITLE);
+		// headless runs render into a framebuffer object, the window only provides the GL context
+		if (headlessOptions.enabled)
+			glutHideWindow();
 
 		// callbacks - use only those you need
 		glutDisplayFunc(displayCb);
@@ -940,7 +1204,7 @@ int main(int argc, char** argv) {
 		glutSpecialUpFunc(specialReleasedKeyboardUpCb); // key released
 		glutMouseFunc(mouseCb);
 		// glutMotionFunc(mouseMotionCb);
-		glutTimerFunc(1000 / 30, timerCb, 0); // redraw every 30 ms
+		glutIdleFunc(idleCb); // frame loop, see frameLoop.h
 
 	}
 	// end for each window 
@@ -980,6 +1244,15 @@ int main(int argc, char** argv) {
 	// init your stuff - shaders & program, buffers, locations, state of the application
 	initApplication();
 
+	if (headlessOptions.enabled) {
+		if (headlessOptions.lightingSweep)
+			runLightingSweep();
+		else
+			runHeadless();
+		finalizeApplication();
+		return EXIT_SUCCESS;
+	}
+
 	// handle window close by the user
 	glutCloseFunc(finalizeApplication);
 
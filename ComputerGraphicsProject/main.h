@@ -13,6 +13,11 @@
 #include "pgr.h"
 #include "renderer.h"
 #include "spline.h"
+#include "threadPool.h"
+#include "meshOptimizer.h"
+#include "headless.h"
+#include "frameLoop.h"
+#include "picking.h"
 
 constexpr int WINDOW_WIDTH = 750;
 constexpr int WINDOW_HEIGHT = 750;
@@ -48,7 +53,25 @@ void movePlayerBackward(float deltaSpeed);
 void movePlayerLeft(float deltaSpeed);
 void movePlayerRight(float deltaSpeed);
 
+// -----------------------  Simulation ---------------------------------
+
+/**
+ * \brief State of the player which is interpolated between two simulation steps for rendering
+ *  (the scene entities keep their previous state in the entity store).
+ */
+typedef struct _SimulationSnapshot {
+	float elapsedTime;
+	glm::vec3 playerPosition;
+	glm::vec3 playerDirection;
+	float playerViewAngle;
+} SimulationSnapshot;
+
+void captureSnapshot(SimulationSnapshot& snapshot);
+void applySnapshot(const SimulationSnapshot& snapshot);
+SimulationSnapshot interpolateSnapshots(const SimulationSnapshot& previous, const SimulationSnapshot& current, float alpha);
+void simulationStep();
+
 // -----------------------  GLUT callbacks ---------------------------------
-void timerCb(int timerId);
+void idleCb();
 
 #endif // __MAIN_H
\ No newline at end of file
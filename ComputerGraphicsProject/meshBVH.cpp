@@ -0,0 +1,357 @@
+/*
+* \file meshBVH.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Bounding volume hierarchy over the triangles of a model - sphere and ray queries for the collisions
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include "meshBVH.h"
+
+/**
+ * \brief Triangle during the build (bounds and centroid are computed once).
+ */
+typedef struct _BuildTriangle {
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 centroid;
+	unsigned int index;
+} BuildTriangle;
+
+typedef struct _Bin {
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	unsigned int count;
+} Bin;
+
+static float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	const glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+/**
+ * \brief Build the node at nodeIndex over triangles [first, first + count), splitting with the binned surface area heuristic.
+ * Nodes at BVH_MAX_DEPTH become leaves whatever their size, so the fixed traversal stacks never overflow.
+ */
+static void buildNode(MeshBVH& bvh, std::vector<BuildTriangle>& triangles, unsigned int nodeIndex, unsigned int first, unsigned int count,
+	unsigned int depth) {
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX);
+	glm::vec3 centroidMax(-FLT_MAX);
+	for (unsigned int i = first; i < first + count; i++) {
+		boundsMin = glm::min(boundsMin, triangles[i].boundsMin);
+		boundsMax = glm::max(boundsMax, triangles[i].boundsMax);
+		centroidMin = glm::min(centroidMin, triangles[i].centroid);
+		centroidMax = glm::max(centroidMax, triangles[i].centroid);
+	}
+	bvh.nodes[nodeIndex].boundsMin = boundsMin;
+	bvh.nodes[nodeIndex].boundsMax = boundsMax;
+
+	// best split of the centroids over every axis
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	const float parentArea = surfaceArea(boundsMin, boundsMax);
+	for (int axis = 0; axis < 3; axis++) {
+		const float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		Bin bins[BVH_SAH_BINS];
+		for (int b = 0; b < BVH_SAH_BINS; b++) {
+			bins[b].boundsMin = glm::vec3(FLT_MAX);
+			bins[b].boundsMax = glm::vec3(-FLT_MAX);
+			bins[b].count = 0;
+		}
+		const float scale = BVH_SAH_BINS / extent;
+		for (unsigned int i = first; i < first + count; i++) {
+			const int b = std::min(BVH_SAH_BINS - 1, (int)((triangles[i].centroid[axis] - centroidMin[axis]) * scale));
+			bins[b].boundsMin = glm::min(bins[b].boundsMin, triangles[i].boundsMin);
+			bins[b].boundsMax = glm::max(bins[b].boundsMax, triangles[i].boundsMax);
+			bins[b].count++;
+		}
+
+		// areas and counts left of every plane, then sweep from the right
+		float leftArea[BVH_SAH_BINS - 1];
+		unsigned int leftCount[BVH_SAH_BINS - 1];
+		glm::vec3 sweepMin(FLT_MAX);
+		glm::vec3 sweepMax(-FLT_MAX);
+		unsigned int sweepCount = 0;
+		for (int b = 0; b < BVH_SAH_BINS - 1; b++) {
+			sweepMin = glm::min(sweepMin, bins[b].boundsMin);
+			sweepMax = glm::max(sweepMax, bins[b].boundsMax);
+			sweepCount += bins[b].count;
+			leftArea[b] = surfaceArea(sweepMin, sweepMax);
+			leftCount[b] = sweepCount;
+		}
+		sweepMin = glm::vec3(FLT_MAX);
+		sweepMax = glm::vec3(-FLT_MAX);
+		sweepCount = 0;
+		for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+			sweepMin = glm::min(sweepMin, bins[b].boundsMin);
+			sweepMax = glm::max(sweepMax, bins[b].boundsMax);
+			sweepCount += bins[b].count;
+			if (sweepCount == 0 || leftCount[b - 1] == 0)
+				continue;
+			const float cost = leftArea[b - 1] * leftCount[b - 1] + surfaceArea(sweepMin, sweepMax) * sweepCount;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	// leaf when splitting does not pay off (traversal cost 1, intersection cost 1 per triangle)
+	const float leafCost = (float)count;
+	const float splitCost = 1.0f + (parentArea > 0.0f ? bestCost / parentArea : FLT_MAX);
+	if (bestAxis < 0 || depth >= BVH_MAX_DEPTH || (count <= BVH_MAX_LEAF_SIZE && splitCost >= leafCost)) {
+		bvh.nodes[nodeIndex].offset = first;
+		bvh.nodes[nodeIndex].count = count;
+		return;
+	}
+
+	const float scale = BVH_SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+	BuildTriangle* middle = std::partition(triangles.data() + first, triangles.data() + first + count,
+		[&](const BuildTriangle& triangle) {
+			return std::min(BVH_SAH_BINS - 1, (int)((triangle.centroid[bestAxis] - centroidMin[bestAxis]) * scale)) < bestSplit;
+		});
+	const unsigned int leftCount = (unsigned int)(middle - (triangles.data() + first));
+
+	// depth first layout, the left child follows its parent
+	const unsigned int left = (unsigned int)bvh.nodes.size();
+	bvh.nodes.push_back(BVHNode());
+	buildNode(bvh, triangles, left, first, leftCount, depth + 1);
+	const unsigned int right = (unsigned int)bvh.nodes.size();
+	bvh.nodes.push_back(BVHNode());
+	buildNode(bvh, triangles, right, first + leftCount, count - leftCount, depth + 1);
+
+	bvh.nodes[nodeIndex].offset = right;
+	bvh.nodes[nodeIndex].count = 0;
+}
+
+/**
+ * \brief Build the hierarchy over every triangle of the model (CPU only, runs on the asset loading threads).
+ */
+void buildMeshBVH(const ModelData& model, MeshBVH& bvh) {
+	std::vector<glm::vec3> vertices;
+	std::vector<unsigned int> indices;
+	for (size_t m = 0; m < model.meshes.size(); m++) {
+		const MeshData& mesh = model.meshes[m];
+		// positions are the first block of the non interleaved vertex data
+		const float* positions = mesh.vertices();
+		getMeshIndices(mesh, indices);
+		for (size_t i = 0; i < indices.size(); i++) {
+			const float* position = positions + 3 * (size_t)indices[i];
+			vertices.push_back(glm::vec3(position[0], position[1], position[2]));
+		}
+	}
+
+	const unsigned int triangleCount = (unsigned int)(vertices.size() / 3);
+	std::vector<BuildTriangle> triangles(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++) {
+		const glm::vec3& a = vertices[3 * t];
+		const glm::vec3& b = vertices[3 * t + 1];
+		const glm::vec3& c = vertices[3 * t + 2];
+		triangles[t].boundsMin = glm::min(a, glm::min(b, c));
+		triangles[t].boundsMax = glm::max(a, glm::max(b, c));
+		triangles[t].centroid = (a + b + c) / 3.0f;
+		triangles[t].index = t;
+	}
+
+	bvh.nodes.clear();
+	bvh.vertices.clear();
+	bvh.boundingRadius = 0.0f;
+	if (triangleCount == 0)
+		return;
+
+	bvh.nodes.reserve(2 * triangleCount);
+	bvh.nodes.push_back(BVHNode());
+	buildNode(bvh, triangles, 0, 0, triangleCount, 0);
+
+	// triangles in leaf order so that a leaf reads one contiguous block
+	bvh.vertices.resize(vertices.size());
+	for (unsigned int t = 0; t < triangleCount; t++) {
+		for (int v = 0; v < 3; v++)
+			bvh.vertices[3 * t + v] = vertices[3 * triangles[t].index + v];
+	}
+
+	const glm::vec3 farthest = glm::max(glm::abs(bvh.nodes[0].boundsMin), glm::abs(bvh.nodes[0].boundsMax));
+	bvh.boundingRadius = glm::length(farthest);
+}
+
+// -----------------------  Queries ---------------------------------
+
+/**
+ * \brief Closest point of the triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5).
+ */
+static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+	const glm::vec3 ab = b - a;
+	const glm::vec3 ac = c - a;
+	const glm::vec3 ap = p - a;
+	const float d1 = glm::dot(ab, ap);
+	const float d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return a;
+
+	const glm::vec3 bp = p - b;
+	const float d3 = glm::dot(ab, bp);
+	const float d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return b;
+
+	const float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+
+	const glm::vec3 cp = p - c;
+	const float d5 = glm::dot(ab, cp);
+	const float d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return c;
+
+	const float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+
+	const float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	const float denominator = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+static inline float boxDistanceSquared(const BVHNode& node, const glm::vec3& point) {
+	const glm::vec3 delta = glm::max(glm::max(node.boundsMin - point, point - node.boundsMax), glm::vec3(0.0f));
+	return glm::dot(delta, delta);
+}
+
+/**
+ * \brief Does the sphere touch the mesh ?
+ * \param contact [out] closest point of the mesh to the center (optional, the whole overlap is searched when set)
+ */
+bool intersectSphere(const MeshBVH& bvh, const glm::vec3& center, float radius, SphereContact* contact) {
+	if (bvh.nodes.empty())
+		return false;
+
+	float closestSquared = radius * radius;
+	bool hit = false;
+	unsigned int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const BVHNode& node = bvh.nodes[stack[--stackSize]];
+		if (boxDistanceSquared(node, center) > closestSquared)
+			continue;
+
+		if (node.count > 0) {
+			for (unsigned int t = node.offset; t < node.offset + node.count; t++) {
+				const glm::vec3 point = closestPointOnTriangle(center, bvh.vertices[3 * t], bvh.vertices[3 * t + 1], bvh.vertices[3 * t + 2]);
+				const glm::vec3 delta = point - center;
+				const float distanceSquared = glm::dot(delta, delta);
+				if (distanceSquared <= closestSquared) {
+					hit = true;
+					if (contact == NULL)
+						return true;
+					closestSquared = distanceSquared;
+					contact->point = point;
+					contact->distance = std::sqrt(distanceSquared);
+				}
+			}
+		}
+		else {
+			// at most one pending sibling per level above, the depth is capped at BVH_MAX_DEPTH
+			const unsigned int left = (unsigned int)(&node - bvh.nodes.data()) + 1;
+			stack[stackSize++] = node.offset;
+			stack[stackSize++] = left;
+		}
+	}
+	return hit;
+}
+
+/**
+ * \brief Slab test, returns the entry distance along the ray or FLT_MAX when the box is missed.
+ */
+static inline float rayBoxDistance(const BVHNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) {
+	const glm::vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+	const glm::vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+/**
+ * \brief Closest intersection of the ray with the mesh (Moller-Trumbore, both faces).
+ * \param distance [out] distance along the (normalized) direction to the hit
+ */
+bool intersectRay(const MeshBVH& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) {
+	if (bvh.nodes.empty())
+		return false;
+
+	const glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	float closest = maxDistance;
+	bool hit = false;
+
+	unsigned int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	if (rayBoxDistance(bvh.nodes[0], origin, inverseDirection, closest) == FLT_MAX)
+		return false;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const unsigned int nodeIndex = stack[--stackSize];
+		const BVHNode& node = bvh.nodes[nodeIndex];
+
+		if (node.count > 0) {
+			for (unsigned int t = node.offset; t < node.offset + node.count; t++) {
+				const glm::vec3& a = bvh.vertices[3 * t];
+				const glm::vec3 edge1 = bvh.vertices[3 * t + 1] - a;
+				const glm::vec3 edge2 = bvh.vertices[3 * t + 2] - a;
+				const glm::vec3 p = glm::cross(direction, edge2);
+				const float determinant = glm::dot(edge1, p);
+				if (std::fabs(determinant) < 1e-12f)
+					continue;
+				const float inverseDeterminant = 1.0f / determinant;
+				const glm::vec3 s = origin - a;
+				const float u = glm::dot(s, p) * inverseDeterminant;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				const glm::vec3 q = glm::cross(s, edge1);
+				const float v = glm::dot(direction, q) * inverseDeterminant;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				const float hitDistance = glm::dot(edge2, q) * inverseDeterminant;
+				if (hitDistance >= 0.0f && hitDistance < closest) {
+					closest = hitDistance;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// visit the nearer child first, the farther one is skipped if a closer hit was found meanwhile
+		unsigned int nearChild = nodeIndex + 1;
+		unsigned int farChild = node.offset;
+		float nearDistance = rayBoxDistance(bvh.nodes[nearChild], origin, inverseDirection, closest);
+		float farDistance = rayBoxDistance(bvh.nodes[farChild], origin, inverseDirection, closest);
+		if (farDistance < nearDistance) {
+			std::swap(nearChild, farChild);
+			std::swap(nearDistance, farDistance);
+		}
+		if (farDistance != FLT_MAX)
+			stack[stackSize++] = farChild;
+		if (nearDistance != FLT_MAX)
+			stack[stackSize++] = nearChild;
+	}
+
+	if (hit)
+		distance = closest;
+	return hit;
+}
@@ -0,0 +1,59 @@
+/*
+* \file meshBVH.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Bounding volume hierarchy over the triangles of a model - sphere and ray queries for the collisions
+*/
+
+#pragma once
+
+#ifndef __MESH_BVH_H
+#define __MESH_BVH_H
+
+#include <vector>
+#include "pgr.h"
+#include "meshCache.h"
+
+#define BVH_SAH_BINS 12			// candidate split planes per axis
+#define BVH_MAX_LEAF_SIZE 8		// a node with more triangles is always split
+#define BVH_STACK_SIZE 64
+#define BVH_MAX_DEPTH (BVH_STACK_SIZE - 1)	// deeper nodes are leaves, a traversal needs at most depth + 1 stack entries
+
+/**
+ * \brief Node of the flattened hierarchy (32 B, two per cache line). The nodes are stored depth first:
+ *  the left child of an inner node directly follows it, offset is the index of its right child.
+ */
+typedef struct _BVHNode {
+	glm::vec3    boundsMin;
+	unsigned int offset;		///< right child (inner node) or first triangle (leaf)
+	glm::vec3    boundsMax;
+	unsigned int count;			///< triangles of the leaf, 0 for inner nodes
+} BVHNode;
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode must stay 32 bytes");
+
+/**
+ * \brief Hierarchy of one model, all sub-meshes merged, in model space.
+ */
+typedef struct _MeshBVH {
+	std::vector<BVHNode> nodes;
+	std::vector<glm::vec3> vertices;	///< 3 vertices per triangle, in the order of the leaves
+	float boundingRadius;				///< distance from the model origin to the farthest corner of the root box
+
+	_MeshBVH() : boundingRadius(0.0f) {}
+} MeshBVH;
+
+/**
+ * \brief Point of a mesh closest to a sphere center.
+ */
+typedef struct _SphereContact {
+	glm::vec3 point;
+	float distance;
+} SphereContact;
+
+void buildMeshBVH(const ModelData& model, MeshBVH& bvh);
+
+bool intersectSphere(const MeshBVH& bvh, const glm::vec3& center, float radius, SphereContact* contact);
+bool intersectRay(const MeshBVH& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance);
+
+#endif // __MESH_BVH_H
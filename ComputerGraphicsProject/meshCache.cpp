@@ -0,0 +1,690 @@
+/*
+* \file meshCache.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Binary mesh cache - CPU side model import and versioned cache files written next to each model
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "meshCache.h"
+#include "meshOptimizer.h"
+#include "meshLod.h"
+
+#define MESH_CACHE_PATH_LENGTH 256
+#define MESH_CACHE_ALIGNMENT 16
+
+/**
+ * \brief Header at the beginning of every cache file.
+ */
+typedef struct _MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceSize;			///< size of the source model file
+	int64_t  sourceModifiedTime;	///< last modification time of the source model file
+	uint64_t sourceHash;			///< FNV-1a hash of the source model file
+	uint32_t numMeshes;
+	uint32_t reserved;
+} MeshCacheHeader;
+
+/**
+ * \brief One record per sub-mesh, follows the header. Offsets are relative to the start of the file.
+ */
+typedef struct _MeshCacheRecord {
+	uint32_t numVertices;
+	uint32_t numTriangles;
+	float    ambient[3];
+	float    diffuse[3];
+	float    specular[3];
+	float    shininess;
+	uint32_t indexSize;				///< bytes per index (2 or 4)
+	uint32_t numLods;				///< levels of detail, their triangles follow each other in the index blob
+	uint32_t lodTriangles[MESH_LOD_LEVELS];
+	float    lodErrors[MESH_LOD_LEVELS];
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	char     textureName[MESH_CACHE_PATH_LENGTH];
+} MeshCacheRecord;
+
+static_assert(sizeof(MeshCacheHeader) == 40, "MeshCacheHeader layout changed, bump MESH_CACHE_VERSION");
+static_assert(sizeof(MeshCacheRecord) == 360, "MeshCacheRecord layout changed, bump MESH_CACHE_VERSION");
+
+// -----------------------  Source file identification ---------------------------------
+
+/**
+ * \brief Get size and modification time of a file.
+ * \return false if the file does not exist.
+ */
+bool getFileInfo(const std::string& fileName, uint64_t& size, int64_t& modifiedTime) {
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(fileName.c_str(), &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(fileName.c_str(), &info) != 0)
+		return false;
+#endif
+	size = (uint64_t)info.st_size;
+	modifiedTime = (int64_t)info.st_mtime;
+	return true;
+}
+
+/**
+ * \brief 64 bit FNV-1a hash of the file content (0 if the file cannot be read).
+ */
+uint64_t hashFile(const std::string& fileName) {
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file)
+		return 0;
+
+	uint64_t hash = 14695981039346656037ull;
+	char buffer[64 * 1024];
+	while (file) {
+		file.read(buffer, sizeof(buffer));
+		std::streamsize count = file.gcount();
+		for (std::streamsize i = 0; i < count; i++) {
+			hash ^= (unsigned char)buffer[i];
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+static size_t alignOffset(size_t offset) {
+	return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(size_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// -----------------------  Memory mapping ---------------------------------
+
+/**
+ * \brief Map the whole file read-only into memory.
+ * \param fileName [in] file to map
+ * \param mapping [out] mapping description, data is NULL on failure
+ */
+bool mapFile(const std::string& fileName, MappedFile& mapping) {
+	unmapFile(mapping);
+
+#ifdef _WIN32
+	// FILE_SHARE_WRITE lets readMeshCache() refresh the header of a mapped cache
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (fileMapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* data = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		CloseHandle(fileMapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	mapping.data = (const unsigned char*)data;
+	mapping.size = (size_t)fileSize.QuadPart;
+	mapping.fileHandle = file;
+	mapping.mappingHandle = fileMapping;
+#else
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+
+	mapping.data = (const unsigned char*)data;
+	mapping.size = (size_t)info.st_size;
+	mapping.fileHandle = (void*)(intptr_t)fd;
+	mapping.mappingHandle = NULL;
+#endif
+	return true;
+}
+
+/**
+ * \brief Release a mapping created by mapFile (does nothing if nothing is mapped).
+ */
+void unmapFile(MappedFile& mapping) {
+	if (mapping.data == NULL)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapping.data);
+	CloseHandle((HANDLE)mapping.mappingHandle);
+	CloseHandle((HANDLE)mapping.fileHandle);
+#else
+	munmap((void*)mapping.data, mapping.size);
+	close((int)(intptr_t)mapping.fileHandle);
+#endif
+
+	mapping.data = NULL;
+	mapping.size = 0;
+	mapping.fileHandle = NULL;
+	mapping.mappingHandle = NULL;
+}
+
+_MappedFile::_MappedFile(_MappedFile&& other) : data(other.data), size(other.size), fileHandle(other.fileHandle), mappingHandle(other.mappingHandle) {
+	other.data = NULL;
+	other.size = 0;
+	other.fileHandle = NULL;
+	other.mappingHandle = NULL;
+}
+
+/**
+ * \brief Take over the mapping of other, the current one is released first.
+ */
+_MappedFile& _MappedFile::operator=(_MappedFile&& other) {
+	if (this == &other)
+		return *this;
+
+	unmapFile(*this);
+	data = other.data;
+	size = other.size;
+	fileHandle = other.fileHandle;
+	mappingHandle = other.mappingHandle;
+	other.data = NULL;
+	other.size = 0;
+	other.fileHandle = NULL;
+	other.mappingHandle = NULL;
+	return *this;
+}
+
+_MappedFile::~_MappedFile() {
+	unmapFile(*this);
+}
+
+// -----------------------  Model import ---------------------------------
+
+/**
+ * \brief Name of the cache file belonging to a model (stored next to the model).
+ */
+std::string meshCacheFileName(const std::string& modelFileName) {
+	return modelFileName + MESH_CACHE_EXTENSION;
+}
+
+/**
+ * \brief Copy the indices of the mesh as 32 bit values.
+ */
+void getMeshIndices(const MeshData& mesh, std::vector<unsigned int>& indices) {
+	const size_t count = 3 * (size_t)mesh.numTriangles;
+	indices.resize(count);
+
+	if (mesh.indexSize == sizeof(unsigned short)) {
+		const unsigned short* source = (const unsigned short*)mesh.indices();
+		for (size_t i = 0; i < count; i++)
+			indices[i] = source[i];
+	}
+	else if (count > 0) {
+		memcpy(indices.data(), mesh.indices(), count * sizeof(unsigned int));
+	}
+}
+
+/**
+ * \brief Store the indices in the mesh, as 16 bit values if every vertex can be addressed with them.
+ * The levels of detail of the mesh are dropped, the indices are its full resolution triangles.
+ */
+void setMeshIndices(MeshData& mesh, const std::vector<unsigned int>& indices) {
+	std::vector<unsigned int> lodTriangles(1, (unsigned int)(indices.size() / 3));
+	setMeshLodIndices(mesh, indices, lodTriangles);
+}
+
+/**
+ * \brief Store the triangles of every level of detail, one after the other, level 0 being the full mesh.
+ * The errors of the levels are reset, they are set by the caller.
+ * \param indices [in] triangles of all levels
+ * \param lodTriangles [in] number of triangles of each level (at most MESH_LOD_LEVELS)
+ */
+void setMeshLodIndices(MeshData& mesh, const std::vector<unsigned int>& indices, const std::vector<unsigned int>& lodTriangles) {
+	mesh.numLods = (unsigned int)std::min(lodTriangles.size(), (size_t)MESH_LOD_LEVELS);
+	for (unsigned int i = 0; i < MESH_LOD_LEVELS; i++) {
+		mesh.lodTriangles[i] = i < mesh.numLods ? lodTriangles[i] : 0;
+		mesh.lodErrors[i] = 0.0f;
+	}
+	mesh.numTriangles = mesh.lodTriangles[0];
+	mesh.indexSize = mesh.numVertices <= 65536 ? sizeof(unsigned short) : sizeof(unsigned int);
+	mesh.indexStorage.resize(mesh.indexBytes());
+	mesh.mappedIndices = NULL;
+
+	if (mesh.indexSize == sizeof(unsigned short)) {
+		unsigned short* destination = (unsigned short*)mesh.indexStorage.data();
+		for (size_t i = 0; i < indices.size(); i++)
+			destination[i] = (unsigned short)indices[i];
+	}
+	else if (!indices.empty()) {
+		memcpy(mesh.indexStorage.data(), indices.data(), indices.size() * sizeof(unsigned int));
+	}
+}
+
+/** Load all meshes of a model using assimp library (CPU only, no OpenGL calls)
+ *  Vertex, normals and texture coordinates data are stored without interleaving |VVVVV...|NNNNN...|tttt
+ * \param fileName [in] file to open/load
+ * \param model [out] imported meshes
+ * \param optimize [in] reorder triangles and vertices for the vertex cache (see meshOptimizer.h) and generate the levels of detail (see meshLod.h)
+ */
+bool importModel(const std::string& fileName, ModelData& model, bool optimize) {
+	Assimp::Importer importer;
+
+	std::cout << "Loading model " << fileName << std::endl;
+
+	// Unitize object in size (scale the model to fit into (-1..1)^3)
+	importer.SetPropertyInteger(AI_CONFIG_PP_PTV_NORMALIZE, 1);
+
+	// Load asset from the file - you can play with various processing steps
+	const aiScene* scn = importer.ReadFile(fileName.c_str(), 0
+		| aiProcess_Triangulate             // Triangulate polygons (if any).
+		| aiProcess_PreTransformVertices    // Transforms scene hierarchy into one root with geometry-leafs only. For more see Doc.
+		| aiProcess_GenSmoothNormals        // Calculate normals per vertex.
+		| aiProcess_JoinIdenticalVertices);
+
+	// abort if the loader fails
+	if (scn == NULL) {
+		std::cerr << "assimp error: " << importer.GetErrorString() << std::endl;
+		return false;
+	}
+
+	model.fileName = fileName;
+	model.fromCache = false;
+	model.meshes.clear();
+	model.meshes.resize(scn->mNumMeshes);
+
+	// some formats store whole scene (multiple meshes and materials, lights, cameras, ...) in one file, we can access the data by scn->*
+	for (unsigned int i = 0; i < scn->mNumMeshes; i++) {
+		const aiMesh* mesh = scn->mMeshes[i];
+		MeshData& meshData = model.meshes[i];
+
+		std::cout << "Mesh " << i << " has " << mesh->mNumVertices << " vertices" << std::endl;
+
+		meshData.numVertices = mesh->mNumVertices;
+		meshData.numTriangles = mesh->mNumFaces;
+
+		// |VVV|NNN|TT| - untextured meshes get zero texture coordinates
+		meshData.vertexStorage.assign(8 * mesh->mNumVertices, 0.0f);
+		float* positions = meshData.vertexStorage.data();
+		float* normals = positions + 3 * mesh->mNumVertices;
+		float* textureCoords = positions + 6 * mesh->mNumVertices;
+
+		memcpy(positions, mesh->mVertices, 3 * sizeof(float) * mesh->mNumVertices);
+		memcpy(normals, mesh->mNormals, 3 * sizeof(float) * mesh->mNumVertices);
+
+		if (mesh->HasTextureCoords(0)) {
+			// we use 2D textures with 2 coordinates and ignore the third coordinate
+			for (unsigned int idx = 0; idx < mesh->mNumVertices; idx++) {
+				const aiVector3D& vect = (mesh->mTextureCoords[0])[idx];
+				*textureCoords++ = vect.x;
+				*textureCoords++ = vect.y;
+			}
+		}
+
+		// copy all mesh faces into one big array (assimp supports faces with ordinary number of vertices, we use only 3 -> triangles)
+		std::vector<unsigned int> indices(3 * mesh->mNumFaces);
+		for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
+			indices[f * 3 + 0] = mesh->mFaces[f].mIndices[0];
+			indices[f * 3 + 1] = mesh->mFaces[f].mIndices[1];
+			indices[f * 3 + 2] = mesh->mFaces[f].mIndices[2];
+		}
+		setMeshIndices(meshData, indices);
+
+		if (optimize) {
+			float acmrBefore = 0.0f;
+			float acmrAfter = 0.0f;
+			optimizeMesh(meshData, &acmrBefore, &acmrAfter);
+			printf("Mesh %u : ACMR %.3f -> %.3f, %u bit indices\n", i, acmrBefore, acmrAfter, 8 * meshData.indexSize);
+
+			generateMeshLods(meshData);
+			printf("Mesh %u : %u levels of detail,", i, meshData.numLods);
+			for (unsigned int l = 0; l < meshData.numLods; l++)
+				printf(" %u", meshData.lodTriangles[l]);
+			printf(" triangles\n");
+		}
+
+		// copy the material info to structure
+		const aiMaterial* material = scn->mMaterials[mesh->mMaterialIndex];
+		aiColor4D color;
+
+		// diffiuse
+		if (aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &color) != AI_SUCCESS)
+			color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
+		meshData.diffuse = glm::vec3(color.r, color.g, color.b);
+
+		// ambient
+		if (aiGetMaterialColor(material, AI_MATKEY_COLOR_AMBIENT, &color) != AI_SUCCESS)
+			color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
+		meshData.ambient = glm::vec3(color.r, color.g, color.b);
+
+		// specular
+		if (aiGetMaterialColor(material, AI_MATKEY_COLOR_SPECULAR, &color) != AI_SUCCESS)
+			color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
+		meshData.specular = glm::vec3(color.r, color.g, color.b);
+
+		// shininess
+		ai_real shininess, strength;
+		unsigned int max;	// changed: to unsigned
+
+		max = 1;
+		if (aiGetMaterialFloatArray(material, AI_MATKEY_SHININESS, &shininess, &max) != AI_SUCCESS)
+			shininess = 1.0f;
+		max = 1;
+		if (aiGetMaterialFloatArray(material, AI_MATKEY_SHININESS_STRENGTH, &strength, &max) != AI_SUCCESS)
+			strength = 1.0f;
+		meshData.shininess = shininess * strength;
+
+		// texture image name
+		meshData.textureName.clear();
+		if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
+			aiString path; // filename
+			material->GetTexture(aiTextureType_DIFFUSE, 0, &path);
+			meshData.textureName = path.data;
+
+			size_t found = fileName.find_last_of("/\\");
+			// insert correct texture file path
+			if (found != std::string::npos) {
+				meshData.textureName.insert(0, fileName.substr(0, found + 1));
+			}
+		}
+		else {
+			std::cout << "No texture found for mesh " << i << std::endl;
+		}
+	}
+
+	return true;
+}
+
+// -----------------------  Cache files ---------------------------------
+
+/**
+ * \brief Write the imported model into a cache file.
+ * The file is written under a temporary name first so a crash never leaves a half written cache behind.
+ */
+bool writeMeshCache(const std::string& cacheFileName, const std::string& sourceFileName, const ModelData& model) {
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.numMeshes = (uint32_t)model.meshes.size();
+	if (!getFileInfo(sourceFileName, header.sourceSize, header.sourceModifiedTime))
+		return false;
+	header.sourceHash = hashFile(sourceFileName);
+
+	// lay out the blobs after the header and the records
+	std::vector<MeshCacheRecord> records(model.meshes.size());
+	size_t offset = alignOffset(sizeof(MeshCacheHeader) + records.size() * sizeof(MeshCacheRecord));
+
+	for (size_t i = 0; i < model.meshes.size(); i++) {
+		const MeshData& mesh = model.meshes[i];
+		MeshCacheRecord& record = records[i];
+		memset(&record, 0, sizeof(record));
+
+		if (mesh.textureName.size() >= MESH_CACHE_PATH_LENGTH) {
+			std::cerr << "\033[31mwriteMeshCache : texture path too long : " << mesh.textureName << "\033[0m" << std::endl;
+			return false;
+		}
+
+		record.numVertices = mesh.numVertices;
+		record.numTriangles = mesh.numTriangles;
+		memcpy(record.ambient, glm::value_ptr(mesh.ambient), sizeof(record.ambient));
+		memcpy(record.diffuse, glm::value_ptr(mesh.diffuse), sizeof(record.diffuse));
+		memcpy(record.specular, glm::value_ptr(mesh.specular), sizeof(record.specular));
+		record.shininess = mesh.shininess;
+		record.indexSize = mesh.indexSize;
+		record.numLods = mesh.numLods;
+		memcpy(record.lodTriangles, mesh.lodTriangles, sizeof(record.lodTriangles));
+		memcpy(record.lodErrors, mesh.lodErrors, sizeof(record.lodErrors));
+		strncpy(record.textureName, mesh.textureName.c_str(), MESH_CACHE_PATH_LENGTH - 1);
+
+		record.vertexOffset = offset;
+		offset = alignOffset(offset + 8 * sizeof(float) * mesh.numVertices);
+		record.indexOffset = offset;
+		offset = alignOffset(offset + mesh.indexBytes());
+	}
+
+	std::string tempFileName = cacheFileName + ".tmp";
+	{
+		std::ofstream file(tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		const char padding[MESH_CACHE_ALIGNMENT] = { 0 };
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)records.data(), records.size() * sizeof(MeshCacheRecord));
+
+		for (size_t i = 0; i < model.meshes.size(); i++) {
+			const MeshData& mesh = model.meshes[i];
+
+			file.write(padding, records[i].vertexOffset - (uint64_t)file.tellp());
+			file.write((const char*)mesh.vertices(), 8 * sizeof(float) * mesh.numVertices);
+			file.write(padding, records[i].indexOffset - (uint64_t)file.tellp());
+			file.write((const char*)mesh.indices(), mesh.indexBytes());
+		}
+		file.write(padding, offset - (uint64_t)file.tellp());
+
+		if (!file)
+			return false;
+	}
+
+	// rename() does not replace existing files on Windows
+	std::remove(cacheFileName.c_str());
+	if (std::rename(tempFileName.c_str(), cacheFileName.c_str()) != 0) {
+		std::remove(tempFileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * \brief Check that the cache still describes the source model.
+ * Size and modification time are compared first, the content hash is only computed when the timestamps differ
+ * (fresh checkout, copied data folder, ...). A missing source keeps the cache valid - it is the only copy left.
+ * When the hash matches, the new modification time is written back so the next launch skips the hash.
+ */
+static bool isMeshCacheUpToDate(const MeshCacheHeader& header, const std::string& cacheFileName, const std::string& sourceFileName) {
+	uint64_t size = 0;
+	int64_t modifiedTime = 0;
+
+	if (!getFileInfo(sourceFileName, size, modifiedTime))
+		return true;
+	if (size != header.sourceSize)
+		return false;
+	if (modifiedTime == header.sourceModifiedTime)
+		return true;
+	if (hashFile(sourceFileName) != header.sourceHash)
+		return false;
+
+	// the header was already copied out of the mapping, only the file is updated
+	std::fstream file(cacheFileName.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+	if (file) {
+		file.seekp(offsetof(MeshCacheHeader, sourceModifiedTime));
+		file.write((const char*)&modifiedTime, sizeof(modifiedTime));
+	}
+	return true;
+}
+
+/**
+ * \brief Memory-map a cache file and point the meshes of the model straight into the mapping.
+ * \return false if the cache is missing, corrupted, from another version or out of date.
+ */
+bool readMeshCache(const std::string& cacheFileName, const std::string& sourceFileName, ModelData& model) {
+	releaseModelData(model);
+
+	if (!mapFile(cacheFileName, model.mapping))
+		return false;
+
+	const unsigned char* data = model.mapping.data;
+	const size_t size = model.mapping.size;
+
+	MeshCacheHeader header;
+	if (size < sizeof(header)) {
+		releaseModelData(model);
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION
+		|| size < sizeof(header) + (uint64_t)header.numMeshes * sizeof(MeshCacheRecord)
+		|| !isMeshCacheUpToDate(header, cacheFileName, sourceFileName)) {
+		releaseModelData(model);
+		return false;
+	}
+
+	const MeshCacheRecord* records = (const MeshCacheRecord*)(data + sizeof(header));
+	model.meshes.resize(header.numMeshes);
+
+	for (uint32_t i = 0; i < header.numMeshes; i++) {
+		const MeshCacheRecord& record = records[i];
+		MeshData& mesh = model.meshes[i];
+
+		const uint64_t vertexBytes = 8 * sizeof(float) * (uint64_t)record.numVertices;
+		uint64_t numTriangles = 0;
+		for (uint32_t l = 0; l < record.numLods && l < MESH_LOD_LEVELS; l++)
+			numTriangles += record.lodTriangles[l];
+		const uint64_t indexBytes = 3 * (uint64_t)record.indexSize * numTriangles;
+		if ((record.indexSize != sizeof(unsigned short) && record.indexSize != sizeof(unsigned int))
+			|| record.numLods < 1 || record.numLods > MESH_LOD_LEVELS || record.lodTriangles[0] != record.numTriangles
+			|| record.vertexOffset + vertexBytes > size || record.indexOffset + indexBytes > size
+			|| record.textureName[MESH_CACHE_PATH_LENGTH - 1] != '\0') {
+			std::cerr << "\033[31mreadMeshCache : corrupted cache file : " << cacheFileName << "\033[0m" << std::endl;
+			releaseModelData(model);
+			return false;
+		}
+
+		mesh.numVertices = record.numVertices;
+		mesh.numTriangles = record.numTriangles;
+		mesh.indexSize = record.indexSize;
+		mesh.numLods = record.numLods;
+		memcpy(mesh.lodTriangles, record.lodTriangles, sizeof(mesh.lodTriangles));
+		memcpy(mesh.lodErrors, record.lodErrors, sizeof(mesh.lodErrors));
+		mesh.ambient = glm::vec3(record.ambient[0], record.ambient[1], record.ambient[2]);
+		mesh.diffuse = glm::vec3(record.diffuse[0], record.diffuse[1], record.diffuse[2]);
+		mesh.specular = glm::vec3(record.specular[0], record.specular[1], record.specular[2]);
+		mesh.shininess = record.shininess;
+		mesh.textureName = record.textureName;
+		mesh.mappedVertices = (const float*)(data + record.vertexOffset);
+		mesh.mappedIndices = data + record.indexOffset;
+	}
+
+	model.fileName = sourceFileName;
+	model.fromCache = true;
+	return true;
+}
+
+/**
+ * \brief Load the model from its cache file, import it with assimp (and write the cache) if the cache is not usable.
+ */
+bool loadModelData(const std::string& fileName, ModelData& model) {
+	const std::string cacheFileName = meshCacheFileName(fileName);
+
+	if (readMeshCache(cacheFileName, fileName, model)) {
+		std::cout << "Loading model " << fileName << " (cached)" << std::endl;
+		return true;
+	}
+
+	if (!importModel(fileName, model))
+		return false;
+
+	if (!writeMeshCache(cacheFileName, fileName, model)) {
+		std::cerr << "\033[31mloadModelData : Cannot write mesh cache : " << cacheFileName << "\033[0m" << std::endl;
+	}
+	return true;
+}
+
+/**
+ * \brief Free the CPU side copy of the model (must not be used after the data was uploaded).
+ */
+void releaseModelData(ModelData& model) {
+	model.meshes.clear();
+	unmapFile(model.mapping);
+	model.fromCache = false;
+}
+
+// -----------------------  Benchmark ---------------------------------
+
+/**
+ * \brief Compare the cold (assimp import + cache write) and warm (mapped cache) load paths.
+ * No OpenGL context is needed, the warm path touches every byte to account for the page faults
+ * glBufferData would otherwise pay.
+ */
+void benchmarkMeshCache(const std::vector<std::string>& fileNames) {
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double totalCold = 0.0;
+	double totalWarm = 0.0;
+
+	printf("%-45s %10s %10s %10s %10s %8s\n", "model", "vertices", "cache KB", "cold ms", "warm ms", "speedup");
+
+	for (size_t i = 0; i < fileNames.size(); i++) {
+		const std::string& fileName = fileNames[i];
+		const std::string cacheFileName = meshCacheFileName(fileName);
+
+		// cold path
+		Clock::time_point start = Clock::now();
+		ModelData imported;
+		if (!importModel(fileName, imported) || !writeMeshCache(cacheFileName, fileName, imported)) {
+			std::cerr << "\033[31mbenchmarkMeshCache : Cannot load : " << fileName << "\033[0m" << std::endl;
+			releaseModelData(imported);
+			continue;
+		}
+		double coldMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		releaseModelData(imported);
+
+		// warm path
+		start = Clock::now();
+		ModelData cached;
+		if (!readMeshCache(cacheFileName, fileName, cached)) {
+			std::cerr << "\033[31mbenchmarkMeshCache : Cannot read cache : " << cacheFileName << "\033[0m" << std::endl;
+			releaseModelData(cached);
+			continue;
+		}
+		volatile unsigned int checksum = 0;
+		for (size_t b = 0; b < cached.mapping.size; b += 4096)
+			checksum += cached.mapping.data[b];
+		double warmMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		unsigned int numVertices = 0;
+		for (size_t m = 0; m < cached.meshes.size(); m++)
+			numVertices += cached.meshes[m].numVertices;
+
+		printf("%-45s %10u %10zu %10.2f %10.2f %7.1fx\n", fileName.c_str(), numVertices, cached.mapping.size / 1024, coldMs, warmMs, coldMs / (warmMs > 0.0 ? warmMs : 1e-3));
+
+		totalCold += coldMs;
+		totalWarm += warmMs;
+		releaseModelData(cached);
+	}
+
+	printf("%-45s %10s %10s %10.2f %10.2f %7.1fx\n", "total", "", "", totalCold, totalWarm, totalCold / (totalWarm > 0.0 ? totalWarm : 1e-3));
+}
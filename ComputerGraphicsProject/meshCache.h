@@ -0,0 +1,132 @@
+/*
+* \file meshCache.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Binary mesh cache - CPU side model import and versioned cache files written next to each model
+*/
+
+#pragma once
+
+#ifndef __MESH_CACHE_H
+#define __MESH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "pgr.h"
+
+#define MESH_CACHE_EXTENSION ".meshcache"
+#define MESH_CACHE_MAGIC 0x48534d43u	// "CMSH"
+#define MESH_CACHE_VERSION 3			// bump whenever the file layout or the import settings change
+#define MESH_LOD_LEVELS 4				// levels of detail stored per mesh, level 0 is the full mesh
+
+/**
+ * \brief Read-only memory mapping of a whole file. It owns the mapping and the file handle: it can be moved but not
+ * copied, and unmaps the file when destroyed (unmapFile() releases it earlier).
+ */
+typedef struct _MappedFile {
+	const unsigned char* data;	///< first byte of the mapping (NULL if nothing is mapped)
+	size_t size;				///< size of the mapping in bytes
+
+	void* fileHandle;			///< platform file handle (HANDLE on Windows, fd on POSIX)
+	void* mappingHandle;		///< platform mapping handle (Windows only)
+
+	_MappedFile() : data(NULL), size(0), fileHandle(NULL), mappingHandle(NULL) {}
+	_MappedFile(_MappedFile&& other);
+	_MappedFile& operator=(_MappedFile&& other);
+	_MappedFile(const _MappedFile&) = delete;
+	_MappedFile& operator=(const _MappedFile&) = delete;
+	~_MappedFile();
+} MappedFile;
+
+/**
+ * \brief CPU side data of one sub-mesh.
+ * Vertex data is stored without interleaving |VVVVV...|NNNNN...|tttt (8 floats per vertex),
+ * i.e. exactly as the vertex buffer expects it, so it can go straight into glBufferData.
+ * Indices are 16 bit when every vertex can be addressed with them, 32 bit otherwise.
+ * The simplified levels of detail share the vertices, their triangles follow the full mesh in the index buffer.
+ */
+typedef struct _MeshData {
+	unsigned int numVertices;
+	unsigned int numTriangles;
+	unsigned int indexSize;		///< bytes per index (2 or 4)
+	unsigned int numLods;		///< levels of detail in the index buffer, level 0 (numTriangles) is the full mesh
+	unsigned int lodTriangles[MESH_LOD_LEVELS];	///< triangles of each level
+	float lodErrors[MESH_LOD_LEVELS];			///< quadric error of each level as a root mean square distance to the full mesh (model space)
+
+	// resolved material (texture is kept as a path, the GL texture is created at upload time)
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	float shininess;
+	std::string textureName;	///< path relative to the working directory, empty if the mesh is not textured
+
+	std::vector<float> vertexStorage;			///< filled when the mesh was imported by assimp
+	std::vector<unsigned char> indexStorage;	///< indexSize bytes per index
+	const float* mappedVertices;				///< set when the mesh was read from a mapped cache file
+	const unsigned char* mappedIndices;
+
+	_MeshData() :
+		numVertices(0),
+		numTriangles(0),
+		indexSize(sizeof(unsigned int)),
+		numLods(1),
+		ambient(0.0f),
+		diffuse(0.0f),
+		specular(0.0f),
+		shininess(1.0f),
+		mappedVertices(NULL),
+		mappedIndices(NULL)
+	{
+		for (unsigned int i = 0; i < MESH_LOD_LEVELS; i++) {
+			lodTriangles[i] = 0;
+			lodErrors[i] = 0.0f;
+		}
+	}
+
+	const float* vertices() const { return mappedVertices != NULL ? mappedVertices : vertexStorage.data(); }
+	const void* indices() const { return mappedIndices != NULL ? mappedIndices : indexStorage.data(); }
+	size_t indexBytes() const { return (size_t)3 * totalTriangles() * indexSize; }	///< every level of detail
+	unsigned int totalTriangles() const {
+		unsigned int triangles = numTriangles;
+		for (unsigned int i = 1; i < numLods; i++)
+			triangles += lodTriangles[i];
+		return triangles;
+	}
+	GLenum indexType() const { return indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+} MeshData;
+
+/**
+ * \brief All sub-meshes of one model file.
+ */
+typedef struct _ModelData {
+	std::string fileName;
+	std::vector<MeshData> meshes;
+	MappedFile mapping;		///< backing storage of the meshes when loaded from the cache
+	bool fromCache;
+
+	_ModelData() : fromCache(false) {}
+} ModelData;
+
+// -----------------------  Source file identification ---------------------------------
+bool getFileInfo(const std::string& fileName, uint64_t& size, int64_t& modifiedTime);
+uint64_t hashFile(const std::string& fileName);
+
+// -----------------------  Memory mapping ---------------------------------
+bool mapFile(const std::string& fileName, MappedFile& mapping);
+void unmapFile(MappedFile& mapping);
+
+// -----------------------  Model import / cache ---------------------------------
+std::string meshCacheFileName(const std::string& modelFileName);
+void getMeshIndices(const MeshData& mesh, std::vector<unsigned int>& indices);
+void setMeshIndices(MeshData& mesh, const std::vector<unsigned int>& indices);
+void setMeshLodIndices(MeshData& mesh, const std::vector<unsigned int>& indices, const std::vector<unsigned int>& lodTriangles);
+bool importModel(const std::string& fileName, ModelData& model, bool optimize = true);
+bool writeMeshCache(const std::string& cacheFileName, const std::string& sourceFileName, const ModelData& model);
+bool readMeshCache(const std::string& cacheFileName, const std::string& sourceFileName, ModelData& model);
+bool loadModelData(const std::string& fileName, ModelData& model);
+void releaseModelData(ModelData& model);
+
+void benchmarkMeshCache(const std::vector<std::string>& fileNames);
+
+#endif // __MESH_CACHE_H
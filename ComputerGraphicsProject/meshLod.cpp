@@ -0,0 +1,531 @@
+/*
+* \file meshLod.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Mesh levels of detail - quadric error simplification at import time and level selection by projected error
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include "meshLod.h"
+#include "meshOptimizer.h"
+#include "frustumCulling.h"
+
+bool useMeshLod = true;
+unsigned int modelStressCount = 0;
+
+/**
+ * \brief Camera used to project the errors of the levels, set once per frame.
+ */
+typedef struct _LodCamera {
+	glm::vec3 position;
+	float pixelScale;		///< pixels covered by one unit at distance 1 (perspective) or anywhere (orthographic)
+	bool perspective;
+
+	_LodCamera() : position(0.0f), pixelScale(0.0f), perspective(true) {}
+} LodCamera;
+
+static LodCamera lodCamera;
+
+// -----------------------  Quadrics ---------------------------------
+
+/**
+ * \brief Sum of the squared distances to a set of planes (Garland & Heckbert), symmetric 4x4 matrix stored as its upper
+ * triangle. Each plane is weighted by the area of its triangle, the error is normalized by the total weight.
+ */
+typedef struct _Quadric {
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+	double weight;
+
+	_Quadric() : a2(0.0), ab(0.0), ac(0.0), ad(0.0), b2(0.0), bc(0.0), bd(0.0), c2(0.0), cd(0.0), d2(0.0), weight(0.0) {}
+} Quadric;
+
+static void addPlane(Quadric& q, double a, double b, double c, double d, double weight) {
+	q.a2 += weight * a * a; q.ab += weight * a * b; q.ac += weight * a * c; q.ad += weight * a * d;
+	q.b2 += weight * b * b; q.bc += weight * b * c; q.bd += weight * b * d;
+	q.c2 += weight * c * c; q.cd += weight * c * d;
+	q.d2 += weight * d * d;
+	q.weight += weight;
+}
+
+static void addQuadric(Quadric& q, const Quadric& other) {
+	q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+	q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+	q.c2 += other.c2; q.cd += other.cd;
+	q.d2 += other.d2;
+	q.weight += other.weight;
+}
+
+/**
+ * \brief Weighted mean of the squared distances of the point to the planes of the quadric.
+ */
+static double quadricError(const Quadric& q, const float* p) {
+	const double x = p[0];
+	const double y = p[1];
+	const double z = p[2];
+	const double error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z
+		+ 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+		+ 2.0 * (q.ad * x + q.bd * y + q.cd * z) + q.d2;
+	return q.weight > 0.0 ? std::max(error, 0.0) / q.weight : 0.0;
+}
+
+// -----------------------  Simplification ---------------------------------
+
+/**
+ * \brief Edge collapse candidate, the position from is moved onto the position to.
+ */
+typedef struct _EdgeCollapse {
+	unsigned int from;
+	unsigned int to;
+	double error;	///< squared
+
+	bool operator<(const struct _EdgeCollapse& other) const { return error < other.error; }
+} EdgeCollapse;
+
+static void triangleNormal(const float* p0, const float* p1, const float* p2, double* normal) {
+	const double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+	const double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+	normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+/**
+ * \brief Group the vertices by position - the vertices split on normal and texture seams are one vertex for the simplifier.
+ * \param canonical [out] representative (one of the vertices) of the position of every vertex
+ * \param wedgeNext [out] circular list of the vertices sharing a position
+ */
+static void findPositionVertices(const float* positions, unsigned int numVertices, std::vector<unsigned int>& canonical,
+	std::vector<unsigned int>& wedgeNext) {
+	std::vector<unsigned int> order(numVertices);
+	for (unsigned int v = 0; v < numVertices; v++)
+		order[v] = v;
+	std::sort(order.begin(), order.end(), [positions](unsigned int a, unsigned int b) {
+		const float* pa = positions + 3 * a;
+		const float* pb = positions + 3 * b;
+		if (pa[0] != pb[0]) return pa[0] < pb[0];
+		if (pa[1] != pb[1]) return pa[1] < pb[1];
+		return pa[2] < pb[2];
+	});
+
+	canonical.resize(numVertices);
+	wedgeNext.resize(numVertices);
+	for (unsigned int first = 0; first < numVertices; ) {
+		const float* p = positions + 3 * order[first];
+		unsigned int last = first + 1;
+		while (last < numVertices && positions[3 * order[last] + 0] == p[0] && positions[3 * order[last] + 1] == p[1]
+			&& positions[3 * order[last] + 2] == p[2])
+			last++;
+
+		for (unsigned int i = first; i < last; i++) {
+			canonical[order[i]] = order[first];
+			wedgeNext[order[i]] = order[i + 1 < last ? i + 1 : first];
+		}
+		first = last;
+	}
+}
+
+/**
+ * \brief True if moving the position from onto the position to turns one of the remaining triangles around from over.
+ */
+static bool collapseFlipsTriangle(const float* positions, const std::vector<unsigned int>& indices, const std::vector<unsigned int>& canonical,
+	const unsigned int* triangles, unsigned int count, unsigned int from, unsigned int to) {
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int corners[3];
+		for (int k = 0; k < 3; k++)
+			corners[k] = canonical[indices[3 * triangles[i] + k]];
+		if (corners[0] == to || corners[1] == to || corners[2] == to)
+			continue;	// removed by the collapse
+
+		const float* p[3];
+		const float* q[3];
+		for (int k = 0; k < 3; k++) {
+			p[k] = positions + 3 * corners[k];
+			q[k] = corners[k] == from ? positions + 3 * to : p[k];
+		}
+
+		double before[3];
+		double after[3];
+		triangleNormal(p[0], p[1], p[2], before);
+		triangleNormal(q[0], q[1], q[2], after);
+		if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * \brief Vertex replacing the vertex w when its position collapses onto the position to - the vertex of the collapsed edge
+ * on the same side of the seams, or the vertex at that position with the closest normal and texture coordinates.
+ */
+static unsigned int collapseTarget(const float* vertices, unsigned int numVertices, const std::vector<unsigned int>& indices,
+	const std::vector<unsigned int>& canonical, const std::vector<unsigned int>& wedgeNext,
+	const unsigned int* triangles, unsigned int count, unsigned int w, unsigned int to) {
+	for (unsigned int i = 0; i < count; i++) {
+		const unsigned int* triangle = &indices[3 * triangles[i]];
+		if (triangle[0] != w && triangle[1] != w && triangle[2] != w)
+			continue;
+		for (int k = 0; k < 3; k++) {
+			if (canonical[triangle[k]] == to)
+				return triangle[k];
+		}
+	}
+
+	const float* normals = vertices + 3 * numVertices;
+	const float* textureCoords = vertices + 6 * numVertices;
+	unsigned int best = to;
+	float bestDistance = -1.0f;
+	unsigned int u = to;
+	do {
+		float distance = 0.0f;
+		for (int k = 0; k < 3; k++)
+			distance += (normals[3 * u + k] - normals[3 * w + k]) * (normals[3 * u + k] - normals[3 * w + k]);
+		for (int k = 0; k < 2; k++)
+			distance += (textureCoords[2 * u + k] - textureCoords[2 * w + k]) * (textureCoords[2 * u + k] - textureCoords[2 * w + k]);
+		if (bestDistance < 0.0f || distance < bestDistance) {
+			best = u;
+			bestDistance = distance;
+		}
+		u = wedgeNext[u];
+	} while (u != to);
+	return best;
+}
+
+/** Simplify a triangle list by collapsing its edges in order of quadric error (Garland & Heckbert).
+ *  Vertices only move onto their neighbours, the result indexes the original vertex buffer. The vertices split on normal
+ *  and texture seams move together, each one onto the vertex on its side of the seam. Open borders are locked so the
+ *  sub-meshes stay closed against each other.
+ *  The collapses run in passes over the edges sorted by error, a collapse locks the neighbourhood of its vertex for the
+ *  rest of the pass so the errors and the flip test of the pass stay valid.
+ * \param vertices [in] vertex data as stored in MeshData |VVVVV...|NNNNN...|tttt
+ * \param indices [in] triangle list
+ * \param targetTriangles [in] stop once the result has at most this many triangles
+ * \param maxError [in] edges whose quadric error is above this distance (root mean square) are not collapsed
+ * \param result [out] simplified triangle list
+ * \return error of the result, the largest quadric error of the collapses as a distance : square root of the area
+ *  weighted mean of the squared distances to the original planes (model space). It is not a maximum distance, a few
+ *  vertices may move further.
+ */
+float simplifyMesh(const float* vertices, unsigned int numVertices, const std::vector<unsigned int>& indices,
+	unsigned int targetTriangles, float maxError, std::vector<unsigned int>& result) {
+	result = indices;
+	if (result.size() / 3 <= targetTriangles || numVertices == 0)
+		return 0.0f;
+
+	const float* positions = vertices;
+	std::vector<unsigned int> canonical;
+	std::vector<unsigned int> wedgeNext;
+	findPositionVertices(positions, numVertices, canonical, wedgeNext);
+
+	// triangles with two corners at the same position have no area and would break the edge topology
+	size_t write = 0;
+	for (size_t t = 0; t < result.size(); t += 3) {
+		const unsigned int a = canonical[result[t + 0]];
+		const unsigned int b = canonical[result[t + 1]];
+		const unsigned int c = canonical[result[t + 2]];
+		if (a == b || b == c || a == c)
+			continue;
+		result[write++] = result[t + 0];
+		result[write++] = result[t + 1];
+		result[write++] = result[t + 2];
+	}
+	result.resize(write);
+	size_t liveTriangles = result.size() / 3;
+
+	// plane quadrics of the triangles around every position
+	std::vector<Quadric> quadrics(numVertices);
+	for (size_t t = 0; t < liveTriangles; t++) {
+		const float* p0 = positions + 3 * canonical[result[3 * t + 0]];
+		const float* p1 = positions + 3 * canonical[result[3 * t + 1]];
+		const float* p2 = positions + 3 * canonical[result[3 * t + 2]];
+		double normal[3];
+		triangleNormal(p0, p1, p2, normal);
+		const double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length <= 0.0)
+			continue;
+
+		const double a = normal[0] / length;
+		const double b = normal[1] / length;
+		const double c = normal[2] / length;
+		const double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+		for (int k = 0; k < 3; k++)
+			addPlane(quadrics[canonical[result[3 * t + k]]], a, b, c, d, 0.5 * length);
+	}
+
+	// positions on edges not shared by exactly two triangles never move
+	std::vector<unsigned char> locked(numVertices, 0);
+	{
+		std::unordered_map<uint64_t, unsigned int> edgeUses;
+		edgeUses.reserve(result.size());
+		for (size_t i = 0; i < result.size(); i++) {
+			const unsigned int a = canonical[result[i]];
+			const unsigned int b = canonical[result[i % 3 == 2 ? i - 2 : i + 1]];
+			edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+		}
+		for (std::unordered_map<uint64_t, unsigned int>::const_iterator it = edgeUses.begin(); it != edgeUses.end(); ++it) {
+			if (it->second != 2) {
+				locked[(unsigned int)(it->first >> 32)] = 1;
+				locked[(unsigned int)(it->first & 0xffffffffu)] = 1;
+			}
+		}
+	}
+
+	const double maxErrorSquared = (double)maxError * maxError;
+	double largestError = 0.0;
+
+	std::vector<unsigned int> firstTriangle(numVertices + 1);
+	std::vector<unsigned int> vertexTriangles;
+	std::vector<unsigned char> touched(numVertices);
+	std::vector<EdgeCollapse> collapses;
+	std::vector<unsigned int> remap(numVertices);
+
+	while (liveTriangles > targetTriangles) {
+		// triangles around every position
+		std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+		for (size_t i = 0; i < result.size(); i++)
+			firstTriangle[canonical[result[i]] + 1]++;
+		for (unsigned int v = 0; v < numVertices; v++)
+			firstTriangle[v + 1] += firstTriangle[v];
+		vertexTriangles.resize(result.size());
+		{
+			std::vector<unsigned int> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				vertexTriangles[cursor[canonical[result[i]]]++] = (unsigned int)(i / 3);
+		}
+
+		// every edge once (the two triangles of an inner edge see it in opposite directions), in its cheapest direction
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i++) {
+			const unsigned int a = canonical[result[i]];
+			const unsigned int b = canonical[result[i % 3 == 2 ? i - 2 : i + 1]];
+			if (a > b || (locked[a] && locked[b]))
+				continue;
+
+			Quadric q = quadrics[a];
+			addQuadric(q, quadrics[b]);
+
+			EdgeCollapse collapse;
+			const double errorAB = locked[a] ? -1.0 : quadricError(q, positions + 3 * b);
+			const double errorBA = locked[b] ? -1.0 : quadricError(q, positions + 3 * a);
+			if (errorBA < 0.0 || (errorAB >= 0.0 && errorAB <= errorBA)) {
+				collapse.from = a;
+				collapse.to = b;
+				collapse.error = errorAB;
+			}
+			else {
+				collapse.from = b;
+				collapse.to = a;
+				collapse.error = errorBA;
+			}
+			collapses.push_back(collapse);
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		for (unsigned int v = 0; v < numVertices; v++)
+			remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t collapsed = 0;
+
+		for (size_t c = 0; c < collapses.size() && liveTriangles > targetTriangles; c++) {
+			const EdgeCollapse& collapse = collapses[c];
+			if (collapse.error > maxErrorSquared)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			const unsigned int* triangles = &vertexTriangles[firstTriangle[collapse.from]];
+			const unsigned int count = firstTriangle[collapse.from + 1] - firstTriangle[collapse.from];
+			if (collapseFlipsTriangle(positions, result, canonical, triangles, count, collapse.from, collapse.to))
+				continue;
+
+			// every vertex at the collapsed position moves, on its own side of the seams
+			unsigned int w = collapse.from;
+			do {
+				remap[w] = collapseTarget(vertices, numVertices, result, canonical, wedgeNext, triangles, count, w, collapse.to);
+				w = wedgeNext[w];
+			} while (w != collapse.from);
+
+			// the triangles sharing the edge degenerate, the neighbourhood is frozen until the next pass
+			for (unsigned int i = 0; i < count; i++) {
+				const unsigned int* triangle = &result[3 * triangles[i]];
+				bool removed = false;
+				for (int k = 0; k < 3; k++) {
+					removed |= canonical[triangle[k]] == collapse.to;
+					touched[canonical[triangle[k]]] = 1;
+				}
+				if (removed)
+					liveTriangles--;
+			}
+
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			largestError = std::max(largestError, collapse.error);
+			collapsed++;
+		}
+
+		if (collapsed == 0)
+			break;
+
+		// move the collapsed vertices and drop the degenerate triangles
+		write = 0;
+		for (size_t t = 0; t < result.size(); t += 3) {
+			const unsigned int a = remap[result[t + 0]];
+			const unsigned int b = remap[result[t + 1]];
+			const unsigned int c = remap[result[t + 2]];
+			if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c])
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+		liveTriangles = write / 3;
+	}
+
+	return (float)std::sqrt(largestError);
+}
+
+/**
+ * \brief Append up to MESH_LOD_LEVELS - 1 simplified levels to the index buffer of the mesh.
+ * Every level is simplified from the full mesh with half the triangles of the previous one. The levels stop when the error
+ * bound or the locked borders keep the mesh from getting noticeably smaller.
+ * The indices of mapped meshes are copied to their own storage.
+ */
+void generateMeshLods(MeshData& mesh) {
+	std::vector<unsigned int> indices;
+	getMeshIndices(mesh, indices);
+
+	std::vector<unsigned int> allIndices(indices);
+	std::vector<unsigned int> lodTriangles(1, mesh.numTriangles);
+	std::vector<float> lodErrors(1, 0.0f);
+	std::vector<unsigned int> lod;
+
+	unsigned int targetTriangles = mesh.numTriangles;
+	for (unsigned int level = 1; level < MESH_LOD_LEVELS; level++) {
+		targetTriangles = (unsigned int)(targetTriangles * MESH_LOD_REDUCTION);
+		if (targetTriangles < MESH_LOD_MIN_TRIANGLES)
+			break;
+
+		const float error = simplifyMesh(mesh.vertices(), mesh.numVertices, indices, targetTriangles, MESH_LOD_MAX_ERROR, lod);
+		if (lod.size() / 3 > 0.9 * lodTriangles.back())
+			break;
+
+		optimizeVertexCache(lod, mesh.numVertices);
+		allIndices.insert(allIndices.end(), lod.begin(), lod.end());
+		lodTriangles.push_back((unsigned int)(lod.size() / 3));
+		lodErrors.push_back(error);
+	}
+
+	setMeshLodIndices(mesh, allIndices, lodTriangles);
+	for (unsigned int i = 0; i < mesh.numLods; i++)
+		mesh.lodErrors[i] = lodErrors[i];
+}
+
+// -----------------------  Level selection ---------------------------------
+
+/**
+ * \brief Camera of the frame, the errors of the levels are projected to pixels with it.
+ * \param viewportHeight [in] height of the viewport in pixels
+ */
+void setLodCamera(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int viewportHeight) {
+	lodCamera.position = glm::vec3(glm::inverse(viewMatrix)[3]);
+	lodCamera.perspective = projectionMatrix[2][3] != 0.0f;
+	// projectionMatrix[1][1] maps one unit (at distance 1) to the half height of the viewport in NDC
+	lodCamera.pixelScale = 0.5f * projectionMatrix[1][1] * (float)viewportHeight;
+}
+
+/**
+ * \brief Diameter in pixels of a world space sphere seen by the camera of the frame (FLT_MAX when the camera is inside).
+ */
+float projectedSphereSize(const glm::vec3& center, float radius) {
+	if (!lodCamera.perspective)
+		return 2.0f * radius * lodCamera.pixelScale;
+
+	const float distance = glm::distance(center, lodCamera.position) - radius;
+	if (distance <= 0.0f)
+		return FLT_MAX;
+	return 2.0f * radius * lodCamera.pixelScale / distance;
+}
+
+/**
+ * \brief Coarsest level of detail of the geometry whose error projects to at most MESH_LOD_PIXEL_ERROR pixels.
+ * The error is projected at the point of the bounding sphere closest to the camera.
+ */
+const ObjectGeometry* selectGeometryLod(const ObjectGeometry* geometry, const glm::mat4& modelMatrix) {
+	if (!useMeshLod || geometry == NULL || geometry->nextLod == NULL || geometry->boundsRadius < 0.0f)
+		return geometry;
+
+	const float scale = maxScale(modelMatrix);
+	float pixelsPerUnit = scale * lodCamera.pixelScale;
+	if (lodCamera.perspective) {
+		const glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(geometry->boundsCenter, 1.0f));
+		const float distance = glm::distance(center, lodCamera.position) - geometry->boundsRadius * scale;
+		if (distance <= 0.0f)
+			return geometry;
+		pixelsPerUnit /= distance;
+	}
+
+	const ObjectGeometry* selected = geometry;
+	while (selected->nextLod != NULL && selected->nextLod->lodError * pixelsPerUnit <= MESH_LOD_PIXEL_ERROR)
+		selected = selected->nextLod;
+	return selected;
+}
+
+// -----------------------  Benchmark ---------------------------------
+
+/**
+ * \brief Import every model and report the triangles and the error of each level of detail and the simplification time.
+ * Everything runs on the CPU, no OpenGL context is needed.
+ */
+void benchmarkMeshLod(const std::vector<std::string>& fileNames) {
+	typedef std::chrono::high_resolution_clock Clock;
+
+	printf("%-45s", "model");
+	for (unsigned int l = 0; l < MESH_LOD_LEVELS; l++) {
+		char label[16];
+		snprintf(label, sizeof(label), "LOD%u tris", l);
+		printf(" %10s %6s", label, "error");
+	}
+	printf(" %10s\n", "lod ms");
+
+	for (size_t i = 0; i < fileNames.size(); i++) {
+		ModelData model;
+		if (!importModel(fileNames[i], model, false)) {
+			std::cerr << "\033[31mbenchmarkMeshLod : Cannot load : " << fileNames[i] << "\033[0m" << std::endl;
+			continue;
+		}
+
+		// levels missing on a sub-mesh count with the triangles of its coarsest level
+		size_t triangles[MESH_LOD_LEVELS] = { 0 };
+		float errors[MESH_LOD_LEVELS] = { 0.0f };
+		double lodMs = 0.0;
+
+		for (size_t m = 0; m < model.meshes.size(); m++) {
+			MeshData& mesh = model.meshes[m];
+			optimizeMesh(mesh);
+
+			Clock::time_point start = Clock::now();
+			generateMeshLods(mesh);
+			lodMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			for (unsigned int l = 0; l < MESH_LOD_LEVELS; l++) {
+				const unsigned int level = std::min(l, mesh.numLods - 1);
+				triangles[l] += mesh.lodTriangles[level];
+				errors[l] = std::max(errors[l], mesh.lodErrors[level]);
+			}
+		}
+
+		printf("%-45s", fileNames[i].c_str());
+		for (unsigned int l = 0; l < MESH_LOD_LEVELS; l++)
+			printf(" %10zu %6.4f", triangles[l], errors[l]);
+		printf(" %10.2f\n", lodMs);
+	}
+}
@@ -0,0 +1,40 @@
+/*
+* \file meshLod.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Mesh levels of detail - quadric error simplification at import time and level selection by projected error
+*/
+
+#pragma once
+
+#ifndef __MESH_LOD_H
+#define __MESH_LOD_H
+
+#include <string>
+#include <vector>
+#include "pgr.h"
+#include "meshCache.h"
+#include "object.h"
+
+#define MESH_LOD_REDUCTION 0.5f			// target triangle count of a level relative to the previous one
+#define MESH_LOD_MIN_TRIANGLES 32		// no level is generated below this triangle count
+#define MESH_LOD_MAX_ERROR 0.05f		// largest quadric error of a level (rms distance, model space, the models are unitized to (-1..1)^3)
+#define MESH_LOD_PIXEL_ERROR 1.0f		// a coarser level is drawn when its error covers at most this many pixels
+#define MESH_LOD_STRESS_COUNT 1000		// default number of cars of the level of detail stress scene
+
+extern bool useMeshLod;					///< false always draws the full resolution meshes (--no-mesh-lod)
+extern unsigned int modelStressCount;	///< cars of the level of detail stress scene, 0 = off (--stress-models)
+
+// -----------------------  Simplification ---------------------------------
+float simplifyMesh(const float* vertices, unsigned int numVertices, const std::vector<unsigned int>& indices,
+	unsigned int targetTriangles, float maxError, std::vector<unsigned int>& result);
+void generateMeshLods(MeshData& mesh);
+
+// -----------------------  Level selection ---------------------------------
+void setLodCamera(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int viewportHeight);
+const ObjectGeometry* selectGeometryLod(const ObjectGeometry* geometry, const glm::mat4& modelMatrix);
+float projectedSphereSize(const glm::vec3& center, float radius);
+
+void benchmarkMeshLod(const std::vector<std::string>& fileNames);
+
+#endif // __MESH_LOD_H
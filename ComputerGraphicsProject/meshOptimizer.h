@@ -0,0 +1,27 @@
+/*
+* \file meshOptimizer.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Load time mesh optimization - triangle order for the post-transform vertex cache and vertex order for fetch locality
+*/
+
+#pragma once
+
+#ifndef __MESH_OPTIMIZER_H
+#define __MESH_OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include "meshCache.h"
+
+#define VERTEX_CACHE_SIZE 16	// simulated post-transform cache (FIFO), conservative for current GPUs
+
+float computeACMR(const std::vector<unsigned int>& indices, unsigned int numVertices, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int numVertices, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+unsigned int optimizeVertexFetch(std::vector<float>& vertices, unsigned int numVertices, std::vector<unsigned int>& indices);
+
+void optimizeMesh(MeshData& mesh, float* acmrBefore = NULL, float* acmrAfter = NULL);
+
+void benchmarkVertexCache(const std::vector<std::string>& fileNames);
+
+#endif // __MESH_OPTIMIZER_H
@@ -32,7 +32,7 @@
 #define TREE2_MODEL_NAME "data/tree2/Tree2.obj"
 
 #define SKYBOX_PATH_NAME "data/skybox"
-#define EXPLOSION_TEXTURE_NAME "data/fire.png";
+#define EXPLOSION_TEXTURE_NAME "data/fire.png"
 #define GAMEOVER_BANNER_NAME "data/gameOver.png"
 #define COMMANDS_BANNER_NAME "data/commands.png"
 #define CUBE_TEXTURE_NAME "data/crate.jpg"
@@ -55,34 +55,15 @@ typedef struct _ShaderProgram {
 		GLint color;		// used only if no lighting 
 		GLint normal;
 		GLint texCoord;
-		GLint time;
-
-		// material locations
-		GLint ambient;
-		GLint diffuse;
-		GLint specular;
-		GLint shininess;
-		GLint useTexture;
 		GLint texSampler;
 
-		// uniforms locations
-		GLint PVM;
-		GLint ViewMatrix;
-		GLint ModelMatrix;
-		GLint NormalMatrix;
-
-		GLint fogOn;
-
-		GLint sunAmbient;
-		GLint sunDiffuse;
-		GLint sunSpecular;
-		GLint sunPosition;
-		GLint sunSpotDirection;
-		GLint turnSunOn;
-		GLint useSpotLight;
-		GLint usePointLight;
-		GLint spotLightPosition;
-		GLint spotLightDirection;
+		// per instance attributes (instanced variant only)
+		GLint instanceModelMatrix;	// mat4, uses 4 consecutive locations
+		GLint instanceTint;
+
+		// uniform blocks (uniformBuffers.h)
+		GLuint frameData;
+		GLuint objectData;
 	} locations;
 
 
@@ -92,29 +73,12 @@ typedef struct _ShaderProgram {
 		locations.normal = -1;
 		locations.texCoord = -1;
 
-		locations.ambient = -1;
-		locations.diffuse = -1;
-		locations.specular = -1;
-		locations.shininess = -1;
-		locations.useTexture = -1;
 		locations.texSampler = -1;
+		locations.instanceModelMatrix = -1;
+		locations.instanceTint = -1;
 
-		locations.PVM = -1;
-		locations.ViewMatrix = -1;
-		locations.ModelMatrix = -1;
-		locations.NormalMatrix = -1;
-
-		locations.fogOn = -1;
-		locations.sunAmbient = -1;
-		locations.sunDiffuse = -1;
-		locations.sunSpecular = -1;
-		locations.sunPosition = -1;
-		locations.sunSpotDirection = -1;
-		locations.turnSunOn = -1;
-		locations.useSpotLight = -1;
-		locations.usePointLight = -1;
-		locations.spotLightPosition = -1;
-		locations.spotLightDirection = -1;
+		locations.frameData = GL_INVALID_INDEX;
+		locations.objectData = GL_INVALID_INDEX;
 	}
 
 } ShaderProgram;
@@ -148,6 +112,8 @@ typedef struct _ExplosionShaderProgram {
 		GLint texCoord;
 		GLint texSampler;
 		GLint frameDuration;
+		GLint particlePositionSize;	// per instance attributes (particleSystem.h)
+		GLint particleStartTime;
 	} locations;
 
 	_ExplosionShaderProgram() : program(0), initialized(false) {
@@ -158,6 +124,8 @@ typedef struct _ExplosionShaderProgram {
 		locations.texCoord = -1;
 		locations.texSampler = -1;
 		locations.frameDuration = -1;
+		locations.particlePositionSize = -1;
+		locations.particleStartTime = -1;
 	}
 } ExplosionShaderProgram;
 
@@ -215,7 +183,31 @@ typedef struct _ObjectGeometry {
 	GLuint        elementBufferObject;  ///< identifier for the element buffer object
 	GLuint        vertexArrayObject;    ///< identifier for the vertex array object
 	unsigned int  numTriangles;         ///< number of triangles in the mesh
+	unsigned int  numVertices;          ///< number of vertices in the vertex buffer (own buffers only)
+	GLenum        indexType;            ///< GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	size_t        indexOffset;          ///< byte offset of the first index in the element buffer
+	GLint         baseVertex;           ///< added to every index (meshes suballocated from the geometry arena)
+	bool          inArena;              ///< buffers and vao belong to the geometry arena
 	Material      material;             ///< material of the object
+	glm::vec3     positionScale;        ///< vertex position = stored position * positionScale + positionOffset
+	glm::vec3     positionOffset;       ///< (1 and 0 unless the positions are quantized)
+	glm::vec3     boundsMin;            ///< model space AABB of the vertices
+	glm::vec3     boundsMax;
+	glm::vec3     boundsCenter;         ///< model space bounding sphere
+	float         boundsRadius;         ///< -1 when the bounds are unknown (never culled)
+	float         lodError;             ///< root mean square quadric distance to the full resolution mesh (model space)
+	struct _ObjectGeometry* nextLod;    ///< next coarser level of detail (same buffers and material, other index range), owned
+
+	_ObjectGeometry() : vertexBufferObject(0), elementBufferObject(0), vertexArrayObject(0), numTriangles(0), numVertices(0), indexType(GL_UNSIGNED_INT),
+		indexOffset(0), baseVertex(0), inArena(false),
+		positionScale(1.0f), positionOffset(0.0f), boundsMin(0.0f), boundsMax(0.0f), boundsCenter(0.0f), boundsRadius(-1.0f),
+		lodError(0.0f), nextLod(NULL) {
+		material.ambient = glm::vec3(0.0f);
+		material.diffuse = glm::vec3(0.0f);
+		material.specular = glm::vec3(0.0f);
+		material.shininess = 0.0f;
+		material.texture = 0;
+	}
 } ObjectGeometry;
 
 
@@ -237,7 +229,7 @@ struct Mesh {
  * \brief Object in the scene.
  */
 typedef struct _Object {
-	int id;				// The id will be used to identify the object when using the stencil test
+	int id;				// The id identifies the object
 	glm::vec3 position;
 	glm::vec3 direction;
 	float     speed;
@@ -278,20 +270,6 @@ typedef struct _Player : public Object {
 
 } Player;
 
-typedef struct _Aircraft : public Object {
-	bool isMoving;
-	float rotationSpeed;
-	glm::vec3 initPosition;
-
-	_Aircraft(int id) : Object(id) {}
-} Aircraft;
-
-typedef struct _ExplosionObject : public Object {
-	int    textureFrames;
-	float  frameDuration;
-
-	_ExplosionObject() : Object(-1) {}
-} ExplosionObject;
 
 
 
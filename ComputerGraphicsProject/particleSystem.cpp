@@ -0,0 +1,127 @@
+/*
+* \file particleSystem.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Fixed capacity pool of animated billboards (explosions), all drawn with one instanced call
+*/
+
+#include <iostream>
+#include <cstddef>
+#include "particleSystem.h"
+#include "renderStats.h"
+#include "data.h"
+
+ParticlePool explosionParticles;
+unsigned int particleStressCount = 0;
+
+/**
+ * \brief Allocate the pool and its instance buffer, nothing is allocated afterwards.
+ */
+void initParticlePool(ParticlePool& pool, unsigned int capacity) {
+	pool.capacity = capacity;
+	pool.instances.resize(capacity);
+	pool.endTime.resize(capacity);
+	pool.count = 0;
+	pool.dropped = 0;
+
+	glGenBuffers(1, &pool.instanceBufferObject);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.instanceBufferObject);
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void cleanupParticlePool(ParticlePool& pool) {
+	glDeleteBuffers(1, &pool.instanceBufferObject);
+	pool.instanceBufferObject = 0;
+	pool.instances.clear();
+	pool.endTime.clear();
+	pool.count = 0;
+	pool.capacity = 0;
+}
+
+/**
+ * \brief Add the per instance attributes of the pool to a vao holding the billboard quad.
+ */
+void attachParticleInstances(const ParticlePool& pool, GLuint vertexArrayObject, GLint positionSizeLocation, GLint startTimeLocation) {
+	glBindVertexArray(vertexArrayObject);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.instanceBufferObject);
+
+	glEnableVertexAttribArray(positionSizeLocation);
+	glVertexAttribPointer(positionSizeLocation, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, positionSize));
+	glVertexAttribDivisor(positionSizeLocation, 1);
+
+	glEnableVertexAttribArray(startTimeLocation);
+	glVertexAttribPointer(startTimeLocation, 1, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, startTime));
+	glVertexAttribDivisor(startTimeLocation, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * \brief Start a billboard animation.
+ * \return false if the pool is full (the billboard is dropped)
+ */
+bool spawnParticle(ParticlePool& pool, const glm::vec3& position, float size, float time, float lifetime) {
+	if (pool.count == pool.capacity) {
+		pool.dropped++;
+		return false;
+	}
+	ParticleInstance& instance = pool.instances[pool.count];
+	instance.positionSize = glm::vec4(position, size);
+	instance.startTime = time;
+	pool.endTime[pool.count] = time + lifetime;
+	pool.count++;
+	return true;
+}
+
+/**
+ * \brief Remove the finished billboards, the last live one takes the place of a removed one.
+ */
+void updateParticles(ParticlePool& pool, float time) {
+	pool.time = time;
+	unsigned int i = 0;
+	while (i < pool.count) {
+		if (time > pool.endTime[i]) {
+			pool.count--;
+			pool.instances[i] = pool.instances[pool.count];
+			pool.endTime[i] = pool.endTime[pool.count];
+		}
+		else {
+			i++;
+		}
+	}
+}
+
+void clearParticles(ParticlePool& pool) {
+	pool.count = 0;
+}
+
+/**
+ * \brief Top the pool up to count billboards scattered over the terrain (stress scene).
+ *  The start times are spread over the lifetime so that every frame of the animation is on screen.
+ */
+void scatterParticles(ParticlePool& pool, unsigned int count, float size, float time, float lifetime) {
+	while (pool.count < count && pool.count < pool.capacity) {
+		const float x = TERRAIN_SIZE * (2.0f * rand() / (float)RAND_MAX - 1.0f);
+		const float y = TERRAIN_SIZE * (2.0f * rand() / (float)RAND_MAX - 1.0f);
+		const float z = MIN_HEIGHT + (MAX_HEIGHT - MIN_HEIGHT) * rand() / (float)RAND_MAX;
+		const float age = lifetime * rand() / (float)RAND_MAX;
+		spawnParticle(pool, glm::vec3(x, y, z), size, time - age, lifetime);
+	}
+}
+
+/**
+ * \brief Stream the live billboards into the instance buffer (orphaning the previous content).
+ * \return number of billboards to draw
+ */
+unsigned int uploadParticles(ParticlePool& pool) {
+	if (pool.count == 0)
+		return 0;
+	glBindBuffer(GL_ARRAY_BUFFER, pool.instanceBufferObject);
+	glBufferData(GL_ARRAY_BUFFER, pool.capacity * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, pool.count * sizeof(ParticleInstance), pool.instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	COUNT_GL_CALLS(4);
+	return pool.count;
+}
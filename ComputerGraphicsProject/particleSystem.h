@@ -0,0 +1,58 @@
+/*
+* \file particleSystem.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Fixed capacity pool of animated billboards (explosions), all drawn with one instanced call
+*/
+
+#pragma once
+
+#ifndef __PARTICLE_SYSTEM_H
+#define __PARTICLE_SYSTEM_H
+
+#include <vector>
+#include "pgr.h"
+
+#define PARTICLE_CAPACITY 4096			// billboards of the explosion pool (raised by the stress scene)
+#define PARTICLE_STRESS_COUNT 50000		// default number of billboards of the stress scene
+
+/**
+ * \brief Per instance vertex attributes of a billboard (divisor 1).
+ */
+typedef struct _ParticleInstance {
+	glm::vec4 positionSize;		///< world space center (xyz) and half size (w)
+	float     startTime;		///< the sprite sheet animation starts at this time
+} ParticleInstance;
+
+static_assert(sizeof(ParticleInstance) == 20, "ParticleInstance is uploaded as is, it must stay tightly packed");
+
+/**
+ * \brief Live billboards are kept in [0, count), a dead one is replaced by the last one.
+ */
+typedef struct _ParticlePool {
+	std::vector<ParticleInstance> instances;	///< uploaded as is to the instance buffer
+	std::vector<float> endTime;					///< the billboard is removed after this time
+	unsigned int count;
+	unsigned int capacity;
+	unsigned int dropped;						///< spawns refused because the pool was full
+	float time;									///< time of the last update, drives the animation
+	GLuint instanceBufferObject;
+
+	_ParticlePool() : count(0), capacity(0), dropped(0), time(0.0f), instanceBufferObject(0) {}
+} ParticlePool;
+
+extern ParticlePool explosionParticles;
+extern unsigned int particleStressCount;	///< billboards of the stress scene, 0 = off (--stress-particles)
+
+void initParticlePool(ParticlePool& pool, unsigned int capacity);
+void cleanupParticlePool(ParticlePool& pool);
+void attachParticleInstances(const ParticlePool& pool, GLuint vertexArrayObject, GLint positionSizeLocation, GLint startTimeLocation);
+
+bool spawnParticle(ParticlePool& pool, const glm::vec3& position, float size, float time, float lifetime);
+void updateParticles(ParticlePool& pool, float time);
+void clearParticles(ParticlePool& pool);
+void scatterParticles(ParticlePool& pool, unsigned int count, float size, float time, float lifetime);
+
+unsigned int uploadParticles(ParticlePool& pool);
+
+#endif // __PARTICLE_SYSTEM_H
@@ -0,0 +1,202 @@
+/*
+* \file picking.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Mouse picking by casting the mouse ray against the entities on the CPU (no stencil read back), the terrain
+* and the player hide the entities behind them
+*/
+
+#include <cfloat>
+#include "picking.h"
+#include "renderer.h"
+
+#define PICKING_CUBE_RADIUS 0.8660254f	// the cube is tested as its bounding sphere (corners of the unit cube)
+#define PICKING_TERRAIN_STEP 0.5f		// terrain march step in heightfield cells
+#define PICKING_TERRAIN_REFINE 8		// bisection steps once the ray went under the ground
+
+static glm::mat4 inverseViewProjection(1.0f);
+static const MeshBVH* playerBVH = NULL;
+static glm::mat4 playerModelMatrix(1.0f);
+
+/**
+ * \brief Camera of the last drawn frame, the mouse rays are cast from it.
+ */
+void setPickingCamera(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+	inverseViewProjection = glm::inverse(projectionMatrix * viewMatrix);
+}
+
+/**
+ * \brief Player of the last drawn frame, it hides the entities behind it (NULL when it is not drawn).
+ */
+void setPickingPlayer(const MeshBVH* bvh, const glm::mat4& modelMatrix) {
+	playerBVH = bvh;
+	playerModelMatrix = modelMatrix;
+}
+
+/**
+ * \brief Ray through the center of the pixel under the mouse (perspective and parallel projections).
+ */
+PickingRay screenRay(int mouseX, int mouseY, int windowWidth, int windowHeight) {
+	const float x = 2.0f * (mouseX + 0.5f) / windowWidth - 1.0f;
+	const float y = 1.0f - 2.0f * (mouseY + 0.5f) / windowHeight;
+
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+	nearPoint = nearPoint / nearPoint.w;
+	farPoint = farPoint / farPoint.w;
+
+	PickingRay ray;
+	ray.origin = glm::vec3(nearPoint);
+	ray.direction = glm::normalize(glm::vec3(farPoint) - glm::vec3(nearPoint));
+	return ray;
+}
+
+/**
+ * \brief Entry distance of the ray into a sphere, FLT_MAX when missed.
+ */
+static float raySphereDistance(const PickingRay& ray, const glm::vec3& center, float radius) {
+	const glm::vec3 toCenter = center - ray.origin;
+	const float along = glm::dot(toCenter, ray.direction);
+	const float distanceSquared = glm::dot(toCenter, toCenter) - along * along;
+	if (distanceSquared > radius * radius)
+		return FLT_MAX;
+	const float entry = along - std::sqrt(radius * radius - distanceSquared);
+	const float exit = along + std::sqrt(radius * radius - distanceSquared);
+	if (exit < 0.0f)
+		return FLT_MAX;
+	return std::max(entry, 0.0f);
+}
+
+/**
+ * \brief Part of the ray inside an axis aligned box.
+ * \return false when the ray misses the box
+ */
+static bool rayBoxRange(const PickingRay& ray, const glm::vec3& boxMin, const glm::vec3& boxMax, float& enter, float& exit) {
+	enter = 0.0f;
+	exit = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++) {
+		if (std::fabs(ray.direction[axis]) < 1e-8f) {
+			if (ray.origin[axis] < boxMin[axis] || ray.origin[axis] > boxMax[axis])
+				return false;
+			continue;
+		}
+		const float t0 = (boxMin[axis] - ray.origin[axis]) / ray.direction[axis];
+		const float t1 = (boxMax[axis] - ray.origin[axis]) / ray.direction[axis];
+		enter = std::max(enter, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+	}
+	return enter <= exit;
+}
+
+/**
+ * \brief First point where the ray goes under the terrain, marched over the heightfield cells and refined by
+ * bisection. FLT_MAX when the ground is not hit before maxDistance (or the heightfield is not baked yet).
+ */
+static float rayTerrainDistance(const Heightfield& heightfield, const PickingRay& ray, float maxDistance) {
+	if (heightfield.resolution == 0)
+		return FLT_MAX;
+
+	float lowest = FLT_MAX;
+	float highest = -FLT_MAX;
+	for (size_t i = 0; i < heightfield.heights.size(); i++) {
+		const float height = heightfield.heightOffset + heightfield.heightScale * heightfield.heights[i];
+		lowest = std::min(lowest, height);
+		highest = std::max(highest, height);
+	}
+	const float extent = (heightfield.resolution - 1) / heightfield.inverseCellSize;
+	const glm::vec3 boxMin(heightfield.gridOriginX, heightfield.gridOriginY - extent, lowest);
+	const glm::vec3 boxMax(heightfield.gridOriginX + extent, heightfield.gridOriginY, highest);
+
+	float enter, exit;
+	if (!rayBoxRange(ray, boxMin, boxMax, enter, exit) || enter > maxDistance)
+		return FLT_MAX;
+	exit = std::min(exit, maxDistance);
+
+	const float step = PICKING_TERRAIN_STEP / heightfield.inverseCellSize;
+	float above = enter;
+	for (float t = enter; ; t = std::min(t + step, exit)) {
+		const glm::vec3 point = ray.origin + ray.direction * t;
+		if (point.z <= terrainHeight(heightfield, point.x, point.y)) {
+			if (t == enter)
+				return t;
+			float below = t;
+			for (int i = 0; i < PICKING_TERRAIN_REFINE; i++) {
+				const float middle = 0.5f * (above + below);
+				const glm::vec3 probe = ray.origin + ray.direction * middle;
+				if (probe.z <= terrainHeight(heightfield, probe.x, probe.y))
+					below = middle;
+				else
+					above = middle;
+			}
+			return below;
+		}
+		above = t;
+		if (t >= exit)
+			return FLT_MAX;
+	}
+}
+
+/**
+ * \brief Closest hit of the ray with the triangles of a model, FLT_MAX when missed before maxDistance.
+ */
+static float rayModelDistance(const MeshBVH& bvh, const glm::mat4& modelMatrix, const PickingRay& ray, float maxDistance) {
+	// the ray is moved into model space, the models are scaled uniformly
+	const glm::mat4 inverseModel = glm::inverse(modelMatrix);
+	const glm::vec3 modelOrigin = glm::vec3(inverseModel * glm::vec4(ray.origin, 1.0f));
+	glm::vec3 modelDirection = glm::vec3(inverseModel * glm::vec4(ray.direction, 0.0f));
+	const float scale = glm::length(modelDirection);	// model units per world unit
+	modelDirection = modelDirection / scale;
+
+	float modelDistance;
+	if (!intersectRay(bvh, modelOrigin, modelDirection, maxDistance == FLT_MAX ? FLT_MAX : maxDistance * scale, modelDistance))
+		return FLT_MAX;
+	return modelDistance / scale;
+}
+
+/**
+ * \brief Closest entity under the ray : bounding sphere first, then the triangles of its model. The entities are
+ * placed where they were drawn (interpolated between the last two simulation steps), and the ones behind the
+ * terrain or the player are not picked.
+ * \param distance [out] distance along the ray to the hit
+ * \return slot of the entity, ENTITY_NONE when the ray hits nothing or an occluder first
+ */
+unsigned int pickEntity(const EntityStore& store, const PickingRay& ray, float& distance) {
+	unsigned int picked = ENTITY_NONE;
+	float closest = rayTerrainDistance(terrainHeightfield, ray, FLT_MAX);
+
+	// the first person camera is inside the player, which must not hide everything
+	if (playerBVH != NULL) {
+		const glm::vec3 playerCenter = glm::vec3(playerModelMatrix[3]);
+		const float playerRadius = playerBVH->boundingRadius * glm::length(glm::vec3(playerModelMatrix[0]));
+		if (glm::length(ray.origin - playerCenter) > playerRadius && raySphereDistance(ray, playerCenter, playerRadius) < closest)
+			closest = std::min(closest, rayModelDistance(*playerBVH, playerModelMatrix, ray, closest));
+	}
+
+	for (unsigned int i = 0; i < store.count; i++) {
+		if (store.flags[i] & ENTITY_DESTROYED)
+			continue;
+
+		const glm::vec3 position = interpolatedPosition(store, i);
+		const MeshBVH* bvh = entityBVH(store.mesh[i]);
+		const float radius = store.size[i] * (bvh != NULL ? bvh->boundingRadius : PICKING_CUBE_RADIUS);
+		const float sphereDistance = raySphereDistance(ray, position, radius);
+		if (sphereDistance >= closest)
+			continue;
+
+		if (bvh == NULL) {
+			closest = sphereDistance;
+			picked = i;
+			continue;
+		}
+
+		const float modelDistance = rayModelDistance(*bvh, modelEntityMatrix(position, interpolatedDirection(store, i), store.size[i]), ray, closest);
+		if (modelDistance < closest) {
+			closest = modelDistance;
+			picked = i;
+		}
+	}
+
+	if (picked != ENTITY_NONE)
+		distance = closest;
+	return picked;
+}
@@ -0,0 +1,31 @@
+/*
+* \file picking.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Mouse picking by casting the mouse ray against the entities on the CPU (no stencil read back), the terrain
+* and the player hide the entities behind them
+*/
+
+#pragma once
+
+#ifndef __PICKING_H
+#define __PICKING_H
+
+#include "pgr.h"
+#include "entityStore.h"
+#include "meshBVH.h"
+
+/**
+ * \brief World space ray under a window position.
+ */
+typedef struct _PickingRay {
+	glm::vec3 origin;		///< on the near plane
+	glm::vec3 direction;	///< normalized
+} PickingRay;
+
+void setPickingCamera(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+void setPickingPlayer(const MeshBVH* bvh, const glm::mat4& modelMatrix);
+PickingRay screenRay(int mouseX, int mouseY, int windowWidth, int windowHeight);
+unsigned int pickEntity(const EntityStore& store, const PickingRay& ray, float& distance);
+
+#endif // __PICKING_H
@@ -0,0 +1,179 @@
+/*
+* \file programCache.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Program cache - linked shader programs saved with glGetProgramBinary and restored at the next start,
+* keyed by the shader sources and the driver
+*/
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include "programCache.h"
+#include "renderer.h"
+
+bool useProgramBinaryCache = true;
+ProgramCacheStats programCacheStats;
+
+/**
+ * \brief Header at the beginning of every cache file, followed by the binary returned by the driver.
+ */
+typedef struct _ProgramCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;	///< hash of the shader types and sources, in link order
+	uint64_t driverHash;	///< hash of the vendor, renderer and version strings
+	uint32_t format;		///< binary format returned by glGetProgramBinary
+	uint32_t size;
+} ProgramCacheHeader;
+
+static_assert(sizeof(ProgramCacheHeader) == 32, "ProgramCacheHeader layout changed, bump PROGRAM_CACHE_VERSION");
+
+static uint64_t hashBytes(uint64_t hash, const char* bytes, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * \brief Identifies the driver, a binary is only valid for the driver version that produced it.
+ */
+static uint64_t driverHash() {
+	static uint64_t hash = 0;
+	if (hash != 0)
+		return hash;
+
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	hash = 14695981039346656037ull;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		const char* text = (const char*)glGetString(names[i]);
+		if (text != NULL)
+			hash = hashBytes(hash, text, strlen(text));
+	}
+	return hash;
+}
+
+/**
+ * \brief True if the driver can save program binaries (OpenGL 4.1 or GL_ARB_get_program_binary, with at least one
+ * binary format).
+ */
+bool programBinariesSupported() {
+	static int supported = -1;
+	if (supported != -1)
+		return supported == 1;
+
+	const bool entryPoints = hasOpenGLVersion(4, 1) || hasOpenGLExtension("GL_ARB_get_program_binary");
+	GLint formats = 0;
+	if (entryPoints)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	supported = entryPoints && formats > 0 ? 1 : 0;
+	return supported == 1;
+}
+
+/**
+ * \brief Cache file next to the first shader, named after the set of shaders (paths and defines) so that the
+ * programs sharing a shader and the permutations of a program do not overwrite each other.
+ */
+std::string programCacheFileName(const std::string& firstShaderPath, const std::vector<std::string>& shaderKeys) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < shaderKeys.size(); i++)
+		hash = hashBytes(hash, shaderKeys[i].c_str(), shaderKeys[i].size() + 1);
+
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), ".%08x", (unsigned int)(hash ^ (hash >> 32)));
+	return firstShaderPath + suffix + PROGRAM_CACHE_EXTENSION;
+}
+
+/**
+ * \brief Program restored from the cache file. The driver may still reject a binary it produced (after an update
+ * keeping the same version string), the caller then links from source.
+ * \return 0 if the file is missing, stale or rejected
+ */
+GLuint loadProgramBinary(const std::string& cacheFileName, uint64_t sourceHash) {
+	if (!useProgramBinaryCache || !programBinariesSupported())
+		return 0;
+
+	std::ifstream file(cacheFileName.c_str(), std::ios::binary);
+	ProgramCacheHeader header;
+	if (!file || !file.read((char*)&header, sizeof(header)) || header.magic != PROGRAM_CACHE_MAGIC ||
+		header.version != PROGRAM_CACHE_VERSION || header.sourceHash != sourceHash || header.driverHash != driverHash()) {
+		programCacheStats.misses++;
+		return 0;
+	}
+
+	std::vector<char> binary(header.size);
+	if (!file.read(binary.data(), binary.size())) {
+		programCacheStats.misses++;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		glDeleteProgram(program);
+		programCacheStats.misses++;
+		return 0;
+	}
+
+	programCacheStats.hits++;
+	programCacheStats.bytesRead += sizeof(header) + binary.size();
+	return program;
+}
+
+/**
+ * \brief Save the binary of a linked program (written to a temporary file then renamed, a crash never leaves a
+ * truncated cache). The program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+ */
+bool saveProgramBinary(const std::string& cacheFileName, uint64_t sourceHash, GLuint program) {
+	if (!useProgramBinaryCache || !programBinariesSupported())
+		return false;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+		return false;
+
+	ProgramCacheHeader header;
+	header.magic = PROGRAM_CACHE_MAGIC;
+	header.version = PROGRAM_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.driverHash = driverHash();
+	header.format = format;
+	header.size = (uint32_t)written;
+
+	std::string tempFileName = cacheFileName + ".tmp";
+	{
+		std::ofstream file(tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), written);
+		if (!file)
+			return false;
+	}
+
+	// rename() does not replace existing files on Windows
+	std::remove(cacheFileName.c_str());
+	if (std::rename(tempFileName.c_str(), cacheFileName.c_str()) != 0) {
+		std::remove(tempFileName.c_str());
+		return false;
+	}
+
+	programCacheStats.saves++;
+	programCacheStats.bytesWritten += sizeof(header) + written;
+	return true;
+}
@@ -0,0 +1,44 @@
+/*
+* \file programCache.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Program cache - linked shader programs saved with glGetProgramBinary and restored at the next start,
+* keyed by the shader sources and the driver
+*/
+
+#pragma once
+
+#ifndef __PROGRAM_CACHE_H
+#define __PROGRAM_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "pgr.h"
+
+#define PROGRAM_CACHE_EXTENSION ".progcache"
+#define PROGRAM_CACHE_MAGIC 0x43475250u	// "PRGC"
+#define PROGRAM_CACHE_VERSION 1			// bump whenever the file layout changes
+
+/**
+ * \brief Counters of the cache since the start of the application.
+ */
+typedef struct _ProgramCacheStats {
+	unsigned int hits;			///< programs restored from a binary
+	unsigned int misses;		///< programs linked from source (no file, other sources, other driver, rejected binary)
+	unsigned int saves;
+	size_t bytesRead;
+	size_t bytesWritten;
+
+	_ProgramCacheStats() : hits(0), misses(0), saves(0), bytesRead(0), bytesWritten(0) {}
+} ProgramCacheStats;
+
+extern bool useProgramBinaryCache;	///< false always links the programs from source (--no-shader-cache)
+extern ProgramCacheStats programCacheStats;
+
+bool programBinariesSupported();
+std::string programCacheFileName(const std::string& firstShaderPath, const std::vector<std::string>& shaderKeys);
+GLuint loadProgramBinary(const std::string& cacheFileName, uint64_t sourceHash);
+bool saveProgramBinary(const std::string& cacheFileName, uint64_t sourceHash, GLuint program);
+
+#endif // __PROGRAM_CACHE_H
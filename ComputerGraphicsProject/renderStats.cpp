@@ -0,0 +1,109 @@
+/*
+* \file renderStats.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Per frame render counters (binds, draw calls, ...) printed once per second
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include "renderStats.h"
+
+RenderStats renderStats;
+bool printRenderStats = false;
+bool printFrameTimes = false;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static RenderStats accumulated;
+static unsigned int accumulatedFrames = 0;
+static float lastReportTime = -1.0f;
+
+static Clock::time_point lastFrameEnd;
+static bool haveLastFrameEnd = false;
+static double frameTimeSum = 0.0;		///< frame times of the current report in ms, measured end to end
+static double frameTimeMin = 0.0;
+static double frameTimeMax = 0.0;
+static unsigned int frameTimeCount = 0;
+
+/**
+ * \brief glBindVertexArray which is counted in the render stats.
+ */
+void bindVertexArray(GLuint vertexArrayObject) {
+	glBindVertexArray(vertexArrayObject);
+	COUNT_GL_CALLS(1);
+	if (vertexArrayObject != 0)
+		renderStats.vertexArrayBinds++;
+}
+
+void beginRenderStatsFrame() {
+	memset(&renderStats, 0, sizeof(renderStats));
+}
+
+/**
+ * \brief Accumulate the counters of the frame and print their average once per second.
+ * \param elapsedTime [in] time since the start of the application in seconds
+ */
+void endRenderStatsFrame(float elapsedTime) {
+	const Clock::time_point now = Clock::now();
+	if (haveLastFrameEnd) {
+		const double frameTime = std::chrono::duration<double, std::milli>(now - lastFrameEnd).count();
+		frameTimeMin = frameTimeCount == 0 ? frameTime : std::min(frameTimeMin, frameTime);
+		frameTimeMax = frameTimeCount == 0 ? frameTime : std::max(frameTimeMax, frameTime);
+		frameTimeSum += frameTime;
+		frameTimeCount++;
+	}
+	lastFrameEnd = now;
+	haveLastFrameEnd = true;
+
+	accumulated.vertexArrayBinds += renderStats.vertexArrayBinds;
+	accumulated.drawCalls += renderStats.drawCalls;
+	accumulated.multiDrawCalls += renderStats.multiDrawCalls;
+	accumulated.meshesDrawn += renderStats.meshesDrawn;
+	accumulated.instancesDrawn += renderStats.instancesDrawn;
+	accumulated.objectsVisible += renderStats.objectsVisible;
+	accumulated.objectsCulled += renderStats.objectsCulled;
+	accumulated.meshesCulled += renderStats.meshesCulled;
+	accumulated.instancesCulled += renderStats.instancesCulled;
+	accumulated.triangles += renderStats.triangles;
+	accumulated.glCalls += renderStats.glCalls;
+	accumulated.stateChangesSkipped += renderStats.stateChangesSkipped;
+	accumulated.dynamicLights += renderStats.dynamicLights;
+	accumulated.dynamicLightsDropped += renderStats.dynamicLightsDropped;
+	accumulated.clusterLightEntries += renderStats.clusterLightEntries;
+	accumulated.lightBinningMicroseconds += renderStats.lightBinningMicroseconds;
+	accumulatedFrames++;
+
+	if (lastReportTime < 0.0f)
+		lastReportTime = elapsedTime;
+	if (elapsedTime - lastReportTime < 1.0f)
+		return;
+
+	if (printRenderStats) {
+		const float frames = (float)accumulatedFrames;
+		printf("%u frames : %.1f vao binds, %.1f draw calls (%.1f multi draw), %.1f meshes, %.0f instances, %.0f triangles, %.1f GL calls, %.1f state changes skipped per frame\n",
+			accumulatedFrames, accumulated.vertexArrayBinds / frames, accumulated.drawCalls / frames,
+			accumulated.multiDrawCalls / frames, accumulated.meshesDrawn / frames, accumulated.instancesDrawn / frames,
+			accumulated.triangles / frames, accumulated.glCalls / frames, accumulated.stateChangesSkipped / frames);
+		printf("%u frames : %.1f objects visible, %.1f objects culled, %.1f meshes culled, %.0f instances culled per frame\n",
+			accumulatedFrames, accumulated.objectsVisible / frames, accumulated.objectsCulled / frames,
+			accumulated.meshesCulled / frames, accumulated.instancesCulled / frames);
+		if (accumulated.dynamicLights > 0)
+			printf("%u frames : %.0f dynamic lights (%.0f dropped), %.0f cluster entries, %.3f ms binning per frame\n",
+				accumulatedFrames, accumulated.dynamicLights / frames, accumulated.dynamicLightsDropped / frames,
+				accumulated.clusterLightEntries / frames, accumulated.lightBinningMicroseconds / frames / 1000.0f);
+	}
+	if (printFrameTimes && frameTimeCount > 0) {
+		const double average = frameTimeSum / frameTimeCount;
+		printf("frame time : %.2f ms average (%.1f fps), %.2f ms min, %.2f ms max over %u frames\n",
+			average, average > 0.0 ? 1000.0 / average : 0.0, frameTimeMin, frameTimeMax, frameTimeCount);
+	}
+	frameTimeSum = 0.0;
+	frameTimeCount = 0;
+
+	memset(&accumulated, 0, sizeof(accumulated));
+	accumulatedFrames = 0;
+	lastReportTime = elapsedTime;
+}
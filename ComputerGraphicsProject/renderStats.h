@@ -0,0 +1,48 @@
+/*
+* \file renderStats.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Per frame render counters (binds, draw calls, ...) printed once per second
+*/
+
+#pragma once
+
+#ifndef __RENDER_STATS_H
+#define __RENDER_STATS_H
+
+#include "pgr.h"
+
+/**
+ * \brief Counters of one frame, reset by beginRenderStatsFrame().
+ */
+typedef struct _RenderStats {
+	unsigned int vertexArrayBinds;	///< glBindVertexArray calls with a non zero vao
+	unsigned int drawCalls;			///< glDraw* and glMultiDraw* calls
+	unsigned int multiDrawCalls;	///< glMultiDraw* calls (also counted in drawCalls)
+	unsigned int meshesDrawn;		///< sub-meshes drawn, several per multi draw call
+	unsigned int instancesDrawn;	///< instances drawn by instanced draw calls
+	unsigned int objectsVisible;	///< objects passing the frustum test
+	unsigned int objectsCulled;		///< objects outside of the view frustum
+	unsigned int meshesCulled;		///< sub-meshes of visible objects outside of the view frustum
+	unsigned int instancesCulled;
+	unsigned int triangles;
+	unsigned int glCalls;				///< GL calls issued by the scene draws (state changes, uniforms, draws)
+	unsigned int stateChangesSkipped;	///< redundant state changes elided by the draw queue state cache
+	unsigned int dynamicLights;			///< lights binned into the clusters (clusteredLighting.h)
+	unsigned int dynamicLightsDropped;	///< lights over CLUSTER_MAX_LIGHTS, cluster entries over CLUSTER_MAX_LIGHTS_PER_CLUSTER or over the index buffer texture
+	unsigned int clusterLightEntries;	///< light indices of all clusters, the shading cost is bounded by these
+	unsigned int lightBinningMicroseconds;
+} RenderStats;
+
+#define COUNT_GL_CALLS(count) (renderStats.glCalls += (count))
+
+extern RenderStats renderStats;
+extern bool printRenderStats;	///< print the averaged counters once per second (--render-stats)
+extern bool printFrameTimes;	///< print average / min / max frame time once per second (stress scenes)
+
+void bindVertexArray(GLuint vertexArrayObject);
+
+void beginRenderStatsFrame();
+void endRenderStatsFrame(float elapsedTime);
+
+#endif // __RENDER_STATS_H
@@ -6,7 +6,12 @@
 */
 
 #include <iostream>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include "renderer.h"
+#include "assetPipeline.h"
 
 ObjectGeometry* TerrainGeometry = NULL;
 ObjectGeometry* PlayerGeometry = NULL;
@@ -22,8 +27,18 @@ std::vector<ObjectGeometry*> CadillacGeometries;
 std::vector<ObjectGeometry*> Tree1Geometries;
 std::vector<ObjectGeometry*> Tree2Geometries;
 std::vector<ObjectGeometry*> ZepplinGeometries;
+MeshBVH PlayerBVH;	// occluder of the mouse picking
+MeshBVH FoxBatBVH;
+MeshBVH CarBVH;
+MeshBVH PoliceBVH;
+MeshBVH CadillacBVH;
+MeshBVH Tree1BVH;
+MeshBVH Tree2BVH;
+MeshBVH ZepplinBVH;
+InstanceGroup* Tree1Instances = NULL;
 
 ShaderProgram commonShaderProgram;
+ShaderProgram instancedShaderProgram;
 SkyboxShaderProgram skyboxShaderProgram;
 ExplosionShaderProgram explosionShaderProgram;
 BannerShaderProgram bannerShaderProgram;
@@ -36,146 +51,231 @@ bool useLighting = false;
 // -----------------------  OpenGL Stuff ---------------------------------
 
 /**
- * \brief Load all shader programs.
+ * \brief Locations of a lighting program (plain or instanced variant), stored into target at once: the shader hot
+ * reload calls it again with the relinked program.
+ * \param layout [in] program whose vertex array objects the new program draws (permutations), its attribute locations
+ * must be the same, NULL for the first program
+ * \param store [in] false only checks the program (see ProgramSetup)
+ * \return false if an attribute or a uniform is missing
  */
-void loadShaderPrograms() {
+bool setupLightingProgram(GLuint program, ShaderProgram& target, bool instanced, const ShaderProgram* layout, bool store) {
+	ShaderProgram shader;
+	shader.program = program;
+	shader.locations.position = glGetAttribLocation(program, "position");
+	shader.locations.normal = glGetAttribLocation(program, "normal");
+	shader.locations.texCoord = glGetAttribLocation(program, "texCoord");
+	if (instanced) {
+		shader.locations.instanceModelMatrix = glGetAttribLocation(program, "instanceModelMatrix");
+		shader.locations.instanceTint = glGetAttribLocation(program, "instanceTint");
+	}
 
-	std::vector<GLuint> shaderList;
+	shader.locations.texSampler = glGetUniformLocation(program, "fragTexSampler");
 
-	shaderList.push_back(pgr::createShaderFromFile(GL_VERTEX_SHADER, "lightingShaderPerFrag.vert"));
-	shaderList.push_back(pgr::createShaderFromFile(GL_FRAGMENT_SHADER, "lightingShaderPerFrag.frag"));
+	// per frame and per object data are uniform blocks
+	shader.locations.frameData = glGetUniformBlockIndex(program, "FrameData");
+	shader.locations.objectData = glGetUniformBlockIndex(program, "ObjectData");
 
-	commonShaderProgram.program = pgr::createProgram(shaderList);
-	commonShaderProgram.locations.position = glGetAttribLocation(commonShaderProgram.program, "position");
-	commonShaderProgram.locations.normal = glGetAttribLocation(commonShaderProgram.program, "normal");
-	commonShaderProgram.locations.texCoord = glGetAttribLocation(commonShaderProgram.program, "texCoord");
+	// Testing if all attributes and uniforms are found. The permutations drop the texture coordinates (and the sampler)
+	// without LIGHTING_TEXTURE and the normals without lighting, their vertex array objects simply feed nothing there
+	if (shader.locations.position == -1 || (layout == NULL && (shader.locations.normal == -1 || shader.locations.texCoord == -1)) ||
+		(instanced && (shader.locations.instanceModelMatrix == -1 || shader.locations.instanceTint == -1)) ||
+		(layout == NULL && shader.locations.texSampler == -1) ||
+		shader.locations.frameData == GL_INVALID_INDEX || shader.locations.objectData == GL_INVALID_INDEX) {
+		std::cerr << "\033[31msetupLightingProgram : missing attribute or uniform\033[0m" << std::endl;
+		return false;
+	}
+	// only the active attributes have to sit where the vertex array objects put them
+	if (layout != NULL && (shader.locations.position != layout->locations.position
+		|| (shader.locations.normal != -1 && shader.locations.normal != layout->locations.normal)
+		|| (shader.locations.texCoord != -1 && shader.locations.texCoord != layout->locations.texCoord)
+		|| shader.locations.instanceModelMatrix != layout->locations.instanceModelMatrix
+		|| shader.locations.instanceTint != layout->locations.instanceTint)) {
+		std::cerr << "\033[31msetupLightingProgram : attribute locations differ from the vertex array objects\033[0m" << std::endl;
+		return false;
+	}
+	if (!store)
+		return true;
+
+	bindUniformBlocks(shader);
+
+	// the texture is always on unit 0, the clustered lights on their own units (optimized out without dynamic lights)
+	const GLint clusterLightData = glGetUniformLocation(program, "clusterLightData");
+	const GLint clusterGrid = glGetUniformLocation(program, "clusterGrid");
+	const GLint clusterLightIndices = glGetUniformLocation(program, "clusterLightIndices");
+	glUseProgram(program);
+	if (shader.locations.texSampler != -1)
+		glUniform1i(shader.locations.texSampler, 0);
+	if (clusterLightData != -1)
+		glUniform1i(clusterLightData, CLUSTER_LIGHT_DATA_UNIT);
+	if (clusterGrid != -1)
+		glUniform1i(clusterGrid, CLUSTER_GRID_UNIT);
+	if (clusterLightIndices != -1)
+		glUniform1i(clusterLightIndices, CLUSTER_INDEX_UNIT);
+	glUseProgram(0);
 
-	// material
-	commonShaderProgram.locations.ambient = glGetUniformLocation(commonShaderProgram.program, "material.ambient");
-	commonShaderProgram.locations.diffuse = glGetUniformLocation(commonShaderProgram.program, "material.diffuse");
-	commonShaderProgram.locations.specular = glGetUniformLocation(commonShaderProgram.program, "material.specular");
-	commonShaderProgram.locations.shininess = glGetUniformLocation(commonShaderProgram.program, "material.shininess");
-	commonShaderProgram.locations.useTexture = glGetUniformLocation(commonShaderProgram.program, "material.useTexture");
-	commonShaderProgram.locations.texSampler = glGetUniformLocation(commonShaderProgram.program, "fragTexSampler");
-
-	// other attributes and uniforms
-	commonShaderProgram.locations.PVM = glGetUniformLocation(commonShaderProgram.program, "PVM");
-	commonShaderProgram.locations.ViewMatrix = glGetUniformLocation(commonShaderProgram.program, "ViewMatrix");
-	commonShaderProgram.locations.ModelMatrix = glGetUniformLocation(commonShaderProgram.program, "ModelMatrix");
-	commonShaderProgram.locations.NormalMatrix = glGetUniformLocation(commonShaderProgram.program, "NormalMatrix");
-	commonShaderProgram.locations.time = glGetUniformLocation(commonShaderProgram.program, "time");
-	commonShaderProgram.locations.fogOn = glGetUniformLocation(commonShaderProgram.program, "fogOn");
-
-	// Lights
-	commonShaderProgram.locations.sunAmbient = glGetUniformLocation(commonShaderProgram.program, "sunAmbient");
-	commonShaderProgram.locations.sunDiffuse = glGetUniformLocation(commonShaderProgram.program, "sunDiffuse");
-	commonShaderProgram.locations.sunSpecular = glGetUniformLocation(commonShaderProgram.program, "sunSpecular");
-	commonShaderProgram.locations.turnSunOn = glGetUniformLocation(commonShaderProgram.program, "turnSunOn");
-	commonShaderProgram.locations.useSpotLight = glGetUniformLocation(commonShaderProgram.program, "useSpotLight");
-	commonShaderProgram.locations.usePointLight = glGetUniformLocation(commonShaderProgram.program, "usePointLight");
-	commonShaderProgram.locations.spotLightPosition = glGetUniformLocation(commonShaderProgram.program, "spotLightPosition");
-	commonShaderProgram.locations.spotLightDirection = glGetUniformLocation(commonShaderProgram.program, "spotLightDirection");
-
-
-	// Testing if all attributes are found
-	assert(commonShaderProgram.locations.position != -1);
-	assert(commonShaderProgram.locations.normal != -1);
-	assert(commonShaderProgram.locations.texCoord != -1);
-
-	// Testing if all uniforms are found
-	assert(commonShaderProgram.locations.ambient != -1);
-	assert(commonShaderProgram.locations.diffuse != -1);
-	assert(commonShaderProgram.locations.specular != -1);
-	assert(commonShaderProgram.locations.shininess != -1);
-	assert(commonShaderProgram.locations.useTexture != -1);
-	assert(commonShaderProgram.locations.texSampler != -1);
-
-	assert(commonShaderProgram.locations.PVM != -1);
-	assert(commonShaderProgram.locations.ViewMatrix != -1);
-	assert(commonShaderProgram.locations.ModelMatrix != -1);
-	assert(commonShaderProgram.locations.NormalMatrix != -1);
-
-	assert(commonShaderProgram.locations.sunAmbient != -1);
-	assert(commonShaderProgram.locations.sunDiffuse != -1);
-	assert(commonShaderProgram.locations.sunSpecular != -1);
-	
-	WARN_IF(commonShaderProgram.locations.time == -1, "commonShaderProgram.locations.time == -1");
-	WARN_IF(commonShaderProgram.locations.fogOn == -1, "commonShaderProgram.locations.fogOn == -1");
-	WARN_IF(commonShaderProgram.locations.turnSunOn == -1, "commonShaderProgram.locations.turnSunOn == -1");
-	WARN_IF(commonShaderProgram.locations.useSpotLight == -1, "commonShaderProgram.locations.useSpotLight == -1");
-	WARN_IF(commonShaderProgram.locations.spotLightPosition == -1, "commonShaderProgram.locations.spotLightPosition == -1");
-	WARN_IF(commonShaderProgram.locations.spotLightDirection == -1, "commonShaderProgram.locations.spotLightDirection == -1");
-
-	commonShaderProgram.initialized = true;
-	shaderList.clear();
+	shader.initialized = true;
+	target = shader;
+	return true;
+}
 
-	// Skybox Shaders
+static bool setupSkyboxProgram(GLuint program, bool store) {
+	// never rejected, the missing locations are only warnings
+	if (!store)
+		return true;
 
-	shaderList.push_back(pgr::createShaderFromFile(GL_VERTEX_SHADER, "skyboxVertexShader.vert"));
-	shaderList.push_back(pgr::createShaderFromFile(GL_FRAGMENT_SHADER, "skyboxFragmentShader.frag"));
+	SkyboxShaderProgram shader;
+	shader.program = program;
+	shader.locations.screenCoord = glGetAttribLocation(program, "screenCoord");
+	// get uniforms locations
+	shader.locations.skyboxSampler = glGetUniformLocation(program, "skyboxSampler");
+	shader.locations.inversePVmatrix = glGetUniformLocation(program, "inversePVmatrix");
 
-	skyboxShaderProgram.program = pgr::createProgram(shaderList);
+	// assertions (Here using MACRO WARN_IF because the skybox is not essential for the game to work properly)
+	WARN_IF(shader.locations.screenCoord == -1, "skyboxShaderProgram.locations.screenCoord == -1");
+	WARN_IF(shader.locations.skyboxSampler == -1, "skyboxShaderProgram.locations.skyboxSampler == -1");
+	WARN_IF(shader.locations.inversePVmatrix == -1, "skyboxShaderProgram.locations.inversePVmatrix == -1");
 
-	skyboxShaderProgram.locations.screenCoord = glGetAttribLocation(skyboxShaderProgram.program, "screenCoord");
-	// get uniforms locations
-	skyboxShaderProgram.locations.skyboxSampler = glGetUniformLocation(skyboxShaderProgram.program, "skyboxSampler");
-	skyboxShaderProgram.locations.inversePVmatrix = glGetUniformLocation(skyboxShaderProgram.program, "inversePVmatrix");
+	shader.initialized = true;
+	skyboxShaderProgram = shader;
+	return true;
+}
 
+static bool setupExplosionProgram(GLuint program, bool store) {
+	if (!store)
+		return true;
+
+	ExplosionShaderProgram shader;
+	shader.program = program;
+	shader.locations.time = glGetUniformLocation(program, "time");
+	shader.locations.frameDuration = glGetUniformLocation(program, "frameDuration");
+	shader.locations.texSampler = glGetUniformLocation(program, "texSampler");
+	shader.locations.PVM = glGetUniformLocation(program, "PVM");
+	shader.locations.ViewMatrix = glGetUniformLocation(program, "ViewMatrix");
+	shader.locations.position = glGetAttribLocation(program, "position");
+	shader.locations.texCoord = glGetAttribLocation(program, "texCoord");
+	shader.locations.particlePositionSize = glGetAttribLocation(program, "particlePositionSize");
+	shader.locations.particleStartTime = glGetAttribLocation(program, "particleStartTime");
+
+	// assertions (Here using MACRO WARN_IF because the explosions are not essential for the game to work properly)
+	WARN_IF(shader.locations.time == -1, "explosionShaderProgram.locations.time == -1");
+	WARN_IF(shader.locations.frameDuration == -1, "explosionShaderProgram.locations.frameDuration == -1");
+	WARN_IF(shader.locations.texSampler == -1, "explosionShaderProgram.locations.texSampler == -1");
+	WARN_IF(shader.locations.PVM == -1, "explosionShaderProgram.locations.PVM == -1");
+	WARN_IF(shader.locations.ViewMatrix == -1, "explosionShaderProgram.locations.ViewMatrix == -1");
+	WARN_IF(shader.locations.position == -1, "explosionShaderProgram.locations.position == -1");
+	WARN_IF(shader.locations.texCoord == -1, "explosionShaderProgram.locations.texCoord == -1");
+	WARN_IF(shader.locations.particlePositionSize == -1, "explosionShaderProgram.locations.particlePositionSize == -1");
+	WARN_IF(shader.locations.particleStartTime == -1, "explosionShaderProgram.locations.particleStartTime == -1");
+
+	shader.initialized = true;
+	explosionShaderProgram = shader;
+	return true;
+}
 
-	// assertions (Here using MACRO WARN_IF because the skybox is not essential for the game to work properly)
-	WARN_IF(skyboxShaderProgram.locations.screenCoord == -1, "skyboxShaderProgram.locations.screenCoord == -1");
-	WARN_IF(skyboxShaderProgram.locations.skyboxSampler == -1, "skyboxShaderProgram.locations.skyboxSampler == -1");
-	WARN_IF(skyboxShaderProgram.locations.inversePVmatrix == -1, "skyboxShaderProgram.locations.inversePVmatrix == -1");
+static bool setupBannerProgram(GLuint program, bool store) {
+	if (!store)
+		return true;
+
+	BannerShaderProgram shader;
+	shader.program = program;
+	shader.locations.position = glGetAttribLocation(program, "position");
+	shader.locations.texCoord = glGetAttribLocation(program, "texCoord");
+	shader.locations.PVM = glGetUniformLocation(program, "PVM");
+	shader.locations.texSampler = glGetUniformLocation(program, "texSampler");
+	shader.locations.time = glGetUniformLocation(program, "time");
+
+	WARN_IF(shader.locations.position == -1, "bannerShaderProgram.locations.position == -1");
+	WARN_IF(shader.locations.PVM == -1, "bannerShaderProgram.locations.PVM == -1");
+	WARN_IF(shader.locations.texCoord == -1, "bannerShaderProgram.locations.texCoord == -1");
+	WARN_IF(shader.locations.texSampler == -1, "bannerShaderProgram.locations.texSampler == -1");
+	WARN_IF(shader.locations.time == -1, "bannerShaderProgram.locations.time == -1");
+
+	shader.initialized = true;
+	bannerShaderProgram = shader;
+	return true;
+}
+
+/**
+ * \brief Load all shader programs (restored from the program cache when possible, see programCache.h) and start
+ * watching their files with --shader-hot-reload.
+ */
+void loadShaderPrograms() {
+
+	typedef std::chrono::high_resolution_clock Clock;
+	const Clock::time_point start = Clock::now();
+	const unsigned int restoredBefore = programCacheStats.hits;
+	std::vector<ShaderResource*> shaderList;
+
+	shaderList.push_back(requestShader(GL_VERTEX_SHADER, "lightingShaderPerFrag.vert"));
+	shaderList.push_back(requestShader(GL_FRAGMENT_SHADER, "lightingShaderPerFrag.frag"));
 
-	skyboxShaderProgram.initialized = true;
+	if (requestProgram(shaderList, [](GLuint program, bool store) { return setupLightingProgram(program, commonShaderProgram, false, NULL, store); }) == 0)
+		pgr::dieWithError("Cannot create the lighting shader program");
+	initUniformBuffers();
+	initClusteredLighting();
 	shaderList.clear();
 
-	// Explosion Shaders
+	// Instanced variant of the lighting shader (same fragment shader, read once)
 
-	shaderList.push_back(pgr::createShaderFromFile(GL_VERTEX_SHADER, "explosionVertexShader.vert"));
-	shaderList.push_back(pgr::createShaderFromFile(GL_FRAGMENT_SHADER, "explosionFragmentShader.frag"));
+	shaderList.push_back(requestShader(GL_VERTEX_SHADER, "lightingShaderInstanced.vert"));
+	shaderList.push_back(requestShader(GL_FRAGMENT_SHADER, "lightingShaderPerFrag.frag"));
 
-	explosionShaderProgram.program = pgr::createProgram(shaderList);
+	if (requestProgram(shaderList, [](GLuint program, bool store) { return setupLightingProgram(program, instancedShaderProgram, true, NULL, store); }) == 0)
+		pgr::dieWithError("Cannot create the instanced lighting shader program");
+	shaderList.clear();
 
-	explosionShaderProgram.locations.time = glGetUniformLocation(explosionShaderProgram.program, "time");
-	explosionShaderProgram.locations.frameDuration = glGetUniformLocation(explosionShaderProgram.program, "frameDuration");
-	explosionShaderProgram.locations.texSampler = glGetUniformLocation(explosionShaderProgram.program, "texSampler");
-	explosionShaderProgram.locations.PVM = glGetUniformLocation(explosionShaderProgram.program, "PVM");
-	explosionShaderProgram.locations.position = glGetAttribLocation(explosionShaderProgram.program, "position");
-	explosionShaderProgram.locations.texCoord = glGetAttribLocation(explosionShaderProgram.program, "texCoord");
+	// Skybox Shaders
 
-	// assertions (Here using MACRO WARN_IF because the skybox is not essential for the game to work properly)
-	WARN_IF(explosionShaderProgram.locations.time == -1, "explosionShaderProgram.locations.time == -1");
-	WARN_IF(explosionShaderProgram.locations.frameDuration == -1, "explosionShaderProgram.locations.frameDuration == -1");
-	WARN_IF(explosionShaderProgram.locations.texSampler == -1, "explosionShaderProgram.locations.texSampler == -1");
-	WARN_IF(explosionShaderProgram.locations.PVM == -1, "explosionShaderProgram.locations.PVM == -1");
-	WARN_IF(explosionShaderProgram.locations.position == -1, "explosionShaderProgram.locations.position == -1");
-	WARN_IF(explosionShaderProgram.locations.texCoord == -1, "explosionShaderProgram.locations.texCoord == -1");
-
-	explosionShaderProgram.initialized = true;
+	shaderList.push_back(requestShader(GL_VERTEX_SHADER, "skyboxVertexShader.vert"));
+	shaderList.push_back(requestShader(GL_FRAGMENT_SHADER, "skyboxFragmentShader.frag"));
+
+	requestProgram(shaderList, setupSkyboxProgram);
 	shaderList.clear();
 
-	// Banner shader
-	shaderList.push_back(pgr::createShaderFromFile(GL_VERTEX_SHADER, "bannerVertexShader.vert"));
-	shaderList.push_back(pgr::createShaderFromFile(GL_FRAGMENT_SHADER, "bannerFragmentShader.frag"));
+	// Explosion Shaders
 
-	bannerShaderProgram.program = pgr::createProgram(shaderList);
+	shaderList.push_back(requestShader(GL_VERTEX_SHADER, "explosionVertexShader.vert"));
+	shaderList.push_back(requestShader(GL_FRAGMENT_SHADER, "explosionFragmentShader.frag"));
 
-	bannerShaderProgram.locations.position = glGetAttribLocation(bannerShaderProgram.program, "position");
-	bannerShaderProgram.locations.texCoord = glGetAttribLocation(bannerShaderProgram.program, "texCoord");
-	bannerShaderProgram.locations.PVM = glGetUniformLocation(bannerShaderProgram.program, "PVM");
-	bannerShaderProgram.locations.texSampler = glGetUniformLocation(bannerShaderProgram.program, "texSampler");
-	bannerShaderProgram.locations.time = glGetUniformLocation(bannerShaderProgram.program, "time");
+	requestProgram(shaderList, setupExplosionProgram);
+	shaderList.clear();
 
-	WARN_IF(bannerShaderProgram.locations.position == -1, "bannerShaderProgram.locations.position == -1");
-	WARN_IF(bannerShaderProgram.locations.PVM == -1, "bannerShaderProgram.locations.PVM == -1");
-	WARN_IF(bannerShaderProgram.locations.texCoord == -1, "bannerShaderProgram.locations.texCoord == -1");
-	WARN_IF(bannerShaderProgram.locations.texSampler == -1, "bannerShaderProgram.locations.texSampler == -1");
-	WARN_IF(bannerShaderProgram.locations.time == -1, "bannerShaderProgram.locations.time == -1");
+	// Banner shader
+	shaderList.push_back(requestShader(GL_VERTEX_SHADER, "bannerVertexShader.vert"));
+	shaderList.push_back(requestShader(GL_FRAGMENT_SHADER, "bannerFragmentShader.frag"));
 
-	bannerShaderProgram.initialized = true;
+	requestProgram(shaderList, setupBannerProgram);
 	shaderList.clear();
 
+	// the specialized lighting programs are created when a combination of features is first drawn
+	printf("Shader programs ready in %.1f ms (%u of 5 restored from the program cache)\n",
+		std::chrono::duration<double, std::milli>(Clock::now() - start).count(), programCacheStats.hits - restoredBefore);
+	startShaderHotReload();
+}
+
+/**
+ * \brief True if the current context supports at least the given OpenGL version.
+ */
+bool hasOpenGLVersion(int major, int minor) {
+	GLint contextMajor = 0;
+	GLint contextMinor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+/**
+ * \brief True if the current context exposes the extension.
+ */
+bool hasOpenGLExtension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension != NULL && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
 }
 
 /**
@@ -183,9 +283,16 @@ void loadShaderPrograms() {
  */
 void cleanupShaderPrograms(void) {
 
-	pgr::deleteProgramAndShaders(commonShaderProgram.program);
-	pgr::deleteProgramAndShaders(skyboxShaderProgram.program);
-	pgr::deleteProgramAndShaders(explosionShaderProgram.program);
+	stopShaderHotReload();
+	cleanupLightingPermutations();
+	cleanupUniformBuffers();
+	cleanupClusteredLighting();
+	// the programs share shaders, they are deleted with the last program linking them
+	releaseProgram(commonShaderProgram.program);
+	releaseProgram(instancedShaderProgram.program);
+	releaseProgram(skyboxShaderProgram.program);
+	releaseProgram(explosionShaderProgram.program);
+	releaseProgram(bannerShaderProgram.program);
 }
 
 
@@ -193,23 +300,57 @@ void cleanupShaderPrograms(void) {
 
 /**
  * \brief Init the objects in the scene.
+ * Every init function only queues its asset: files are imported/decoded on the worker threads and the
+ * OpenGL objects are created on the GL thread by finishAssetLoading() in initSceneObjects().
  */
 
 void initTerrain() {
-	if (loadSingleMesh(TERRAIN_MODEL_NAME, commonShaderProgram, &TerrainGeometry) != true) {
-		std::cerr << "initTerrain() : Cannot load terrain model" << std::endl;
-	}
+	std::shared_ptr<PendingModel> pending = std::make_shared<PendingModel>();
+	std::shared_ptr<Heightfield> heightfield = std::make_shared<Heightfield>();
+	std::shared_ptr<TerrainChunks> chunks = std::make_shared<TerrainChunks>();
+	queueAsset(TERRAIN_MODEL_NAME,
+		[pending, heightfield, chunks] {
+			if (!loadPendingModel(TERRAIN_MODEL_NAME, *pending))
+				return false;
+			// ground height queries of the simulation, the chunks are drawn from the same grid
+			bakeHeightfield(pending->model, *heightfield);
+			if (useTerrainLod)
+				buildTerrainChunks(*chunks, pending->model, *heightfield, 1, true);
+			return true;
+		},
+		[pending, heightfield, chunks] {
+			if (uploadPendingSingleMesh(*pending, commonShaderProgram, &TerrainGeometry) != true) {
+				std::cerr << "initTerrain() : Cannot load terrain model" << std::endl;
+			}
+			else if (useTerrainLod) {
+				Material material = TerrainGeometry->material;
+				material.shininess = 30.0f;
+				uploadTerrainChunks(*chunks, commonShaderProgram, material, useLighting);
+				std::swap(terrainChunks, *chunks);
+			}
+			std::swap(terrainHeightfield, *heightfield);
+		});
 }
 
 void initPlayer() {
-	if(loadSingleMesh(PLAYER_MODEL_NAME, commonShaderProgram, &PlayerGeometry) != true) {
-		std::cerr << "initPlayer() : Cannot load player model" << std::endl;
-	}
-
-	CHECK_GL_ERROR();
+	std::shared_ptr<PendingModel> pending = std::make_shared<PendingModel>();
+	queueAsset(PLAYER_MODEL_NAME,
+		[pending] {
+			if (!loadPendingModel(PLAYER_MODEL_NAME, *pending))
+				return false;
+			buildMeshBVH(pending->model, pending->bvh);
+			return true;
+		},
+		[pending] {
+			std::swap(PlayerBVH, pending->bvh);
+			if (uploadPendingSingleMesh(*pending, commonShaderProgram, &PlayerGeometry) != true) {
+				std::cerr << "initPlayer() : Cannot load player model" << std::endl;
+			}
+			CHECK_GL_ERROR();
+		});
 }
 
-void initSkybox() {
+static void createSkyboxGeometry(const std::vector<ImageData>& faces) {
 	GLint screenCoordLoc = glGetAttribLocation(skyboxShaderProgram.program, "screenCoord");
 	CHECK_GL_ERROR();
 	static const float screenCoords[] = {
@@ -244,7 +385,6 @@ void initSkybox() {
 	glGenTextures(1, &SkyboxGeometry->material.texture);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, SkyboxGeometry->material.texture);
 
-	const char* suffixes[] = { "posx", "negx", "posy", "negy", "posz", "negz" };
 	GLuint targets[] = {
 	  GL_TEXTURE_CUBE_MAP_POSITIVE_X, GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
 	  GL_TEXTURE_CUBE_MAP_POSITIVE_Y, GL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
@@ -252,11 +392,10 @@ void initSkybox() {
 	};
 
 	for (int i = 0; i < 6; i++) {
-		std::string texName = std::string(SKYBOX_PATH_NAME) + "/sh_" + suffixes[i] + ".jpg";
-		std::cout << "Loading cube map texture: " << texName << std::endl;
-		if (!pgr::loadTexImage2D(texName, targets[i])) {
+		if (faces[i].empty()) {
 			pgr::dieWithError("Skybox cube map loading failed!");
 		}
+		loadTexImageFromImage(faces[i], targets[i]);
 	}
 
 	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -264,18 +403,42 @@ void initSkybox() {
 	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	// baked faces bring their mip chain
+	if (faces[0].levels.empty())
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	else
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, (GLint)faces[0].levels.size() - 1);
 
 	// unbind the texture (just in case someone will mess up with texture calls later)
 	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 	CHECK_GL_ERROR();
 }
 
-void initExplosion(ObjectGeometry ** geometry) {
+void initSkybox() {
+	const char* suffixes[] = { "posx", "negx", "posy", "negy", "posz", "negz" };
+
+	// one job per face, the cube map is created once the last face is decoded
+	std::shared_ptr<std::vector<ImageData> > faces = std::make_shared<std::vector<ImageData> >(6);
+	std::shared_ptr<int> facesUploaded = std::make_shared<int>(0);
+
+	for (int i = 0; i < 6; i++) {
+		std::string texName = std::string(SKYBOX_PATH_NAME) + "/sh_" + suffixes[i] + ".jpg";
+		queueAsset(texName,
+			[faces, i, texName] {
+				std::cout << "Loading cube map texture: " << texName << std::endl;
+				return loadTextureImage(texName, (*faces)[i]);
+			},
+			[faces, facesUploaded] {
+				if (++(*facesUploaded) == 6)
+					createSkyboxGeometry(*faces);
+			});
+	}
+}
+
+static void createExplosionGeometry(ObjectGeometry** geometry, GLuint texture) {
 	*geometry = new ObjectGeometry();
 
-	std::string textureName = EXPLOSION_TEXTURE_NAME;
-	(*geometry)->material.texture = pgr::createTexture(textureName);
+	(*geometry)->material.texture = texture;
 
 	glGenVertexArrays(1, &((*geometry)->vertexArrayObject));
 	glBindVertexArray((*geometry)->vertexArrayObject);
@@ -294,13 +457,25 @@ void initExplosion(ObjectGeometry ** geometry) {
 
 	glBindVertexArray(0);
 
+	// every live explosion is one instance of the quad
+	attachParticleInstances(explosionParticles, (*geometry)->vertexArrayObject,
+		explosionShaderProgram.locations.particlePositionSize, explosionShaderProgram.locations.particleStartTime);
+
 	(*geometry)->numTriangles = explosionNumQuadVertices;
 }
 
-void initBanner(ObjectGeometry** geometry, std::string pathName) {
+void initExplosion(ObjectGeometry ** geometry) {
+	std::string textureName = EXPLOSION_TEXTURE_NAME;
+	std::shared_ptr<TextureResource*> texture = std::make_shared<TextureResource*>((TextureResource*)NULL);
+	queueAsset(textureName,
+		[texture, textureName] { return (*texture = requestTexture(textureName)) != NULL; },
+		[texture, geometry] { createExplosionGeometry(geometry, acquireTexture(*texture, false)); });
+}
+
+static void createBannerGeometry(ObjectGeometry** geometry, GLuint texture) {
 	*geometry = new ObjectGeometry;
 
-	(*geometry)->material.texture = pgr::createTexture(pathName);
+	(*geometry)->material.texture = texture;
 	glBindTexture(GL_TEXTURE_2D, (*geometry)->material.texture);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 
@@ -323,60 +498,101 @@ void initBanner(ObjectGeometry** geometry, std::string pathName) {
 	(*geometry)->numTriangles = bannerNumQuadVertices;
 }
 
-void initCube(ObjectGeometry** geometry) {
-	*geometry = new ObjectGeometry();
+void initBanner(ObjectGeometry** geometry, std::string pathName) {
+	std::shared_ptr<TextureResource*> texture = std::make_shared<TextureResource*>((TextureResource*)NULL);
+	queueAsset(pathName,
+		[texture, pathName] { return (*texture = requestTexture(pathName)) != NULL; },
+		[texture, geometry] { createBannerGeometry(geometry, acquireTexture(*texture, false)); });
+}
 
-	std::string textureName = CUBE_TEXTURE_NAME;
-	(*geometry)->material.texture = pgr::createTexture(textureName);
+/**
+ * \brief Cube vertices (interleaved position, uv, normal in data.h) converted to a mesh.
+ */
+static void createCubeMeshData(MeshData& mesh) {
+	const unsigned int numVertices = sizeof(cubeVertices) / sizeof(cubeVertices[0]) / 8;
+
+	mesh.numVertices = numVertices;
+	mesh.ambient = glm::vec3(1.0f, 0.0f, 1.0f);
+	mesh.diffuse = glm::vec3(1.0f, 0.0f, 1.0f);
+	mesh.specular = glm::vec3(1.0f, 0.0f, 1.0f);
+	mesh.shininess = 10.0f;
+
+	// |VVV|NNN|TT|
+	mesh.vertexStorage.resize(8 * numVertices);
+	float* positions = mesh.vertexStorage.data();
+	float* normals = positions + 3 * numVertices;
+	float* texCoords = positions + 6 * numVertices;
+	for (unsigned int v = 0; v < numVertices; v++) {
+		const float* vertex = cubeVertices + 8 * v;
+		memcpy(positions + 3 * v, vertex, 3 * sizeof(float));
+		memcpy(texCoords + 2 * v, vertex + 3, 2 * sizeof(float));
+		memcpy(normals + 3 * v, vertex + 5, 3 * sizeof(float));
+	}
 
-	// VAO
-	glGenVertexArrays(1, &((*geometry)->vertexArrayObject));
-	glBindVertexArray((*geometry)->vertexArrayObject);
+	std::vector<unsigned int> indices(cubeIndices, cubeIndices + sizeof(cubeIndices) / sizeof(cubeIndices[0]));
+	setMeshIndices(mesh, indices);
+}
 
-	// VBO
-	glGenBuffers(1, &((*geometry)->vertexBufferObject));
-	glBindBuffer(GL_ARRAY_BUFFER, (*geometry)->vertexBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+static void createCubeGeometry(ObjectGeometry** geometry, GLuint texture) {
+	MeshData mesh;
+	createCubeMeshData(mesh);
 
-	// EBO
-	glGenBuffers(1, &((*geometry)->elementBufferObject));
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (*geometry)->elementBufferObject);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+	PackedVertices vertices;
+	packVertices(mesh, meshVertexLayout(), vertices);
+	*geometry = useGeometryArena ? addArenaGeometry(mesh, vertices, texture) : createMeshGeometry(mesh, vertices, commonShaderProgram, texture);
+}
 
-	// Position attribute
-	glEnableVertexAttribArray(commonShaderProgram.locations.position);
-	glVertexAttribPointer(commonShaderProgram.locations.position, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), 0);
-	CHECK_GL_ERROR();
+void initCube(ObjectGeometry** geometry) {
+	std::string textureName = CUBE_TEXTURE_NAME;
+	std::shared_ptr<TextureResource*> texture = std::make_shared<TextureResource*>((TextureResource*)NULL);
+	queueAsset(textureName,
+		[texture, textureName] { return (*texture = requestTexture(textureName)) != NULL; },
+		[texture, geometry] { createCubeGeometry(geometry, acquireTexture(*texture)); });
+}
 
-	// Texture attribute
-	glEnableVertexAttribArray(commonShaderProgram.locations.texCoord);
-	glVertexAttribPointer(commonShaderProgram.locations.texCoord, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	CHECK_GL_ERROR();
+void initModel(const std::string ModelName, std::vector<ObjectGeometry*> *ModelGeometries, MeshBVH* ModelBVH) {
+	// a model file is loaded once, the other object lists get its geometries when it is uploaded
+	ModelResource* resource = requestModel(ModelName, ModelGeometries, ModelBVH);
+	if (resource == NULL)
+		return;
+
+	std::shared_ptr<PendingModel> pending = std::make_shared<PendingModel>();
+	queueAsset(ModelName,
+		[pending, ModelName] {
+			if (!loadPendingModel(ModelName, *pending))
+				return false;
+			// the collision hierarchy is built on the loading thread with the rest of the CPU work
+			buildMeshBVH(pending->model, pending->bvh);
+			return true;
+		},
+		[pending, resource] {
+			uploadPendingModel(*pending, commonShaderProgram, modelGeometries(resource));
+			std::swap(modelBVH(resource), pending->bvh);
+			publishModel(resource);
+		});
+}
 
-	// Normal attribute
-	glEnableVertexAttribArray(commonShaderProgram.locations.normal);
-	glVertexAttribPointer(commonShaderProgram.locations.normal, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
-	CHECK_GL_ERROR();
+void initSceneObjects() {
+	useLighting = true;
 
-	(*geometry)->material.ambient = glm::vec3(1.0f, 0.0f, 1.0f);
-	(*geometry)->material.diffuse = glm::vec3(1.0f, 0.0f, 1.0f);
-	(*geometry)->material.specular = glm::vec3(1.0f, 0.0f, 1.0f);
-	(*geometry)->material.shininess = 10.0f;
-	
-	glBindVertexArray(0);
-	CHECK_GL_ERROR();
+	// static meshes are suballocated from the arena while the assets are uploaded
+	if (useGeometryArena)
+		initGeometryArena(commonShaderProgram, vertexLayout);
 
-	(*geometry)->numTriangles = sizeof(cubeIndices) / sizeof(cubeIndices[0]) / 3;
-}
+	// the explosion vao refers to the instance buffer of the pool
+	if (explosionParticles.capacity == 0)
+		initParticlePool(explosionParticles, std::max((unsigned int)PARTICLE_CAPACITY, particleStressCount));
 
-void initModel(const std::string ModelName, std::vector<ObjectGeometry*> *ModelGeometries) {
-	if (loadMeshes(ModelName, commonShaderProgram, *ModelGeometries) != true) {
-		std::cerr << "\033[31minitModel : Cannot load : " << ModelName << "\033[0m" << std::endl;
+	// the textures are baked to S3TC, fall back to RGBA8 when the driver cannot sample it
+	if (useTextureCompression && !textureCompressionSupported()) {
+		std::cerr << "\033[31mS3TC texture compression is not supported, textures are loaded as RGBA8\033[0m" << std::endl;
+		useTextureCompression = false;
 	}
-}
+	textureMemory = TextureMemory();
+	// model textures start with their low mip levels, the others are streamed in by updateTextureStreaming()
+	initTextureStreaming();
 
-void initSceneObjects() {
-	useLighting = true;
+	beginAssetLoading();
 	initTerrain();
 	initPlayer();
 	initSkybox();
@@ -384,13 +600,40 @@ void initSceneObjects() {
 	initBanner(&BannerGeometry, GAMEOVER_BANNER_NAME);
 	initBanner(&CommandsBannerGeometry, COMMANDS_BANNER_NAME);
 	initCube(&CubeGeometry);
-	initModel(FOXBAT_MODEL_NAME, &FoxBatGeometries);
-	initModel(CAR_MODEL_NAME, &CarGeometries);
-	initModel(POLICE_MODEL_NAME, &PoliceGeometries);
-	initModel(CADILLAC_MODEL_NAME, &CadillacGeometries);
-	initModel(ZEPPLIN_MODEL_NAME, &ZepplinGeometries);
-	initModel(TREE1_MODEL_NAME, &Tree1Geometries);
-	initModel(TREE2_MODEL_NAME, &Tree2Geometries);
+	initModel(FOXBAT_MODEL_NAME, &FoxBatGeometries, &FoxBatBVH);
+	initModel(CAR_MODEL_NAME, &CarGeometries, &CarBVH);
+	initModel(POLICE_MODEL_NAME, &PoliceGeometries, &PoliceBVH);
+	initModel(CADILLAC_MODEL_NAME, &CadillacGeometries, &CadillacBVH);
+	initModel(ZEPPLIN_MODEL_NAME, &ZepplinGeometries, &ZepplinBVH);
+	initModel(TREE1_MODEL_NAME, &Tree1Geometries, &Tree1BVH);
+	initModel(TREE2_MODEL_NAME, &Tree2Geometries, &Tree2BVH);
+	finishAssetLoading();
+	releaseUnusedTextures();
+	printTextureMemoryReport();
+	printResourceReport();
+
+	// instancing stress scene, the instances are drawn once the tree model is loaded
+	if (instanceStressCount > 0 && Tree1Instances == NULL) {
+		Tree1Instances = createInstanceGroup(&Tree1Geometries);
+		scatterInstances(Tree1Instances, instanceStressCount, TREE_SIZE);
+		printFrameTimes = true;
+		std::cout << "Stress scene : " << instanceStressCount << " instances of " << TREE1_MODEL_NAME << std::endl;
+	}
+	// particle stress scene, the pool is topped up every simulation step
+	if (particleStressCount > 0) {
+		printFrameTimes = true;
+		std::cout << "Stress scene : " << particleStressCount << " explosion billboards" << std::endl;
+	}
+	// level of detail stress scene, the cars are entities created with the scene
+	if (modelStressCount > 0) {
+		printFrameTimes = true;
+		std::cout << "Stress scene : " << modelStressCount << " cars" << (useMeshLod ? "" : " (full resolution)") << std::endl;
+	}
+	// dynamic lights stress scene, the lights are animated by collectSceneLights()
+	if (lightStressCount > 0) {
+		printFrameTimes = true;
+		std::cout << "Stress scene : " << lightStressCount << " dynamic lights" << (useClusteredLighting ? "" : " (clustered lighting off)") << std::endl;
+	}
 }
 
 
@@ -416,150 +659,132 @@ glm::vec3 checkBounds(const glm::vec3& position, float objectSize) {
 // -----------------------  Drawing ---------------------------------
 
 /**
- * \brief Draw the objects in the scene.
+ * \brief Queue the draws of the lighting shader objects, they are executed by executeDrawQueue() in drawObjects().
  */
-
-void setTransformUniforms(const glm::mat4& modelMatrix, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
-	glm::mat4 PVM = projectionMatrix * viewMatrix * modelMatrix;
-
-	glUniformMatrix4fv(commonShaderProgram.locations.PVM, 1, GL_FALSE, glm::value_ptr(PVM));
-	glUniformMatrix4fv(commonShaderProgram.locations.ViewMatrix, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-	glUniformMatrix4fv(commonShaderProgram.locations.ModelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-
-	const glm::mat3 modelRotationMatrix = glm::mat3(
-		modelMatrix[0],
-		modelMatrix[1],
-		modelMatrix[2]
-	);
-	glm::mat4 normalMatrix = glm::transpose(glm::inverse(glm::mat4(glm::mat3(modelRotationMatrix))));
-	glUniformMatrix4fv(commonShaderProgram.locations.NormalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	CHECK_GL_ERROR();
-
-	// Passing Sun component 
-	Light sun;
-	sun.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
-	sun.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
-	sun.specular = glm::vec3(1.0f, 1.0f, 1.0f);
-
-	glUniform3fv(commonShaderProgram.locations.sunAmbient, 1, glm::value_ptr(sun.ambient));
-	glUniform3fv(commonShaderProgram.locations.sunDiffuse, 1, glm::value_ptr(sun.diffuse));
-	glUniform3fv(commonShaderProgram.locations.sunSpecular, 1, glm::value_ptr(sun.specular));
-}
-
-void setMaterialUniforms(const Material& material) {
-	glUniform3fv(commonShaderProgram.locations.ambient, 1, glm::value_ptr(material.ambient));
-	glUniform3fv(commonShaderProgram.locations.diffuse, 1, glm::value_ptr(material.diffuse));
-	glUniform3fv(commonShaderProgram.locations.specular, 1, glm::value_ptr(material.specular));
-	glUniform1f(commonShaderProgram.locations.shininess, material.shininess);
-	CHECK_GL_ERROR();
-	if (material.texture != 0) {
-		glUniform1i(commonShaderProgram.locations.useTexture, 1);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, material.texture);
-		glUniform1i(commonShaderProgram.locations.texSampler, 0);
-	}
-	else {
-		glUniform1i(commonShaderProgram.locations.useTexture, 0);
-	}
-}
-
-void drawPlayer(Player* Player, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+void drawPlayer(Player* Player) {
 	if (Player->isInitialized && !Player->destroyed) {
-		glEnable(GL_STENCIL_TEST);
-		glStencilFunc(GL_ALWAYS, Player->id, 0xFF);
-		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-		CHECK_GL_ERROR();
-		glUseProgram(commonShaderProgram.program);
-
 		// prepare modeling transform matrix
 		glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), Player->position);
 		modelMatrix = glm::rotate(modelMatrix, glm::radians(Player->viewAngle), glm::vec3(0, 0, 1));
 		modelMatrix = glm::scale(modelMatrix, glm::vec3(Player->size, Player->size, Player->size));
 
-		// send matrices to the vertex & fragment shader
-		setTransformUniforms(modelMatrix, viewMatrix, projectionMatrix);
-		// set material uniforms
-		setMaterialUniforms(PlayerGeometry->material);
-
-		glBindVertexArray(PlayerGeometry->vertexArrayObject);
-		glDrawElements(GL_TRIANGLES, PlayerGeometry->numTriangles * 3, GL_UNSIGNED_INT, 0);
-
-
-		glBindVertexArray(0);
-		glUseProgram(0);
-
-		glDisable(GL_STENCIL_TEST);
-		CHECK_GL_ERROR();
+		// the mouse rays are tested against the player where it was drawn
+		setPickingPlayer(PlayerBVH.nodes.empty() ? NULL : &PlayerBVH, modelMatrix);
+		if (objectVisible(&PlayerGeometry, 1, modelMatrix))
+			submitDraw(selectGeometryLod(PlayerGeometry, modelMatrix), submitTransform(modelMatrix));
+	}
+	else {
+		setPickingPlayer(NULL, glm::mat4(1.0f));
 	}
 }
 
-void drawTerrain(Terrain* Terrain, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+void drawTerrain(Terrain* Terrain, const glm::mat4& viewMatrix) {
 	if (Terrain->isInitialized) {
-		glEnable(GL_STENCIL_TEST);
-		glStencilFunc(GL_ALWAYS, Terrain->id, 0xFF);
-		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-		CHECK_GL_ERROR();
-		glUseProgram(commonShaderProgram.program);
-
 		// prepare modeling transform matrix
 		glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), Terrain->position);
 		modelMatrix = glm::rotate(modelMatrix, glm::radians(90.0f), glm::vec3(1, 0, 0));
 		modelMatrix = glm::scale(modelMatrix, glm::vec3(Terrain->size));
 
-		// send matrices to the vertex & fragment shader
-		setTransformUniforms(modelMatrix, viewMatrix, projectionMatrix);
-		TerrainGeometry->material.shininess = 30.0f;
-		// set material uniforms
-		setMaterialUniforms(TerrainGeometry->material);
-
-		// draw geometry
-		glBindVertexArray(TerrainGeometry->vertexArrayObject);
-		glDrawElements(GL_TRIANGLES, TerrainGeometry->numTriangles * 3, GL_UNSIGNED_INT, 0);
-
-		glBindVertexArray(0);
-		glUseProgram(0);
+		if (useTerrainLod && terrainChunks.vertexArrayObject != 0) {
+			// level of every chunk from the camera position in the model space of the terrain, the chunks outside of
+			// the view frustum are culled by the queue and the others are drawn by one multi draw call
+			const glm::vec3 camera = glm::vec3(glm::inverse(modelMatrix) * glm::inverse(viewMatrix)[3]);
+			selectTerrainLevels(terrainChunks, camera);
+			const unsigned int transform = submitTransform(modelMatrix);
+			for (size_t i = 0; i < terrainChunks.chunks.size(); i++)
+				submitDraw(&terrainChunks.chunks[i].geometry, transform);
+			return;
+		}
 
-		glDisable(GL_STENCIL_TEST);
-		CHECK_GL_ERROR();
+		TerrainGeometry->material.shininess = 30.0f;
+		if (objectVisible(&TerrainGeometry, 1, modelMatrix))
+			submitDraw(TerrainGeometry, submitTransform(modelMatrix));
 	}
 	else {
 		std::cerr << "Terrain not initialised" << std::endl;
 	}
 }
 
-void drawCube(Object* Cube, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
-	if (Cube->isInitialized) {
-		glEnable(GL_STENCIL_TEST);
-		glStencilFunc(GL_ALWAYS, Cube->id, 0xFF);
-		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-		CHECK_GL_ERROR();
-		glUseProgram(commonShaderProgram.program);
+/**
+ * \brief Position of an entity in the rendered frame, between its last two simulation steps.
+ */
+glm::vec3 interpolatedPosition(const EntityStore& store, unsigned int slot) {
+	const glm::vec3& previous = store.previousPosition[slot];
+	const glm::vec3& current = store.position[slot];
+	// jumps (wrap around the scene bounds) are not interpolated
+	if (glm::length(current - previous) > 0.5f * SCENE_WIDTH)
+		return current;
+	return glm::mix(previous, current, frameLoop.interpolationAlpha);
+}
 
-		// prepare modeling transform matrix
-		glm::mat4 modelMatrix = alignObject(Cube->position, (Cube->direction), glm::vec3(1.0f, 1.0f, 1.0f)); // make the cube rotate around its center
-		modelMatrix = glm::rotate(modelMatrix, glm::radians(90.f), glm::vec3(1, 0, 0));
-		modelMatrix = glm::scale(modelMatrix, glm::vec3(Cube->size));
+glm::vec3 interpolatedDirection(const EntityStore& store, unsigned int slot) {
+	const glm::vec3 direction = glm::mix(store.previousDirection[slot], store.direction[slot], frameLoop.interpolationAlpha);
+	const float length = glm::length(direction);
+	return length > 1e-4f ? direction / length : store.direction[slot];
+}
 
-		// send matrices to the vertex & fragment shader
-		setTransformUniforms(modelMatrix, viewMatrix, projectionMatrix);
-		// set material uniforms
-		setMaterialUniforms(CubeGeometry->material);
+/**
+ * \brief Geometry drawn for an entity mesh (models only, the cube and the explosions have their own draw).
+ */
+static const std::vector<ObjectGeometry*>* entityGeometries(unsigned char mesh) {
+	switch (mesh) {
+		case ENTITY_MESH_FOXBAT:	return &FoxBatGeometries;
+		case ENTITY_MESH_ZEPPLIN:	return &ZepplinGeometries;
+		case ENTITY_MESH_CAR:		return &CarGeometries;
+		case ENTITY_MESH_POLICE:	return &PoliceGeometries;
+		case ENTITY_MESH_CADILLAC:	return &CadillacGeometries;
+		case ENTITY_MESH_TREE1:		return &Tree1Geometries;
+		case ENTITY_MESH_TREE2:		return &Tree2Geometries;
+		default:					return NULL;
+	}
+}
 
-		// draw geometry
-		glBindVertexArray(CubeGeometry->vertexArrayObject);
-		glDrawElements(GL_TRIANGLES, CubeGeometry->numTriangles * 3, GL_UNSIGNED_INT, 0);
-		CHECK_GL_ERROR();
+/**
+ * \brief Collision hierarchy of an entity mesh, NULL when the entity collides as a sphere (cube) or the model is not loaded yet.
+ */
+const MeshBVH* entityBVH(unsigned char mesh) {
+	const MeshBVH* bvh = NULL;
+	switch (mesh) {
+		case ENTITY_MESH_FOXBAT:	bvh = &FoxBatBVH; break;
+		case ENTITY_MESH_ZEPPLIN:	bvh = &ZepplinBVH; break;
+		case ENTITY_MESH_CAR:		bvh = &CarBVH; break;
+		case ENTITY_MESH_POLICE:	bvh = &PoliceBVH; break;
+		case ENTITY_MESH_CADILLAC:	bvh = &CadillacBVH; break;
+		case ENTITY_MESH_TREE1:		bvh = &Tree1BVH; break;
+		case ENTITY_MESH_TREE2:		bvh = &Tree2BVH; break;
+		default:					return NULL;
+	}
+	return bvh->nodes.empty() ? NULL : bvh;
+}
 
-		glBindVertexArray(0);
-		glUseProgram(0);
+/**
+ * \brief Largest distance from the origin of a loaded model to its surface, in model units.
+ */
+float maxMeshBoundingRadius() {
+	const MeshBVH* bvhs[] = { &FoxBatBVH, &ZepplinBVH, &CarBVH, &PoliceBVH, &CadillacBVH, &Tree1BVH, &Tree2BVH };
+	float radius = 0.0f;
+	for (size_t i = 0; i < sizeof(bvhs) / sizeof(bvhs[0]); i++)
+		radius = std::max(radius, bvhs[i]->boundingRadius);
+	return radius;
+}
 
-		glDisable(GL_STENCIL_TEST);
-		CHECK_GL_ERROR();
-	}
-	else {
-		std::cerr << "Cube not initialised" << std::endl;
-	}
+/**
+ * \brief Modelling transform of the models (shared by the rendering and the mesh collisions).
+ */
+glm::mat4 modelEntityMatrix(const glm::vec3& position, const glm::vec3& direction, float size) {
+	glm::mat4 modelMatrix = alignObject(position, direction, glm::vec3(0.0f, 0.0f, 1.0f));
+	modelMatrix = glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0, 1, 0));
+	return glm::scale(modelMatrix, glm::vec3(size));
+}
+
+void drawCube(const EntityStore& store, unsigned int slot) {
+	// prepare modeling transform matrix
+	glm::mat4 modelMatrix = alignObject(interpolatedPosition(store, slot), interpolatedDirection(store, slot), glm::vec3(1.0f, 1.0f, 1.0f)); // make the cube rotate around its center
+	modelMatrix = glm::rotate(modelMatrix, glm::radians(90.f), glm::vec3(1, 0, 0));
+	modelMatrix = glm::scale(modelMatrix, glm::vec3(store.size[slot]));
 
+	if (objectVisible(&CubeGeometry, 1, modelMatrix))
+		submitDraw(CubeGeometry, submitTransform(modelMatrix));
 }
 
 void drawSkybox(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
@@ -574,72 +799,65 @@ void drawSkybox(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
 	glUniformMatrix4fv(skyboxShaderProgram.locations.inversePVmatrix, 1, GL_FALSE, glm::value_ptr(inversePVmatrix));
 	glUniform1i(skyboxShaderProgram.locations.skyboxSampler, 0);
 
-	glBindVertexArray(SkyboxGeometry->vertexArrayObject);
+	bindVertexArray(SkyboxGeometry->vertexArrayObject);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, SkyboxGeometry->material.texture);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	renderStats.drawCalls++;
 
 	glBindVertexArray(0);
 	glUseProgram(0);
 }
 
-void drawModel(Object* Model, std::vector<ObjectGeometry*> ModelGeometry, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
-	if (Model->isInitialized && !Model->destroyed) {
-		
-		glEnable(GL_STENCIL_TEST);
-		glStencilFunc(GL_ALWAYS, Model->id, 0xFF);
-		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-		CHECK_GL_ERROR();
-
-		glUseProgram(commonShaderProgram.program);
-
-		// prepare modelling transform matrix
-		glm::mat4 modelMatrix = alignObject(Model->position, (Model->direction), glm::vec3(0.0f, 0.0f, 1.0f));
-		modelMatrix = glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0, 1, 0));
+void drawModel(const EntityStore& store, unsigned int slot, const std::vector<ObjectGeometry*>& ModelGeometry) {
+	// prepare modelling transform matrix
+	const glm::mat4 modelMatrix = modelEntityMatrix(interpolatedPosition(store, slot), interpolatedDirection(store, slot), store.size[slot]);
 
-		modelMatrix = glm::scale(modelMatrix, glm::vec3(Model->size, Model->size, Model->size));
+	// the whole model is skipped when its bounding sphere is outside of the view frustum
+	if (!objectVisible(ModelGeometry.data(), ModelGeometry.size(), modelMatrix))
+		return;
 
-		// send matrices to the vertex & fragment shader
-		setTransformUniforms(modelMatrix, viewMatrix, projectionMatrix);
-		for (size_t i = 0; i < ModelGeometry.size(); i++) {
-			setMaterialUniforms(ModelGeometry[i]->material);
-
-			// draw geometry
-			glBindVertexArray(ModelGeometry[i]->vertexArrayObject);
-			glDrawElements(GL_TRIANGLES, ModelGeometry[i]->numTriangles * 3, GL_UNSIGNED_INT, 0);
-		}
-		glBindVertexArray(0);
-		glUseProgram(0);
-
-		glDisable(GL_STENCIL_TEST);
-		CHECK_GL_ERROR();
+	// every sub-mesh shares the model matrix, the queue draws the ones with the same material together,
+	// each one at the level of detail matching its size on the screen
+	const unsigned int transform = submitTransform(modelMatrix);
+	for (size_t i = 0; i < ModelGeometry.size(); i++) {
+		submitDraw(selectGeometryLod(ModelGeometry[i], modelMatrix), transform);
 	}
 }
 
-void drawExplosion(ExplosionObject* explosion, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+/**
+ * \brief Draw every live explosion of the pool with one instanced call (additive blending, no depth test).
+ */
+void drawExplosions(ParticlePool& pool, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+	if (ExplosionGeometry == NULL)
+		return;
+	const unsigned int count = uploadParticles(pool);
+	if (count == 0)
+		return;
 
 	// enable blending and set proper blending function  
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_ONE, GL_ONE);
+	glDisable(GL_DEPTH_TEST);
 
 	glUseProgram(explosionShaderProgram.program);
 
-	glm::mat4 viewTranslateMatrix = viewMatrix * glm::translate(glm::mat4(1.0f), explosion->position);
-	glm::mat4 viewTranslateRotateMatrix = viewTranslateMatrix * glm::mat4(glm::inverse(glm::mat3(viewMatrix)));
-	glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(explosion->size));
-	glm::mat4 PVMmatrix = projectionMatrix * viewTranslateRotateMatrix * scaleMatrix;
-
-	glUniformMatrix4fv(explosionShaderProgram.locations.PVM, 1, GL_FALSE, glm::value_ptr(PVMmatrix));  // model-view-projection
-	glUniform1f(explosionShaderProgram.locations.time, explosion->currentTime - explosion->startTime);
+	glm::mat4 PVmatrix = projectionMatrix * viewMatrix;
+	glUniformMatrix4fv(explosionShaderProgram.locations.PVM, 1, GL_FALSE, glm::value_ptr(PVmatrix));  // billboards are in world space
+	glUniformMatrix4fv(explosionShaderProgram.locations.ViewMatrix, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+	glUniform1f(explosionShaderProgram.locations.time, pool.time);
 	glUniform1i(explosionShaderProgram.locations.texSampler, 0);
-	glUniform1f(explosionShaderProgram.locations.frameDuration, explosion->frameDuration);
+	glUniform1f(explosionShaderProgram.locations.frameDuration, EXPLOSION_FRAME_DURATION);
 
-	glBindVertexArray(ExplosionGeometry->vertexArrayObject);
+	bindVertexArray(ExplosionGeometry->vertexArrayObject);
 	glBindTexture(GL_TEXTURE_2D, ExplosionGeometry->material.texture);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, ExplosionGeometry->numTriangles);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, ExplosionGeometry->numTriangles, count);
+	renderStats.drawCalls++;
+	renderStats.instancesDrawn += count;
 
 	glBindVertexArray(0);
 	glUseProgram(0);
 
+	glEnable(GL_DEPTH_TEST);
 	glDisable(GL_BLEND);
 }
 
@@ -660,8 +878,9 @@ void drawGameOver(Object* Banner, const glm::mat4& viewMatrix, const glm::mat4&
 	glUniform1i(bannerShaderProgram.locations.texSampler, 0);
 
 	glBindTexture(GL_TEXTURE_2D, BannerGeometry->material.texture);
-	glBindVertexArray(BannerGeometry->vertexArrayObject);
+	bindVertexArray(BannerGeometry->vertexArrayObject);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, BannerGeometry->numTriangles);
+	renderStats.drawCalls++;
 
 	CHECK_GL_ERROR();
 
@@ -689,8 +908,9 @@ void drawCommandsBanner(Object* Banner, const glm::mat4& viewMatrix, const glm::
 	glUniform1i(bannerShaderProgram.locations.texSampler, 0);
 
 	glBindTexture(GL_TEXTURE_2D, CommandsBannerGeometry->material.texture);
-	glBindVertexArray(CommandsBannerGeometry->vertexArrayObject);
+	bindVertexArray(CommandsBannerGeometry->vertexArrayObject);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, CommandsBannerGeometry->numTriangles);
+	renderStats.drawCalls++;
 
 	CHECK_GL_ERROR();
 
@@ -702,30 +922,49 @@ void drawCommandsBanner(Object* Banner, const glm::mat4& viewMatrix, const glm::
 }
 
 void drawObjects(GameObjectsList GameObjects, glm::mat4 viewMatrix, glm::mat4 projectionMatrix) {
-	drawTerrain(GameObjects.terrain, viewMatrix, projectionMatrix);
-	drawPlayer(GameObjects.player, viewMatrix, projectionMatrix);
-	drawCube(GameObjects.cube, viewMatrix, projectionMatrix);
-	drawModel(GameObjects.foxbat, FoxBatGeometries, viewMatrix, projectionMatrix);
-	drawModel(GameObjects.zepplin, ZepplinGeometries, viewMatrix, projectionMatrix);
-	drawModel(GameObjects.car, CarGeometries, viewMatrix, projectionMatrix);
-	drawModel(GameObjects.police, PoliceGeometries, viewMatrix, projectionMatrix);
-	drawModel(GameObjects.cadillac, CadillacGeometries, viewMatrix, projectionMatrix);
-	drawModel(GameObjects.tree1, Tree1Geometries, viewMatrix, projectionMatrix);
-	drawModel(GameObjects.tree2, Tree2Geometries, viewMatrix, projectionMatrix);
-
-	
-	glDisable(GL_DEPTH_TEST);
-	for (std::list<void*>::iterator it = GameObjects.explosions.begin(); it != GameObjects.explosions.end(); ++it) {
-		ExplosionObject* explosion = (ExplosionObject*)(*it);
-		drawExplosion(explosion, viewMatrix, projectionMatrix);
+	beginDrawQueue(viewMatrix, projectionMatrix);
+	drawTerrain(GameObjects.terrain, viewMatrix);
+	drawPlayer(GameObjects.player);
+
+	// scene entities, in the order of the store
+	for (unsigned int i = 0; i < entities.count; i++) {
+		if (entities.flags[i] & ENTITY_DESTROYED)
+			continue;
+		if (entities.mesh[i] == ENTITY_MESH_CUBE) {
+			drawCube(entities, i);
+		}
+		else {
+			const std::vector<ObjectGeometry*>* geometries = entityGeometries(entities.mesh[i]);
+			if (geometries != NULL)
+				drawModel(entities, i, *geometries);
+		}
 	}
-	glEnable(GL_DEPTH_TEST);
+	submitInstanceGroup(Tree1Instances);
+	executeDrawQueue();
+
+	drawExplosions(explosionParticles, viewMatrix, projectionMatrix);
 }
 
 
 // -----------------------  Cleanup scene objects ----------------------------
 
 void cleanupGeometry(ObjectGeometry* geometry) {
+	if (geometry == NULL)
+		return;
+
+	releaseTexture(geometry->material.texture);
+
+	// the levels of detail are records sharing the buffers of the geometry
+	while (geometry->nextLod != NULL) {
+		ObjectGeometry* lod = geometry->nextLod;
+		geometry->nextLod = lod->nextLod;
+		delete lod;
+	}
+
+	// arena geometries are only records, the arena owns the buffers
+	if (geometry->inArena)
+		return;
+
 	glDeleteVertexArrays(1, &(geometry->vertexArrayObject));
 	glDeleteBuffers(1, &(geometry->elementBufferObject));
 	glDeleteBuffers(1, &(geometry->vertexBufferObject));
@@ -735,367 +974,212 @@ void cleanupGeometry(ObjectGeometry* geometry) {
 void cleanupModels() {
 	cleanupGeometry(PlayerGeometry);
 	cleanupGeometry(TerrainGeometry);
+	cleanupTerrainChunks(terrainChunks);
 	cleanupGeometry(SkyboxGeometry);
 	cleanupGeometry(ExplosionGeometry);
+	cleanupGeometry(BannerGeometry);
+	cleanupGeometry(CommandsBannerGeometry);
 	cleanupGeometry(CubeGeometry);
-	for (size_t i = 0; i < FoxBatGeometries.size(); i++) {
-		cleanupGeometry(FoxBatGeometries[i]);
-	}
-	for (size_t i = 0; i < CarGeometries.size(); i++) {
-		cleanupGeometry(CarGeometries[i]);
-	}
-	for (size_t i = 0; i < PoliceGeometries.size(); i++) {
-		cleanupGeometry(PoliceGeometries[i]);
-	}
-	for (size_t i = 0; i < CadillacGeometries.size(); i++) {
-		cleanupGeometry(CadillacGeometries[i]);
-	}
-	for (size_t i = 0; i < ZepplinGeometries.size(); i++) {
-		cleanupGeometry(ZepplinGeometries[i]);
-	}
-	for (size_t i = 0; i < Tree1Geometries.size(); i++) {
-		cleanupGeometry(Tree1Geometries[i]);
-	}
-	for (size_t i = 0; i < Tree2Geometries.size(); i++) {
-		cleanupGeometry(Tree2Geometries[i]);
-	}
+	destroyInstanceGroup(Tree1Instances);
+	Tree1Instances = NULL;
+	// shared models are deleted with their last object list, their textures with their last geometry
+	releaseModel(FoxBatGeometries);
+	releaseModel(CarGeometries);
+	releaseModel(PoliceGeometries);
+	releaseModel(CadillacGeometries);
+	releaseModel(ZepplinGeometries);
+	releaseModel(Tree1Geometries);
+	releaseModel(Tree2Geometries);
+	releaseUnusedTextures();
+	cleanupParticlePool(explosionParticles);
+	cleanupGeometryArena();
+	cleanupTextureStreaming();
 }
 
 // -----------------------  Loading .obj file ---------------------------------
 
-
-/** Load mesh using assimp library
- *  Vertex, normals and texture coordinates data are stored without interleaving |VVVVV...|NNNNN...|tttt
- * \param fileName [in] file to open/load
+/**
+ * \brief Create the OpenGL objects (buffers, vao) of one sub-mesh.
+ * The vertex buffer uses the layout of the packed vertices, for VERTEX_LAYOUT_SEPARATE the mesh data is uploaded
+ * as is without interleaving |VVVVV...|NNNNN...|tttt
+ * \param mesh [in] CPU side mesh (imported or mapped straight from the cache file)
+ * \param vertices [in] vertex buffer content prepared by packVertices()
  * \param shader [in] vao will connect loaded data to shader
- * \param geometry
+ * \param texture [in] diffuse texture of the mesh (0 if the mesh is not textured)
  */
-bool loadMeshes(const std::string& fileName, ShaderProgram& shader, std::vector<ObjectGeometry*>& geometries) {
-	Assimp::Importer importer;
+ObjectGeometry* createMeshGeometry(const MeshData& mesh, const PackedVertices& vertices, ShaderProgram& shader, GLuint texture) {
+	ObjectGeometry* geometry = new ObjectGeometry;
+
+	// vertex buffer object, store all vertex positions, normals and texture coordinates in one go
+	glGenBuffers(1, &(geometry->vertexBufferObject));
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBufferObject);
+	if (vertices.layout == VERTEX_LAYOUT_SEPARATE)
+		glBufferData(GL_ARRAY_BUFFER, 8 * sizeof(float) * mesh.numVertices, mesh.vertices(), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, vertices.bytes.size(), vertices.bytes.data(), GL_STATIC_DRAW);
+	geometry->positionScale = vertices.positionScale;
+	geometry->positionOffset = vertices.positionOffset;
+	computeGeometryBounds(geometry, mesh);
+
+	// element buffer object
+	glGenBuffers(1, &(geometry->elementBufferObject));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBufferObject);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBytes(), mesh.indices(), GL_STATIC_DRAW);
 
-	std::cout << "Loading model " << fileName << std::endl;
+	// material
+	geometry->material.ambient = mesh.ambient;
+	geometry->material.diffuse = mesh.diffuse;
+	geometry->material.specular = mesh.specular;
+	geometry->material.shininess = mesh.shininess;
+	geometry->material.texture = texture;
+	CHECK_GL_ERROR();
 
-	// Unitize object in size (scale the model to fit into (-1..1)^3)
-	importer.SetPropertyInteger(AI_CONFIG_PP_PTV_NORMALIZE, 1);
+	glGenVertexArrays(1, &(geometry->vertexArrayObject));
+	glBindVertexArray(geometry->vertexArrayObject);
 
-	// Load asset from the file - you can play with various processing steps
-	const aiScene* scn = importer.ReadFile(fileName.c_str(), 0
-		| aiProcess_Triangulate             // Triangulate polygons (if any).
-		| aiProcess_PreTransformVertices    // Transforms scene hierarchy into one root with geometry-leafs only. For more see Doc.
-		| aiProcess_GenSmoothNormals        // Calculate normals per vertex.
-		| aiProcess_JoinIdenticalVertices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBufferObject); // bind our element array buffer (indices) to vao
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBufferObject);
 
-	// abort if the loader fails
-	if (scn == NULL) {
-		std::cerr << "assimp error: " << importer.GetErrorString() << std::endl;
-		return false;
-	}
+	setVertexLayoutAttributes(vertices.layout, mesh.numVertices, shader, useLighting);
 
-	for (int i = 0; i < scn->mNumMeshes; i++) {
-		std::cout << "Mesh " << i << " has " << scn->mMeshes[i]->mNumVertices << " vertices" << std::endl;
+	if (!useLighting) {
+		glDisableVertexAttribArray(shader.locations.color);
+		// following line is problematic on AMD/ATI graphic cards
+		// -> if you see black screen (no objects at all) than try to set color manually in vertex shader to see at least something
+		glVertexAttrib3f(shader.locations.color, mesh.diffuse.r, mesh.diffuse.g, mesh.diffuse.b);
 	}
+	CHECK_GL_ERROR();
 
-	// some formats store whole scene (multiple meshes and materials, lights, cameras, ...) in one file, we can access the data by scn->*
-	for (int i = 0; i < scn->mNumMeshes; i++) {
-		// get the current mesh
-		const aiMesh* mesh = scn->mMeshes[i];
-
-		ObjectGeometry* geometry = new ObjectGeometry;
-
-		// vertex buffer object, store all vertex positions and normals
-		glGenBuffers(1, &(geometry->vertexBufferObject));
-		glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBufferObject);
-		glBufferData(GL_ARRAY_BUFFER, 8 * sizeof(float) * mesh->mNumVertices, 0, GL_STATIC_DRAW); // allocate memory for vertices, normals, and texture coordinates
-		// first store all vertices
-		glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * sizeof(float) * mesh->mNumVertices, mesh->mVertices);
-		// then store all normals
-		glBufferSubData(GL_ARRAY_BUFFER, 3 * sizeof(float) * mesh->mNumVertices, 3 * sizeof(float) * mesh->mNumVertices, mesh->mNormals);
-
-		// just texture 0 for now
-		float* textureCoords = new float[2 * mesh->mNumVertices];  // 2 floats per vertex
-		float* currentTextureCoord = textureCoords;
-
-		// copy texture coordinates
-		aiVector3D vect;
-
-		if (mesh->HasTextureCoords(0)) {
-			// we use 2D textures with 2 coordinates and ignore the third coordinate
-			for (unsigned int idx = 0; idx < mesh->mNumVertices; idx++) {
-				vect = (mesh->mTextureCoords[0])[idx];
-				*currentTextureCoord++ = vect.x;
-				*currentTextureCoord++ = vect.y;
-			}
-		}
-
-		// finally store all texture coordinates
-		glBufferSubData(GL_ARRAY_BUFFER, 6 * sizeof(float) * mesh->mNumVertices, 2 * sizeof(float) * mesh->mNumVertices, textureCoords);
-
-		// copy all mesh faces into one big array (assimp supports faces with ordinary number of vertices, we use only 3 -> triangles)
-		unsigned int* indices = new unsigned int[mesh->mNumFaces * 3];
-		for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
-			indices[f * 3 + 0] = mesh->mFaces[f].mIndices[0];
-			indices[f * 3 + 1] = mesh->mFaces[f].mIndices[1];
-			indices[f * 3 + 2] = mesh->mFaces[f].mIndices[2];
-		}
-
-		// copy our temporary index array to OpenGL and free the array
-		glGenBuffers(1, &(geometry->elementBufferObject));
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBufferObject);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, 3 * sizeof(unsigned) * mesh->mNumFaces, indices, GL_STATIC_DRAW);
-
-		delete[] indices;
-
-		// copy material
-		// copy the material info to structure
-		const aiMaterial* material = scn->mMaterials[mesh->mMaterialIndex];
-		aiColor4D color;
-		aiString name;
-		aiReturn retValue = AI_SUCCESS;
-
-		material->Get(AI_MATKEY_NAME, name);
-
-		// diffiuse
-		if ((retValue = aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &color)) != AI_SUCCESS)
-			color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
-		geometry->material.diffuse = glm::vec3(color.r, color.g, color.b);
-
-		// ambient
-		if ((retValue = aiGetMaterialColor(material, AI_MATKEY_COLOR_AMBIENT, &color)) != AI_SUCCESS)
-			color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
-		geometry->material.ambient = glm::vec3(color.r, color.g, color.b);
-
-		// specular
-		if ((retValue = aiGetMaterialColor(material, AI_MATKEY_COLOR_SPECULAR, &color)) != AI_SUCCESS)
-			color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
-		geometry->material.specular = glm::vec3(color.r, color.g, color.b);
-
-		// shininess
-		ai_real shininess, strength;
-		unsigned int max;	// changed: to unsigned
-
-		max = 1;
-		if ((retValue = aiGetMaterialFloatArray(material, AI_MATKEY_SHININESS, &shininess, &max)) != AI_SUCCESS)
-			shininess = 1.0f;
-		max = 1;
-		if ((retValue = aiGetMaterialFloatArray(material, AI_MATKEY_SHININESS_STRENGTH, &strength, &max)) != AI_SUCCESS)
-			strength = 1.0f;
-		geometry->material.shininess = shininess * strength;
-
-
-		geometry->material.texture = 0;
-		// load texture image
-		if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-			// get texture name 
-			aiString path; // filename
-
-			aiReturn texFound = material->GetTexture(aiTextureType_DIFFUSE, 0, &path);
-			std::string textureName = path.data;
-
-			size_t found = fileName.find_last_of("/\\");
-			// insert correct texture file path 
-			if (found != std::string::npos) { // not found
-				textureName.insert(0, fileName.substr(0, found + 1));
-			}
-
-			std::cout << "Loading texture file: " << textureName << std::endl;
-			geometry->material.texture = pgr::createTexture(textureName);
-		}
-		else {
-			std::cout << "No texture found for mesh " << i << std::endl;
-		}
-		CHECK_GL_ERROR();
-
-		glGenVertexArrays(1, &(geometry->vertexArrayObject));
-		glBindVertexArray(geometry->vertexArrayObject);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBufferObject); // bind our element array buffer (indices) to vao
-		glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBufferObject);
-
-		glEnableVertexAttribArray(shader.locations.position);
-		glVertexAttribPointer(shader.locations.position, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		if (useLighting) {
-			glEnableVertexAttribArray(shader.locations.normal);
-			glVertexAttribPointer(shader.locations.normal, 3, GL_FLOAT, GL_FALSE, 0, (void*)(3 * sizeof(float) * mesh->mNumVertices));
-		}
-		else {
-			glDisableVertexAttribArray(shader.locations.color);
-			// following line is problematic on AMD/ATI graphic cards
-			// -> if you see black screen (no objects at all) than try to set color manually in vertex shader to see at least something
-			glVertexAttrib3f(shader.locations.color, color.r, color.g, color.b);
-		}
-
-		glEnableVertexAttribArray(shader.locations.texCoord);
-		glVertexAttribPointer(shader.locations.texCoord, 2, GL_FLOAT, GL_FALSE, 0, (void*)(6 * sizeof(float) * mesh->mNumVertices));
-		CHECK_GL_ERROR();
+	glBindVertexArray(0);
 
-		glBindVertexArray(0);
+	geometry->numTriangles = mesh.numTriangles;
+	geometry->numVertices = mesh.numVertices;
+	geometry->indexType = mesh.indexType();
 
-		geometry->numTriangles = mesh->mNumFaces;
+	return geometry;
+}
 
-		geometries.push_back(geometry);
+/**
+ * \brief Chain the coarser levels of detail of the mesh behind its geometry. They share its buffers, material and bounds,
+ * their triangles follow the full mesh in the index buffer.
+ */
+static void createGeometryLods(ObjectGeometry* geometry, const MeshData& mesh) {
+	ObjectGeometry* previous = geometry;
+	size_t indexOffset = geometry->indexOffset + (size_t)3 * mesh.numTriangles * mesh.indexSize;
+
+	for (unsigned int level = 1; level < mesh.numLods; level++) {
+		ObjectGeometry* lod = new ObjectGeometry(*geometry);
+		lod->nextLod = NULL;
+		lod->numTriangles = mesh.lodTriangles[level];
+		lod->indexOffset = indexOffset;
+		lod->lodError = mesh.lodErrors[level];
+		indexOffset += (size_t)3 * lod->numTriangles * mesh.indexSize;
+
+		previous->nextLod = lod;
+		previous = lod;
 	}
-
-	return true;
 }
 
-bool loadSingleMesh(const std::string & fileName, ShaderProgram & shader, ObjectGeometry **geometry) {
-	Assimp::Importer importer;
-
-	// Unitize object in size (scale the model to fit into (-1..1)^3)
-	importer.SetPropertyInteger(AI_CONFIG_PP_PTV_NORMALIZE, 1);
-
-	// Load asset from the file - you can play with various processing steps
-	const aiScene* scn = importer.ReadFile(fileName.c_str(), 0
-		| aiProcess_Triangulate             // Triangulate polygons (if any).
-		| aiProcess_PreTransformVertices    // Transforms scene hierarchy into one root with geometry-leafs only. For more see Doc.
-		| aiProcess_GenSmoothNormals        // Calculate normals per vertex.
-		| aiProcess_JoinIdenticalVertices);
+/**
+ * \brief Vertex layout of the loaded meshes (the arena cannot share separate vertex blocks).
+ */
+VertexLayout meshVertexLayout() {
+	return useGeometryArena ? geometryArenaLayout(vertexLayout) : vertexLayout;
+}
 
-	// abort if the loader fails
-	if (scn == NULL) {
-		std::cerr << "assimp error: " << importer.GetErrorString() << std::endl;
-		*geometry = NULL;
+/**
+ * \brief CPU part of a model load: meshes (imported or mapped from the mesh cache) and decoded textures.
+ * Safe to call from a worker thread, no OpenGL call is made.
+ */
+bool loadPendingModel(const std::string& fileName, PendingModel& pending) {
+	if (!loadModelData(fileName, pending.model))
 		return false;
-	}
 
-	// some formats store whole scene (multiple meshes and materials, lights, cameras, ...) in one file, we cannot handle that in our simplified example
-	if (scn->mNumMeshes != 1) {
-		std::cerr << "this simplified loader can only process files with only one mesh" << std::endl;
-		*geometry = NULL;
-		return false;
+	// convert the vertices to the selected layout here, so the GL thread only uploads them
+	pending.vertices.resize(pending.model.meshes.size());
+	for (size_t i = 0; i < pending.model.meshes.size(); i++) {
+		packVertices(pending.model.meshes[i], meshVertexLayout(), pending.vertices[i]);
 	}
 
-	// in this phase we know we have one mesh in our loaded scene, we can directly copy its data to OpenGL ...
-	const aiMesh* mesh = scn->mMeshes[0];
-
-	*geometry = new ObjectGeometry;
-
-	// vertex buffer object, store all vertex positions and normals
-	glGenBuffers(1, &((*geometry)->vertexBufferObject));
-	glBindBuffer(GL_ARRAY_BUFFER, (*geometry)->vertexBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, 8 * sizeof(float) * mesh->mNumVertices, 0, GL_STATIC_DRAW); // allocate memory for vertices, normals, and texture coordinates
-	// first store all vertices
-	glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * sizeof(float) * mesh->mNumVertices, mesh->mVertices);
-	// then store all normals
-	glBufferSubData(GL_ARRAY_BUFFER, 3 * sizeof(float) * mesh->mNumVertices, 3 * sizeof(float) * mesh->mNumVertices, mesh->mNormals);
-
-	// just texture 0 for now
-	float* textureCoords = new float[2 * mesh->mNumVertices];  // 2 floats per vertex
-	float* currentTextureCoord = textureCoords;
-
-	// copy texture coordinates
-	aiVector3D vect;
-
-	if (mesh->HasTextureCoords(0)) {
-		// we use 2D textures with 2 coordinates and ignore the third coordinate
-		for (unsigned int idx = 0; idx < mesh->mNumVertices; idx++) {
-			vect = (mesh->mTextureCoords[0])[idx];
-			*currentTextureCoord++ = vect.x;
-			*currentTextureCoord++ = vect.y;
-		}
+	// every texture is decoded once, even when several sub-meshes or models use it
+	pending.textures.assign(pending.model.meshes.size(), NULL);
+	for (size_t i = 0; i < pending.model.meshes.size(); i++) {
+		const std::string& textureName = pending.model.meshes[i].textureName;
+		if (!textureName.empty())
+			pending.textures[i] = requestTexture(textureName);
 	}
+	return true;
+}
 
-	// finally store all texture coordinates
-	glBufferSubData(GL_ARRAY_BUFFER, 6 * sizeof(float) * mesh->mNumVertices, 2 * sizeof(float) * mesh->mNumVertices, textureCoords);
-
-	// copy all mesh faces into one big array (assimp supports faces with ordinary number of vertices, we use only 3 -> triangles)
-	unsigned int* indices = new unsigned int[mesh->mNumFaces * 3];
-	for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
-		indices[f * 3 + 0] = mesh->mFaces[f].mIndices[0];
-		indices[f * 3 + 1] = mesh->mFaces[f].mIndices[1];
-		indices[f * 3 + 2] = mesh->mFaces[f].mIndices[2];
+/**
+ * \brief GL part of a model load: create textures, buffers and vaos and free the CPU side data.
+ */
+void uploadPendingModel(PendingModel& pending, ShaderProgram& shader, std::vector<ObjectGeometry*>& geometries) {
+	const size_t first = geometries.size();
+	for (size_t i = 0; i < pending.model.meshes.size(); i++) {
+		const MeshData& mesh = pending.model.meshes[i];
+		// one reference per sub-mesh, released by cleanupGeometry()
+		GLuint texture = acquireTexture(pending.textures[i]);
+		ObjectGeometry* geometry = NULL;
+		if (useGeometryArena && &shader == &commonShaderProgram)
+			geometry = addArenaGeometry(mesh, pending.vertices[i], texture);
+		if (geometry == NULL)
+			geometry = createMeshGeometry(mesh, pending.vertices[i], shader, texture);
+		createGeometryLods(geometry, mesh);
+		geometries.push_back(geometry);
 	}
 
-	// copy our temporary index array to OpenGL and free the array
-	glGenBuffers(1, &((*geometry)->elementBufferObject));
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (*geometry)->elementBufferObject);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, 3 * sizeof(unsigned) * mesh->mNumFaces, indices, GL_STATIC_DRAW);
-
-	delete[] indices;
-
-	// copy the material info to structure
-	const aiMaterial* mat = scn->mMaterials[mesh->mMaterialIndex];
-	aiColor4D color;
-	aiString name;
-	aiReturn retValue = AI_SUCCESS;
-
-	// Get returns: aiReturn_SUCCESS 0 | aiReturn_FAILURE -1 | aiReturn_OUTOFMEMORY -3
-	mat->Get(AI_MATKEY_NAME, name); // may be "" after the input mesh processing. Must be aiString type!
-
-	if ((retValue = aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &color)) != AI_SUCCESS)
-		color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
-
-	(*geometry)->material.diffuse = glm::vec3(color.r, color.g, color.b);
+	// sub-meshes with the same material end up next to each other and can be drawn together
+	std::stable_sort(geometries.begin() + first, geometries.end(), drawStateLess);
 
-	if ((retValue = aiGetMaterialColor(mat, AI_MATKEY_COLOR_AMBIENT, &color)) != AI_SUCCESS)
-		color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
-	(*geometry)->material.ambient = glm::vec3(color.r, color.g, color.b);
+	printVertexLayoutReport(pending.model, meshVertexLayout());
 
-	if ((retValue = aiGetMaterialColor(mat, AI_MATKEY_COLOR_SPECULAR, &color)) != AI_SUCCESS)
-		color = aiColor4D(0.0f, 0.0f, 0.0f, 0.0f);
-	(*geometry)->material.specular = glm::vec3(color.r, color.g, color.b);
-
-	ai_real shininess, strength;
-	unsigned int max;	// changed: to unsigned
-
-	max = 1;
-	if ((retValue = aiGetMaterialFloatArray(mat, AI_MATKEY_SHININESS, &shininess, &max)) != AI_SUCCESS)
-		shininess = 1.0f;
-	max = 1;
-	if ((retValue = aiGetMaterialFloatArray(mat, AI_MATKEY_SHININESS_STRENGTH, &strength, &max)) != AI_SUCCESS)
-		strength = 1.0f;
-	(*geometry)->material.shininess = shininess * strength;
-
-	(*geometry)->material.texture = 0;
-
-	// load texture image
-	if (mat->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-		// get texture name 
-		aiString path; // filename
-
-		aiReturn texFound = mat->GetTexture(aiTextureType_DIFFUSE, 0, &path);
-		std::string textureName = path.data;
+	pending.textures.clear();
+	pending.vertices.clear();
+	releaseModelData(pending.model);
+}
 
-		size_t found = fileName.find_last_of("/\\");
-		// insert correct texture file path 
-		if (found != std::string::npos) { // not found
-			//subMesh_p->textureName.insert(0, "/");
-			textureName.insert(0, fileName.substr(0, found + 1));
-		}
+bool uploadPendingSingleMesh(PendingModel& pending, ShaderProgram& shader, ObjectGeometry** geometry) {
+	*geometry = NULL;
 
-		std::cout << "Loading texture file: " << textureName << std::endl;
-		(*geometry)->material.texture = pgr::createTexture(textureName);
+	// some formats store whole scene (multiple meshes and materials, lights, cameras, ...) in one file, we cannot handle that in our simplified example
+	if (pending.model.meshes.size() != 1) {
+		if (!pending.model.meshes.empty())
+			std::cerr << "this simplified loader can only process files with only one mesh" << std::endl;
+		pending.textures.clear();
+		pending.vertices.clear();
+		releaseModelData(pending.model);
+		return false;
 	}
-	CHECK_GL_ERROR();
 
-	glGenVertexArrays(1, &((*geometry)->vertexArrayObject));
-	glBindVertexArray((*geometry)->vertexArrayObject);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (*geometry)->elementBufferObject); // bind our element array buffer (indices) to vao
-	glBindBuffer(GL_ARRAY_BUFFER, (*geometry)->vertexBufferObject);
+	std::vector<ObjectGeometry*> geometries;
+	uploadPendingModel(pending, shader, geometries);
+	*geometry = geometries[0];
+	return true;
+}
 
-	glEnableVertexAttribArray(shader.locations.position);
-	glVertexAttribPointer(shader.locations.position, 3, GL_FLOAT, GL_FALSE, 0, 0);
+/** Load all meshes of a model right away on the calling (GL) thread
+ * \param fileName [in] file to open/load
+ * \param shader [in] vao will connect loaded data to shader
+ * \param geometries [out] one geometry per sub-mesh
+ */
+bool loadMeshes(const std::string& fileName, ShaderProgram& shader, std::vector<ObjectGeometry*>& geometries) {
+	PendingModel pending;
 
-	if (useLighting) {
-		glEnableVertexAttribArray(shader.locations.normal);
-		glVertexAttribPointer(shader.locations.normal, 3, GL_FLOAT, GL_FALSE, 0, (void*)(3 * sizeof(float) * mesh->mNumVertices));
-	}
-	else {
-		glDisableVertexAttribArray(shader.locations.color);
-		// following line is problematic on AMD/ATI graphic cards
-		// -> if you see black screen (no objects at all) than try to set color manually in vertex shader to see at least something
-		glVertexAttrib3f(shader.locations.color, color.r, color.g, color.b);
-	}
+	if (!loadPendingModel(fileName, pending))
+		return false;
 
-	glEnableVertexAttribArray(shader.locations.texCoord);
-	glVertexAttribPointer(shader.locations.texCoord, 2, GL_FLOAT, GL_FALSE, 0, (void*)(6 * sizeof(float) * mesh->mNumVertices));
-	CHECK_GL_ERROR();
+	uploadPendingModel(pending, shader, geometries);
+	return true;
+}
 
-	glBindVertexArray(0);
+bool loadSingleMesh(const std::string & fileName, ShaderProgram & shader, ObjectGeometry **geometry) {
+	PendingModel pending;
 
-	(*geometry)->numTriangles = mesh->mNumFaces;
+	if (!loadPendingModel(fileName, pending)) {
+		*geometry = NULL;
+		return false;
+	}
 
-	return true;
+	return uploadPendingSingleMesh(pending, shader, geometry);
 }
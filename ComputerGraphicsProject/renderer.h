@@ -12,42 +12,57 @@
 
 #include <vector>
 #include <list>
+#include <map>
 #include "data.h"
 #include "object.h"
 #include "spline.h"
+#include "meshCache.h"
+#include "image.h"
+#include "textureCache.h"
+#include "textureStreaming.h"
+#include "resourceManager.h"
+#include "programCache.h"
+#include "shaderPermutations.h"
+#include "vertexFormat.h"
+#include "geometryArena.h"
+#include "renderStats.h"
+#include "drawQueue.h"
+#include "uniformBuffers.h"
+#include "clusteredLighting.h"
+#include "instancing.h"
+#include "frustumCulling.h"
+#include "entityStore.h"
+#include "spatialHash.h"
+#include "particleSystem.h"
+#include "frameLoop.h"
+#include "meshBVH.h"
+#include "picking.h"
+#include "terrainChunks.h"
+#include "meshLod.h"
 
 extern ShaderProgram commonShaderProgram;
+extern ShaderProgram instancedShaderProgram;
 extern SkyboxShaderProgram skyboxShaderProgram;
 
 
 typedef struct _GameObjects {
 	Player* player;
 	Terrain* terrain;
-	Object* cube;
-	Aircraft* foxbat;
-	Aircraft* zepplin;
-	std::list<void*> explosions;
-	Object* car;
-	Object* police;
-	Object* cadillac;
-	Object* tree1;
-	Object* tree2;
 	Object* gameOver;
 	Object* commandsBanner;
 
+	// the other scene objects live in the entity store (entityStore.h), the explosions in explosionParticles
+	// (particleSystem.h), these are the entities controlled from the keyboard
+	EntityId foxbat;
+	EntityId car;
+
 	_GameObjects() {
 		player = NULL;
 		terrain = NULL;
-		cube = NULL;
-		foxbat = NULL;
-		zepplin = NULL;
-		car = NULL;
-		police = NULL;
-		cadillac = NULL;
-		tree1 = NULL;
-		tree2 = NULL;
 		gameOver = NULL;
 		commandsBanner = NULL;
+		foxbat = ENTITY_NONE;
+		car = ENTITY_NONE;
 	}
 
 } GameObjectsList;
@@ -55,6 +70,9 @@ typedef struct _GameObjects {
 extern GameObjectsList GameObjects;
 
 void loadShaderPrograms();
+bool setupLightingProgram(GLuint program, ShaderProgram& target, bool instanced, const ShaderProgram* layout, bool store);
+bool hasOpenGLVersion(int major, int minor);
+bool hasOpenGLExtension(const char* name);
 void cleanupShaderPrograms(void);
 
 
@@ -63,20 +81,26 @@ void cleanupShaderPrograms(void);
 void initTerrain();
 void initPlayer();
 void initSkybox();
-void initModel(const std::string ModelName, std::vector<ObjectGeometry*> ModelGeometries);
+void initModel(const std::string ModelName, std::vector<ObjectGeometry*> *ModelGeometries, MeshBVH* ModelBVH = NULL);
 
 void initSceneObjects();
 
 // -----------------------  Colision Detection -------------------------------
 glm::vec3 checkBounds(const glm::vec3& position, float objectSize);
+const MeshBVH* entityBVH(unsigned char mesh);
+float maxMeshBoundingRadius();
+glm::mat4 modelEntityMatrix(const glm::vec3& position, const glm::vec3& direction, float size);
+glm::vec3 interpolatedPosition(const EntityStore& store, unsigned int slot);
+glm::vec3 interpolatedDirection(const EntityStore& store, unsigned int slot);
 
 // -----------------------  Draw scene objects ---------------------------------
 
-void drawTerrain(Terrain* Terrain, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
-void drawPlayer(Player* Player, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+void drawTerrain(Terrain* Terrain, const glm::mat4& viewMatrix);
+void drawPlayer(Player* Player);
+void drawCube(const EntityStore& store, unsigned int slot);
 void drawSkybox(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
-void drawModel(Object* Model, std::vector<ObjectGeometry*> ModelGeometry, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
-void drawExplosion(ExplosionObject* explosion, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+void drawModel(const EntityStore& store, unsigned int slot, const std::vector<ObjectGeometry*>& ModelGeometry);
+void drawExplosions(ParticlePool& pool, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
 void drawGameOver(Object* Banner, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
 void drawCommandsBanner(Object* Banner, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
 void drawObjects(GameObjectsList GameObjects, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
@@ -88,6 +112,22 @@ void cleanupGeometry(ObjectGeometry* geometry);
 void cleanupModels();
 
 // -----------------------  Loading .obj file ---------------------------------
+
+/**
+ * \brief Model loaded on the CPU side, waiting for its GL upload.
+ */
+typedef struct _PendingModel {
+	ModelData model;
+	std::vector<TextureResource*> textures;	///< texture of each mesh (NULL if none), see resourceManager.h
+	std::vector<PackedVertices> vertices;		///< vertex buffer of each mesh in the selected layout
+	MeshBVH bvh;								///< collision hierarchy, built when requested by initModel
+} PendingModel;
+
+ObjectGeometry* createMeshGeometry(const MeshData& mesh, const PackedVertices& vertices, ShaderProgram& shader, GLuint texture);
+VertexLayout meshVertexLayout();
+bool loadPendingModel(const std::string& fileName, PendingModel& pending);
+void uploadPendingModel(PendingModel& pending, ShaderProgram& shader, std::vector<ObjectGeometry*>& geometries);
+bool uploadPendingSingleMesh(PendingModel& pending, ShaderProgram& shader, ObjectGeometry** geometry);
 bool loadMeshes(const std::string& fileName, ShaderProgram& shader, std::vector<ObjectGeometry*>& geometries);
 bool loadSingleMesh(const std::string& fileName, ShaderProgram& shader, ObjectGeometry** geometry);
 
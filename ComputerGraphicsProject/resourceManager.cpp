@@ -0,0 +1,996 @@
+/*
+* \file resourceManager.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Resource manager - textures, models and shader programs loaded once per file and shared by reference counting
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "resourceManager.h"
+#include "programCache.h"
+#include "textureCache.h"
+#include "textureStreaming.h"
+#include "meshCache.h"
+#include "renderer.h"
+
+ResourceStats textureResourceStats;
+ResourceStats modelResourceStats;
+ResourceStats shaderResourceStats;
+
+enum ResourceState {
+	RESOURCE_LOADING,
+	RESOURCE_READY,
+	RESOURCE_FAILED
+};
+
+/**
+ * \brief One image file, decoded (or read from the texture cache) once whatever the number of requests.
+ * The image is dropped once the texture is created.
+ */
+struct _TextureResource {
+	std::string path;			///< canonical path of the first request
+	uint64_t contentHash;		///< hash of the image file, 0 if it cannot be read
+	ResourceState state;
+	ImageData image;
+	size_t bytes;				///< size of the decoded / baked image
+	GLuint texture;
+	unsigned int references;	///< users of the texture (one per geometry)
+};
+
+/**
+ * \brief One model file, its geometries are shared by every object list loading it.
+ */
+struct _ModelResource {
+	std::string path;
+	std::vector<ObjectGeometry*> geometries;
+	MeshBVH bvh;
+	bool published;
+	size_t bytes;				///< size of the model file
+	unsigned int references;	///< object lists holding the geometries
+	std::vector<std::vector<ObjectGeometry*>*> users;	///< filled by publishModel()
+	std::vector<MeshBVH*> userBVHs;
+};
+
+/**
+ * \brief One shader file read once, compiled by the first program linked from source (a program restored from the
+ * program cache needs no shader object).
+ */
+struct _ShaderResource {
+	std::string path;
+	GLenum type;
+	std::string defines;		///< inserted after the #version line (permutations of the same file)
+	std::string source;			///< with the defines
+	uint64_t contentHash;
+	GLuint shader;				///< 0 until compiled
+	unsigned int references;	///< programs linking the shader
+};
+
+/**
+ * \brief One program, keyed by the shaders it links.
+ */
+typedef struct _ProgramResource {
+	std::vector<ShaderResource*> shaders;	///< in link order
+	std::vector<ShaderResource*> key;		///< sorted
+	std::string cacheFileName;
+	std::vector<ProgramSetup> setups;		///< one per request, called again after a hot reload
+	GLuint program;
+	unsigned int references;
+} ProgramResource;
+
+// the textures are requested from the worker threads, everything else only from the GL thread
+static std::mutex textureMutex;
+static std::condition_variable textureReady;
+static std::map<std::string, TextureResource*> texturesByPath;
+static std::map<uint64_t, TextureResource*> texturesByContent;
+static std::map<GLuint, TextureResource*> texturesByName;
+
+static std::map<std::string, ModelResource*> modelsByPath;
+
+static std::map<std::string, ShaderResource*> shadersByPath;
+static std::map<uint64_t, ShaderResource*> shadersByContent;
+static std::map<GLuint, ProgramResource*> programs;
+static unsigned int programsLinked = 0;	///< linked from source, at load and by the hot reload
+
+/**
+ * \brief Path with / separators and without . and dir/.. components, so that the same file always gets the same key.
+ * Windows paths are compared case-insensitively.
+ */
+std::string canonicalPath(const std::string& fileName) {
+	std::string path = fileName;
+	std::replace(path.begin(), path.end(), '\\', '/');
+#ifdef _WIN32
+	std::transform(path.begin(), path.end(), path.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+#endif
+
+	std::vector<std::string> components;
+	std::stringstream stream(path);
+	std::string component;
+	while (std::getline(stream, component, '/')) {
+		if (component.empty() || component == ".")
+			continue;
+		if (component == ".." && !components.empty() && components.back() != "..")
+			components.pop_back();
+		else
+			components.push_back(component);
+	}
+
+	std::string canonical = !path.empty() && path[0] == '/' ? "/" : "";
+	for (size_t i = 0; i < components.size(); i++) {
+		if (i > 0)
+			canonical += '/';
+		canonical += components[i];
+	}
+	return canonical;
+}
+
+static size_t imageBytes(const ImageData& image) {
+	size_t bytes = image.pixels.size();
+	for (size_t i = 0; i < image.levels.size(); i++)
+		bytes += image.levels[i].size;
+	return bytes;
+}
+
+// -----------------------  Textures ---------------------------------
+
+/**
+ * \brief Forget the resource under every path and content hash leading to it and delete it, the texture is deleted by
+ * the caller. textureMutex must be held.
+ */
+static void deleteTextureResource(TextureResource* resource) {
+	std::map<uint64_t, TextureResource*>::iterator same = texturesByContent.find(resource->contentHash);
+	if (same != texturesByContent.end() && same->second == resource)
+		texturesByContent.erase(same);
+	// the resource may be reached through several paths (copies of the file)
+	for (std::map<std::string, TextureResource*>::iterator path = texturesByPath.begin(); path != texturesByPath.end();) {
+		if (path->second == resource)
+			path = texturesByPath.erase(path);
+		else
+			++path;
+	}
+	delete resource;
+	textureResourceStats.releases++;
+}
+
+/**
+ * \brief Texture of the image file, decoded by the first request only. Safe to call from worker threads: a request for
+ * a file being decoded by another thread waits for it. Files with the same content under another path share the
+ * texture as well.
+ * \return NULL if the image cannot be loaded
+ */
+TextureResource* requestTexture(const std::string& fileName) {
+	const std::string path = canonicalPath(fileName);
+
+	std::unique_lock<std::mutex> lock(textureMutex);
+	textureResourceStats.requests++;
+
+	// same file, the waiters look the path up again as the entry may become an alias of another file (or be released)
+	std::map<std::string, TextureResource*>::const_iterator it = texturesByPath.find(path);
+	if (it != texturesByPath.end()) {
+		textureReady.wait(lock, [&path] {
+			std::map<std::string, TextureResource*>::const_iterator entry = texturesByPath.find(path);
+			return entry == texturesByPath.end() || entry->second->state != RESOURCE_LOADING;
+		});
+		it = texturesByPath.find(path);
+	}
+	if (it != texturesByPath.end()) {
+		TextureResource* resource = it->second;
+		if (resource->state == RESOURCE_FAILED)
+			return NULL;
+		textureResourceStats.pathHits++;
+		textureResourceStats.bytesAvoided += resource->bytes;
+		return resource;
+	}
+
+	TextureResource* resource = new TextureResource;
+	resource->path = path;
+	resource->contentHash = 0;
+	resource->state = RESOURCE_LOADING;
+	resource->bytes = 0;
+	resource->texture = 0;
+	resource->references = 0;
+	texturesByPath[path] = resource;
+	lock.unlock();
+
+	const uint64_t contentHash = hashFile(path);
+
+	lock.lock();
+	std::map<uint64_t, TextureResource*>::const_iterator same = texturesByContent.find(contentHash);
+	if (contentHash != 0 && same != texturesByContent.end()) {
+		// copy of a file already requested, this path becomes an alias of it
+		TextureResource* original = same->second;
+		textureReady.wait(lock, [original] { return original->state != RESOURCE_LOADING; });
+		texturesByPath[path] = original;
+		delete resource;
+		textureReady.notify_all();
+
+		if (original->state == RESOURCE_FAILED)
+			return NULL;
+		textureResourceStats.contentHits++;
+		textureResourceStats.bytesAvoided += original->bytes;
+		return original;
+	}
+	resource->contentHash = contentHash;
+	if (contentHash != 0)
+		texturesByContent[contentHash] = resource;
+	lock.unlock();
+
+	std::cout << "Loading texture file: " << path << std::endl;
+	ImageData image;
+	const bool loaded = loadTextureImage(path, image);
+
+	lock.lock();
+	resource->image = image;
+	resource->bytes = imageBytes(image);
+	resource->state = loaded ? RESOURCE_READY : RESOURCE_FAILED;
+	textureResourceStats.loads++;
+	textureResourceStats.bytesLoaded += resource->bytes;
+	textureReady.notify_all();
+	return loaded ? resource : NULL;
+}
+
+/**
+ * \brief Texture of the resource, created by the first user. Every user takes one reference, given back by
+ * releaseTexture(). Must be called from the GL thread.
+ * \param streamed [in] stream the finer levels (see textureStreaming.h), only for the textures drawn through the draw
+ * queue or the instance groups, which request the levels they need. The first user decides
+ * \return 0 if the resource is NULL
+ */
+GLuint acquireTexture(TextureResource* resource, bool streamed) {
+	if (resource == NULL)
+		return 0;
+
+	// only the GL thread touches the texture of a ready resource
+	if (resource->texture == 0) {
+		resource->texture = streamed ? createStreamedTexture(resource->image) : createTextureFromImage(resource->image);
+		resource->image = ImageData();
+
+		std::lock_guard<std::mutex> lock(textureMutex);
+		texturesByName[resource->texture] = resource;
+	}
+	resource->references++;
+	return resource->texture;
+}
+
+/**
+ * \brief Give back one reference to the texture, the texture and its resource are deleted with the last one.
+ * Textures not created by acquireTexture() are left alone. Must be called from the GL thread.
+ */
+void releaseTexture(GLuint texture) {
+	std::lock_guard<std::mutex> lock(textureMutex);
+
+	std::map<GLuint, TextureResource*>::iterator it = texturesByName.find(texture);
+	if (texture == 0 || it == texturesByName.end())
+		return;
+
+	TextureResource* resource = it->second;
+	if (--resource->references > 0)
+		return;
+
+	deleteStreamedTexture(texture);
+	texturesByName.erase(it);
+	deleteTextureResource(resource);
+}
+
+/**
+ * \brief Delete the resources nobody acquired: images that failed to load and images requested by a load whose
+ * upload gave up (a model with several meshes loaded as a single mesh). Called once no worker thread requests
+ * textures any more. Must be called from the GL thread.
+ */
+void releaseUnusedTextures() {
+	std::lock_guard<std::mutex> lock(textureMutex);
+
+	std::vector<TextureResource*> unused;
+	for (std::map<std::string, TextureResource*>::const_iterator it = texturesByPath.begin(); it != texturesByPath.end(); ++it) {
+		TextureResource* resource = it->second;
+		if (resource->references == 0 && resource->state != RESOURCE_LOADING
+			&& std::find(unused.begin(), unused.end(), resource) == unused.end())
+			unused.push_back(resource);
+	}
+	for (size_t i = 0; i < unused.size(); i++)
+		deleteTextureResource(unused[i]);
+}
+
+// -----------------------  Models ---------------------------------
+
+/**
+ * \brief Register a user of the model file. The first user gets the resource back and has to load the model into
+ * modelGeometries() / modelBVH() and call publishModel(), the others get NULL and receive the geometries and the
+ * collision hierarchy from publishModel() (right away if the model is already loaded). Must be called from the GL thread.
+ * \param geometries [out] geometries of the model, shared by every user
+ * \param bvh [out] copy of the collision hierarchy (can be NULL)
+ */
+ModelResource* requestModel(const std::string& fileName, std::vector<ObjectGeometry*>* geometries, MeshBVH* bvh) {
+	const std::string path = canonicalPath(fileName);
+	modelResourceStats.requests++;
+
+	std::map<std::string, ModelResource*>::iterator it = modelsByPath.find(path);
+	if (it != modelsByPath.end()) {
+		ModelResource* resource = it->second;
+		resource->references++;
+		modelResourceStats.pathHits++;
+		modelResourceStats.bytesAvoided += resource->bytes;
+
+		resource->users.push_back(geometries);
+		resource->userBVHs.push_back(bvh);
+		if (resource->published) {
+			*geometries = resource->geometries;
+			if (bvh != NULL)
+				*bvh = resource->bvh;
+		}
+		return NULL;
+	}
+
+	ModelResource* resource = new ModelResource;
+	resource->path = path;
+	resource->published = false;
+	resource->references = 1;
+	uint64_t size = 0;
+	int64_t modifiedTime = 0;
+	resource->bytes = getFileInfo(path, size, modifiedTime) ? (size_t)size : 0;
+	resource->users.push_back(geometries);
+	resource->userBVHs.push_back(bvh);
+	modelsByPath[path] = resource;
+
+	modelResourceStats.loads++;
+	modelResourceStats.bytesLoaded += resource->bytes;
+	return resource;
+}
+
+std::vector<ObjectGeometry*>& modelGeometries(ModelResource* resource) {
+	return resource->geometries;
+}
+
+MeshBVH& modelBVH(ModelResource* resource) {
+	return resource->bvh;
+}
+
+/**
+ * \brief Hand the loaded geometries (empty if the load failed) to every user of the model.
+ */
+void publishModel(ModelResource* resource) {
+	resource->published = true;
+	for (size_t i = 0; i < resource->users.size(); i++) {
+		*resource->users[i] = resource->geometries;
+		if (resource->userBVHs[i] != NULL)
+			*resource->userBVHs[i] = resource->bvh;
+	}
+}
+
+/**
+ * \brief Give back the reference of one user, the geometries are deleted with the last one. The list is emptied.
+ */
+void releaseModel(std::vector<ObjectGeometry*>& geometries) {
+	for (std::map<std::string, ModelResource*>::iterator it = modelsByPath.begin(); it != modelsByPath.end(); ++it) {
+		ModelResource* resource = it->second;
+		std::vector<std::vector<ObjectGeometry*>*>::iterator user = std::find(resource->users.begin(), resource->users.end(), &geometries);
+		if (user == resource->users.end())
+			continue;
+
+		resource->userBVHs.erase(resource->userBVHs.begin() + (user - resource->users.begin()));
+		resource->users.erase(user);
+		geometries.clear();
+		if (--resource->references > 0)
+			return;
+
+		for (size_t i = 0; i < resource->geometries.size(); i++)
+			cleanupGeometry(resource->geometries[i]);
+		modelsByPath.erase(it);
+		delete resource;
+		modelResourceStats.releases++;
+		return;
+	}
+}
+
+// -----------------------  Shader programs ---------------------------------
+
+static uint64_t hashString(const std::string& text) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < text.size(); i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * \brief Source with the defines inserted after the #version line, which must stay the first line.
+ */
+static std::string insertDefines(const std::string& source, const std::string& defines) {
+	if (defines.empty())
+		return source;
+	const size_t line = source.compare(0, 8, "#version") == 0 ? source.find('\n') : std::string::npos;
+	if (line == std::string::npos)
+		return defines + source;
+	return source.substr(0, line + 1) + defines + source.substr(line + 1);
+}
+
+/**
+ * \brief Shader file, read once per path, defines and content. It is compiled only when a program links it from
+ * source, the reference is taken by that program (requestProgram()). Must be called from the GL thread.
+ * \param defines [in] #define lines inserted after the #version line, each set of defines is its own shader
+ * \return NULL if the file cannot be read
+ */
+ShaderResource* requestShader(GLenum type, const std::string& fileName, const std::string& defines) {
+	const std::string path = canonicalPath(fileName);
+	const std::string key = defines.empty() ? path : path + "\n" + defines;
+	shaderResourceStats.requests++;
+
+	std::map<std::string, ShaderResource*>::const_iterator it = shadersByPath.find(key);
+	if (it != shadersByPath.end() && it->second->type == type) {
+		shaderResourceStats.pathHits++;
+		return it->second;
+	}
+
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file) {
+		std::cerr << "\033[31mrequestShader : Cannot open : " << path << "\033[0m" << std::endl;
+		return NULL;
+	}
+	std::stringstream source;
+	source << file.rdbuf();
+	const std::string text = insertDefines(source.str(), defines);
+	const uint64_t contentHash = hashString(text);
+
+	std::map<uint64_t, ShaderResource*>::const_iterator same = shadersByContent.find(contentHash);
+	if (same != shadersByContent.end() && same->second->type == type) {
+		shadersByPath[key] = same->second;
+		shaderResourceStats.contentHits++;
+		shaderResourceStats.bytesAvoided += text.size();
+		return same->second;
+	}
+
+	ShaderResource* resource = new ShaderResource;
+	resource->path = path;
+	resource->type = type;
+	resource->defines = defines;
+	resource->source = text;
+	resource->contentHash = contentHash;
+	resource->shader = 0;
+	resource->references = 0;
+	shadersByPath[key] = resource;
+	shadersByContent[contentHash] = resource;
+
+	shaderResourceStats.bytesLoaded += text.size();
+	return resource;
+}
+
+static bool compileShader(ShaderResource* resource) {
+	if (resource->shader == 0) {
+		resource->shader = pgr::createShaderFromSource(resource->type, resource->source);
+		if (resource->shader != 0)
+			shaderResourceStats.loads++;
+	}
+	return resource->shader != 0;
+}
+
+/**
+ * \brief Delete the shader once no program links it any more: after the last program using it is released, or right
+ * away when the program requesting it fails.
+ */
+static void releaseUnusedShader(ShaderResource* shader) {
+	if (shader->references > 0)
+		return;
+
+	if (shader->shader != 0)
+		glDeleteShader(shader->shader);
+	std::map<uint64_t, ShaderResource*>::iterator same = shadersByContent.find(shader->contentHash);
+	if (same != shadersByContent.end() && same->second == shader)
+		shadersByContent.erase(same);
+	for (std::map<std::string, ShaderResource*>::iterator path = shadersByPath.begin(); path != shadersByPath.end();) {
+		if (path->second == shader)
+			path = shadersByPath.erase(path);
+		else
+			++path;
+	}
+	delete shader;
+	shaderResourceStats.releases++;
+}
+
+/**
+ * \brief Release the shaders of a program that could not be created, the ones no other program links are deleted.
+ */
+static void releaseUnusedShaders(const std::vector<ShaderResource*>& shaders) {
+	std::vector<ShaderResource*> unique;
+	for (size_t i = 0; i < shaders.size(); i++) {
+		if (shaders[i] != NULL && std::find(unique.begin(), unique.end(), shaders[i]) == unique.end())
+			unique.push_back(shaders[i]);
+	}
+	for (size_t i = 0; i < unique.size(); i++)
+		releaseUnusedShader(unique[i]);
+}
+
+/**
+ * \brief Key of the program cache, changes with the source of any of the shaders.
+ */
+static uint64_t programSourceHash(const std::vector<ShaderResource*>& shaders) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < shaders.size(); i++) {
+		hash = (hash ^ shaders[i]->type) * 1099511628211ull;
+		hash = (hash ^ shaders[i]->contentHash) * 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * \brief Attach and link, the link status is read later (the hot reload does not wait for it).
+ * \param previous program replaced by this one (or sharing its vertex array objects), its attribute locations are
+ * kept because the vertex array objects of the geometries refer to them
+ */
+static GLuint linkProgram(const std::vector<GLuint>& shaders, GLuint previous) {
+	const GLuint program = glCreateProgram();
+	for (size_t i = 0; i < shaders.size(); i++)
+		glAttachShader(program, shaders[i]);
+
+	if (previous != 0) {
+		GLint count = 0;
+		glGetProgramiv(previous, GL_ACTIVE_ATTRIBUTES, &count);
+		for (GLint i = 0; i < count; i++) {
+			char name[256];
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveAttrib(previous, (GLuint)i, sizeof(name), &length, &size, &type, name);
+			const GLint location = glGetAttribLocation(previous, name);
+			if (location >= 0)
+				glBindAttribLocation(program, (GLuint)location, name);
+		}
+	}
+
+	if (useProgramBinaryCache && programBinariesSupported())
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	return program;
+}
+
+static bool checkProgramLinked(GLuint program, const std::string& name) {
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_TRUE)
+		return true;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+	std::string log(length > 0 ? length : 1, '\0');
+	glGetProgramInfoLog(program, (GLsizei)log.size(), NULL, &log[0]);
+	std::cerr << "\033[31m" << name << " : link failed : " << log.c_str() << "\033[0m" << std::endl;
+	return false;
+}
+
+/**
+ * \brief Program linking the shaders (returned by requestShader()), linked once per set of shaders. The program is
+ * restored from the program cache when the sources and the driver did not change, otherwise the shaders are compiled,
+ * linked and the binary is saved for the next start. Must be called from the GL thread.
+ * \param setup resolves and stores the locations, called before returning
+ * \param attributeLayout program whose attribute locations are given to the new program (variants of a program
+ * drawing the same vertex array objects), 0 lets the linker choose
+ * \return 0 if a shader does not compile, the program does not link or the setup rejects it
+ */
+GLuint requestProgram(const std::vector<ShaderResource*>& shaders, const ProgramSetup& setup, GLuint attributeLayout) {
+	if (shaders.empty() || std::find(shaders.begin(), shaders.end(), (ShaderResource*)NULL) != shaders.end()) {
+		releaseUnusedShaders(shaders);
+		return 0;
+	}
+
+	std::vector<ShaderResource*> key = shaders;
+	std::sort(key.begin(), key.end());
+
+	for (std::map<GLuint, ProgramResource*>::iterator it = programs.begin(); it != programs.end(); ++it) {
+		if (it->second->key == key) {
+			if (!setup(it->first, true))
+				return 0;	// the shaders are still linked by the existing program
+			it->second->setups.push_back(setup);
+			it->second->references++;
+			return it->first;
+		}
+	}
+
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < shaders.size(); i++)
+		keys.push_back(shaders[i]->path + "\n" + shaders[i]->defines);
+	const std::string cacheFileName = programCacheFileName(shaders[0]->path, keys);
+	const uint64_t sourceHash = programSourceHash(shaders);
+
+	GLuint program = loadProgramBinary(cacheFileName, sourceHash);
+	if (program == 0) {
+		std::vector<GLuint> objects;
+		for (size_t i = 0; i < shaders.size(); i++) {
+			if (!compileShader(shaders[i])) {
+				releaseUnusedShaders(shaders);
+				return 0;
+			}
+			objects.push_back(shaders[i]->shader);
+		}
+
+		program = linkProgram(objects, attributeLayout);
+		if (!checkProgramLinked(program, shaders[0]->path)) {
+			glDeleteProgram(program);
+			releaseUnusedShaders(shaders);
+			return 0;
+		}
+		programsLinked++;
+		saveProgramBinary(cacheFileName, sourceHash, program);
+	}
+
+	if (!setup(program, true)) {
+		glDeleteProgram(program);
+		releaseUnusedShaders(shaders);
+		return 0;
+	}
+
+	ProgramResource* resource = new ProgramResource;
+	resource->shaders = shaders;
+	resource->key = key;
+	resource->cacheFileName = cacheFileName;
+	resource->setups.push_back(setup);
+	resource->program = program;
+	resource->references = 1;
+	programs[program] = resource;
+	for (size_t i = 0; i < key.size(); i++)
+		key[i]->references++;
+	return program;
+}
+
+/**
+ * \brief Give back one reference to the program, the program is deleted with the last one and its shaders with the
+ * last program linking them.
+ */
+void releaseProgram(GLuint program) {
+	std::map<GLuint, ProgramResource*>::iterator it = programs.find(program);
+	if (it == programs.end())
+		return;
+
+	ProgramResource* resource = it->second;
+	if (--resource->references > 0)
+		return;
+
+	glDeleteProgram(program);
+	for (size_t i = 0; i < resource->key.size(); i++) {
+		resource->key[i]->references--;
+		releaseUnusedShader(resource->key[i]);
+	}
+	programs.erase(it);
+	delete resource;
+}
+
+// -----------------------  Shader hot reload ---------------------------------
+
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile, not part of the core profile headers
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+bool useShaderHotReload = false;
+
+/**
+ * \brief Shader file seen by the watcher thread.
+ */
+typedef struct _WatchedShader {
+	std::string path;
+	uint64_t size;
+	int64_t modifiedTime;
+	uint64_t contentHash;
+} WatchedShader;
+
+/**
+ * \brief New source of a shader, compiled into a new shader object while the programs keep using the previous one.
+ */
+typedef struct _ShaderChange {
+	std::string path;
+	std::string source;
+	ShaderResource* resource;
+	GLuint shader;
+} ShaderChange;
+
+/**
+ * \brief The changes picked up together and the programs relinked with them. Only one reload is in flight, the
+ * changes arriving meanwhile wait for the next one so that every relink sees all the previous edits.
+ */
+typedef struct _ShaderReload {
+	std::vector<ShaderChange> changes;
+	std::vector<ProgramResource*> programs;
+	std::vector<GLuint> relinked;	///< one per program
+	std::chrono::high_resolution_clock::time_point start;
+} ShaderReload;
+
+static std::thread watcherThread;
+static std::atomic<bool> watcherRunning(false);
+static std::mutex changesMutex;
+static std::vector<ShaderChange> changedShaders;	///< filled by the watcher thread
+static ShaderReload shaderReload;
+static bool parallelShaderCompile = false;
+
+/**
+ * \brief Watcher thread: polls the size and modification time of the shader files and reads the ones that changed.
+ * Touching a file without changing it (or saving the same text again) is filtered by the content hash.
+ */
+static void watchShaderFiles(std::vector<WatchedShader> files) {
+	while (watcherRunning) {
+		for (int slept = 0; slept < SHADER_WATCH_INTERVAL_MS && watcherRunning; slept += 10)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		for (size_t i = 0; i < files.size() && watcherRunning; i++) {
+			WatchedShader& watched = files[i];
+			uint64_t size = 0;
+			int64_t modifiedTime = 0;
+			if (!getFileInfo(watched.path, size, modifiedTime) || (size == watched.size && modifiedTime == watched.modifiedTime))
+				continue;
+
+			std::ifstream file(watched.path.c_str(), std::ios::binary);
+			if (!file)
+				continue;
+			std::stringstream source;
+			source << file.rdbuf();
+
+			watched.size = size;
+			watched.modifiedTime = modifiedTime;
+			const uint64_t contentHash = hashString(source.str());
+			if (contentHash == watched.contentHash)
+				continue;
+			watched.contentHash = contentHash;
+
+			ShaderChange change;
+			change.path = watched.path;
+			change.source = source.str();
+			change.resource = NULL;
+			change.shader = 0;
+
+			std::lock_guard<std::mutex> lock(changesMutex);
+			changedShaders.push_back(change);
+		}
+	}
+}
+
+/**
+ * \brief Start watching the files of the shaders requested so far (after loadShaderPrograms()).
+ */
+void startShaderHotReload() {
+	if (!useShaderHotReload || watcherRunning)
+		return;
+
+	// one entry per file, whatever the number of permutations compiled from it. Aliases of a shader loaded from
+	// another path with the same content are not watched, only the first path
+	std::vector<WatchedShader> files;
+	for (std::map<std::string, ShaderResource*>::const_iterator it = shadersByPath.begin(); it != shadersByPath.end(); ++it) {
+		bool watched = false;
+		for (size_t i = 0; i < files.size() && !watched; i++)
+			watched = files[i].path == it->second->path;
+		if (watched)
+			continue;
+
+		WatchedShader file;
+		file.path = it->second->path;
+		file.size = 0;
+		file.modifiedTime = 0;
+		file.contentHash = 0;
+		getFileInfo(file.path, file.size, file.modifiedTime);
+		std::ifstream text(file.path.c_str(), std::ios::binary);
+		if (text) {
+			std::stringstream source;
+			source << text.rdbuf();
+			file.contentHash = hashString(source.str());
+		}
+		files.push_back(file);
+	}
+
+	parallelShaderCompile = hasOpenGLExtension("GL_KHR_parallel_shader_compile") || hasOpenGLExtension("GL_ARB_parallel_shader_compile");
+	watcherRunning = true;
+	watcherThread = std::thread(watchShaderFiles, files);
+	printf("Shader hot reload : watching %u files%s\n", (unsigned int)files.size(),
+		parallelShaderCompile ? " (parallel shader compile)" : "");
+}
+
+static void discardShaderReload() {
+	for (size_t i = 0; i < shaderReload.relinked.size(); i++)
+		glDeleteProgram(shaderReload.relinked[i]);
+	for (size_t i = 0; i < shaderReload.changes.size(); i++)
+		glDeleteShader(shaderReload.changes[i].shader);
+	shaderReload = ShaderReload();
+}
+
+/**
+ * \brief Stop the watcher thread and drop the reload in flight, before the programs are released.
+ */
+void stopShaderHotReload() {
+	if (!watcherRunning)
+		return;
+
+	watcherRunning = false;
+	watcherThread.join();
+	discardShaderReload();
+	changedShaders.clear();
+}
+
+/**
+ * \brief Compile the changed shaders and relink every program using one of them, without waiting for the driver.
+ */
+static void beginShaderReload() {
+	std::vector<ShaderChange> changes;
+	{
+		std::lock_guard<std::mutex> lock(changesMutex);
+		changes.swap(changedShaders);
+	}
+
+	// every shader compiled from a changed file (one per set of defines) is rebuilt
+	for (size_t i = 0; i < changes.size(); i++) {
+		for (std::map<std::string, ShaderResource*>::const_iterator it = shadersByPath.begin(); it != shadersByPath.end(); ++it) {
+			ShaderResource* resource = it->second;
+			if (resource->path != changes[i].path)
+				continue;
+
+			// the same file saved twice since the last reload, the last source wins
+			size_t index = 0;
+			while (index < shaderReload.changes.size() && shaderReload.changes[index].resource != resource)
+				index++;
+			if (index == shaderReload.changes.size())
+				shaderReload.changes.push_back(changes[i]);
+			shaderReload.changes[index].source = insertDefines(changes[i].source, resource->defines);
+			shaderReload.changes[index].resource = resource;
+		}
+	}
+	if (shaderReload.changes.empty())
+		return;
+
+	shaderReload.start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < shaderReload.changes.size(); i++) {
+		ShaderChange& change = shaderReload.changes[i];
+		const char* source = change.source.c_str();
+		change.shader = glCreateShader(change.resource->type);
+		glShaderSource(change.shader, 1, &source, NULL);
+		glCompileShader(change.shader);
+	}
+
+	for (std::map<GLuint, ProgramResource*>::const_iterator it = programs.begin(); it != programs.end(); ++it) {
+		const ProgramResource* program = it->second;
+		std::vector<GLuint> objects;
+		bool changed = false;
+		for (size_t i = 0; i < program->shaders.size(); i++) {
+			size_t index = 0;
+			while (index < shaderReload.changes.size() && shaderReload.changes[index].resource != program->shaders[i])
+				index++;
+			if (index < shaderReload.changes.size()) {
+				objects.push_back(shaderReload.changes[index].shader);
+				changed = true;
+			}
+			// a program restored from the cache never compiled its other shaders
+			else if (compileShader(program->shaders[i]))
+				objects.push_back(program->shaders[i]->shader);
+		}
+		if (!changed || objects.size() != program->shaders.size())
+			continue;
+
+		shaderReload.programs.push_back(it->second);
+		shaderReload.relinked.push_back(linkProgram(objects, it->first));
+	}
+}
+
+static bool checkShaderCompiled(const ShaderChange& change) {
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(change.shader, GL_COMPILE_STATUS, &compiled);
+	if (compiled == GL_TRUE)
+		return true;
+
+	GLint length = 0;
+	glGetShaderiv(change.shader, GL_INFO_LOG_LENGTH, &length);
+	std::string log(length > 0 ? length : 1, '\0');
+	glGetShaderInfoLog(change.shader, (GLsizei)log.size(), NULL, &log[0]);
+	std::cerr << "\033[31m" << change.path << " : compile failed : " << log.c_str() << "\033[0m" << std::endl;
+	return false;
+}
+
+/**
+ * \brief Swap the relinked programs in once the driver is done with all of them. A compile or link error, or a program
+ * rejected by one of its setups, keeps every previous program and shader, the next save of the file tries again.
+ */
+static void finishShaderReload() {
+	if (parallelShaderCompile) {
+		for (size_t i = 0; i < shaderReload.relinked.size(); i++) {
+			GLint completed = GL_FALSE;
+			glGetProgramiv(shaderReload.relinked[i], GL_COMPLETION_STATUS_KHR, &completed);
+			if (completed != GL_TRUE)
+				return;
+		}
+	}
+
+	bool success = true;
+	for (size_t i = 0; i < shaderReload.changes.size(); i++)
+		success = checkShaderCompiled(shaderReload.changes[i]) && success;
+	for (size_t i = 0; i < shaderReload.relinked.size() && success; i++)
+		success = checkProgramLinked(shaderReload.relinked[i], shaderReload.programs[i]->shaders[0]->path);
+	// every setup checks its program before any of them stores anything
+	for (size_t i = 0; i < shaderReload.programs.size() && success; i++) {
+		const ProgramResource* resource = shaderReload.programs[i];
+		for (size_t j = 0; j < resource->setups.size() && success; j++)
+			success = resource->setups[j](shaderReload.relinked[i], false);
+		if (!success)
+			std::cerr << "\033[31m" << resource->shaders[0]->path << " : relinked program rejected\033[0m" << std::endl;
+	}
+	if (!success) {
+		std::cerr << "\033[31mShader reload failed, the previous programs are kept\033[0m" << std::endl;
+		discardShaderReload();
+		return;
+	}
+
+	// the shader resources take the new sources first, the cache keys of the relinked programs depend on them
+	for (size_t i = 0; i < shaderReload.changes.size(); i++) {
+		ShaderChange& change = shaderReload.changes[i];
+		ShaderResource* resource = change.resource;
+		std::map<uint64_t, ShaderResource*>::iterator same = shadersByContent.find(resource->contentHash);
+		if (same != shadersByContent.end() && same->second == resource)
+			shadersByContent.erase(same);
+		// the programs not relinked keep the previous shader object alive until they are deleted
+		if (resource->shader != 0)
+			glDeleteShader(resource->shader);
+		resource->shader = change.shader;
+		resource->source.swap(change.source);
+		resource->contentHash = hashString(resource->source);
+		if (shadersByContent.find(resource->contentHash) == shadersByContent.end())
+			shadersByContent[resource->contentHash] = resource;
+	}
+
+	for (size_t i = 0; i < shaderReload.programs.size(); i++) {
+		ProgramResource* resource = shaderReload.programs[i];
+		const GLuint program = shaderReload.relinked[i];
+		for (size_t j = 0; j < resource->setups.size(); j++)
+			resource->setups[j](program, true);
+
+		programs.erase(resource->program);
+		glDeleteProgram(resource->program);
+		resource->program = program;
+		programs[program] = resource;
+		programsLinked++;
+		saveProgramBinary(resource->cacheFileName, programSourceHash(resource->shaders), program);
+	}
+
+	const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - shaderReload.start).count();
+	printf("Shader reload : %u shaders, %u programs swapped in %.1f ms\n", (unsigned int)shaderReload.changes.size(),
+		(unsigned int)shaderReload.programs.size(), elapsed);
+	shaderReload = ShaderReload();
+}
+
+/**
+ * \brief Called once per frame from the GL thread: starts a reload with the files the watcher saw change and swaps
+ * the programs of the reload in flight once they are linked. The draws never wait for the driver when it supports
+ * parallel shader compilation, otherwise the frame picking the result waits for the link.
+ */
+void updateShaderHotReload() {
+	if (!watcherRunning)
+		return;
+
+	if (shaderReload.changes.empty())
+		beginShaderReload();
+	if (!shaderReload.changes.empty())
+		finishShaderReload();
+}
+
+// -----------------------  Report ---------------------------------
+
+static void printResourceStats(const char* name, const ResourceStats& stats) {
+	printf("%-10s %8u %8u %10u %10u %12.1f %12.1f %8u\n", name, stats.requests, stats.loads, stats.pathHits,
+		stats.contentHits, stats.bytesLoaded / 1024.0, stats.bytesAvoided / 1024.0, stats.releases);
+}
+
+/**
+ * \brief Print the requests, loads and duplicate loads avoided of every kind of resource.
+ */
+void printResourceReport() {
+	printf("\nResource report\n");
+	printf("%-10s %8s %8s %10s %10s %12s %12s %8s\n", "resource", "requests", "loads", "same path", "same data",
+		"loaded KB", "avoided KB", "released");
+	printResourceStats("textures", textureResourceStats);
+	printResourceStats("models", modelResourceStats);
+	printResourceStats("shaders", shaderResourceStats);
+	printf("programs   %u restored from the program cache, %u linked from source, %u binaries saved (%.1f KB)\n",
+		programCacheStats.hits, programsLinked, programCacheStats.saves, programCacheStats.bytesWritten / 1024.0);
+	printf("\n");
+}
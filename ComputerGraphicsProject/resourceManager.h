@@ -0,0 +1,86 @@
+/*
+* \file resourceManager.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Resource manager - textures, models and shader programs loaded once per file and shared by reference counting
+*/
+
+#pragma once
+
+#ifndef __RESOURCE_MANAGER_H
+#define __RESOURCE_MANAGER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "pgr.h"
+#include "image.h"
+#include "object.h"
+#include "meshBVH.h"
+
+/**
+ * \brief Counters of one kind of resource since the start of the application.
+ */
+typedef struct _ResourceStats {
+	unsigned int requests;
+	unsigned int loads;			///< files decoded / imported / compiled
+	unsigned int pathHits;		///< requests served by a resource already loaded from the same file
+	unsigned int contentHits;	///< requests served by a resource loaded from another file with the same content
+	size_t bytesLoaded;			///< decoded image bytes, source bytes of the models and shaders
+	size_t bytesAvoided;		///< bytes the hits did not load again
+	unsigned int releases;		///< resources deleted when their last reference was released
+
+	_ResourceStats() : requests(0), loads(0), pathHits(0), contentHits(0), bytesLoaded(0), bytesAvoided(0), releases(0) {}
+} ResourceStats;
+
+extern ResourceStats textureResourceStats;
+extern ResourceStats modelResourceStats;
+extern ResourceStats shaderResourceStats;
+
+std::string canonicalPath(const std::string& fileName);
+
+// -----------------------  Textures ---------------------------------
+typedef struct _TextureResource TextureResource;
+
+TextureResource* requestTexture(const std::string& fileName);
+GLuint acquireTexture(TextureResource* resource, bool streamed = true);
+void releaseTexture(GLuint texture);
+void releaseUnusedTextures();
+
+// -----------------------  Models ---------------------------------
+typedef struct _ModelResource ModelResource;
+
+ModelResource* requestModel(const std::string& fileName, std::vector<ObjectGeometry*>* geometries, MeshBVH* bvh);
+std::vector<ObjectGeometry*>& modelGeometries(ModelResource* resource);
+MeshBVH& modelBVH(ModelResource* resource);
+void publishModel(ModelResource* resource);
+void releaseModel(std::vector<ObjectGeometry*>& geometries);
+
+// -----------------------  Shader programs ---------------------------------
+#define SHADER_WATCH_INTERVAL_MS 250	// delay between two checks of the shader files by the hot reload
+
+typedef struct _ShaderResource ShaderResource;
+
+/**
+ * \brief Resolves the locations of a linked program and stores them with the program, called when the program is
+ * created and again with the relinked program by the hot reload. The hot reload first calls every setup with
+ * store = false and stores the locations only once all of them accepted their program.
+ * \param store [in] false only checks the program, nothing is written
+ * \return false if the program cannot be used (missing attribute or uniform), the previous program is then kept
+ */
+typedef std::function<bool(GLuint program, bool store)> ProgramSetup;
+
+extern bool useShaderHotReload;	///< relink the programs whose shader files change (--shader-hot-reload)
+
+ShaderResource* requestShader(GLenum type, const std::string& fileName, const std::string& defines = "");
+GLuint requestProgram(const std::vector<ShaderResource*>& shaders, const ProgramSetup& setup, GLuint attributeLayout = 0);
+void releaseProgram(GLuint program);
+
+void startShaderHotReload();
+void stopShaderHotReload();
+void updateShaderHotReload();
+
+void printResourceReport();
+
+#endif // __RESOURCE_MANAGER_H
@@ -0,0 +1,113 @@
+/*
+* \file shaderPermutations.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Shader permutations - lighting programs specialized with #defines for each combination of lighting features
+* actually drawn, instead of branching on the toggles for every fragment
+*
+* lightingShaderPerFrag.frag reads every feature through a LIGHTING_* macro. Without defines the macros read the
+* toggles from the uniform blocks (the generic program loaded by loadShaderPrograms()), a permutation defines them
+* as true / false and the compiler drops the unused lights. Permutations are created the first time a combination is
+* drawn and go through the resource manager, so they are restored from the program cache at the next start and
+* relinked by the shader hot reload like the other programs.
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include "shaderPermutations.h"
+#include "renderer.h"
+
+bool useShaderPermutations = true;
+unsigned int lightingFeatures = LIGHTING_SUN;
+
+static ShaderProgram lightingVariants[2][LIGHTING_PERMUTATIONS];	///< [instanced][features]
+static bool variantFailed[2][LIGHTING_PERMUTATIONS] = { { false } };
+
+static const char* featureNames[] = { "fog", "sun", "spot", "point", "texture", "lights" };
+static const char* featureDefines[] = { "LIGHTING_FOG", "LIGHTING_SUN", "LIGHTING_SPOT_LIGHT", "LIGHTING_POINT_LIGHT", "LIGHTING_TEXTURE",
+	"LIGHTING_DYNAMIC_LIGHTS" };
+
+/**
+ * \brief Readable list of the features, "fog+sun+texture" or "none".
+ */
+std::string lightingFeatureNames(unsigned int features) {
+	std::string names;
+	for (unsigned int i = 0; i < sizeof(featureNames) / sizeof(featureNames[0]); i++) {
+		if ((features & (1u << i)) == 0)
+			continue;
+		if (!names.empty())
+			names += "+";
+		names += featureNames[i];
+	}
+	return names.empty() ? "none" : names;
+}
+
+/**
+ * \brief #define lines of the permutation, every feature is defined so that none falls back to its uniform.
+ */
+std::string lightingDefines(unsigned int features) {
+	std::string defines;
+	for (unsigned int i = 0; i < sizeof(featureDefines) / sizeof(featureDefines[0]); i++)
+		defines += std::string("#define ") + featureDefines[i] + ((features & (1u << i)) != 0 ? " true\n" : " false\n");
+	return defines;
+}
+
+static void createLightingVariant(unsigned int features, bool instanced) {
+	typedef std::chrono::high_resolution_clock Clock;
+	const Clock::time_point start = Clock::now();
+
+	const ShaderProgram* base = instanced ? &instancedShaderProgram : &commonShaderProgram;
+	ShaderProgram* target = &lightingVariants[instanced ? 1 : 0][features];
+
+	std::vector<ShaderResource*> shaders;
+	shaders.push_back(requestShader(GL_VERTEX_SHADER, instanced ? "lightingShaderInstanced.vert" : "lightingShaderPerFrag.vert"));
+	shaders.push_back(requestShader(GL_FRAGMENT_SHADER, "lightingShaderPerFrag.frag", lightingDefines(features)));
+
+	// same attribute locations as the generic program, the permutations draw its vertex array objects
+	const unsigned int restoredBefore = programCacheStats.hits;
+	const GLuint program = requestProgram(shaders,
+		[target, instanced, base](GLuint program, bool store) { return setupLightingProgram(program, *target, instanced, base, store); }, base->program);
+
+	const std::string name = lightingFeatureNames(features) + (instanced ? " (instanced)" : "");
+	if (program == 0) {
+		variantFailed[instanced ? 1 : 0][features] = true;
+		std::cerr << "\033[31mLighting permutation " << name << " cannot be created, the generic program is used\033[0m" << std::endl;
+		return;
+	}
+	printf("Lighting permutation %-36s %s in %.1f ms\n", name.c_str(), programCacheStats.hits != restoredBefore ? "restored" : "compiled",
+		std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+}
+
+/**
+ * \brief Program drawing the lighting features, the permutation is created on first use (the draw waits for it
+ * once, then it is restored from the program cache at every start).
+ * \param features [in] LIGHTING_* flags
+ * \param instanced [in] variant of instancedShaderProgram instead of commonShaderProgram
+ * \return the generic program with --no-shader-permutations or if the permutation cannot be created
+ */
+GLuint lightingProgram(unsigned int features, bool instanced) {
+	const ShaderProgram& base = instanced ? instancedShaderProgram : commonShaderProgram;
+	if (!useShaderPermutations || !base.initialized)
+		return base.program;
+
+	features &= LIGHTING_PERMUTATIONS - 1;
+	const int variant = instanced ? 1 : 0;
+	if (lightingVariants[variant][features].program == 0 && !variantFailed[variant][features])
+		createLightingVariant(features, instanced);
+
+	return lightingVariants[variant][features].program != 0 ? lightingVariants[variant][features].program : base.program;
+}
+
+/**
+ * \brief Release the permutations created so far (before the generic programs, they share its shaders).
+ */
+void cleanupLightingPermutations() {
+	for (int variant = 0; variant < 2; variant++) {
+		for (int features = 0; features < LIGHTING_PERMUTATIONS; features++) {
+			releaseProgram(lightingVariants[variant][features].program);
+			lightingVariants[variant][features] = ShaderProgram();
+			variantFailed[variant][features] = false;
+		}
+	}
+}
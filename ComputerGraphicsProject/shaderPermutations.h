@@ -0,0 +1,35 @@
+/*
+* \file shaderPermutations.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Shader permutations - lighting programs specialized with #defines for each combination of lighting features
+* actually drawn, instead of branching on the toggles for every fragment
+*/
+
+#pragma once
+
+#ifndef __SHADER_PERMUTATIONS_H
+#define __SHADER_PERMUTATIONS_H
+
+#include <string>
+#include "pgr.h"
+
+#define LIGHTING_FOG			0x01
+#define LIGHTING_SUN			0x02
+#define LIGHTING_SPOT_LIGHT		0x04
+#define LIGHTING_POINT_LIGHT	0x08
+#define LIGHTING_TEXTURE		0x10	// per material, the other features are constant over a frame
+#define LIGHTING_DYNAMIC_LIGHTS	0x20	// clustered lights (clusteredLighting.h), on when the frame has any
+#define LIGHTING_TOGGLES (LIGHTING_FOG | LIGHTING_SUN | LIGHTING_SPOT_LIGHT | LIGHTING_POINT_LIGHT)	// keyboard toggles
+#define LIGHTING_FRAME_FEATURES (LIGHTING_TOGGLES | LIGHTING_DYNAMIC_LIGHTS)
+#define LIGHTING_PERMUTATIONS 64
+
+extern bool useShaderPermutations;		///< false draws with the generic program branching on the toggles (--no-shader-permutations)
+extern unsigned int lightingFeatures;	///< LIGHTING_FRAME_FEATURES of the frame being drawn
+
+std::string lightingFeatureNames(unsigned int features);
+std::string lightingDefines(unsigned int features);
+GLuint lightingProgram(unsigned int features, bool instanced);
+void cleanupLightingPermutations();
+
+#endif // __SHADER_PERMUTATIONS_H
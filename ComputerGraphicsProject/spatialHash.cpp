@@ -0,0 +1,211 @@
+/*
+* \file spatialHash.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Collision broad phase - entities hashed into a uniform grid, candidate pairs tested by sphere overlap
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include "spatialHash.h"
+#include "data.h"
+#include "frameLoop.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static inline glm::ivec3 cellOf(const SpatialHash& hash, const glm::vec3& position) {
+	return glm::ivec3(
+		(int)std::floor(position.x / hash.cellSize),
+		(int)std::floor(position.y / hash.cellSize),
+		(int)std::floor(position.z / hash.cellSize));
+}
+
+static inline unsigned int bucketOf(const SpatialHash& hash, int x, int y, int z) {
+	return ((unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)z * 83492791u) & hash.bucketMask;
+}
+
+static inline bool spheresOverlap(const glm::vec4& a, const glm::vec4& b) {
+	const float reach = (a.w + b.w) * COLLISION_RADIUS_SCALE;
+	const glm::vec3 delta = glm::vec3(a) - glm::vec3(b);
+	return glm::dot(delta, delta) < reach * reach;
+}
+
+/**
+ * \brief Hash the entities having one of the flags (and not destroyed) into the grid.
+ * \param flags [in] ENTITY_COLLIDE, ENTITY_LETHAL, ... - entities with none of them are ignored
+ */
+void buildSpatialHash(SpatialHash& hash, const EntityStore& store, unsigned int flags) {
+	// cell size and bucket count follow the content of the store
+	unsigned int count = 0;
+	hash.maxRadius = 0.0f;
+	for (unsigned int i = 0; i < store.count; i++) {
+		if ((store.flags[i] & flags) && !(store.flags[i] & ENTITY_DESTROYED)) {
+			hash.maxRadius = std::max(hash.maxRadius, store.size[i]);
+			count++;
+		}
+	}
+	hash.cellSize = std::max(SPATIAL_HASH_MIN_CELL_SIZE, 2.0f * COLLISION_RADIUS_SCALE * hash.maxRadius);
+
+	unsigned int buckets = SPATIAL_HASH_MIN_BUCKETS;
+	while (buckets < 2 * count)
+		buckets *= 2;
+	hash.bucketMask = buckets - 1;
+
+	// count the entries of every bucket
+	hash.bucketStart.assign(buckets + 1, 0);
+	hash.entryBucket.clear();
+	for (unsigned int i = 0; i < store.count; i++) {
+		if ((store.flags[i] & flags) && !(store.flags[i] & ENTITY_DESTROYED)) {
+			const glm::ivec3 cell = cellOf(hash, store.position[i]);
+			const unsigned int bucket = bucketOf(hash, cell.x, cell.y, cell.z);
+			hash.entryBucket.push_back(bucket);
+			hash.bucketStart[bucket + 1]++;
+		}
+	}
+	for (unsigned int b = 0; b < buckets; b++)
+		hash.bucketStart[b + 1] += hash.bucketStart[b];
+
+	// place the entries
+	hash.bucketFill.assign(hash.bucketStart.begin(), hash.bucketStart.end() - 1);
+	hash.entrySlot.resize(count);
+	hash.entrySphere.resize(count);
+	unsigned int entry = 0;
+	for (unsigned int i = 0; i < store.count; i++) {
+		if ((store.flags[i] & flags) && !(store.flags[i] & ENTITY_DESTROYED)) {
+			const unsigned int index = hash.bucketFill[hash.entryBucket[entry++]]++;
+			hash.entrySlot[index] = i;
+			hash.entrySphere[index] = glm::vec4(store.position[i], store.size[i]);
+		}
+	}
+}
+
+/**
+ * \brief Distinct buckets of the cells in [minCell, maxCell] (different cells may share a bucket).
+ */
+static void collectBuckets(const SpatialHash& hash, const glm::ivec3& minCell, const glm::ivec3& maxCell, std::vector<unsigned int>& buckets) {
+	buckets.clear();
+	for (int z = minCell.z; z <= maxCell.z; z++)
+		for (int y = minCell.y; y <= maxCell.y; y++)
+			for (int x = minCell.x; x <= maxCell.x; x++)
+				buckets.push_back(bucketOf(hash, x, y, z));
+	std::sort(buckets.begin(), buckets.end());
+	buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+}
+
+/**
+ * \brief Entities overlapping a sphere which is not in the grid (player).
+ * \return number of hits, their slots are in hits
+ */
+unsigned int querySpatialHash(const SpatialHash& hash, const glm::vec3& center, float radius, std::vector<unsigned int>& hits) {
+	hits.clear();
+	if (hash.entrySlot.empty())
+		return 0;
+
+	const float reach = (radius + hash.maxRadius) * COLLISION_RADIUS_SCALE;
+	std::vector<unsigned int> buckets;
+	collectBuckets(hash, cellOf(hash, center - glm::vec3(reach)), cellOf(hash, center + glm::vec3(reach)), buckets);
+
+	const glm::vec4 sphere(center, radius);
+	for (size_t b = 0; b < buckets.size(); b++) {
+		for (unsigned int e = hash.bucketStart[buckets[b]]; e < hash.bucketStart[buckets[b] + 1]; e++) {
+			if (spheresOverlap(sphere, hash.entrySphere[e]))
+				hits.push_back(hash.entrySlot[e]);
+		}
+	}
+	return (unsigned int)hits.size();
+}
+
+/**
+ * \brief Narrow phase over the candidate pairs of the grid (entries in the same or neighbouring cells).
+ * \return number of overlapping pairs passed to the callback
+ */
+unsigned int forEachCollisionPair(SpatialHash& hash, const CollisionCallback& callback) {
+	unsigned int pairs = 0;
+	hash.candidatePairs = 0;
+	std::vector<unsigned int> buckets;
+	buckets.reserve(27);
+
+	for (unsigned int a = 0; a < hash.entrySlot.size(); a++) {
+		const glm::ivec3 cell = cellOf(hash, glm::vec3(hash.entrySphere[a]));
+		collectBuckets(hash, cell - glm::ivec3(1), cell + glm::ivec3(1), buckets);
+
+		const unsigned int slotA = hash.entrySlot[a];
+		for (size_t b = 0; b < buckets.size(); b++) {
+			for (unsigned int e = hash.bucketStart[buckets[b]]; e < hash.bucketStart[buckets[b] + 1]; e++) {
+				// every pair is visited from its lower slot only
+				const unsigned int slotB = hash.entrySlot[e];
+				if (slotB <= slotA)
+					continue;
+				hash.candidatePairs++;
+				if (spheresOverlap(hash.entrySphere[a], hash.entrySphere[e])) {
+					callback(slotA, slotB);
+					pairs++;
+				}
+			}
+		}
+	}
+	return pairs;
+}
+
+// -----------------------  Benchmark ---------------------------------
+
+/**
+ * \brief Compare the collision pairs of count moving spheres found by testing all pairs and through the grid.
+ */
+void benchmarkSpatialHash(unsigned int count) {
+	const int steps = 10;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+	EntityStore store;
+	reserveEntities(store, count);
+	for (unsigned int i = 0; i < count; i++) {
+		const glm::vec3 position(
+			TERRAIN_SIZE * (2.0f * uniform(random) - 1.0f),
+			TERRAIN_SIZE * (2.0f * uniform(random) - 1.0f),
+			MIN_HEIGHT + (MAX_HEIGHT - MIN_HEIGHT) * uniform(random));
+		const float angle = 6.2831853f * uniform(random);
+		const EntityId id = createEntity(store, ENTITY_MESH_NONE, ENTITY_DYNAMIC | ENTITY_COLLIDE, position,
+			glm::vec3(std::cos(angle), std::sin(angle), 0.0f), 0.005f + 0.01f * uniform(random), 0.0f);
+		store.speed[entitySlot(store, id)] = 0.2f + 0.2f * uniform(random);
+	}
+
+	double allPairsMs = 0.0;
+	double gridMs = 0.0;
+	unsigned long long allPairsFound = 0;
+	unsigned long long gridFound = 0;
+	unsigned long long candidates = 0;
+	SpatialHash hash;
+
+	for (int step = 0; step < steps; step++) {
+		updateEntities(store, (float)(step * SIMULATION_STEP));
+
+		Clock::time_point start = Clock::now();
+		for (unsigned int a = 0; a < store.count; a++) {
+			const glm::vec4 sphereA(store.position[a], store.size[a]);
+			for (unsigned int b = a + 1; b < store.count; b++) {
+				if (spheresOverlap(sphereA, glm::vec4(store.position[b], store.size[b])))
+					allPairsFound++;
+			}
+		}
+		allPairsMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		start = Clock::now();
+		buildSpatialHash(hash, store, ENTITY_COLLIDE);
+		gridFound += forEachCollisionPair(hash, [](unsigned int, unsigned int) {});
+		gridMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		candidates += hash.candidatePairs;
+	}
+
+	printf("%u moving spheres, %d steps\n", count, steps);
+	printf("  all pairs    : %9.3f ms per step, %llu pairs tested, %llu collisions\n", allPairsMs / steps,
+		(unsigned long long)count * (count - 1) / 2, allPairsFound / steps);
+	printf("  spatial hash : %9.3f ms per step (build + pairs), %llu candidate pairs, %llu collisions, cell size %.3f, x%.1f\n",
+		gridMs / steps, candidates / steps, gridFound / steps, hash.cellSize, gridMs > 0.0 ? allPairsMs / gridMs : 0.0);
+	if (allPairsFound != gridFound)
+		std::cerr << "\033[31mbenchmarkSpatialHash : the grid found " << gridFound << " collisions instead of " << allPairsFound << "\033[0m" << std::endl;
+}
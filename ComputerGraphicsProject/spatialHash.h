@@ -0,0 +1,52 @@
+/*
+* \file spatialHash.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Collision broad phase - entities hashed into a uniform grid, candidate pairs tested by sphere overlap
+*/
+
+#pragma once
+
+#ifndef __SPATIAL_HASH_H
+#define __SPATIAL_HASH_H
+
+#include <vector>
+#include <functional>
+#include "pgr.h"
+#include "entityStore.h"
+
+#define COLLISION_RADIUS_SCALE 0.7f		// spheres collide when distance < (radius1 + radius2) * COLLISION_RADIUS_SCALE
+#define SPATIAL_HASH_MIN_CELL_SIZE 0.05f
+#define SPATIAL_HASH_MIN_BUCKETS 1024		// power of two, grows to twice the number of entities
+#define COLLISION_BENCH_COUNT 10000			// moving spheres of the --bench-collisions benchmark
+
+/**
+ * \brief Called for every pair of overlapping entities (slots in the entity store, slotA < slotB).
+ */
+typedef std::function<void(unsigned int slotA, unsigned int slotB)> CollisionCallback;
+
+/**
+ * \brief Entities sorted by hash bucket of their grid cell (counting sort, rebuilt every simulation step).
+ *  The cell size is at least the largest collision distance, so overlapping spheres are in neighbouring cells.
+ */
+typedef struct _SpatialHash {
+	float cellSize;
+	float maxRadius;							///< largest entity size in the grid
+	unsigned int bucketMask;
+	std::vector<unsigned int> bucketStart;		///< entries of bucket b are [bucketStart[b], bucketStart[b + 1])
+	std::vector<unsigned int> bucketFill;		///< insertion cursor of every bucket during the build
+	std::vector<unsigned int> entrySlot;		///< entity store slot of every entry
+	std::vector<glm::vec4> entrySphere;			///< position (xyz) and size (w) of every entry, copied for the narrow phase
+	std::vector<unsigned int> entryBucket;		///< bucket of every collidable entity in store order (build only)
+	unsigned int candidatePairs;				///< pairs tested by the narrow phase during the last traversal
+
+	_SpatialHash() : cellSize(SPATIAL_HASH_MIN_CELL_SIZE), maxRadius(0.0f), bucketMask(0), candidatePairs(0) {}
+} SpatialHash;
+
+void buildSpatialHash(SpatialHash& hash, const EntityStore& store, unsigned int flags);
+unsigned int querySpatialHash(const SpatialHash& hash, const glm::vec3& center, float radius, std::vector<unsigned int>& hits);
+unsigned int forEachCollisionPair(SpatialHash& hash, const CollisionCallback& callback);
+
+void benchmarkSpatialHash(unsigned int count);
+
+#endif // __SPATIAL_HASH_H
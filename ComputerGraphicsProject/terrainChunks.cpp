@@ -0,0 +1,371 @@
+/*
+* \file terrainChunks.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Terrain split into chunks drawn at a level of detail chosen by camera distance (geomipmapping)
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <cfloat>
+#include "terrainChunks.h"
+#include "frustumCulling.h"
+#include "vertexFormat.h"
+#include "object.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+#define TERRAIN_CHUNK_VERTICES (TERRAIN_CHUNK_QUADS + 1)
+#define TERRAIN_VERTEX_FLOATS 8		// |VNT| interleaved, VERTEX_LAYOUT_INTERLEAVED
+
+TerrainChunks terrainChunks;
+bool useTerrainLod = true;
+
+// -----------------------  Build ---------------------------------
+
+/**
+ * \brief Sample of the heightfield at a grid position of the tiled terrain, the tiles are mirrored so that they join.
+ */
+static inline int mirroredSample(int index, int resolution) {
+	const int period = 2 * (resolution - 1);
+	const int wrapped = ((index % period) + period) % period;
+	return wrapped < resolution ? wrapped : period - wrapped;
+}
+
+static inline float sampleHeight(const Heightfield& heightfield, int x, int z) {
+	const int resolution = (int)heightfield.resolution;
+	return heightfield.heights[(size_t)mirroredSample(z, resolution) * resolution + mirroredSample(x, resolution)];
+}
+
+/**
+ * \brief Texture mapping of the terrain model as a linear function of the model (x, z) : uv = a.x + b.z + c (least squares).
+ */
+static void fitTextureMapping(const ModelData& model, glm::vec3& uMapping, glm::vec3& vMapping) {
+	// normal equations of the fit, [x z 1]^T [x z 1]
+	double sxx = 0, sxz = 0, sx = 0, szz = 0, sz = 0, n = 0;
+	double sxu = 0, szu = 0, su = 0, sxv = 0, szv = 0, sv = 0;
+	for (size_t m = 0; m < model.meshes.size(); m++) {
+		const MeshData& mesh = model.meshes[m];
+		const float* positions = mesh.vertices();
+		const float* texCoords = positions + 6 * (size_t)mesh.numVertices;
+		for (unsigned int i = 0; i < mesh.numVertices; i++) {
+			const double x = positions[3 * i], z = positions[3 * i + 2];
+			const double u = texCoords[2 * i], v = texCoords[2 * i + 1];
+			sxx += x * x; sxz += x * z; sx += x; szz += z * z; sz += z; n += 1.0;
+			sxu += x * u; szu += z * u; su += u;
+			sxv += x * v; szv += z * v; sv += v;
+		}
+	}
+
+	// Cramer's rule
+	const double determinant = sxx * (szz * n - sz * sz) - sxz * (sxz * n - sz * sx) + sx * (sxz * sz - szz * sx);
+	if (std::fabs(determinant) < 1e-12) {
+		uMapping = glm::vec3(0.5f, 0.0f, 0.5f);
+		vMapping = glm::vec3(0.0f, 0.5f, 0.5f);
+		return;
+	}
+	const auto solve = [&](double bx, double bz, double b) {
+		const double a0 = (bx * (szz * n - sz * sz) - sxz * (bz * n - sz * b) + sx * (bz * sz - szz * b)) / determinant;
+		const double a1 = (sxx * (bz * n - b * sz) - bx * (sxz * n - sz * sx) + sx * (sxz * b - bz * sx)) / determinant;
+		const double a2 = (sxx * (szz * b - bz * sz) - sxz * (sxz * b - bz * sx) + bx * (sxz * sz - szz * sx)) / determinant;
+		return glm::vec3((float)a0, (float)a1, (float)a2);
+	};
+	uMapping = solve(sxu, szu, su);
+	vMapping = solve(sxv, szv, sv);
+}
+
+/**
+ * \brief Index of the chunk vertex, the odd vertices of the stitched edges are moved onto the previous vertex so that
+ *  the edge matches the one of the coarser neighbour (no T-junction, no crack).
+ */
+static inline unsigned short stitchedVertex(int x, int z, int step, unsigned int stitch) {
+	if ((stitch & TERRAIN_EDGE_MIN_Z) && z == 0 && (x / step) % 2 == 1)
+		x -= step;
+	if ((stitch & TERRAIN_EDGE_MAX_Z) && z == TERRAIN_CHUNK_QUADS && (x / step) % 2 == 1)
+		x -= step;
+	if ((stitch & TERRAIN_EDGE_MIN_X) && x == 0 && (z / step) % 2 == 1)
+		z -= step;
+	if ((stitch & TERRAIN_EDGE_MAX_X) && x == TERRAIN_CHUNK_QUADS && (z / step) % 2 == 1)
+		z -= step;
+	return (unsigned short)(z * TERRAIN_CHUNK_VERTICES + x);
+}
+
+/**
+ * \brief Triangles of every level and stitching, shared by all chunks (same vertex grid).
+ */
+static void buildChunkIndices(TerrainChunks& terrain) {
+	terrain.indices.clear();
+	for (int level = 0; level < TERRAIN_CHUNK_LEVELS; level++) {
+		const int step = 1 << level;
+		for (unsigned int stitch = 0; stitch < TERRAIN_STITCH_VARIANTS; stitch++) {
+			terrain.variantFirst[level][stitch] = (unsigned int)terrain.indices.size();
+			for (int z = 0; z < TERRAIN_CHUNK_QUADS; z += step) {
+				for (int x = 0; x < TERRAIN_CHUNK_QUADS; x += step) {
+					const unsigned short a = stitchedVertex(x, z, step, stitch);
+					const unsigned short b = stitchedVertex(x, z + step, step, stitch);
+					const unsigned short c = stitchedVertex(x + step, z, step, stitch);
+					const unsigned short d = stitchedVertex(x + step, z + step, step, stitch);
+					// counter clockwise seen from above (+y in model space), collapsed triangles are dropped
+					if (a != b && b != c && a != c) {
+						terrain.indices.push_back(a);
+						terrain.indices.push_back(b);
+						terrain.indices.push_back(c);
+					}
+					if (c != b && b != d && c != d) {
+						terrain.indices.push_back(c);
+						terrain.indices.push_back(b);
+						terrain.indices.push_back(d);
+					}
+				}
+			}
+			terrain.variantTriangles[level][stitch] = ((unsigned int)terrain.indices.size() - terrain.variantFirst[level][stitch]) / 3;
+		}
+	}
+}
+
+/**
+ * \brief Split the terrain into chunks (CPU only, runs on the asset loading threads).
+ * \param heightfield [in] baked terrain, the chunks sample it at its resolution
+ * \param tiles [in] the map is tiles x tiles mirrored copies of the heightfield (1 = the terrain model)
+ * \param withVertices [in] false only computes the chunk layout and bounds (benchmark of huge maps)
+ */
+bool buildTerrainChunks(TerrainChunks& terrain, const ModelData& model, const Heightfield& heightfield, unsigned int tiles, bool withVertices) {
+	const Clock::time_point start = Clock::now();
+	terrain.chunks.clear();
+	terrain.vertices.clear();
+	if (heightfield.resolution < 2 || tiles == 0)
+		return false;
+
+	const int quads = (int)(tiles * (heightfield.resolution - 1));
+	terrain.chunksPerSide = (quads + TERRAIN_CHUNK_QUADS - 1) / TERRAIN_CHUNK_QUADS;
+	terrain.chunkSize = TERRAIN_CHUNK_QUADS * heightfield.cellSize;
+	terrain.modelMin = heightfield.modelMin;
+	terrain.chunks.resize((size_t)terrain.chunksPerSide * terrain.chunksPerSide);
+	buildChunkIndices(terrain);
+
+	glm::vec3 uMapping, vMapping;
+	fitTextureMapping(model, uMapping, vMapping);
+	if (withVertices)
+		terrain.vertices.resize(terrain.chunks.size() * TERRAIN_CHUNK_VERTICES * TERRAIN_CHUNK_VERTICES * TERRAIN_VERTEX_FLOATS);
+
+	const float cell = heightfield.cellSize;
+	const int resolution = (int)heightfield.resolution;
+	for (unsigned int cz = 0; cz < terrain.chunksPerSide; cz++) {
+		for (unsigned int cx = 0; cx < terrain.chunksPerSide; cx++) {
+			const size_t chunkIndex = (size_t)cz * terrain.chunksPerSide + cx;
+			float lowest = FLT_MAX;
+			float highest = -FLT_MAX;
+			float* vertex = withVertices ? &terrain.vertices[chunkIndex * TERRAIN_CHUNK_VERTICES * TERRAIN_CHUNK_VERTICES * TERRAIN_VERTEX_FLOATS] : NULL;
+
+			for (int vz = 0; vz < TERRAIN_CHUNK_VERTICES; vz++) {
+				// the last chunk may reach beyond the map, its extra vertices are clamped to the border
+				const int z = std::min((int)cz * TERRAIN_CHUNK_QUADS + vz, quads);
+				for (int vx = 0; vx < TERRAIN_CHUNK_VERTICES; vx++) {
+					const int x = std::min((int)cx * TERRAIN_CHUNK_QUADS + vx, quads);
+					const float height = sampleHeight(heightfield, x, z);
+					lowest = std::min(lowest, height);
+					highest = std::max(highest, height);
+					if (vertex == NULL)
+						continue;
+
+					const float slopeX = (sampleHeight(heightfield, x + 1, z) - sampleHeight(heightfield, x - 1, z)) / (2.0f * cell);
+					const float slopeZ = (sampleHeight(heightfield, x, z + 1) - sampleHeight(heightfield, x, z - 1)) / (2.0f * cell);
+					const glm::vec3 normal = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+					// texture coordinates of the mirrored sample, the texture is mirrored with the tiles
+					const float textureX = terrain.modelMin.x + mirroredSample(x, resolution) * cell;
+					const float textureZ = terrain.modelMin.y + mirroredSample(z, resolution) * cell;
+
+					vertex[0] = terrain.modelMin.x + x * cell;
+					vertex[1] = height;
+					vertex[2] = terrain.modelMin.y + z * cell;
+					vertex[3] = normal.x;
+					vertex[4] = normal.y;
+					vertex[5] = normal.z;
+					vertex[6] = uMapping.x * textureX + uMapping.y * textureZ + uMapping.z;
+					vertex[7] = vMapping.x * textureX + vMapping.y * textureZ + vMapping.z;
+					vertex += TERRAIN_VERTEX_FLOATS;
+				}
+			}
+
+			ObjectGeometry& geometry = terrain.chunks[chunkIndex].geometry;
+			geometry.boundsMin = glm::vec3(terrain.modelMin.x + cx * terrain.chunkSize, lowest, terrain.modelMin.y + cz * terrain.chunkSize);
+			geometry.boundsMax = glm::vec3(geometry.boundsMin.x + terrain.chunkSize, highest, geometry.boundsMin.z + terrain.chunkSize);
+			geometry.boundsCenter = (geometry.boundsMin + geometry.boundsMax) * 0.5f;
+			geometry.boundsRadius = glm::length(geometry.boundsMax - geometry.boundsCenter);
+			geometry.indexType = GL_UNSIGNED_SHORT;
+			geometry.baseVertex = (GLint)(chunkIndex * TERRAIN_CHUNK_VERTICES * TERRAIN_CHUNK_VERTICES);
+			geometry.numVertices = TERRAIN_CHUNK_VERTICES * TERRAIN_CHUNK_VERTICES;
+		}
+	}
+
+	printf("Terrain chunks : %ux%u chunks of %d quads, %u levels, %zu indices, %.1f ms\n", terrain.chunksPerSide, terrain.chunksPerSide,
+		TERRAIN_CHUNK_QUADS, TERRAIN_CHUNK_LEVELS, terrain.indices.size(), std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	return true;
+}
+
+/**
+ * \brief Create the buffers shared by all chunks (GL thread), the CPU copy of the vertices is released.
+ */
+void uploadTerrainChunks(TerrainChunks& terrain, const ShaderProgram& shader, const Material& material, bool useNormals) {
+	if (terrain.chunks.empty() || terrain.vertices.empty())
+		return;
+
+	glGenBuffers(1, &terrain.vertexBufferObject);
+	glBindBuffer(GL_ARRAY_BUFFER, terrain.vertexBufferObject);
+	glBufferData(GL_ARRAY_BUFFER, terrain.vertices.size() * sizeof(float), terrain.vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &terrain.elementBufferObject);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain.elementBufferObject);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, terrain.indices.size() * sizeof(unsigned short), terrain.indices.data(), GL_STATIC_DRAW);
+
+	glGenVertexArrays(1, &terrain.vertexArrayObject);
+	glBindVertexArray(terrain.vertexArrayObject);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain.elementBufferObject);
+	glBindBuffer(GL_ARRAY_BUFFER, terrain.vertexBufferObject);
+	setVertexLayoutAttributes(VERTEX_LAYOUT_INTERLEAVED, 0, shader, useNormals);
+	glBindVertexArray(0);
+	CHECK_GL_ERROR();
+
+	for (size_t i = 0; i < terrain.chunks.size(); i++) {
+		ObjectGeometry& geometry = terrain.chunks[i].geometry;
+		geometry.vertexBufferObject = terrain.vertexBufferObject;
+		geometry.elementBufferObject = terrain.elementBufferObject;
+		geometry.vertexArrayObject = terrain.vertexArrayObject;
+		geometry.material = material;
+	}
+	selectTerrainLevels(terrain, glm::vec3(0.0f));
+
+	std::cout << "Terrain chunks : " << terrain.vertices.size() * sizeof(float) / 1024 << " KB of vertices, "
+		<< terrain.indices.size() * sizeof(unsigned short) / 1024 << " KB of indices" << std::endl;
+	std::vector<float>().swap(terrain.vertices);
+}
+
+// -----------------------  Level selection ---------------------------------
+
+/**
+ * \brief Choose the level of every chunk from its distance to the camera, neighbours differ by one level at most
+ *  and the finer chunk of two neighbours stitches its edge.
+ * \param modelCamera [in] camera position in the model space of the terrain
+ */
+void selectTerrainLevels(TerrainChunks& terrain, const glm::vec3& modelCamera) {
+	const unsigned int side = terrain.chunksPerSide;
+	std::vector<TerrainChunk>& chunks = terrain.chunks;
+
+	for (size_t i = 0; i < chunks.size(); i++) {
+		const ObjectGeometry& geometry = chunks[i].geometry;
+		const glm::vec3 nearest = glm::clamp(modelCamera, geometry.boundsMin, geometry.boundsMax);
+		const float distance = glm::length(modelCamera - nearest) / (TERRAIN_LOD_RANGE * terrain.chunkSize);
+		int level = 0;
+		if (distance >= 1.0f)
+			level = std::min(TERRAIN_CHUNK_LEVELS - 1, (int)std::floor(std::log2(distance)) + 1);
+		chunks[i].level = (unsigned char)level;
+	}
+
+	// a chunk is at most one level coarser than its neighbours (the levels only go down, a few passes settle)
+	for (int pass = 0; pass < TERRAIN_CHUNK_LEVELS; pass++) {
+		bool changed = false;
+		for (unsigned int cz = 0; cz < side; cz++) {
+			for (unsigned int cx = 0; cx < side; cx++) {
+				TerrainChunk& chunk = chunks[(size_t)cz * side + cx];
+				unsigned char limit = chunk.level;
+				if (cx > 0)        limit = std::min(limit, (unsigned char)(chunks[(size_t)cz * side + cx - 1].level + 1));
+				if (cx + 1 < side) limit = std::min(limit, (unsigned char)(chunks[(size_t)cz * side + cx + 1].level + 1));
+				if (cz > 0)        limit = std::min(limit, (unsigned char)(chunks[(size_t)(cz - 1) * side + cx].level + 1));
+				if (cz + 1 < side) limit = std::min(limit, (unsigned char)(chunks[(size_t)(cz + 1) * side + cx].level + 1));
+				if (limit != chunk.level) {
+					chunk.level = limit;
+					changed = true;
+				}
+			}
+		}
+		if (!changed)
+			break;
+	}
+
+	terrain.selectedTriangles = 0;
+	for (unsigned int cz = 0; cz < side; cz++) {
+		for (unsigned int cx = 0; cx < side; cx++) {
+			TerrainChunk& chunk = chunks[(size_t)cz * side + cx];
+			const unsigned char coarser = (unsigned char)(chunk.level + 1);
+			unsigned char stitch = 0;
+			if (cz > 0 && chunks[(size_t)(cz - 1) * side + cx].level == coarser)        stitch |= TERRAIN_EDGE_MIN_Z;
+			if (cx + 1 < side && chunks[(size_t)cz * side + cx + 1].level == coarser)   stitch |= TERRAIN_EDGE_MAX_X;
+			if (cz + 1 < side && chunks[(size_t)(cz + 1) * side + cx].level == coarser) stitch |= TERRAIN_EDGE_MAX_Z;
+			if (cx > 0 && chunks[(size_t)cz * side + cx - 1].level == coarser)          stitch |= TERRAIN_EDGE_MIN_X;
+			chunk.stitch = stitch;
+
+			chunk.geometry.indexOffset = terrain.variantFirst[chunk.level][stitch] * sizeof(unsigned short);
+			chunk.geometry.numTriangles = terrain.variantTriangles[chunk.level][stitch];
+			terrain.selectedTriangles += chunk.geometry.numTriangles;
+		}
+	}
+}
+
+void cleanupTerrainChunks(TerrainChunks& terrain) {
+	glDeleteVertexArrays(1, &terrain.vertexArrayObject);
+	glDeleteBuffers(1, &terrain.elementBufferObject);
+	glDeleteBuffers(1, &terrain.vertexBufferObject);
+	terrain.vertexArrayObject = 0;
+	terrain.elementBufferObject = 0;
+	terrain.vertexBufferObject = 0;
+	terrain.chunks.clear();
+}
+
+// -----------------------  Benchmark ---------------------------------
+
+/**
+ * \brief Triangles drawn for growing maps (mirrored copies of the terrain) seen from the same camera (--bench-terrain).
+ */
+void benchmarkTerrainChunks() {
+	ModelData model;
+	if (!loadModelData(TERRAIN_MODEL_NAME, model)) {
+		std::cerr << "\033[31mbenchmarkTerrainChunks : Cannot load " << TERRAIN_MODEL_NAME << "\033[0m" << std::endl;
+		return;
+	}
+	Heightfield heightfield;
+	bakeHeightfield(model, heightfield);
+
+	float highest = -FLT_MAX;
+	for (size_t i = 0; i < heightfield.heights.size(); i++)
+		highest = std::max(highest, heightfield.heights[i]);
+
+	printf("%8s %10s %14s %9s %14s %14s %10s\n", "tiles", "chunks", "full triangles", "visible", "full visible", "LOD triangles", "select ms");
+	for (unsigned int tiles = 1; tiles <= 32; tiles *= 2) {
+		TerrainChunks terrain;
+		if (!buildTerrainChunks(terrain, model, heightfield, tiles, false))
+			break;
+
+		// camera in the middle of the map, a little above the highest point, looking along the diagonal (no far plane cut)
+		const float span = terrain.chunksPerSide * terrain.chunkSize;
+		const glm::vec3 eye(terrain.modelMin.x + 0.5f * span, highest + 0.1f, terrain.modelMin.y + 0.5f * span);
+		const glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(1.0f, -0.2f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.01f, 1.0e5f);
+		Frustum frustum;
+		extractFrustum(projection * view, frustum);
+
+		const int runs = 20;
+		unsigned int visible = 0;
+		unsigned int triangles = 0;
+		const Clock::time_point start = Clock::now();
+		for (int run = 0; run < runs; run++) {
+			selectTerrainLevels(terrain, eye);
+			visible = 0;
+			triangles = 0;
+			for (size_t i = 0; i < terrain.chunks.size(); i++) {
+				const ObjectGeometry& geometry = terrain.chunks[i].geometry;
+				if (!boxInFrustum(frustum, geometry.boundsCenter, (geometry.boundsMax - geometry.boundsMin) * 0.5f))
+					continue;
+				visible++;
+				triangles += geometry.numTriangles;
+			}
+		}
+		const double selectMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+
+		const unsigned int fullChunkTriangles = 2 * TERRAIN_CHUNK_QUADS * TERRAIN_CHUNK_QUADS;
+		printf("%8u %10zu %14zu %9u %14u %14u %10.3f\n", tiles * tiles, terrain.chunks.size(), terrain.chunks.size() * fullChunkTriangles,
+			visible, visible * fullChunkTriangles, triangles, selectMs);
+	}
+	releaseModelData(model);
+}
@@ -0,0 +1,80 @@
+/*
+* \file terrainChunks.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Terrain split into chunks drawn at a level of detail chosen by camera distance (geomipmapping)
+*/
+
+#pragma once
+
+#ifndef __TERRAIN_CHUNKS_H
+#define __TERRAIN_CHUNKS_H
+
+#include <vector>
+#include "pgr.h"
+#include "object.h"
+#include "meshCache.h"
+#include "heightfield.h"
+
+#define TERRAIN_CHUNK_QUADS 32		// quads per chunk side at the finest level (33 x 33 vertices, 16 bit indices)
+#define TERRAIN_CHUNK_LEVELS 6		// 32, 16, 8, 4, 2 and 1 quads per side
+#define TERRAIN_LOD_RANGE 2.0f		// distance (in chunks) drawn at the finest level, doubled for every coarser level
+#define TERRAIN_STITCH_VARIANTS 16	// every combination of the 4 edges stitched to a coarser neighbour
+
+/**
+ * \brief Edges of a chunk (bits of TerrainChunk::stitch), z and x are the horizontal axes of the terrain model.
+ */
+enum TerrainChunkEdge {
+	TERRAIN_EDGE_MIN_Z = 1 << 0,
+	TERRAIN_EDGE_MAX_X = 1 << 1,
+	TERRAIN_EDGE_MAX_Z = 1 << 2,
+	TERRAIN_EDGE_MIN_X = 1 << 3
+};
+
+/**
+ * \brief One tile of the terrain. Its geometry shares the buffers of the terrain, the index range is the one of
+ *  the selected level and stitching.
+ */
+typedef struct _TerrainChunk {
+	ObjectGeometry geometry;	///< model space bounds of the chunk, drawn with the terrain model matrix
+	unsigned char level;		///< 0 = finest
+	unsigned char stitch;		///< TerrainChunkEdge towards a neighbour one level coarser
+
+	_TerrainChunk() : level(0), stitch(0) {}
+} TerrainChunk;
+
+/**
+ * \brief The chunks of the terrain and the index ranges of every level / stitching variant.
+ */
+typedef struct _TerrainChunks {
+	unsigned int chunksPerSide;
+	float chunkSize;					///< side of a chunk in model units
+	glm::vec2 modelMin;					///< model (x, z) of the first chunk corner
+	std::vector<TerrainChunk> chunks;	///< row (z) major
+
+	std::vector<float> vertices;		///< |VNT| of every chunk, released once uploaded
+	std::vector<unsigned short> indices;
+	unsigned int variantFirst[TERRAIN_CHUNK_LEVELS][TERRAIN_STITCH_VARIANTS];		///< first index
+	unsigned int variantTriangles[TERRAIN_CHUNK_LEVELS][TERRAIN_STITCH_VARIANTS];
+
+	GLuint vertexBufferObject;
+	GLuint elementBufferObject;
+	GLuint vertexArrayObject;
+
+	unsigned int selectedTriangles;		///< triangles of every chunk at its selected level (before culling)
+
+	_TerrainChunks() : chunksPerSide(0), chunkSize(1.0f), modelMin(0.0f), vertexBufferObject(0), elementBufferObject(0),
+		vertexArrayObject(0), selectedTriangles(0) {}
+} TerrainChunks;
+
+extern TerrainChunks terrainChunks;
+extern bool useTerrainLod;	///< false draws the terrain model at full resolution (--no-terrain-lod)
+
+bool buildTerrainChunks(TerrainChunks& terrain, const ModelData& model, const Heightfield& heightfield, unsigned int tiles, bool withVertices);
+void uploadTerrainChunks(TerrainChunks& terrain, const ShaderProgram& shader, const Material& material, bool useNormals);
+void selectTerrainLevels(TerrainChunks& terrain, const glm::vec3& modelCamera);
+void cleanupTerrainChunks(TerrainChunks& terrain);
+
+void benchmarkTerrainChunks();
+
+#endif // __TERRAIN_CHUNKS_H
@@ -0,0 +1,563 @@
+/*
+* \file textureCache.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Texture cache - mip chains baked into block compressed (BC1/BC3) cache files written next to each image
+*/
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include "textureCache.h"
+#include "meshCache.h"
+
+#define TEXTURE_CACHE_ALIGNMENT 16
+
+bool useTextureCompression = true;
+
+/**
+ * \brief Header at the beginning of every cache file, followed by one record per mip level.
+ */
+typedef struct _TextureCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceSize;			///< size of the source image file
+	int64_t  sourceModifiedTime;	///< last modification time of the source image file
+	uint64_t sourceHash;			///< FNV-1a hash of the source image file
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;				///< GL compressed format of the levels
+	uint32_t numLevels;
+} TextureCacheHeader;
+
+/**
+ * \brief One mip level, offsets are relative to the start of the file.
+ */
+typedef struct _TextureCacheLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+} TextureCacheLevel;
+
+static_assert(sizeof(TextureCacheHeader) == 48, "TextureCacheHeader layout changed, bump TEXTURE_CACHE_VERSION");
+static_assert(sizeof(TextureCacheLevel) == 24, "TextureCacheLevel layout changed, bump TEXTURE_CACHE_VERSION");
+
+static size_t alignOffset(size_t offset) {
+	return (offset + TEXTURE_CACHE_ALIGNMENT - 1) & ~(size_t)(TEXTURE_CACHE_ALIGNMENT - 1);
+}
+
+/**
+ * \brief Bytes of one level in the compressed format (4x4 texel blocks, partial blocks are padded).
+ */
+static size_t compressedLevelSize(GLenum format, unsigned int width, unsigned int height) {
+	const size_t blockBytes = format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8;
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+// -----------------------  Block compression ---------------------------------
+
+static unsigned short packRGB565(const float* color) {
+	const int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+	const int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+	const int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(unsigned short packed, int* color) {
+	const int r = (packed >> 11) & 31;
+	const int g = (packed >> 5) & 63;
+	const int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+/**
+ * \brief Encode the colors of a 4x4 block (BC1 4 color mode, also the color half of BC3).
+ * The endpoints are the texels furthest apart along the principal axis of the block colors.
+ * \param texels [in] 16 RGBA8 texels, row by row
+ * \param output [out] 8 bytes
+ */
+static void encodeColorBlock(const unsigned char* texels, unsigned char* output) {
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += texels[4 * i + c] / 16.0f;
+
+	// covariance of the colors (xx, xy, xz, yy, yz, zz)
+	float covariance[6] = { 0.0f };
+	for (int i = 0; i < 16; i++) {
+		const float d[3] = { texels[4 * i] - mean[0], texels[4 * i + 1] - mean[1], texels[4 * i + 2] - mean[2] };
+		covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+		covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+	}
+
+	// principal axis by power iteration
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		const float next[3] = {
+			covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+		};
+		const float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+		if (length < 1e-6f)
+			break;	// flat block, any axis works
+		for (int c = 0; c < 3; c++)
+			axis[c] = next[c] / length;
+	}
+
+	int minTexel = 0;
+	int maxTexel = 0;
+	float minProjection = 1e30f;
+	float maxProjection = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		const float projection = texels[4 * i] * axis[0] + texels[4 * i + 1] * axis[1] + texels[4 * i + 2] * axis[2];
+		if (projection < minProjection) {
+			minProjection = projection;
+			minTexel = i;
+		}
+		if (projection > maxProjection) {
+			maxProjection = projection;
+			maxTexel = i;
+		}
+	}
+
+	const float maxColor[3] = { (float)texels[4 * maxTexel], (float)texels[4 * maxTexel + 1], (float)texels[4 * maxTexel + 2] };
+	const float minColor[3] = { (float)texels[4 * minTexel], (float)texels[4 * minTexel + 1], (float)texels[4 * minTexel + 2] };
+	unsigned short endpoint0 = packRGB565(maxColor);
+	unsigned short endpoint1 = packRGB565(minColor);
+	// endpoint0 > endpoint1 selects the 4 color mode of BC1
+	if (endpoint0 < endpoint1)
+		std::swap(endpoint0, endpoint1);
+
+	uint32_t indices = 0;
+	if (endpoint0 != endpoint1) {
+		int palette[4][3];
+		unpackRGB565(endpoint0, palette[0]);
+		unpackRGB565(endpoint1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int bestDistance = 1 << 30;
+			for (int p = 0; p < 4; p++) {
+				int distance = 0;
+				for (int c = 0; c < 3; c++)
+					distance += (texels[4 * i + c] - palette[p][c]) * (texels[4 * i + c] - palette[p][c]);
+				if (distance < bestDistance) {
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= (uint32_t)best << (2 * i);
+		}
+	}
+
+	output[0] = (unsigned char)(endpoint0 & 0xff);
+	output[1] = (unsigned char)(endpoint0 >> 8);
+	output[2] = (unsigned char)(endpoint1 & 0xff);
+	output[3] = (unsigned char)(endpoint1 >> 8);
+	for (int b = 0; b < 4; b++)
+		output[4 + b] = (unsigned char)(indices >> (8 * b));
+}
+
+/**
+ * \brief Encode the alpha of a 4x4 block (alpha half of BC3, 8 interpolated values between the extremes).
+ * \param texels [in] 16 RGBA8 texels, row by row
+ * \param output [out] 8 bytes
+ */
+static void encodeAlphaBlock(const unsigned char* texels, unsigned char* output) {
+	int alpha0 = 0;
+	int alpha1 = 255;
+	for (int i = 0; i < 16; i++) {
+		alpha0 = std::max(alpha0, (int)texels[4 * i + 3]);
+		alpha1 = std::min(alpha1, (int)texels[4 * i + 3]);
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1) {
+		int palette[8];
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		for (int p = 2; p < 8; p++)
+			palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			for (int p = 1; p < 8; p++) {
+				if (std::abs(texels[4 * i + 3] - palette[p]) < std::abs(texels[4 * i + 3] - palette[best]))
+					best = p;
+			}
+			indices |= (uint64_t)best << (3 * i);
+		}
+	}
+
+	output[0] = (unsigned char)alpha0;
+	output[1] = (unsigned char)alpha1;
+	for (int b = 0; b < 6; b++)
+		output[2 + b] = (unsigned char)(indices >> (8 * b));
+}
+
+/**
+ * \brief Compress one RGBA8 level, the texels of partial blocks repeat the last row / column.
+ */
+static void compressLevel(const unsigned char* pixels, unsigned int width, unsigned int height, GLenum format, unsigned char* output) {
+	unsigned char texels[16 * 4];
+
+	for (unsigned int by = 0; by < height; by += 4) {
+		for (unsigned int bx = 0; bx < width; bx += 4) {
+			for (unsigned int y = 0; y < 4; y++) {
+				const unsigned int row = std::min(by + y, height - 1);
+				for (unsigned int x = 0; x < 4; x++) {
+					const unsigned int column = std::min(bx + x, width - 1);
+					memcpy(texels + 4 * (4 * y + x), pixels + 4 * ((size_t)row * width + column), 4);
+				}
+			}
+
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				encodeAlphaBlock(texels, output);
+				encodeColorBlock(texels, output + 8);
+				output += 16;
+			}
+			else {
+				encodeColorBlock(texels, output);
+				output += 8;
+			}
+		}
+	}
+}
+
+/**
+ * \brief Next mip level, box filter over 2x2 texels (odd sizes reuse the last row / column).
+ */
+static void downsampleLevel(const std::vector<unsigned char>& source, unsigned int width, unsigned int height,
+	std::vector<unsigned char>& destination, unsigned int& nextWidth, unsigned int& nextHeight) {
+	nextWidth = width > 1 ? width / 2 : 1;
+	nextHeight = height > 1 ? height / 2 : 1;
+	destination.resize(4 * (size_t)nextWidth * nextHeight);
+
+	for (unsigned int y = 0; y < nextHeight; y++) {
+		const unsigned int y0 = std::min(2 * y, height - 1);
+		const unsigned int y1 = std::min(2 * y + 1, height - 1);
+		for (unsigned int x = 0; x < nextWidth; x++) {
+			const unsigned int x0 = std::min(2 * x, width - 1);
+			const unsigned int x1 = std::min(2 * x + 1, width - 1);
+			for (unsigned int c = 0; c < 4; c++) {
+				const unsigned int sum = source[4 * ((size_t)y0 * width + x0) + c] + source[4 * ((size_t)y0 * width + x1) + c]
+					+ source[4 * ((size_t)y1 * width + x0) + c] + source[4 * ((size_t)y1 * width + x1) + c];
+				destination[4 * ((size_t)y * nextWidth + x) + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+// -----------------------  Baking ---------------------------------
+
+/** Build the mip chain of a decoded image and compress every level.
+ *  Opaque images are stored as BC1 (8:1 against RGBA8), images with transparent texels as BC3 (4:1).
+ * \param source [in] decoded RGBA8 image
+ * \param baked [out] compressed mip chain, owns its storage
+ */
+void bakeImage(const ImageData& source, ImageData& baked) {
+	bool opaque = true;
+	for (size_t i = 3; i < source.pixels.size() && opaque; i += 4)
+		opaque = source.pixels[i] == 255;
+	const GLenum format = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+	// level layout first, so the storage is allocated once
+	std::vector<ImageLevel> levels;
+	size_t size = 0;
+	unsigned int width = source.width;
+	unsigned int height = source.height;
+	while (levels.size() < TEXTURE_CACHE_MAX_LEVELS) {
+		ImageLevel level;
+		level.width = width;
+		level.height = height;
+		level.offset = size;
+		level.size = compressedLevelSize(format, width, height);
+		levels.push_back(level);
+		size += level.size;
+		if (width == 1 && height == 1)
+			break;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	std::shared_ptr<std::vector<unsigned char> > storage = std::make_shared<std::vector<unsigned char> >(size);
+	std::vector<unsigned char> pixels = source.pixels;
+	std::vector<unsigned char> nextPixels;
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		const ImageLevel& level = levels[i];
+		compressLevel(pixels.data(), level.width, level.height, format, storage->data() + level.offset);
+		if (i + 1 < levels.size()) {
+			unsigned int nextWidth;
+			unsigned int nextHeight;
+			downsampleLevel(pixels, level.width, level.height, nextPixels, nextWidth, nextHeight);
+			pixels.swap(nextPixels);
+		}
+	}
+
+	baked.fileName = source.fileName;
+	baked.width = source.width;
+	baked.height = source.height;
+	baked.pixels.clear();
+	baked.compressedFormat = format;
+	baked.levels = levels;
+	baked.levelData = storage->data();
+	baked.levelStorage = storage;
+}
+
+// -----------------------  Cache files ---------------------------------
+
+std::string textureCacheFileName(const std::string& imageFileName) {
+	return imageFileName + TEXTURE_CACHE_EXTENSION;
+}
+
+/**
+ * \brief Write the baked image into a cache file.
+ * The file is written under a temporary name first so a crash never leaves a half written cache behind.
+ */
+bool writeTextureCache(const std::string& cacheFileName, const std::string& sourceFileName, const ImageData& image) {
+	if (image.levels.empty() || image.levels.size() > TEXTURE_CACHE_MAX_LEVELS)
+		return false;
+
+	TextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.width = image.width;
+	header.height = image.height;
+	header.format = image.compressedFormat;
+	header.numLevels = (uint32_t)image.levels.size();
+	if (!getFileInfo(sourceFileName, header.sourceSize, header.sourceModifiedTime))
+		return false;
+	header.sourceHash = hashFile(sourceFileName);
+
+	std::vector<TextureCacheLevel> records(image.levels.size());
+	size_t offset = alignOffset(sizeof(TextureCacheHeader) + records.size() * sizeof(TextureCacheLevel));
+	for (size_t i = 0; i < image.levels.size(); i++) {
+		records[i].width = image.levels[i].width;
+		records[i].height = image.levels[i].height;
+		records[i].offset = offset;
+		records[i].size = image.levels[i].size;
+		offset = alignOffset(offset + image.levels[i].size);
+	}
+
+	std::string tempFileName = cacheFileName + ".tmp";
+	{
+		std::ofstream file(tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		const char padding[TEXTURE_CACHE_ALIGNMENT] = { 0 };
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)records.data(), records.size() * sizeof(TextureCacheLevel));
+		for (size_t i = 0; i < image.levels.size(); i++) {
+			file.write(padding, records[i].offset - (uint64_t)file.tellp());
+			file.write((const char*)image.levelData + image.levels[i].offset, image.levels[i].size);
+		}
+		file.write(padding, offset - (uint64_t)file.tellp());
+
+		if (!file)
+			return false;
+	}
+
+	// rename() does not replace existing files on Windows
+	std::remove(cacheFileName.c_str());
+	if (std::rename(tempFileName.c_str(), cacheFileName.c_str()) != 0) {
+		std::remove(tempFileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * \brief Check that the cache still describes the source image (same rules as the mesh cache).
+ */
+static bool isTextureCacheUpToDate(const TextureCacheHeader& header, const std::string& sourceFileName) {
+	uint64_t size = 0;
+	int64_t modifiedTime = 0;
+
+	if (!getFileInfo(sourceFileName, size, modifiedTime))
+		return true;
+	if (size != header.sourceSize)
+		return false;
+	if (modifiedTime == header.sourceModifiedTime)
+		return true;
+	return hashFile(sourceFileName) == header.sourceHash;
+}
+
+/**
+ * \brief Memory-map a cache file and point the levels of the image straight into the mapping.
+ * \return false if the cache is missing, corrupted, from another version or out of date.
+ */
+bool readTextureCache(const std::string& cacheFileName, const std::string& sourceFileName, ImageData& image) {
+	// unmapped with the last image pointing into it
+	std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+	if (!mapFile(cacheFileName, *mapping))
+		return false;
+
+	const unsigned char* data = mapping->data;
+	const size_t size = mapping->size;
+
+	TextureCacheHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION
+		|| header.numLevels == 0 || header.numLevels > TEXTURE_CACHE_MAX_LEVELS
+		|| (header.format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && header.format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		|| size < sizeof(header) + header.numLevels * sizeof(TextureCacheLevel)
+		|| !isTextureCacheUpToDate(header, sourceFileName))
+		return false;
+
+	std::vector<ImageLevel> levels(header.numLevels);
+	for (uint32_t i = 0; i < header.numLevels; i++) {
+		TextureCacheLevel record;
+		memcpy(&record, data + sizeof(header) + i * sizeof(TextureCacheLevel), sizeof(record));
+
+		if (record.size != compressedLevelSize(header.format, record.width, record.height) || record.offset + record.size > size) {
+			std::cerr << "\033[31mreadTextureCache : corrupted cache file : " << cacheFileName << "\033[0m" << std::endl;
+			return false;
+		}
+		levels[i].width = record.width;
+		levels[i].height = record.height;
+		levels[i].offset = (size_t)record.offset;
+		levels[i].size = (size_t)record.size;
+	}
+
+	image.fileName = sourceFileName;
+	image.width = header.width;
+	image.height = header.height;
+	image.pixels.clear();
+	image.compressedFormat = header.format;
+	image.levels = levels;
+	image.levelData = data;
+	image.levelStorage = mapping;
+	return true;
+}
+
+/**
+ * \brief Load the baked image from its cache file, decode, bake (and write the cache) if the cache is not usable.
+ * Safe to call from worker threads. Without texture compression the image is only decoded.
+ */
+bool loadTextureImage(const std::string& fileName, ImageData& image) {
+	if (!useTextureCompression)
+		return decodeImage(fileName, image);
+
+	const std::string cacheFileName = textureCacheFileName(fileName);
+	if (readTextureCache(cacheFileName, fileName, image))
+		return true;
+
+	ImageData decoded;
+	if (!decodeImage(fileName, decoded))
+		return false;
+	bakeImage(decoded, image);
+
+	if (!writeTextureCache(cacheFileName, fileName, image)) {
+		std::cerr << "\033[31mloadTextureImage : Cannot write texture cache : " << cacheFileName << "\033[0m" << std::endl;
+	}
+	return true;
+}
+
+/**
+ * \brief True if the context can sample S3TC (BC1/BC3) textures, must be called from the GL thread.
+ */
+bool textureCompressionSupported() {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension != NULL && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+			return true;
+	}
+	return false;
+}
+
+// -----------------------  Benchmark ---------------------------------
+
+/**
+ * \brief Compare the runtime path (decode, driver mipmaps, RGBA8) with the baked cache: load time on the CPU and
+ * video memory of the mip chains. The driver mipmap generation is not timed, no OpenGL context is needed.
+ */
+void benchmarkTextureCache(const std::vector<std::string>& fileNames) {
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double totalDecode = 0.0;
+	double totalBake = 0.0;
+	double totalWarm = 0.0;
+	size_t totalRGBA = 0;
+	size_t totalBaked = 0;
+
+	printf("%-45s %11s %6s %10s %10s %10s %10s %10s %10s\n", "texture", "size", "format", "decode ms", "bake ms", "warm ms",
+		"RGBA8 KB", "baked KB", "VRAM");
+
+	for (size_t i = 0; i < fileNames.size(); i++) {
+		const std::string& fileName = fileNames[i];
+		const std::string cacheFileName = textureCacheFileName(fileName);
+
+		// runtime path
+		Clock::time_point start = Clock::now();
+		ImageData decoded;
+		if (!decodeImage(fileName, decoded)) {
+			std::cerr << "\033[31mbenchmarkTextureCache : Cannot decode : " << fileName << "\033[0m" << std::endl;
+			continue;
+		}
+		const double decodeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		// first run : bake and write the cache
+		start = Clock::now();
+		ImageData baked;
+		bakeImage(decoded, baked);
+		if (!writeTextureCache(cacheFileName, fileName, baked)) {
+			std::cerr << "\033[31mbenchmarkTextureCache : Cannot write cache : " << cacheFileName << "\033[0m" << std::endl;
+			continue;
+		}
+		const double bakeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		// warm path, touches every page as the upload would
+		start = Clock::now();
+		ImageData cached;
+		if (!readTextureCache(cacheFileName, fileName, cached)) {
+			std::cerr << "\033[31mbenchmarkTextureCache : Cannot read cache : " << cacheFileName << "\033[0m" << std::endl;
+			continue;
+		}
+		volatile unsigned int checksum = 0;
+		const ImageLevel& last = cached.levels.back();
+		for (size_t b = 0; b < last.offset + last.size; b += 4096)
+			checksum += cached.levelData[b];
+		const double warmMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		const size_t rgbaBytes = mipChainBytes(decoded.width, decoded.height, 4);
+		size_t bakedBytes = 0;
+		for (size_t l = 0; l < cached.levels.size(); l++)
+			bakedBytes += cached.levels[l].size;
+
+		char size[32];
+		snprintf(size, sizeof(size), "%ux%u", decoded.width, decoded.height);
+		printf("%-45s %11s %6s %10.2f %10.2f %10.2f %10.1f %10.1f %9.1fx\n", fileName.c_str(), size,
+			cached.compressedFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? "BC3" : "BC1", decodeMs, bakeMs, warmMs,
+			rgbaBytes / 1024.0, bakedBytes / 1024.0, (double)rgbaBytes / bakedBytes);
+
+		totalDecode += decodeMs;
+		totalBake += bakeMs;
+		totalWarm += warmMs;
+		totalRGBA += rgbaBytes;
+		totalBaked += bakedBytes;
+	}
+
+	printf("%-45s %11s %6s %10.2f %10.2f %10.2f %10.1f %10.1f %9.1fx\n", "total", "", "", totalDecode, totalBake, totalWarm,
+		totalRGBA / 1024.0, totalBaked / 1024.0, totalBaked > 0 ? (double)totalRGBA / totalBaked : 1.0);
+}
@@ -0,0 +1,45 @@
+/*
+* \file textureCache.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Texture cache - mip chains baked into block compressed (BC1/BC3) cache files written next to each image
+*/
+
+#pragma once
+
+#ifndef __TEXTURE_CACHE_H
+#define __TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include "pgr.h"
+#include "image.h"
+
+#define TEXTURE_CACHE_EXTENSION ".texcache"
+#define TEXTURE_CACHE_MAGIC 0x58544343u	// "CCTX"
+#define TEXTURE_CACHE_VERSION 1			// bump whenever the file layout or the baking changes
+#define TEXTURE_CACHE_MAX_LEVELS 16		// enough for 32768 x 32768 images
+
+// S3TC formats (GL_EXT_texture_compression_s3tc), not part of the core profile headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+extern bool useTextureCompression;	///< false decodes the images and lets the driver build the mipmaps (--no-texture-compression)
+
+// -----------------------  Baking ---------------------------------
+void bakeImage(const ImageData& source, ImageData& baked);
+
+// -----------------------  Cache files ---------------------------------
+std::string textureCacheFileName(const std::string& imageFileName);
+bool writeTextureCache(const std::string& cacheFileName, const std::string& sourceFileName, const ImageData& image);
+bool readTextureCache(const std::string& cacheFileName, const std::string& sourceFileName, ImageData& image);
+bool loadTextureImage(const std::string& fileName, ImageData& image);
+bool textureCompressionSupported();
+
+void benchmarkTextureCache(const std::vector<std::string>& fileNames);
+
+#endif // __TEXTURE_CACHE_H
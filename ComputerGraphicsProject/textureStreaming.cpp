@@ -0,0 +1,492 @@
+/*
+* \file textureStreaming.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Texture streaming - low mip placeholders at load, finer levels uploaded through a ring of pixel buffer objects
+* as the objects using them grow on the screen, under a video memory budget
+*/
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include "textureStreaming.h"
+#include "threadPool.h"
+#include "frustumCulling.h"
+#include "meshLod.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+bool useTextureStreaming = true;
+size_t textureStreamingBudget = (size_t)TEXTURE_STREAMING_BUDGET_MB << 20;
+bool printStreamingStats = false;
+TextureStreamingStats textureStreamingStats;
+
+/**
+ * \brief Texture whose baked mip chain is streamed. Level numbers follow the image (0 = full resolution),
+ * the levels from residentLevel to the last one are in video memory.
+ */
+typedef struct _StreamedTexture {
+	GLuint texture;
+	ImageData image;				///< baked mip chain (mapped cache file), source of the uploads
+	unsigned int placeholderLevel;	///< finest level uploaded at load, never evicted
+	unsigned int residentLevel;		///< finest level in video memory (GL_TEXTURE_BASE_LEVEL)
+	unsigned int wantedLevel;		///< finest level the screen size of its objects asks for
+	float screenSize;				///< largest size in pixels of the objects using it in lastUsedFrame
+	unsigned int lastUsedFrame;
+	bool uploading;					///< a level is in the upload ring
+} StreamedTexture;
+
+enum UploadSlotState {
+	SLOT_FREE,
+	SLOT_COPYING,		///< buffer mapped, a worker copies the level into it
+	SLOT_UPLOADING		///< level uploaded from the buffer, waiting for the GPU before the buffer is reused
+};
+
+/**
+ * \brief One pixel buffer object of the upload ring.
+ */
+typedef struct _UploadSlot {
+	GLuint buffer;
+	size_t capacity;
+	unsigned char* mapped;
+	GLsync fence;
+	UploadSlotState state;
+	std::atomic<bool> copied;	///< set by the worker once the level is in the buffer
+	size_t texture;				///< index in streamedTextures
+	unsigned int level;
+} UploadSlot;
+
+static std::vector<StreamedTexture> streamedTextures;
+static std::unordered_map<GLuint, size_t> textureIndices;
+static UploadSlot uploadSlots[TEXTURE_STREAMING_UPLOAD_SLOTS];
+static size_t inFlightBytes = 0;		// levels in the upload ring, already counted against the budget
+static unsigned int streamingFrame = 1;
+static Clock::time_point lastReport = Clock::now();
+
+/**
+ * \brief Create the pixel buffer objects of the upload ring.
+ */
+void initTextureStreaming() {
+	if (!useTextureStreaming)
+		return;
+
+	for (int i = 0; i < TEXTURE_STREAMING_UPLOAD_SLOTS; i++) {
+		UploadSlot& slot = uploadSlots[i];
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAMING_SLOT_SIZE, NULL, GL_STREAM_DRAW);
+		slot.capacity = TEXTURE_STREAMING_SLOT_SIZE;
+		slot.mapped = NULL;
+		slot.fence = 0;
+		slot.state = SLOT_FREE;
+		slot.copied = false;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	CHECK_GL_ERROR();
+}
+
+/**
+ * \brief Wait for the copies in flight and delete the ring and every streamed texture.
+ */
+void cleanupTextureStreaming() {
+	for (int i = 0; i < TEXTURE_STREAMING_UPLOAD_SLOTS; i++) {
+		UploadSlot& slot = uploadSlots[i];
+		if (slot.buffer == 0)
+			continue;
+
+		if (slot.state == SLOT_COPYING) {
+			while (!slot.copied)
+				std::this_thread::yield();
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		if (slot.fence != 0)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+		slot.buffer = 0;
+		slot.fence = 0;
+		slot.state = SLOT_FREE;
+	}
+
+	for (size_t i = 0; i < streamedTextures.size(); i++) {
+		if (streamedTextures[i].texture != 0)
+			glDeleteTextures(1, &streamedTextures[i].texture);
+	}
+	streamedTextures.clear();
+	textureIndices.clear();
+	inFlightBytes = 0;
+	textureStreamingStats = TextureStreamingStats();
+}
+
+/**
+ * \brief Create a texture from a baked image with only its placeholder levels (up to TEXTURE_STREAMING_PLACEHOLDER_SIZE)
+ * in video memory, the finer levels are streamed in by updateTextureStreaming(). Decoded images and small baked images
+ * are created whole. Must be called from the GL thread.
+ */
+GLuint createStreamedTexture(const ImageData& image) {
+	if (!useTextureStreaming || image.levels.empty())
+		return createTextureFromImage(image);
+
+	unsigned int placeholderLevel = (unsigned int)image.levels.size() - 1;
+	for (unsigned int level = 0; level < image.levels.size(); level++) {
+		if (std::max(image.levels[level].width, image.levels[level].height) <= TEXTURE_STREAMING_PLACEHOLDER_SIZE) {
+			placeholderLevel = level;
+			break;
+		}
+	}
+	if (placeholderLevel == 0)
+		return createTextureFromImage(image);
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// placeholder levels straight from the image, they are a few KB
+	size_t placeholderBytes = 0;
+	for (unsigned int level = placeholderLevel; level < image.levels.size(); level++) {
+		const ImageLevel& data = image.levels[level];
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, image.compressedFormat, data.width, data.height, 0,
+			(GLsizei)data.size, image.levelData + data.offset);
+		placeholderBytes += data.size;
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	// the texture samples the resident levels only, it is complete from the start
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, placeholderLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	CHECK_GL_ERROR();
+
+	textureMemory.images++;
+	textureMemory.bytes += placeholderBytes;
+	textureMemory.rgbaBytes += mipChainBytes(image.width, image.height, 4);
+	textureStreamingStats.residentBytes += placeholderBytes;
+	textureStreamingStats.placeholderBytes += placeholderBytes;
+
+	StreamedTexture streamed;
+	streamed.texture = texture;
+	streamed.image = image;
+	streamed.placeholderLevel = placeholderLevel;
+	streamed.residentLevel = placeholderLevel;
+	streamed.wantedLevel = placeholderLevel;
+	streamed.screenSize = 0.0f;
+	streamed.lastUsedFrame = 0;
+	streamed.uploading = false;
+	textureIndices[texture] = streamedTextures.size();
+	streamedTextures.push_back(streamed);
+	return texture;
+}
+
+/**
+ * \brief Delete a texture created by createStreamedTexture(). The record stays (a level may still be in the upload ring),
+ * without texture and without resident levels.
+ */
+void deleteStreamedTexture(GLuint texture) {
+	std::unordered_map<GLuint, size_t>::iterator it = textureIndices.find(texture);
+	if (it == textureIndices.end()) {
+		glDeleteTextures(1, &texture);
+		return;
+	}
+
+	StreamedTexture& streamed = streamedTextures[it->second];
+	for (unsigned int level = streamed.residentLevel; level < streamed.image.levels.size(); level++)
+		textureStreamingStats.residentBytes -= streamed.image.levels[level].size;
+	for (unsigned int level = streamed.placeholderLevel; level < streamed.image.levels.size(); level++)
+		textureStreamingStats.placeholderBytes -= streamed.image.levels[level].size;
+
+	glDeleteTextures(1, &streamed.texture);
+	streamed.texture = 0;
+	streamed.residentLevel = streamed.placeholderLevel;
+	streamed.wantedLevel = streamed.placeholderLevel;
+	textureIndices.erase(it);
+}
+
+// -----------------------  Residency requests ---------------------------------
+
+/**
+ * \brief Record that the texture of the geometry is drawn this frame, at the size of its bounding sphere on the screen.
+ */
+void requestTextureResidency(const ObjectGeometry* geometry, const glm::mat4& modelMatrix) {
+	if (!useTextureStreaming || geometry->material.texture == 0)
+		return;
+
+	float screenSize = FLT_MAX;
+	if (geometry->boundsRadius >= 0.0f) {
+		const glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(geometry->boundsCenter, 1.0f));
+		screenSize = projectedSphereSize(center, geometry->boundsRadius * maxScale(modelMatrix));
+	}
+	requestTextureCoverage(geometry->material.texture, screenSize);
+}
+
+/**
+ * \brief Record that the texture is drawn this frame on an object screenSize pixels wide.
+ */
+void requestTextureCoverage(GLuint texture, float screenSize) {
+	if (!useTextureStreaming || texture == 0)
+		return;
+
+	std::unordered_map<GLuint, size_t>::const_iterator it = textureIndices.find(texture);
+	if (it == textureIndices.end())
+		return;
+
+	StreamedTexture& streamed = streamedTextures[it->second];
+	if (streamed.lastUsedFrame != streamingFrame) {
+		streamed.lastUsedFrame = streamingFrame;
+		streamed.screenSize = 0.0f;
+	}
+	streamed.screenSize = std::max(streamed.screenSize, screenSize);
+}
+
+/**
+ * \brief Finest level worth sampling, assuming the texture is mapped once over the object:
+ * one texel per pixel of its size on the screen.
+ */
+static unsigned int levelForScreenSize(const StreamedTexture& streamed) {
+	const float texels = (float)std::max(streamed.image.width, streamed.image.height);
+	unsigned int level = 0;
+	if (streamed.screenSize < texels)
+		level = (unsigned int)std::floor(std::log2(texels / std::max(streamed.screenSize, 1.0f)));
+	return std::min(level, streamed.placeholderLevel);
+}
+
+// -----------------------  Uploads and eviction ---------------------------------
+
+/**
+ * \brief Drop the finest resident level of the texture. The level is respecified empty so the driver frees it,
+ * levels under GL_TEXTURE_BASE_LEVEL do not take part in the completeness of the texture.
+ */
+static void evictLevel(StreamedTexture& streamed) {
+	const unsigned int level = streamed.residentLevel;
+	const size_t size = streamed.image.levels[level].size;
+
+	glBindTexture(GL_TEXTURE_2D, streamed.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	streamed.residentLevel = level + 1;
+	textureStreamingStats.residentBytes -= size;
+	textureStreamingStats.evictedBytes += size;
+	textureStreamingStats.evictions++;
+}
+
+/**
+ * \brief Texture whose finest level should go first to make room for the requester, -1 if none may go.
+ * Levels finer than what their texture wants go first, then the textures not drawn this frame, least recently drawn first.
+ * Textures drawn this frame at their wanted level are never evicted, the request waits for the budget instead.
+ */
+static int pickEvictionVictim(size_t requester) {
+	int victim = -1;
+	for (size_t i = 0; i < streamedTextures.size(); i++) {
+		const StreamedTexture& candidate = streamedTextures[i];
+		if (i == requester || candidate.uploading || candidate.residentLevel >= candidate.placeholderLevel)
+			continue;
+
+		const bool overResident = candidate.residentLevel < candidate.wantedLevel;
+		if (!overResident && candidate.lastUsedFrame == streamingFrame)
+			continue;
+
+		if (victim < 0) {
+			victim = (int)i;
+			continue;
+		}
+		const StreamedTexture& best = streamedTextures[victim];
+		const bool bestOverResident = best.residentLevel < best.wantedLevel;
+		if (overResident != bestOverResident) {
+			if (overResident)
+				victim = (int)i;
+		}
+		else if (candidate.lastUsedFrame != best.lastUsedFrame) {
+			if (candidate.lastUsedFrame < best.lastUsedFrame)
+				victim = (int)i;
+		}
+		else if (candidate.screenSize < best.screenSize) {
+			victim = (int)i;
+		}
+	}
+	return victim;
+}
+
+/**
+ * \brief Evict levels until size more bytes fit in the budget.
+ */
+static bool makeRoom(size_t size, size_t requester) {
+	while (textureStreamingStats.residentBytes + inFlightBytes + size > textureStreamingBudget) {
+		const int victim = pickEvictionVictim(requester);
+		if (victim < 0)
+			return false;
+		evictLevel(streamedTextures[victim]);
+	}
+	return true;
+}
+
+/**
+ * \brief Map the buffer of the slot and let a worker copy the level into it (reading the level from the mapped cache
+ * file pages it in from the disk off the GL thread). The mapping is unsynchronized, the fence of the slot guarantees
+ * the GPU is done with its previous content.
+ */
+static bool startUpload(UploadSlot& slot, size_t index, unsigned int level) {
+	StreamedTexture& streamed = streamedTextures[index];
+	const ImageLevel& data = streamed.image.levels[level];
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	if (data.size > slot.capacity) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, data.size, NULL, GL_STREAM_DRAW);
+		slot.capacity = data.size;
+	}
+	slot.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, data.size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (slot.mapped == NULL)
+		return false;
+
+	slot.state = SLOT_COPYING;
+	slot.copied = false;
+	slot.texture = index;
+	slot.level = level;
+	streamed.uploading = true;
+	inFlightBytes += data.size;
+
+	UploadSlot* target = &slot;
+	const unsigned char* source = streamed.image.levelData + data.offset;
+	const size_t size = data.size;
+	submitTask([target, source, size] {
+		memcpy(target->mapped, source, size);
+		target->copied = true;
+	});
+	return true;
+}
+
+/**
+ * \brief Upload the copied level from the buffer of the slot (the copy to video memory is done by the driver
+ * asynchronously) and make it the base level of the texture.
+ */
+static void finishUpload(UploadSlot& slot) {
+	StreamedTexture& streamed = streamedTextures[slot.texture];
+	const ImageLevel& data = streamed.image.levels[slot.level];
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	// the content of the buffer is undefined if the mapping was lost (display mode change, ...)
+	const bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+	slot.mapped = NULL;
+	inFlightBytes -= data.size;
+	streamed.uploading = false;
+
+	// the texture may have been deleted while its level was copied
+	if (intact && streamed.texture != 0) {
+		glBindTexture(GL_TEXTURE_2D, streamed.texture);
+		glCompressedTexImage2D(GL_TEXTURE_2D, slot.level, streamed.image.compressedFormat, data.width, data.height, 0,
+			(GLsizei)data.size, (const void*)0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, slot.level);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		streamed.residentLevel = slot.level;
+		textureStreamingStats.residentBytes += data.size;
+		textureStreamingStats.uploadedBytes += data.size;
+		textureStreamingStats.uploads++;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = SLOT_UPLOADING;
+}
+
+/**
+ * \brief Once per frame, after the draws: upload the levels copied by the workers, recycle the slots the GPU is done
+ * with and start the next uploads, largest textures on the screen first, one level per texture at a time.
+ * Never waits for the GPU or the workers.
+ */
+void updateTextureStreaming() {
+	if (!useTextureStreaming || streamedTextures.empty()) {
+		streamingFrame++;
+		return;
+	}
+
+	for (int i = 0; i < TEXTURE_STREAMING_UPLOAD_SLOTS; i++) {
+		UploadSlot& slot = uploadSlots[i];
+		if (slot.state == SLOT_COPYING && slot.copied)
+			finishUpload(slot);
+		else if (slot.state == SLOT_UPLOADING && glClientWaitSync(slot.fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			slot.state = SLOT_FREE;
+		}
+	}
+
+	// textures drawn this frame wanting a finer level than the resident one
+	std::vector<size_t> requests;
+	for (size_t i = 0; i < streamedTextures.size(); i++) {
+		StreamedTexture& streamed = streamedTextures[i];
+		if (streamed.lastUsedFrame != streamingFrame)
+			continue;
+		streamed.wantedLevel = levelForScreenSize(streamed);
+		if (!streamed.uploading && streamed.residentLevel > streamed.wantedLevel)
+			requests.push_back(i);
+	}
+	std::sort(requests.begin(), requests.end(), [](size_t a, size_t b) {
+		return streamedTextures[a].screenSize > streamedTextures[b].screenSize;
+	});
+
+	int slot = 0;
+	for (size_t r = 0; r < requests.size(); r++) {
+		while (slot < TEXTURE_STREAMING_UPLOAD_SLOTS && uploadSlots[slot].state != SLOT_FREE)
+			slot++;
+		if (slot == TEXTURE_STREAMING_UPLOAD_SLOTS)
+			break;
+
+		const StreamedTexture& streamed = streamedTextures[requests[r]];
+		const unsigned int level = streamed.residentLevel - 1;
+		if (!makeRoom(streamed.image.levels[level].size, requests[r])) {
+			textureStreamingStats.budgetStalls++;
+			break;
+		}
+		if (!startUpload(uploadSlots[slot], requests[r], level))
+			break;
+	}
+	CHECK_GL_ERROR();
+
+	streamingFrame++;
+	if (printStreamingStats)
+		printTextureStreamingStats();
+}
+
+/**
+ * \brief Print the resident bytes, the upload bandwidth and the evictions once per second.
+ */
+void printTextureStreamingStats() {
+	const Clock::time_point now = Clock::now();
+	const double seconds = std::chrono::duration<double>(now - lastReport).count();
+	if (seconds < 1.0)
+		return;
+
+	unsigned int waiting = 0;
+	for (size_t i = 0; i < streamedTextures.size(); i++) {
+		if (streamedTextures[i].residentLevel > streamedTextures[i].wantedLevel)
+			waiting++;
+	}
+
+	TextureStreamingStats& stats = textureStreamingStats;
+	printf("Texture streaming : %.1f / %.1f MB resident (%.1f MB placeholders), %u uploads %.2f MB/s, %u evictions %.2f MB, %u budget stalls, %u / %zu textures below their wanted level\n",
+		stats.residentBytes / 1048576.0, textureStreamingBudget / 1048576.0, stats.placeholderBytes / 1048576.0,
+		stats.uploads, stats.uploadedBytes / 1048576.0 / seconds, stats.evictions, stats.evictedBytes / 1048576.0,
+		stats.budgetStalls, waiting, streamedTextures.size());
+
+	stats.uploadedBytes = 0;
+	stats.evictedBytes = 0;
+	stats.uploads = 0;
+	stats.evictions = 0;
+	stats.budgetStalls = 0;
+	lastReport = now;
+}
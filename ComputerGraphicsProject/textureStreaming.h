@@ -0,0 +1,56 @@
+/*
+* \file textureStreaming.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Texture streaming - low mip placeholders at load, finer levels uploaded through a ring of pixel buffer objects
+* as the objects using them grow on the screen, under a video memory budget
+*/
+
+#pragma once
+
+#ifndef __TEXTURE_STREAMING_H
+#define __TEXTURE_STREAMING_H
+
+#include "pgr.h"
+#include "image.h"
+#include "object.h"
+
+#define TEXTURE_STREAMING_BUDGET_MB 64			// default video memory budget of the streamed levels
+#define TEXTURE_STREAMING_PLACEHOLDER_SIZE 64	// levels up to this size are uploaded at load and never evicted
+#define TEXTURE_STREAMING_UPLOAD_SLOTS 4		// pixel buffer objects of the upload ring (levels in flight)
+#define TEXTURE_STREAMING_SLOT_SIZE (1 << 20)	// initial size of each pixel buffer object, grown for larger levels
+
+/**
+ * \brief Telemetry of the streaming, reset by printTextureStreamingStats().
+ */
+typedef struct _TextureStreamingStats {
+	size_t residentBytes;		///< streamed levels in video memory, placeholders included
+	size_t placeholderBytes;	///< part of residentBytes that is never evicted
+	size_t uploadedBytes;		///< since the last report
+	size_t evictedBytes;
+	unsigned int uploads;
+	unsigned int evictions;
+	unsigned int budgetStalls;	///< frames where a wanted level did not fit in the budget
+
+	_TextureStreamingStats() : residentBytes(0), placeholderBytes(0), uploadedBytes(0), evictedBytes(0),
+		uploads(0), evictions(0), budgetStalls(0) {}
+} TextureStreamingStats;
+
+extern bool useTextureStreaming;		///< false uploads the whole mip chains at load (--no-texture-streaming)
+extern size_t textureStreamingBudget;	///< bytes (--texture-budget)
+extern bool printStreamingStats;		///< print the telemetry once per second (--texture-stats)
+extern TextureStreamingStats textureStreamingStats;
+
+void initTextureStreaming();
+void cleanupTextureStreaming();
+
+GLuint createStreamedTexture(const ImageData& image);
+void deleteStreamedTexture(GLuint texture);
+
+void requestTextureResidency(const ObjectGeometry* geometry, const glm::mat4& modelMatrix);
+void requestTextureCoverage(GLuint texture, float screenSize);
+
+void updateTextureStreaming();
+void printTextureStreamingStats();
+
+#endif // __TEXTURE_STREAMING_H
@@ -0,0 +1,174 @@
+/*
+* \file threadPool.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Worker thread pool used for CPU side work (asset import, ...)
+*/
+
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include "threadPool.h"
+
+typedef struct _PoolTask {
+	std::function<void()> function;
+	TaskGroup* group;
+} PoolTask;
+
+static std::vector<std::thread> workers;
+static std::deque<PoolTask> tasks;
+static std::mutex tasksMutex;
+static std::condition_variable tasksAvailable;
+static bool stopping = false;
+
+static void finishTask(TaskGroup* group) {
+	if (group == NULL)
+		return;
+
+	std::lock_guard<std::mutex> lock(group->mutex);
+	if (--group->pending == 0)
+		group->done.notify_all();
+}
+
+static void workerLoop() {
+	for (;;) {
+		PoolTask task;
+		{
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			tasksAvailable.wait(lock, [] { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return; // stopping and nothing left to do
+			task = tasks.front();
+			tasks.pop_front();
+		}
+
+		task.function();
+		finishTask(task.group);
+	}
+}
+
+/**
+ * \brief Start the worker threads.
+ * \param numThreads number of workers, -1 = one per core (minus the GL thread), 0 = run tasks inline
+ */
+void initThreadPool(int numThreads) {
+	shutdownThreadPool();
+
+	if (numThreads < 0) {
+		int cores = (int)std::thread::hardware_concurrency();
+		numThreads = cores > 1 ? cores - 1 : 1;
+	}
+
+	stopping = false;
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(std::thread(workerLoop));
+}
+
+/**
+ * \brief Finish the queued tasks and join all workers.
+ */
+void shutdownThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		stopping = true;
+	}
+	tasksAvailable.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+}
+
+unsigned int threadPoolSize() {
+	return (unsigned int)workers.size();
+}
+
+/**
+ * \brief Queue a task for the workers (runs it right away when the pool has no threads).
+ * \param group optional group the task is counted in, see waitForTaskGroup()
+ */
+void submitTask(const std::function<void()>& task, TaskGroup* group) {
+	if (group != NULL) {
+		std::lock_guard<std::mutex> lock(group->mutex);
+		group->pending++;
+	}
+
+	if (workers.empty()) {
+		task();
+		finishTask(group);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		PoolTask poolTask;
+		poolTask.function = task;
+		poolTask.group = group;
+		tasks.push_back(poolTask);
+	}
+	tasksAvailable.notify_one();
+}
+
+/**
+ * \brief Block until every task of the group has finished.
+ * The waiting thread runs queued tasks meanwhile, so tasks may wait for their own sub-tasks without deadlocking the pool.
+ */
+void waitForTaskGroup(TaskGroup& group) {
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> lock(group.mutex);
+			if (group.pending == 0)
+				return;
+		}
+
+		PoolTask task;
+		bool found = false;
+		{
+			std::lock_guard<std::mutex> lock(tasksMutex);
+			if (!tasks.empty()) {
+				task = tasks.front();
+				tasks.pop_front();
+				found = true;
+			}
+		}
+
+		if (found) {
+			task.function();
+			finishTask(task.group);
+		}
+		else {
+			std::unique_lock<std::mutex> lock(group.mutex);
+			group.done.wait_for(lock, std::chrono::milliseconds(1), [&group] { return group.pending == 0; });
+		}
+	}
+}
+
+/**
+ * \brief Split [0, count) into chunks of at least grainSize items and process them on the workers.
+ * The calling thread waits for all chunks, so body may safely reference local variables.
+ */
+void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body) {
+	if (count == 0)
+		return;
+
+	if (grainSize == 0)
+		grainSize = 1;
+
+	const size_t maxChunks = 4 * ((size_t)workers.size() + 1);
+	size_t chunkSize = (count + maxChunks - 1) / maxChunks;
+	if (chunkSize < grainSize)
+		chunkSize = grainSize;
+
+	if (workers.empty() || chunkSize >= count) {
+		body(0, count);
+		return;
+	}
+
+	TaskGroup group;
+	for (size_t begin = 0; begin < count; begin += chunkSize) {
+		size_t end = begin + chunkSize < count ? begin + chunkSize : count;
+		submitTask([&body, begin, end] { body(begin, end); }, &group);
+	}
+	waitForTaskGroup(group);
+}
@@ -0,0 +1,38 @@
+/*
+* \file threadPool.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Worker thread pool used for CPU side work (asset import, ...)
+*/
+
+#pragma once
+
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * \brief Counter of pending tasks, lets the submitter wait for a group of tasks only.
+ */
+typedef struct _TaskGroup {
+	int pending;
+	std::mutex mutex;
+	std::condition_variable done;
+
+	_TaskGroup() : pending(0) {}
+} TaskGroup;
+
+// 0 threads = every task runs inline on the calling thread
+void initThreadPool(int numThreads = -1);	// -1 = one thread per core minus the GL thread
+void shutdownThreadPool();
+unsigned int threadPoolSize();
+
+void submitTask(const std::function<void()>& task, TaskGroup* group = NULL);
+void waitForTaskGroup(TaskGroup& group);
+
+void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body);
+
+#endif // __THREAD_POOL_H
@@ -0,0 +1,199 @@
+/*
+* \file uniformBuffers.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief std140 uniform blocks of the lighting shader - per frame block and ring buffered per object blocks
+*
+* The object ring is split into OBJECT_RING_FRAMES regions, a fence after each frame protects the region from being
+* overwritten while the GPU still reads it. With GL 4.4 the ring is persistently mapped (glBufferStorage), on older
+* contexts the region of the frame is mapped unsynchronized and unmapped before the draws.
+*/
+
+#include <iostream>
+#include <cmath>
+#include "uniformBuffers.h"
+#include "renderStats.h"
+#include "renderer.h"
+
+static GLuint frameBuffer = 0;
+static GLuint objectBuffer = 0;
+static GLsizeiptr objectStride = 0;			///< sizeof(ObjectData) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+static unsigned char* persistentMapping = NULL;
+static GLsync regionFences[OBJECT_RING_FRAMES] = { 0 };
+static unsigned int region = 0;
+static unsigned int regionCount = 0;		///< object blocks written in the region of the current frame
+static bool regionMapped = false;			///< region mapped by glMapBufferRange, unmapped in endObjectData()
+static unsigned char* regionData = NULL;
+
+static GLintptr regionOffset(unsigned int ringRegion) {
+	return (GLintptr)ringRegion * OBJECT_RING_ENTRIES * objectStride;
+}
+
+/**
+ * \brief Create the frame block buffer and the object ring.
+ */
+void initUniformBuffers() {
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	objectStride = ((GLsizeiptr)sizeof(ObjectData) + alignment - 1) / alignment * alignment;
+
+	glGenBuffers(1, &frameBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameBuffer);
+
+	const GLsizeiptr ringSize = regionOffset(OBJECT_RING_FRAMES);
+	glGenBuffers(1, &objectBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, objectBuffer);
+	if (hasOpenGLVersion(4, 4)) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, ringSize, NULL, flags);
+		persistentMapping = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, ringSize, flags);
+	}
+	if (persistentMapping == NULL)
+		glBufferData(GL_UNIFORM_BUFFER, ringSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	CHECK_GL_ERROR();
+
+	std::cout << "Object uniform ring : " << OBJECT_RING_FRAMES << " x " << OBJECT_RING_ENTRIES << " blocks of " << objectStride
+		<< " B, " << (persistentMapping != NULL ? "persistent mapping" : "glMapBufferRange per frame") << std::endl;
+}
+
+void cleanupUniformBuffers() {
+	for (int i = 0; i < OBJECT_RING_FRAMES; i++) {
+		if (regionFences[i] != 0)
+			glDeleteSync(regionFences[i]);
+		regionFences[i] = 0;
+	}
+	if (persistentMapping != NULL) {
+		glBindBuffer(GL_UNIFORM_BUFFER, objectBuffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		persistentMapping = NULL;
+	}
+	glDeleteBuffers(1, &frameBuffer);
+	glDeleteBuffers(1, &objectBuffer);
+	frameBuffer = 0;
+	objectBuffer = 0;
+}
+
+/**
+ * \brief Connect the FrameData and ObjectData blocks of the program to their binding points.
+ */
+void bindUniformBlocks(const ShaderProgram& shader) {
+	WARN_IF(shader.locations.frameData == GL_INVALID_INDEX, "FrameData uniform block not found");
+	WARN_IF(shader.locations.objectData == GL_INVALID_INDEX, "ObjectData uniform block not found");
+
+	if (shader.locations.frameData != GL_INVALID_INDEX)
+		glUniformBlockBinding(shader.program, shader.locations.frameData, FRAME_DATA_BINDING);
+	if (shader.locations.objectData != GL_INVALID_INDEX)
+		glUniformBlockBinding(shader.program, shader.locations.objectData, OBJECT_DATA_BINDING);
+}
+
+/**
+ * \brief Light setup of the frame in view space (was evaluated for every fragment), frameData.viewMatrix and
+ * frameData.time must be set.
+ * \param spotLightPosition [in] world space position of the player spot light
+ * \param spotLightDirection [in] world space direction of the player spot light
+ */
+void setFrameLights(FrameData& frameData, const glm::vec3& spotLightPosition, const glm::vec3& spotLightDirection) {
+	const glm::mat4& view = frameData.viewMatrix;
+	const float sunAngle = frameData.time * SUN_SPEED;
+
+	frameData.sunPosition = view * glm::vec4(std::cos(sunAngle), 0.0f, std::sin(sunAngle), 0.0f);
+	frameData.spotLightPosition = view * glm::vec4(spotLightPosition, 1.0f);
+	frameData.spotLightDirection = glm::vec4(glm::normalize(glm::vec3(view * glm::vec4(spotLightDirection, 0.0f))), 0.0f);
+	frameData.pointLightPosition = view * glm::vec4(POINT_LIGHT_POSITION, 1.0f);
+	frameData.fogAmount = (std::sin(frameData.time * 0.4f) + 1.0f) / 2.0f;
+}
+
+/**
+ * \brief Upload the per frame block (the buffer is orphaned, the previous frame may still read it).
+ */
+void updateFrameData(const FrameData& frameData) {
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), &frameData, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	COUNT_GL_CALLS(3);
+}
+
+/**
+ * \brief Reserve count object blocks in the region of the current frame, fill them with objectDataAt().
+ * \return false if the blocks do not fit in the region or the buffer cannot be mapped
+ */
+bool beginObjectData(unsigned int count) {
+	regionCount = 0;
+	regionData = NULL;
+	if (count == 0)
+		return false;
+	if (count > OBJECT_RING_ENTRIES) {
+		std::cerr << "\033[31mbeginObjectData : " << count << " objects do not fit in the ring (" << OBJECT_RING_ENTRIES << ")\033[0m" << std::endl;
+		return false;
+	}
+
+	// wait until the GPU is done with the region (written OBJECT_RING_FRAMES frames ago)
+	if (regionFences[region] != 0) {
+		while (glClientWaitSync(regionFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+		glDeleteSync(regionFences[region]);
+		regionFences[region] = 0;
+		COUNT_GL_CALLS(2);
+	}
+
+	if (persistentMapping != NULL) {
+		regionData = persistentMapping + regionOffset(region);
+	}
+	else {
+		glBindBuffer(GL_UNIFORM_BUFFER, objectBuffer);
+		regionData = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, regionOffset(region), count * objectStride,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		COUNT_GL_CALLS(2);
+		regionMapped = regionData != NULL;
+	}
+	if (regionData == NULL) {
+		std::cerr << "\033[31mbeginObjectData : cannot map the object uniform buffer\033[0m" << std::endl;
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		return false;
+	}
+	regionCount = count;
+	return true;
+}
+
+/**
+ * \brief index-th object block reserved by beginObjectData().
+ */
+ObjectData* objectDataAt(unsigned int index) {
+	return (ObjectData*)(regionData + index * objectStride);
+}
+
+/**
+ * \brief Done writing the object blocks of the frame, must be called before the draws.
+ */
+void endObjectData() {
+	regionData = NULL;
+	if (!regionMapped)
+		return;
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	COUNT_GL_CALLS(2);
+	regionMapped = false;
+}
+
+/**
+ * \brief Use the index-th block of the current frame for the following draws.
+ */
+void bindObjectData(unsigned int index) {
+	glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_DATA_BINDING, objectBuffer, regionOffset(region) + index * objectStride, sizeof(ObjectData));
+	COUNT_GL_CALLS(1);
+}
+
+/**
+ * \brief Fence the region of the frame after its draws were issued and move to the next region.
+ */
+void finishObjectDataFrame() {
+	if (regionCount == 0)
+		return;
+	regionFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	COUNT_GL_CALLS(1);
+	region = (region + 1) % OBJECT_RING_FRAMES;
+	regionCount = 0;
+}
@@ -0,0 +1,83 @@
+/*
+* \file uniformBuffers.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief std140 uniform blocks of the lighting shader - per frame block and ring buffered per object blocks
+*/
+
+#pragma once
+
+#ifndef __UNIFORM_BUFFERS_H
+#define __UNIFORM_BUFFERS_H
+
+#include "pgr.h"
+#include "object.h"
+
+#define FRAME_DATA_BINDING 0		// uniform buffer binding points
+#define OBJECT_DATA_BINDING 1
+
+#define OBJECT_RING_FRAMES 3		// frames in flight, each one has its own region of the object ring
+#define OBJECT_RING_ENTRIES 4096	// object blocks per frame
+
+#define SUN_SPEED 0.25f									// sun angle per second, night and day cycle
+#define POINT_LIGHT_POSITION glm::vec3(0.0f, 1.0f, 1.0f)	// world space position of the bulb light
+
+/**
+ * \brief FrameData block of lightingShaderPerFrag (std140), updated once per frame. The lights are transformed to
+ * view space on the CPU (setFrameLights()), the shader only reads them.
+ */
+typedef struct _FrameData {
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+	glm::vec4 sunAmbient;			///< xyz used
+	glm::vec4 sunDiffuse;
+	glm::vec4 sunSpecular;
+	glm::vec4 sunPosition;			///< view space direction towards the sun, w = 0
+	glm::vec4 spotLightPosition;	///< view space, player position
+	glm::vec4 spotLightDirection;	///< view space, normalized
+	glm::vec4 pointLightPosition;	///< view space
+	glm::vec4 clusterParams;		///< tiles x, tiles y, slice scale, slice bias (clusteredLighting.h)
+	glm::vec4 clusterTileSize;		///< tile width and height in pixels, slices, 1 = logarithmic slices
+	float     time;
+	float     fogAmount;			///< fog movement along a sin wave, 0 to 1
+	GLint     fogOn;
+	GLint     turnSunOn;
+	GLint     useSpotLight;
+	GLint     usePointLight;
+	GLint     dynamicLightCount;	///< lights binned in the clusters, 0 = no dynamic lights this frame
+	GLint     padding;
+} FrameData;
+
+/**
+ * \brief ObjectData block of lightingShaderPerFrag (std140), one per drawn object/material.
+ */
+typedef struct _ObjectData {
+	glm::mat4 PVM;
+	glm::mat4 modelMatrix;
+	glm::mat4 normalMatrix;
+	glm::vec4 positionScale;		///< dequantization of 16 bit positions, xyz used
+	glm::vec4 positionOffset;
+	glm::vec4 materialAmbient;
+	glm::vec4 materialDiffuse;
+	glm::vec4 materialSpecular;		///< w = shininess
+	GLint     useTexture;
+	GLint     padding[3];
+} ObjectData;
+
+static_assert(sizeof(FrameData) == 304, "FrameData must match the std140 layout of the shader block");
+static_assert(sizeof(ObjectData) == 288, "ObjectData must match the std140 layout of the shader block");
+
+void initUniformBuffers();
+void cleanupUniformBuffers();
+void bindUniformBlocks(const ShaderProgram& shader);
+
+void setFrameLights(FrameData& frameData, const glm::vec3& spotLightPosition, const glm::vec3& spotLightDirection);
+void updateFrameData(const FrameData& frameData);
+
+bool beginObjectData(unsigned int count);
+ObjectData* objectDataAt(unsigned int index);
+void endObjectData();
+void bindObjectData(unsigned int index);
+void finishObjectDataFrame();
+
+#endif // __UNIFORM_BUFFERS_H
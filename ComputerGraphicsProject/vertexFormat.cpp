@@ -0,0 +1,240 @@
+/*
+* \file vertexFormat.cpp
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Vertex layouts of the loaded meshes (separate, interleaved, packed, quantized)
+*/
+
+#include <cstdio>
+#include <cstring>
+#include "vertexFormat.h"
+
+VertexLayout vertexLayout = VERTEX_LAYOUT_PACKED;
+
+static const char* layoutNames[VERTEX_LAYOUT_COUNT] = { "separate", "interleaved", "packed", "quantized" };
+
+/**
+ * \brief Size of one vertex in bytes.
+ */
+unsigned int vertexLayoutStride(VertexLayout layout) {
+	switch (layout) {
+	case VERTEX_LAYOUT_INTERLEAVED:
+		return 8 * sizeof(float);
+	case VERTEX_LAYOUT_PACKED:
+		return 3 * sizeof(float) + sizeof(uint32_t) + 2 * sizeof(uint16_t);
+	case VERTEX_LAYOUT_QUANTIZED:
+		return 4 * sizeof(uint16_t) + sizeof(uint32_t) + 2 * sizeof(uint16_t);
+	default:
+		return 8 * sizeof(float);
+	}
+}
+
+const char* vertexLayoutName(VertexLayout layout) {
+	return layout < VERTEX_LAYOUT_COUNT ? layoutNames[layout] : "unknown";
+}
+
+/**
+ * \brief Parse a layout name given on the command line.
+ */
+bool parseVertexLayout(const std::string& name, VertexLayout& layout) {
+	for (int i = 0; i < VERTEX_LAYOUT_COUNT; i++) {
+		if (name == layoutNames[i]) {
+			layout = (VertexLayout)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// -----------------------  Packing ---------------------------------
+
+/**
+ * \brief Convert a 32 bit float to a 16 bit half float (round to nearest even).
+ */
+uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = (bits >> 16) & 0x8000u;
+	const uint32_t absBits = bits & 0x7fffffffu;
+
+	// NaN stays NaN, too large values become infinity
+	if (absBits >= 0x7f800000u)
+		return (uint16_t)(sign | 0x7c00u | (absBits > 0x7f800000u ? 0x200u : 0u));
+	if (absBits >= 0x477ff000u)
+		return (uint16_t)(sign | 0x7c00u);
+
+	// too small values become (signed) zero
+	if (absBits < 0x33000000u)
+		return (uint16_t)sign;
+
+	int exponent = (int)(absBits >> 23) - 127 + 15;
+	uint32_t mantissa = (absBits & 0x007fffffu) | 0x00800000u;
+
+	if (exponent <= 0) {
+		// denormalized half
+		const int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1u)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+
+	uint32_t half = ((uint32_t)exponent << 10) | ((mantissa >> 13) & 0x3ffu);
+	const uint32_t remainder = mantissa & 0x1fffu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+		half++; // may carry into the exponent, which is the correct rounding
+	return (uint16_t)(sign | half);
+}
+
+/**
+ * \brief Pack a unit normal into GL_INT_2_10_10_10_REV (x in the lowest bits, w = 0).
+ */
+uint32_t packNormal2_10_10_10(const glm::vec3& normal) {
+	uint32_t packed = 0;
+	for (int i = 0; i < 3; i++) {
+		float component = glm::clamp(normal[i], -1.0f, 1.0f);
+		int value = (int)std::floor(component * 511.0f + 0.5f);
+		packed |= ((uint32_t)value & 0x3ffu) << (10 * i);
+	}
+	return packed;
+}
+
+/**
+ * \brief Convert the mesh vertices (separate 32 bit float blocks) into the given layout.
+ */
+void packVertices(const MeshData& mesh, VertexLayout layout, PackedVertices& packed) {
+	packed.layout = layout;
+	packed.bytes.clear();
+	packed.positionScale = glm::vec3(1.0f);
+	packed.positionOffset = glm::vec3(0.0f);
+
+	if (layout == VERTEX_LAYOUT_SEPARATE || mesh.numVertices == 0)
+		return;
+
+	const unsigned int count = mesh.numVertices;
+	const float* positions = mesh.vertices();
+	const float* normals = positions + 3 * count;
+	const float* texCoords = positions + 6 * count;
+	const unsigned int stride = vertexLayoutStride(layout);
+
+	packed.bytes.resize((size_t)stride * count);
+	unsigned char* out = packed.bytes.data();
+
+	if (layout == VERTEX_LAYOUT_INTERLEAVED) {
+		for (unsigned int v = 0; v < count; v++, out += stride) {
+			memcpy(out, positions + 3 * v, 3 * sizeof(float));
+			memcpy(out + 3 * sizeof(float), normals + 3 * v, 3 * sizeof(float));
+			memcpy(out + 6 * sizeof(float), texCoords + 2 * v, 2 * sizeof(float));
+		}
+		return;
+	}
+
+	// positions are quantized relative to the AABB of the mesh
+	glm::vec3 minimum(positions[0], positions[1], positions[2]);
+	glm::vec3 maximum = minimum;
+	if (layout == VERTEX_LAYOUT_QUANTIZED) {
+		for (unsigned int v = 1; v < count; v++) {
+			glm::vec3 position(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]);
+			minimum = glm::min(minimum, position);
+			maximum = glm::max(maximum, position);
+		}
+		packed.positionOffset = minimum;
+		packed.positionScale = maximum - minimum;
+	}
+
+	for (unsigned int v = 0; v < count; v++, out += stride) {
+		size_t offset = 0;
+
+		if (layout == VERTEX_LAYOUT_QUANTIZED) {
+			uint16_t position[4] = { 0, 0, 0, 0 };
+			for (int i = 0; i < 3; i++) {
+				float extent = packed.positionScale[i];
+				float t = extent > 0.0f ? (positions[3 * v + i] - minimum[i]) / extent : 0.0f;
+				position[i] = (uint16_t)std::floor(glm::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+			}
+			memcpy(out, position, sizeof(position));
+			offset += sizeof(position);
+		}
+		else {
+			memcpy(out, positions + 3 * v, 3 * sizeof(float));
+			offset += 3 * sizeof(float);
+		}
+
+		uint32_t normal = packNormal2_10_10_10(glm::vec3(normals[3 * v], normals[3 * v + 1], normals[3 * v + 2]));
+		memcpy(out + offset, &normal, sizeof(normal));
+		offset += sizeof(normal);
+
+		uint16_t texCoord[2] = { floatToHalf(texCoords[2 * v]), floatToHalf(texCoords[2 * v + 1]) };
+		memcpy(out + offset, texCoord, sizeof(texCoord));
+	}
+}
+
+/**
+ * \brief Set the vertex attribute pointers of the currently bound vao / vertex buffer for the given layout.
+ */
+void setVertexLayoutAttributes(VertexLayout layout, unsigned int numVertices, const ShaderProgram& shader, bool useNormals) {
+	const GLsizei stride = (GLsizei)vertexLayoutStride(layout);
+
+	glEnableVertexAttribArray(shader.locations.position);
+	glEnableVertexAttribArray(shader.locations.texCoord);
+	if (useNormals)
+		glEnableVertexAttribArray(shader.locations.normal);
+
+	switch (layout) {
+	case VERTEX_LAYOUT_INTERLEAVED:
+		glVertexAttribPointer(shader.locations.position, 3, GL_FLOAT, GL_FALSE, stride, 0);
+		if (useNormals)
+			glVertexAttribPointer(shader.locations.normal, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+		glVertexAttribPointer(shader.locations.texCoord, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+		break;
+	case VERTEX_LAYOUT_PACKED:
+		glVertexAttribPointer(shader.locations.position, 3, GL_FLOAT, GL_FALSE, stride, 0);
+		if (useNormals)
+			glVertexAttribPointer(shader.locations.normal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(3 * sizeof(float)));
+		glVertexAttribPointer(shader.locations.texCoord, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(float)));
+		break;
+	case VERTEX_LAYOUT_QUANTIZED:
+		glVertexAttribPointer(shader.locations.position, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, 0);
+		if (useNormals)
+			glVertexAttribPointer(shader.locations.normal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(4 * sizeof(uint16_t)));
+		glVertexAttribPointer(shader.locations.texCoord, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(uint16_t) + sizeof(uint32_t)));
+		break;
+	default:
+		// |VVVVV...|NNNNN...|tttt
+		glVertexAttribPointer(shader.locations.position, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		if (useNormals)
+			glVertexAttribPointer(shader.locations.normal, 3, GL_FLOAT, GL_FALSE, 0, (void*)(3 * sizeof(float) * numVertices));
+		glVertexAttribPointer(shader.locations.texCoord, 2, GL_FLOAT, GL_FALSE, 0, (void*)(6 * sizeof(float) * numVertices));
+		break;
+	}
+	CHECK_GL_ERROR();
+}
+
+// -----------------------  Report ---------------------------------
+
+/**
+ * \brief Print the vertex/index memory of the model in every layout.
+ */
+void printVertexLayoutReport(const ModelData& model, VertexLayout usedLayout) {
+	size_t numVertices = 0;
+	size_t numIndices = 0;
+	size_t indexBytes = 0;
+	for (size_t i = 0; i < model.meshes.size(); i++) {
+		numVertices += model.meshes[i].numVertices;
+		numIndices += 3 * (size_t)model.meshes[i].totalTriangles();
+		indexBytes += model.meshes[i].indexBytes();
+	}
+
+	const double separateBytes = (double)(numVertices * vertexLayoutStride(VERTEX_LAYOUT_SEPARATE) + indexBytes);
+
+	printf("Vertex memory of %s (%zu vertices, %zu indices of every level of detail = %.1f KB)\n", model.fileName.c_str(), numVertices, numIndices, indexBytes / 1024.0);
+	for (int i = 0; i < VERTEX_LAYOUT_COUNT; i++) {
+		VertexLayout layout = (VertexLayout)i;
+		size_t bytes = numVertices * vertexLayoutStride(layout) + indexBytes;
+		printf("  %-12s %2u B/vertex %10.1f KB %5.0f%%%s\n", vertexLayoutName(layout), vertexLayoutStride(layout),
+			bytes / 1024.0, separateBytes > 0.0 ? 100.0 * bytes / separateBytes : 100.0, layout == usedLayout ? "  <- used" : "");
+	}
+}
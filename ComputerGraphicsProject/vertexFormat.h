@@ -0,0 +1,56 @@
+/*
+* \file vertexFormat.h
+* \author Valentin Lhermitte
+* \date 2023-2024
+* \brief Vertex layouts of the loaded meshes (separate, interleaved, packed, quantized)
+*/
+
+#pragma once
+
+#ifndef __VERTEX_FORMAT_H
+#define __VERTEX_FORMAT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "pgr.h"
+#include "object.h"
+#include "meshCache.h"
+
+/**
+ * \brief Layout of the vertex buffer of loaded meshes.
+ */
+enum VertexLayout {
+	VERTEX_LAYOUT_SEPARATE,		///< |VVV...|NNN...|TT...| 32 bit floats, 32 B per vertex (layout of the mesh cache)
+	VERTEX_LAYOUT_INTERLEAVED,	///< |VNT|VNT|... 32 bit floats, 32 B per vertex
+	VERTEX_LAYOUT_PACKED,		///< |VNT|... float position, GL_INT_2_10_10_10_REV normal, half float uv, 20 B per vertex
+	VERTEX_LAYOUT_QUANTIZED,	///< |VNT|... 16 bit position relative to the mesh AABB, packed normal, half float uv, 16 B per vertex
+	VERTEX_LAYOUT_COUNT
+};
+
+extern VertexLayout vertexLayout;	///< layout used for every mesh loaded from a model file
+
+/**
+ * \brief Vertex buffer content of one mesh in the selected layout.
+ */
+typedef struct _PackedVertices {
+	VertexLayout layout;
+	std::vector<unsigned char> bytes;	///< empty for VERTEX_LAYOUT_SEPARATE, the mesh data is uploaded as is
+	glm::vec3 positionScale;			///< dequantization of positions : position = stored * scale + offset
+	glm::vec3 positionOffset;
+
+	_PackedVertices() : layout(VERTEX_LAYOUT_SEPARATE), positionScale(1.0f), positionOffset(0.0f) {}
+} PackedVertices;
+
+unsigned int vertexLayoutStride(VertexLayout layout);
+const char* vertexLayoutName(VertexLayout layout);
+bool parseVertexLayout(const std::string& name, VertexLayout& layout);
+
+uint16_t floatToHalf(float value);
+uint32_t packNormal2_10_10_10(const glm::vec3& normal);
+
+void packVertices(const MeshData& mesh, VertexLayout layout, PackedVertices& packed);
+void setVertexLayoutAttributes(VertexLayout layout, unsigned int numVertices, const ShaderProgram& shader, bool useNormals);
+void printVertexLayoutReport(const ModelData& model, VertexLayout usedLayout);
+
+#endif // __VERTEX_FORMAT_H